@@ -1,7 +1,8 @@
 /*
 MixLit Firmware V2
 
-For Arduino Nano
+For Arduino Nano, and the MixLit Lite on an Arduino Leonardo
+The board's pins and counts come from its profile in profiles.h, picked from the board being built for
 
 Authors: Sam Mantell, Goddeh
 GitHub: @SamMantell, @Goddeh1
@@ -10,7 +11,9 @@ This program is the firmware for the MixLit, it is responsible for taking slider
 
 Example of changing a slider colour pallete
 This would change slider 1 to be a red to yellow gradient with no animation
-10FFAA00FF9B00FF8C00FF7B00FF6900FF5400FF3A00FF0000
+10FFAA00FF9B00FF8C00FF7B00FF6900FF5400FF3A00FF0000!
+
+The software sends the smaller LED frames described in definitions.h instead
 
 */
 
@@ -32,14 +35,17 @@ void loop()
 {
   mixlit.serialHandler();
 
+  mixlit.checkBaudRate();
+
   mixlit.readStates();
 
-  mixlit.denoiseAndBuildString();
+  mixlit.denoiseAndQueueUpdate();
+
+  mixlit.flushOutput();
+
+  mixlit.animate();
 
-  if (mixlit.stringToSendToSoftware != "")
-  {
-    Serial.println(mixlit.stringToSendToSoftware);
-  }
+  mixlit.showLEDs();
 
-  FastLED.show();
+  mixlit.saveState();
 }
\ No newline at end of file
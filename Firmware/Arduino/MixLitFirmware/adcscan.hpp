@@ -0,0 +1,117 @@
+// background adc scan, the conversion complete interrupt reads each pin in turn and starts the next
+// conversion straight away, so the main loop never waits on the adc
+
+#define ADC_NUM_OF_PINS (NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS)
+
+class adcScanner {
+  public:
+    // scans hardware::analogPins
+    void begin()
+    {
+      active() = this;
+
+#if defined(__AVR__)
+      // enabled, conversion complete interrupt on, clock / 128 so each conversion takes 104us at 16MHz
+      ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+#endif
+
+      startConversion(hardware::analogPins[0]);
+    }
+
+    // copies the newest complete scan into samples, returns false if there hasn't been one since the last call
+    // scannedAt is set to the micros() the scan finished at
+    bool takeScan(int16_t *samples, unsigned long &scannedAt)
+    {
+      uint8_t count;
+      do
+      {
+        // the interrupt only ever writes the back buffer, this catches it flipping them mid copy
+        count = scanCount;
+        const volatile int16_t *scan = scans[front];
+        for (uint8_t i = 0; i < ADC_NUM_OF_PINS; i++) samples[i] = scan[i];
+        scannedAt = finishedAt[front];
+      } while (count != scanCount);
+
+      bool isNew = count != takenScanCount;
+      takenScanCount = count;
+      return isNew;
+    }
+
+    bool hasScanned() { return scanCount != 0; }
+
+    // called from the interrupt with each result
+    static void conversionComplete(uint16_t value)
+    {
+      adcScanner *scanner = active();
+      if (scanner) scanner->addSample(value);
+    }
+
+  private:
+    // each pin gets 2^ADC_OVERSAMPLE_SHIFT conversions in a row, summed in sum
+    uint8_t pin = 0;
+    uint8_t sample = 0;
+    uint16_t sum = 0;
+
+    // the interrupt fills scans[!front] and flips front when a scan is complete
+    volatile int16_t scans[2][ADC_NUM_OF_PINS];
+    volatile uint8_t front = 0;
+    volatile uint8_t scanCount = 0;
+    volatile unsigned long finishedAt[2] = {0, 0};
+    uint8_t takenScanCount = 0;
+
+    static adcScanner *&active()
+    {
+      static adcScanner *scanner = nullptr;
+      return scanner;
+    }
+
+    void addSample(uint16_t value)
+    {
+      sum += value;
+
+      if (++sample >= (1 << ADC_OVERSAMPLE_SHIFT))
+      {
+        // scaled to the filter's fixed point
+        scans[!front][pin] = sum << (FILTER_FRACTION_BITS - ADC_OVERSAMPLE_SHIFT);
+        sum = 0;
+        sample = 0;
+
+        if (++pin >= ADC_NUM_OF_PINS)
+        {
+          pin = 0;
+          finishedAt[!front] = micros();
+          front = !front;
+          scanCount++;
+        }
+      }
+
+      startConversion(hardware::analogPins[pin]);
+    }
+
+    static void startConversion(uint8_t analogPin)
+    {
+#if defined(__AVR__)
+      // the same pin to channel mapping as analogRead
+      uint8_t channel = analogPin >= A0 ? analogPin - A0 : analogPin;
+#if defined(analogPinToChannel)
+      channel = analogPinToChannel(channel);
+#endif
+#if defined(MUX5)
+      ADCSRB = (ADCSRB & ~_BV(MUX5)) | (((channel >> 3) & 0x01) << MUX5);
+#endif
+      // AVcc reference
+      ADMUX = _BV(REFS0) | (channel & 0x07);
+      ADCSRA |= _BV(ADSC);
+#else
+      // off the AVR this is the simulator's model of the adc, see Firmware/Simulator
+      sim::startConversion(analogPin, conversionComplete);
+#endif
+    }
+};
+
+#if defined(__AVR__)
+ISR(ADC_vect)
+{
+  adcScanner::conversionComplete(ADC);
+}
+#endif
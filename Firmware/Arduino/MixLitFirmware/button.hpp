@@ -0,0 +1,113 @@
+// per button debounce and gesture detection, everything is timed from the millis() the button was read at
+
+// set from the software with "~K", see BUTTON_DEBOUNCE_MS
+struct buttonTimings {
+  uint16_t debounce = BUTTON_DEBOUNCE_MS;
+  uint16_t longPress = BUTTON_LONG_PRESS_MS;
+  uint16_t doubleClick = BUTTON_DOUBLE_CLICK_MS;
+  uint16_t repeat = BUTTON_REPEAT_MS;
+};
+
+class buttonInput {
+  public:
+    // takes a reading (true while pressed) and writes any BUTTON_ events it finishes to events, returns how many
+    // there are never more than 2, a release and the double click it finishes or a click that timed out and what followed it
+    uint8_t update(bool reading, unsigned long now, const buttonTimings &timings, uint8_t *events)
+    {
+      uint8_t count = 0;
+
+      if (!primed)
+      {
+        // a button already held at start up isn't a press, or a long one
+        pressed = reading;
+        changedAt = now;
+        longPressed = true;
+        primed = true;
+        return 0;
+      }
+
+      unsigned long sinceChange = now - changedAt;
+
+      // the first edge is taken straight away and anything in the debounce time after it is bounce,
+      // so a press goes out without waiting for the contacts to settle
+      if (reading != pressed && sinceChange >= timings.debounce)
+      {
+        pressed = reading;
+        changedAt = now;
+
+        if (pressed)
+        {
+          // this press came too late to make a double click of the one before
+          if (clickPending && sinceChange > timings.doubleClick)
+          {
+            events[count++] = BUTTON_CLICK;
+            clickPending = false;
+          }
+
+          events[count++] = BUTTON_PRESSED;
+          longPressed = false;
+          return count;
+        }
+
+        events[count++] = BUTTON_RELEASED;
+        if (longPressed) return count;
+
+        if (clickPending)
+        {
+          events[count++] = BUTTON_DOUBLE_CLICK;
+          clickPending = false;
+        }
+        else if (timings.doubleClick == 0)
+        {
+          events[count++] = BUTTON_CLICK;
+        }
+        else
+        {
+          clickPending = true;
+        }
+        return count;
+      }
+
+      if (!pressed)
+      {
+        if (clickPending && sinceChange > timings.doubleClick)
+        {
+          events[count++] = BUTTON_CLICK;
+          clickPending = false;
+        }
+        return count;
+      }
+
+      if (!longPressed)
+      {
+        if (timings.longPress == 0 || sinceChange < timings.longPress) return count;
+
+        // the click before it can't be the first half of a double click any more
+        if (clickPending)
+        {
+          events[count++] = BUTTON_CLICK;
+          clickPending = false;
+        }
+
+        events[count++] = BUTTON_LONG_PRESS;
+        longPressed = true;
+        repeatAt = timings.longPress + timings.repeat;
+      }
+      else if (timings.repeat != 0 && sinceChange >= repeatAt)
+      {
+        events[count++] = BUTTON_REPEAT;
+        repeatAt += timings.repeat;
+      }
+      return count;
+    }
+
+    bool isPressed() { return pressed; }
+
+  private:
+    bool primed = false;
+    bool pressed = false;
+    bool longPressed = false;
+    bool clickPending = false;
+    unsigned long changedAt = 0;
+    unsigned long repeatAt = 0; // since the press
+};
@@ -1,12 +1,153 @@
 // definitions for the MixLit
 
-#define NUM_OF_SLIDERS 5
-#define NUM_OF_POTENTIOMETERS 3/*2*/
-#define NUM_OF_LED_STRIPS 5
-#define NUM_OF_LEDS_PER_STRIP 8
-#define NUM_OF_BUTTONS 5
+// the counts, pins and led chains of the board being built for
+#include "profiles.h"
 
-#define SLIDER_DENOISE 5
-#define POTENTIOMETER_DENOISE 5
+// analog filtering
+// the adc scans every analog pin in the background, 2^ADC_OVERSAMPLE_SHIFT conversions at a time
+// each reading is the average of those samples, which are then filtered in fixed point with FILTER_FRACTION_BITS of extra resolution
+// at 104us a conversion, a scan of all 8 pins with 4 samples each takes 3.3ms
+#define ADC_OVERSAMPLE_SHIFT 2
+#define FILTER_FRACTION_BITS 4
 
-#define STRING_PRODUCT "TEST"
\ No newline at end of file
+// smoothing is FILTER_MIN_ALPHA / 256 at rest, each count the reading moves away from the filtered value adds FILTER_BETA / 256
+#define FILTER_MIN_ALPHA 32
+#define FILTER_BETA 16
+
+// how far the filtered value has to move before the output follows, in fractions of a count (24 is 1.5 counts with 4 fraction bits)
+#define SLIDER_HYSTERESIS 24
+#define POTENTIOMETER_HYSTERESIS 32
+
+// readings within this many counts of either end snap to 0 or 1023
+#define ADC_END_SNAP 3
+
+#if ADC_OVERSAMPLE_SHIFT > FILTER_FRACTION_BITS
+#error "ADC_OVERSAMPLE_SHIFT can't be more than FILTER_FRACTION_BITS"
+#endif
+
+#define STRING_PRODUCT "TEST"
+
+// led animation, animated strips move ANIMATION_STEP palette steps every ANIMATION_FRAME_MS
+#define ANIMATION_FRAME_MS 20
+#define ANIMATION_STEP 1
+
+// serial protocol
+// the handshake reply is DEVICE_IDENTIFIER, the protocol version and free RAM in bytes, eg "mixlit|v2|ram1234|baud1000000"
+// from protocol version 5 it ends with "|id" and the device id as 8 hex digits, see EEPROM_DEVICE_ID_ADDRESS
+// from protocol version 6 "|state" follows with the hash of the led state as 8 hex digits, see STATE_LENGTH
+// the software can then send "~B!" to switch to binary frames or "~A!" to go back to "id|value|" strings
+// from protocol version 4 "~T1!" turns on latency tracing and "~T0!" turns it off again, see FRAME_SYNC_TRACED
+// from protocol version 7 "~G1!" has the buttons report gestures instead of their state, see BUTTON_PRESSED
+#define DEVICE_IDENTIFIER "mixlit"
+#define PROTOCOL_VERSION 7
+
+// device id, so the software can tell units apart when there is more than one plugged in
+// [EEPROM_DEVICE_ID_MAGIC][id, 4 bytes LSB first][crc8 of the id] at EEPROM_DEVICE_ID_ADDRESS
+// a board without one makes it up at its first handshake and keeps it from then on
+#define EEPROM_DEVICE_ID_ADDRESS 0
+#define EEPROM_DEVICE_ID_MAGIC 0x4D
+#define EEPROM_DEVICE_ID_LENGTH 6
+
+// led state, so the strips come back the way the software left them after a power cycle without it sending anything
+// every strip is [flags, LED_FRAME_ANIMATED if it scrolls][brightness][16 * r g b], the hash is 32 bit FNV-1a over all of them
+#define STATE_STRIP_LENGTH (2 + 16 * 3)
+#define STATE_LENGTH (NUM_OF_LED_STRIPS * STATE_STRIP_LENGTH)
+
+// EEPROM_STATE_SLOTS records of [EEPROM_STATE_MAGIC][sequence][state][crc8 of sequence and state], the newest good one is loaded
+// each save goes in the slot after the newest, a byte at a time between loop passes, so no slot is written more than once
+// every EEPROM_STATE_SLOTS saves and a save cut short by a power cut still leaves the one before it
+// the magic is cleared before anything else in the slot is written and put back last, so a record only ever has it once it is whole
+#define EEPROM_LENGTH 1024
+#define EEPROM_STATE_ADDRESS 16
+#define EEPROM_STATE_MAGIC 0x53
+#define EEPROM_STATE_SLOTS 3
+#define EEPROM_STATE_RECORD_LENGTH (2 + STATE_LENGTH + 1)
+
+// the state is saved once it has stopped changing for this long, the software sends a burst of frames at a time
+#define STATE_SAVE_DELAY_MS 2000
+
+#if EEPROM_DEVICE_ID_ADDRESS + EEPROM_DEVICE_ID_LENGTH > EEPROM_STATE_ADDRESS || EEPROM_STATE_ADDRESS + EEPROM_STATE_SLOTS * EEPROM_STATE_RECORD_LENGTH > EEPROM_LENGTH
+#error "the eeprom records overlap or don't fit"
+#endif
+
+// baud rate, the firmware always starts at DEFAULT_BAUD_RATE and the handshake reply ends with "|baud" and MAX_BAUD_RATE
+// the software moves to a faster rate with "~S<rate>!", the reply "~S<rate>" (or "~S0" for a rate it can't do) is sent at the old rate
+// if no "?" arrives at the new rate within BAUD_CONFIRM_TIMEOUT_MS it drops back to DEFAULT_BAUD_RATE on its own
+#define DEFAULT_BAUD_RATE 38400
+#define MAX_BAUD_RATE 1000000
+#define NUM_OF_BAUD_RATES 6
+#define BAUD_CONFIRM_TIMEOUT_MS 1000
+
+// binary frame: [FRAME_SYNC][sequence][channel mask][payload][crc8 of sequence, mask and payload]
+// a non zero channel mask is followed by the 10 bit value of every set channel, packed LSB first
+// a channel mask of 0 is a button frame, the payload is [changed buttons][button states]
+#define FRAME_SYNC 0xA5
+#define FRAME_HEADER_LENGTH 3
+#define FRAME_MAX_ANALOG_LENGTH (FRAME_HEADER_LENGTH + (((NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS) * 10 + 7) / 8) + 1)
+#define FRAME_BUTTON_LENGTH (FRAME_HEADER_LENGTH + 2 + 1)
+
+// with tracing on, analog frames start with FRAME_SYNC_TRACED and have FRAME_TRACE_LENGTH more bytes before the crc
+// [micros() when the frame was queued, 4 bytes LSB first][how long before that the adc finished the scan, 2 bytes in us]
+// the sequence number ties the frame to what the software does with it, the software works out the link time from the clocks
+#define FRAME_SYNC_TRACED 0xA6
+#define FRAME_TRACE_LENGTH 6
+
+// led frames from the software, from protocol version 3
+// [FRAME_SYNC][type][strip][payload][crc8 of type, strip and payload]
+// the strip byte is the strip number, with LED_FRAME_ANIMATED set if its palette should scroll
+// the old "<strip><animated><16 RRGGBB colours>!" text command still works
+#define LED_FRAME_SOLID 'S'         // [r][g][b], every palette entry the same colour
+#define LED_FRAME_GRADIENT 'G'      // [r][g][b][r][g][b], the first colour to the second at entry 8 and back again
+#define LED_FRAME_BRIGHTNESS 'L'    // [brightness], keeps the palette and scales the whole strip
+#define LED_FRAME_PALETTE 'P'       // 16 * [r][g][b]
+#define LED_FRAME_ANIMATED 0x80
+#define LED_FRAME_MAX_LENGTH (2 + 16 * 3 + 1)
+
+// a frame that stops arriving part way through is dropped after this long
+#define LED_FRAME_TIMEOUT_MS 50
+
+// the leds wait for a text command to finish arriving, but not for one that has stopped part way for this long
+#define COMMAND_IDLE_MS 5
+
+// buttons
+// each edge is taken as soon as it is seen, then the button is left to settle for BUTTON_DEBOUNCE_MS before another is believed
+// held for BUTTON_LONG_PRESS_MS is a long press, repeated every BUTTON_REPEAT_MS after that (0 for never)
+// a second click within BUTTON_DOUBLE_CLICK_MS of the first is a double click, a click only goes out once that has passed (0 sends it straight away)
+// "~K<debounce>,<long press>,<double click>,<repeat>!" sets them all in ms, a handshake puts them back to these
+#define BUTTON_DEBOUNCE_MS 10
+#define BUTTON_LONG_PRESS_MS 500
+#define BUTTON_DOUBLE_CLICK_MS 250
+#define BUTTON_REPEAT_MS 100
+
+// with "~G1!" each gesture is sent as it happens, "A|<event>|" in ascii or an event frame, "~G0!" goes back to the state
+// 0 and 1 are the same as a state report, so anything that only knows about those still works
+#define BUTTON_RELEASED 0
+#define BUTTON_PRESSED 1
+#define BUTTON_CLICK 2
+#define BUTTON_DOUBLE_CLICK 3
+#define BUTTON_LONG_PRESS 4
+#define BUTTON_REPEAT 5
+
+// [FRAME_SYNC_EVENT][sequence][button << 4 | event][crc8 of sequence and event]
+#define FRAME_SYNC_EVENT 0xA7
+#define FRAME_EVENT_LENGTH (FRAME_HEADER_LENGTH + 1)
+
+// gestures waiting to be sent, a pass sends at most one per button
+#define BUTTON_EVENT_BUFFER_SIZE 16
+
+// everything is statically allocated, nothing in the main loop uses the heap
+#define OUTPUT_BUFFER_SIZE 128
+#define COMMAND_BUFFER_SIZE 100 // a palette command is 2 + 16 colours * 6 hex digits
+
+// longest update in each protocol, "7|1023|" per analog channel and "A|1|" per button
+// a binary update has either a button frame or an event frame per button
+#define ASCII_MAX_UPDATE_LENGTH ((NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS) * 7 + NUM_OF_BUTTONS * 4 + 2)
+#if NUM_OF_BUTTONS * FRAME_EVENT_LENGTH > FRAME_BUTTON_LENGTH
+#define BINARY_MAX_UPDATE_LENGTH (FRAME_MAX_ANALOG_LENGTH + FRAME_TRACE_LENGTH + NUM_OF_BUTTONS * FRAME_EVENT_LENGTH)
+#else
+#define BINARY_MAX_UPDATE_LENGTH (FRAME_MAX_ANALOG_LENGTH + FRAME_TRACE_LENGTH + FRAME_BUTTON_LENGTH)
+#endif
+
+#if LED_FRAME_MAX_LENGTH > COMMAND_BUFFER_SIZE
+#error "an led frame has to fit in COMMAND_BUFFER_SIZE"
+#endif
@@ -0,0 +1,51 @@
+// per channel analog filter, everything is fixed point with FILTER_FRACTION_BITS below each count
+
+class channelFilter {
+  public:
+    // takes an oversampled reading scaled up by FILTER_FRACTION_BITS, returns the filtered value in counts
+    int update(int16_t sample, int16_t hysteresis)
+    {
+      if (!primed)
+      {
+        filtered = sample;
+        held = sample;
+        primed = true;
+      }
+      else
+      {
+        // one euro style smoothing, the further the reading is from the filtered value the less
+        // it is smoothed, so a resting fader is heavily filtered but a moving one doesn't lag
+        int16_t difference = sample - filtered;
+        uint16_t speed = difference < 0 ? -difference : difference;
+
+        uint32_t alpha = FILTER_MIN_ALPHA + (((uint32_t)speed * FILTER_BETA) >> FILTER_FRACTION_BITS);
+        if (alpha > 256) alpha = 256;
+
+        int16_t step = ((int32_t)difference * (int32_t)alpha) / 256;
+
+        // without this the filter stalls up to 256 / alpha short of the reading
+        if (step == 0 && difference != 0) step = difference > 0 ? 1 : -1;
+        filtered += step;
+      }
+
+      // the output only moves once the filtered value is more than the hysteresis away from it,
+      // then it follows one count at a time without jumping
+      if (filtered > held + hysteresis)         held = filtered - hysteresis;
+      else if (filtered < held - hysteresis)    held = filtered + hysteresis;
+
+      int value = (held + (1 << (FILTER_FRACTION_BITS - 1))) >> FILTER_FRACTION_BITS;
+
+      // the hysteresis would otherwise stop the ends from ever being reached
+      if (value > 1023 - ADC_END_SNAP)    return 1023;
+      if (value < ADC_END_SNAP)           return 0;
+      return value;
+    }
+
+    void reset() { primed = false; }
+    bool isPrimed() { return primed; }
+
+  private:
+    int16_t filtered = 0;
+    int16_t held = 0;
+    bool primed = false;
+};
@@ -0,0 +1,32 @@
+// pin tables for the profile picked in profiles.h
+// anything that can walks them with unrolled, so each pin is a constant folded into the code and the
+// tables are only kept for the adc scan, which picks its next pin at run time
+
+struct hardware {
+  // sliders first, then potentiometers, the order the adc scans them in and the channels are numbered in
+  static constexpr uint8_t analogPins[NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS] = {PROFILE_SLIDER_PINS, PROFILE_POTENTIOMETER_PINS};
+  static constexpr uint8_t ledStrips[NUM_OF_LED_STRIPS] = {PROFILE_LED_STRIP_PINS};
+  static constexpr uint8_t buttons[NUM_OF_BUTTONS] = {PROFILE_BUTTON_PINS};
+};
+
+constexpr uint8_t hardware::analogPins[];
+constexpr uint8_t hardware::ledStrips[];
+constexpr uint8_t hardware::buttons[];
+
+// calls action.each<I>() for every I from 0 to COUNT - 1, with I as a template argument so it can pick a pin
+// out of a table at compile time, FastLED needs its data pins that way
+template <uint8_t COUNT>
+struct unrolled {
+  template <class ACTION>
+  static void run(ACTION &action)
+  {
+    unrolled<COUNT - 1>::run(action);
+    action.template each<COUNT - 1>();
+  }
+};
+
+template <>
+struct unrolled<0> {
+  template <class ACTION>
+  static void run(ACTION &action) {}
+};
@@ -1,15 +1,23 @@
 #include <FastLED.h>
+#include <EEPROM.h>
 #include "definitions.h"
+#include "hardware.hpp"
+#include "ringbuffer.hpp"
+#include "filter.hpp"
+#include "button.hpp"
+#include "adcscan.hpp"
 
-#include <List.hpp>
+#if defined(__AVR__)
+extern char __heap_start;
+extern char *__brkval;
+#endif
 
 class mixlit {
   public:
-    const int sliders[NUM_OF_SLIDERS] = {A4, A3, A2, A1, A0};
-    const int potentiometers[NUM_OF_POTENTIOMETERS] = {A5, A7, A6};
-    const int ledStrips[NUM_OF_LED_STRIPS] = {11, 10, 9, 8, 7};
-    const int buttons[NUM_OF_BUTTONS] = {6, 5, 4, 3, 2};
-    const String buttonNames[NUM_OF_BUTTONS] = {"A", "B", "C", "D", "E"};
+    // the pins are in hardware.hpp, from the profile in profiles.h
+
+    // the rates a 16MHz AVR can run within 2.1% of
+    const uint32_t baudRates[NUM_OF_BAUD_RATES] = {1000000, 500000, 250000, 115200, 57600, 38400};
 
     int previousSliderState[NUM_OF_SLIDERS];
     int currentSliderState[NUM_OF_SLIDERS];
@@ -17,14 +25,35 @@ class mixlit {
     int currentPotentiometerState[NUM_OF_POTENTIOMETERS];
     int previousPotentiometerState[NUM_OF_POTENTIOMETERS];
 
+    // sliders first, then potentiometers
+    adcScanner adc;
+    int16_t analogSamples[NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS];
+    unsigned long analogScannedAt = 0;
+    channelFilter filters[NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS];
+
+    // the raw readings go through the debounce in buttons, currentButtonState is what comes out of it
+    bool buttonReadings[NUM_OF_BUTTONS];
+    buttonInput buttons[NUM_OF_BUTTONS];
     bool previousButtonState[NUM_OF_BUTTONS];
     bool currentButtonState[NUM_OF_BUTTONS];
 
+    // with "~G1!" gestures are sent instead of the state, [button << 4 | event] in the order they happened
+    bool reportGestures = false;
+    buttonTimings gestureTimings;
+    ringBuffer<BUTTON_EVENT_BUFFER_SIZE> buttonEvents;
+
     CRGB leds[NUM_OF_LED_STRIPS][NUM_OF_LEDS_PER_STRIP];
 
-    bool isAnimated = false;
-    uint8_t ColorIndex;
-    int colorIndexOffset;
+    // each animated strip scrolls through its palette, one step every ANIMATION_FRAME_MS
+    bool isAnimated[NUM_OF_LED_STRIPS];
+    uint8_t colorIndexOffset[NUM_OF_LED_STRIPS];
+    unsigned long lastAnimationFrame = 0;
+
+    // set by LED_FRAME_BRIGHTNESS, scales everything on the strip
+    uint8_t stripBrightness[NUM_OF_LED_STRIPS];
+
+    // strips with a pixel that changed since they were last shown
+    uint8_t dirtyStrips = 0;
 
     int sliderToChange;
 
@@ -32,137 +61,690 @@ class mixlit {
 
     bool needsUpdating = false;
 
-    String serialCommand;
-    List<String> serialCommandBuffer;
+    // incoming commands are decoded in place once their '!' arrives
+    char serialCommand[COMMAND_BUFFER_SIZE];
+    uint8_t serialCommandLength = 0;
+    bool serialCommandOverflow = false;
+    unsigned long serialCommandByteAt = 0;
+
+    // led frames are collected in serialCommand too, the sync byte never appears in a text command
+    bool receivingFrame = false;
+    uint8_t frameLength = 0;
+    unsigned long frameStartedAt = 0;
 
     uint8_t loadingValue = 0;
     bool loadingUp = true;
 
-    uint32_t HEX_VALUE[16];
     int SliderToChange;
 
-    String stringToSendToSoftware = "";
-
-    CRGBPalette16 All_ColorPallete[NUM_OF_LED_STRIPS] = 
-    {
-      CRGBPalette16   (
-                        0xfffdf0, 0xfffbde, 0xfff8cd,  0xfff5bb, 0xfff3a9, 0xfff096, 0xffed84,  0xffea70,
-                        0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF
-                      ),
-      CRGBPalette16   (
-                        0xea81b2, 0xeb7eb1, 0xed7ab0,  0xee77af, 0xef73ae, 0xf170ad, 0xf26cac,  0xf368ab,
-                        0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF
-                      ),
-      CRGBPalette16   (
-                        0x917cbb, 0x8a76b9, 0x8371b7,  0x7b6cb5, 0x7367b3, 0x6b62b1, 0x625daf,  0x5958ad,
-                        0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF
-                      ),
-      CRGBPalette16   (
-                        0x797edc, 0x6f79d8, 0x6574d4,  0x5a6fcf, 0x4e6acb, 0x4165c7, 0x3260c2,  0x1e5bbe,
-                        0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF
-                      ),
-      CRGBPalette16   (
-                        0xa96ae0, 0xa96ae0, 0xa96ae0,  0xa96ae0, 0xa96ae0, 0xa96ae0, 0xa96ae0,  0xa96ae0,
-                        0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF
-                      )
-    };
+    // everything sent to the software is queued here and drained by flushOutput() without blocking
+    ringBuffer<OUTPUT_BUFFER_SIZE> outputBuffer;
+
+    bool useBinaryProtocol = false;
+
+    // analog frames carry when they were queued and how old their scan was, see FRAME_SYNC_TRACED
+    bool traceLatency = false;
+
+    // reported at the handshake, 0 until it has been read from the eeprom or made up
+    uint32_t deviceId = 0;
+
+    // the led state is saved once it settles, see EEPROM_STATE_ADDRESS
+    bool stateChanged = false;
+    unsigned long stateChangedAt = 0;
+    uint8_t savedStateSlot = EEPROM_STATE_SLOTS - 1;
+    uint8_t savedStateSequence = 0;
+    int16_t stateSaveIndex = -1; // the next step of the record being written, -1 when there isn't one, see saveState()
+    uint8_t stateSaveCrc = 0;
+
+    uint32_t baudRate = DEFAULT_BAUD_RATE;
+    bool awaitingBaudConfirm = false;
+    unsigned long baudChangedAt = 0;
+    uint8_t frameSequence = 0;
+    uint8_t frameCrc = 0;
 
+    CRGBPalette16 All_ColorPallete[NUM_OF_LED_STRIPS] = {PROFILE_DEFAULT_PALETTES};
+
+    // the first NUM_OF_LED_STRIPS sliders have a strip, any others don't
     void setLEDs(int iCurrentValue, int ledStrip)
     {
-      if (isAnimated)
+      if (ledStrip >= NUM_OF_LED_STRIPS) return;
+
+      // this will take the 10 bit value from the slider, scale it to the strip and use bitshift and remainder calculation to get the number of leds on and the brightness of the final one.
+      // the strip length is a constant, so with 8 leds this is value >> 7 and (value % 128) << 1
+      uint16_t iScaledValue = (uint16_t)iCurrentValue * NUM_OF_LEDS_PER_STRIP;
+      uint8_t iNumOfLedsOn = iScaledValue >> 10;
+      uint8_t iFinalLedBrightness = (iScaledValue & 1023) >> 2;
+
+      // the strip's own brightness scales both
+      iFinalLedBrightness = (iFinalLedBrightness * (stripBrightness[ledStrip] + 1)) >> 8;
+      uint8_t iFullBrightness = stripBrightness[ledStrip];
+
+      for (int i = 0; i < NUM_OF_LEDS_PER_STRIP; i++)
       {
-        colorIndexOffset++;
+        // spread over the first half of the palette, 16 apart with 8 leds
+        uint8_t ColorIndex = (128 * i) / NUM_OF_LEDS_PER_STRIP + colorIndexOffset[ledStrip];
+        CRGB colour;
+
+        if (i == (NUM_OF_LEDS_PER_STRIP - 1 - iNumOfLedsOn))        colour = ColorFromPalette( All_ColorPallete[ledStrip], ColorIndex, iFinalLedBrightness);
+      
+        else if (i > (NUM_OF_LEDS_PER_STRIP - 1 - iNumOfLedsOn))    colour = ColorFromPalette( All_ColorPallete[ledStrip], ColorIndex, iFullBrightness);
+          
+        else                                                        colour = ColorFromPalette( All_ColorPallete[ledStrip], ColorIndex, 0);
+
+        if (leds[ledStrip][i] != colour)
+        {
+          leds[ledStrip][i] = colour;
+          dirtyStrips |= (1 << ledStrip);
+        }
       }
-      else
+    }
+
+    // moves every animated strip on a frame once ANIMATION_FRAME_MS has passed, never waits
+    void animate()
+    {
+      unsigned long now = millis();
+      if (now - lastAnimationFrame < ANIMATION_FRAME_MS) return;
+      lastAnimationFrame = now;
+
+      for (int i = 0; i < NUM_OF_LED_STRIPS; i++)
       {
-        colorIndexOffset = 0;
+        if (!isAnimated[i]) continue;
+
+        colorIndexOffset[i] += ANIMATION_STEP;
+        setLEDs(previousSliderState[i], i);
       }
+    }
 
-      // this will take the 10 bit value from the slider, and use bitshift and remainder calculation to get the number of leds on and the brightness of the final one.
-      uint8_t iNumOfLedsOn = iCurrentValue >> 7;
-      uint8_t iFinalLedBrightness = (iCurrentValue % 128) << 1;
+    void setBrightness(uint8_t brightness)
+    {
+      if (FastLED.getBrightness() == brightness) return;
 
-      for (int i = 0; i < 8; i++)
-      {
-        ColorIndex = 16*i + colorIndexOffset;
+      FastLED.setBrightness(brightness);
+      dirtyStrips = (1 << NUM_OF_LED_STRIPS) - 1;
+    }
 
-        if (i == (NUM_OF_LEDS_PER_STRIP - 1 - iNumOfLedsOn))        leds[ledStrip][i] = ColorFromPalette( All_ColorPallete[ledStrip], ColorIndex, iFinalLedBrightness);
-      
-        else if (i > (NUM_OF_LEDS_PER_STRIP - 1 - iNumOfLedsOn))    leds[ledStrip][i] = ColorFromPalette( All_ColorPallete[ledStrip], ColorIndex, 255);
-          
-        else                                                        leds[ledStrip][i] = ColorFromPalette( All_ColorPallete[ledStrip], ColorIndex, 0);
+    // only sends the strips that changed, writing all of them takes over a millisecond
+    void showLEDs()
+    {
+      if (dirtyStrips == 0) return;
+
+      // interrupts are off while the strips are written, at the faster baud rates that would drop
+      // incoming bytes, so wait until a command has come in completely, or has stopped coming in
+      if (receivingFrame || Serial.available() > 0) return;
+      if (serialCommandLength > 0 && millis() - serialCommandByteAt < COMMAND_IDLE_MS) return;
+
+      if (dirtyStrips == (1 << NUM_OF_LED_STRIPS) - 1)
+      {
+        FastLED.show();
       }
-      if (isAnimated) delay(5);
+      else
+      {
+        for (int i = 0; i < NUM_OF_LED_STRIPS; i++)
+        {
+          if (dirtyStrips & (1 << i)) FastLED[i].showLeds(FastLED.getBrightness());
+        }
+      }
+      dirtyStrips = 0;
     }
 
     void serialHandler()
     {
+      if (receivingFrame && millis() - frameStartedAt > LED_FRAME_TIMEOUT_MS)
+      {
+        receivingFrame = false;
+        serialCommandLength = 0;
+      }
+
       while (Serial.available() > 0)
       {
-        char incomingChar = Serial.read();
-        if (incomingChar != 10 && incomingChar != 63 && incomingChar != 33 && incomingChar != 32 && incomingChar != 9) serialCommand += incomingChar;
+        uint8_t incomingByte = Serial.read();
+        if (receivingFrame)
+        {
+          receiveFrameByte(incomingByte);
+          continue;
+        }
+        if (incomingByte == FRAME_SYNC)
+        {
+          // anything part way through a text command is dropped
+          receivingFrame = true;
+          frameLength = 0;
+          frameStartedAt = millis();
+          serialCommandLength = 0;
+          serialCommandOverflow = false;
+          continue;
+        }
+
+        char incomingChar = incomingByte;
+        if (incomingChar == 63)
+        {
+          // a handshake at a new baud rate confirms it
+          awaitingBaudConfirm = false;
+
+          // a new handshake always starts off in the ascii protocol
+          sendHandshake();
+          continue;
+        }
         if (incomingChar == 33)
         {
-          if (serialCommand == "")
+          if (serialCommandOverflow)
+          {
+            // the end of a command that was too long to be valid, drop it
+          }
+          else if (serialCommandLength == 0)
           {
-            Serial.println("ping");
+            queueText("ping");
+            queueLineEnd();
+          }
+          else if (serialCommand[0] == '~')
+          {
+            readProtocolCommand(serialCommand, serialCommandLength);
           }
           else
           {
-            //Serial.println(serialCommand);
-            serialCommandBuffer.add(serialCommand);
-            //Serial.println(serialCommandBuffer.get(0));
-            // readDataSetLEDs(serialCommand);
-            serialCommand = "";
+            readDataSetLEDs(serialCommand, serialCommandLength);
           }
+
+          serialCommandLength = 0;
+          serialCommandOverflow = false;
+        }
+        else if (incomingChar != 10 && incomingChar != 13 && incomingChar != 32 && incomingChar != 9)
+        {
+          if (serialCommandLength < COMMAND_BUFFER_SIZE)    serialCommand[serialCommandLength++] = incomingChar;
+          else                                              serialCommandOverflow = true;
+          serialCommandByteAt = millis();
         }
       }
-      
-      while (serialCommandBuffer.getSize() != 0)
+    }
+
+    void receiveFrameByte(uint8_t value)
+    {
+      serialCommand[serialCommandLength++] = value;
+
+      if (serialCommandLength == 1)
       {
-        readDataSetLEDs(serialCommandBuffer.get(0));
-        // Serial.println(serialCommandBuffer.get(0));
-        serialCommandBuffer.removeFirst();
+        // the type gives the length, type and strip bytes, the payload and the crc
+        switch (value)
+        {
+          case LED_FRAME_SOLID:         frameLength = 2 + 3 + 1;        break;
+          case LED_FRAME_GRADIENT:      frameLength = 2 + 6 + 1;        break;
+          case LED_FRAME_BRIGHTNESS:    frameLength = 2 + 1 + 1;        break;
+          case LED_FRAME_PALETTE:       frameLength = 2 + 16 * 3 + 1;   break;
+          default:
+            receivingFrame = false;
+            serialCommandLength = 0;
+        }
+        return;
       }
+
+      if (serialCommandLength < frameLength) return;
+
+      receivingFrame = false;
+      serialCommandLength = 0;
+
+      uint8_t crc = 0;
+      for (uint8_t i = 0; i < frameLength - 1; i++) crc = crc8Update(crc, serialCommand[i]);
+      if (crc != (uint8_t)serialCommand[frameLength - 1]) return;
+
+      readLEDFrame((const uint8_t *)serialCommand);
     }
 
-    void readDataSetLEDs(String serialDataFromPC)
+    void readLEDFrame(const uint8_t *frame)
     {
-      // Serial.println(serialDataFromPC);
-      
-      SliderToChange = strtol(serialDataFromPC.substring(0,1).c_str(), NULL, 16);
-      isAnimated = bool(strtol(serialDataFromPC.substring(1,2).c_str(), NULL, 16));
-      // Serial.println("setting led strip " + String(SliderToChange) + " and setting animation to " + String (isAnimated));
+      int strip = frame[1] & ~LED_FRAME_ANIMATED;
+      if (strip >= NUM_OF_LED_STRIPS) return;
+
+      const uint8_t *payload = &frame[2];
+      CRGBPalette16 &palette = All_ColorPallete[strip];
+
+      switch (frame[0])
+      {
+        case LED_FRAME_SOLID:
+          for (uint8_t i = 0; i < 16; i++) palette[i] = CRGB(payload[0], payload[1], payload[2]);
+          break;
+
+        case LED_FRAME_GRADIENT:
+          for (uint8_t i = 0; i < 16; i++)
+          {
+            // out to the second colour at entry 8 and back, so a scrolling palette wraps without a jump
+            int16_t distance = i <= 8 ? i : 16 - i;
+            uint8_t rgb[3];
+            for (uint8_t c = 0; c < 3; c++) rgb[c] = payload[c] + (((int16_t)payload[c + 3] - payload[c]) * distance) / 8;
+            palette[i] = CRGB(rgb[0], rgb[1], rgb[2]);
+          }
+          break;
+
+        case LED_FRAME_BRIGHTNESS:
+          stripBrightness[strip] = payload[0];
+          break;
+
+        case LED_FRAME_PALETTE:
+          for (uint8_t i = 0; i < 16; i++) palette[i] = CRGB(payload[i * 3], payload[i * 3 + 1], payload[i * 3 + 2]);
+          break;
+      }
+
+      isAnimated[strip] = frame[1] & LED_FRAME_ANIMATED;
+      if (!isAnimated[strip]) colorIndexOffset[strip] = 0;
 
-      for (int i = 0; i < 16; i++)
+      needsUpdating = true;
+      markStateChanged();
+    }
+
+    void readProtocolCommand(const char *command, uint8_t length)
+    {
+      if (length > 2 && command[1] == 'S')
       {
-        HEX_VALUE[i] = strtol(serialDataFromPC.substring(2+i*6, 8+i*6).c_str(), NULL, 16);
+        uint32_t rate = 0;
+        for (uint8_t i = 2; i < length && command[i] >= '0' && command[i] <= '9'; i++) rate = rate * 10 + (command[i] - '0');
+
+        changeBaudRate(rate);
+        return;
       }
 
-      All_ColorPallete[SliderToChange] = 
+      if (length == 3 && command[1] == 'T')
       {
-        CRGBPalette16   (
-                            HEX_VALUE[0], HEX_VALUE[1], HEX_VALUE[2],  HEX_VALUE[3], HEX_VALUE[4], HEX_VALUE[5], HEX_VALUE[6],  HEX_VALUE[7],
-                            HEX_VALUE[8], HEX_VALUE[9], HEX_VALUE[10],  HEX_VALUE[11], HEX_VALUE[12], HEX_VALUE[13], HEX_VALUE[14],  HEX_VALUE[15]
-                        )
-      };
+        traceLatency = command[2] == '1';
+        return;
+      }
+
+      if (length == 3 && command[1] == 'G')
+      {
+        reportGestures = command[2] == '1';
+        buttonEvents.clear();
+        return;
+      }
+
+      if (length > 2 && command[1] == 'K')
+      {
+        readButtonTimings(&command[2], length - 2);
+        return;
+      }
+
+      if (length != 2) return;
+
+      if (command[1] == 'B')
+      {
+        useBinaryProtocol = true;
+        needsUpdating = true;
+      }
+      else if (command[1] == 'A')
+      {
+        useBinaryProtocol = false;
+        needsUpdating = true;
+      }
+    }
+
+    // "<debounce>,<long press>,<double click>,<repeat>" in ms, an empty field leaves that one as it was
+    void readButtonTimings(const char *text, uint8_t length)
+    {
+      uint16_t *timings[] = {&gestureTimings.debounce, &gestureTimings.longPress, &gestureTimings.doubleClick, &gestureTimings.repeat};
+      uint8_t field = 0;
+      uint32_t value = 0;
+      bool hasValue = false;
+
+      for (uint8_t i = 0; i <= length && field < 4; i++)
+      {
+        if (i == length || text[i] == ',')
+        {
+          if (hasValue) *timings[field] = value > 0xFFFF ? 0xFFFF : value;
+          field++;
+          value = 0;
+          hasValue = false;
+        }
+        else if (text[i] >= '0' && text[i] <= '9')
+        {
+          if (value <= 0xFFFF) value = value * 10 + (text[i] - '0');
+          hasValue = true;
+        }
+        else
+        {
+          return;
+        }
+      }
+    }
+
+    void changeBaudRate(uint32_t rate)
+    {
+      bool supported = false;
+      for (uint8_t i = 0; i < NUM_OF_BAUD_RATES; i++)
+      {
+        if (baudRates[i] == rate) supported = true;
+      }
+
+      queueText("~S");
+      queueNumber(supported ? rate : 0);
+      queueLineEnd();
+
+      if (!supported) return;
+
+      setBaudRate(rate);
+      awaitingBaudConfirm = rate != DEFAULT_BAUD_RATE;
+      baudChangedAt = millis();
+    }
+
+    void setBaudRate(uint32_t rate)
+    {
+      // everything queued so far, the reply included, has to go out at the old rate
+      uint8_t value;
+      while (outputBuffer.pop(value)) Serial.write(value);
+      Serial.flush();
+
+      Serial.end();
+      Serial.begin(rate);
+      baudRate = rate;
+    }
+
+    // drops back to the default rate if the software never spoke at the new one
+    void checkBaudRate()
+    {
+      if (!awaitingBaudConfirm || millis() - baudChangedAt < BAUD_CONFIRM_TIMEOUT_MS) return;
+
+      awaitingBaudConfirm = false;
+      setBaudRate(DEFAULT_BAUD_RATE);
+    }
+
+    // returns the value of a single hex digit, or -1 if it isn't one
+    int8_t hexDigit(char c)
+    {
+      if (c >= '0' && c <= '9') return c - '0';
+      if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+      if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+      return -1;
+    }
+
+    uint8_t hexByte(const char *digits)
+    {
+      int8_t high = hexDigit(digits[0]);
+      int8_t low = hexDigit(digits[1]);
+      if (high < 0 || low < 0) return 0;
+      return (high << 4) | low;
+    }
+
+    void readDataSetLEDs(const char *command, uint8_t length)
+    {
+      if (length < 2) return;
+
+      SliderToChange = hexDigit(command[0]);
+      if (SliderToChange < 0 || SliderToChange >= NUM_OF_LED_STRIPS) return;
+
+      isAnimated[SliderToChange] = hexDigit(command[1]) > 0;
+      if (!isAnimated[SliderToChange]) colorIndexOffset[SliderToChange] = 0;
+
+      // the colours are decoded straight into the palette, any missing from a short command are turned off
+      for (uint8_t i = 0; i < 16; i++)
+      {
+        uint8_t offset = 2 + i * 6;
+
+        if (offset + 6 <= length)
+        {
+          All_ColorPallete[SliderToChange][i] = CRGB(hexByte(&command[offset]), hexByte(&command[offset + 2]), hexByte(&command[offset + 4]));
+        }
+        else
+        {
+          All_ColorPallete[SliderToChange][i] = CRGB(0, 0, 0);
+        }
+      }
 
       needsUpdating = true;
+      markStateChanged();
     }
 
     void initialize()
     {
-      Serial.begin(38400);
+      Serial.begin(DEFAULT_BAUD_RATE);
+
+      analogInputs analogPins;
+      buttonInputs buttonPins;
+      unrolled<NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS>::run(analogPins);
+      unrolled<NUM_OF_BUTTONS>::run(buttonPins);
+
+      for (int i = 0; i < NUM_OF_LED_STRIPS; i++)       stripBrightness[i] = 255;
+
+      loadDeviceId();
+      loadState();
+
+      // wait for the first scan so there is always something to read
+      adc.begin();
+      while (!adc.hasScanned()) delay(1);
+
+      ledChains chains = {leds};
+      unrolled<NUM_OF_LED_STRIPS>::run(chains);
+    }
+
+    // unrolled over the pin tables, see hardware.hpp
+    struct analogInputs {
+      template <uint8_t I> void each() { pinMode(hardware::analogPins[I], INPUT); }
+    };
+
+    struct buttonInputs {
+      template <uint8_t I> void each() { pinMode(hardware::buttons[I], INPUT); }
+    };
+
+    struct buttonReader {
+      bool *readings;
+      template <uint8_t I> void each() { readings[I] = digitalRead(hardware::buttons[I]); }
+    };
+
+    struct ledChains {
+      CRGB (*leds)[NUM_OF_LEDS_PER_STRIP];
+      template <uint8_t I> void each() { FastLED.addLeds<LED_CHIPSET, hardware::ledStrips[I], LED_COLOUR_ORDER>(leds[I], NUM_OF_LEDS_PER_STRIP); }
+    };
+
+    void sendHandshake()
+    {
+      useBinaryProtocol = false;
+      traceLatency = false;
+      reportGestures = false;
+      gestureTimings = buttonTimings();
+      buttonEvents.clear();
+
+      // start the filters again from where the faders are now
+      for (int i = 0; i < NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS; i++) filters[i].reset();
+      readStates();
 
-      for (int i = 0; i > NUM_OF_SLIDERS; i++)          pinMode(sliders[i], INPUT);
-      for (int i = 0; i > NUM_OF_POTENTIOMETERS; i++)   pinMode(potentiometers[i], INPUT);
-      for (int i = 0; i > NUM_OF_BUTTONS; i++)          pinMode(buttons[i], INPUT);
+      queueText(DEVICE_IDENTIFIER);
+      queueText("|v");
+      queueNumber(PROTOCOL_VERSION);
+      queueText("|ram");
+      queueNumber(freeMemory());
+      queueText("|baud");
+      queueNumber(MAX_BAUD_RATE);
 
-      FastLED.addLeds<WS2812, 11, GRB>(leds[0], NUM_OF_LEDS_PER_STRIP);
-      FastLED.addLeds<WS2812, 10, GRB>(leds[1], NUM_OF_LEDS_PER_STRIP);
-      FastLED.addLeds<WS2812, 9, GRB>(leds[2], NUM_OF_LEDS_PER_STRIP);
-      FastLED.addLeds<WS2812, 8, GRB>(leds[3], NUM_OF_LEDS_PER_STRIP);
-      FastLED.addLeds<WS2812, 7, GRB>(leds[4], NUM_OF_LEDS_PER_STRIP);
+      if (deviceId == 0) createDeviceId();
+      queueText("|id");
+      queueHex(deviceId);
+      queueText("|state");
+      queueHex(stateHash());
+      queueLineEnd();
+
+      for (int i = 0; i < NUM_OF_SLIDERS; i++)
+      {
+        previousSliderState[i] = currentSliderState[i];
+        queueAsciiValue(i, previousSliderState[i]);
+      }
+      for (int i = 0; i < NUM_OF_POTENTIOMETERS; i++)
+      {
+        previousPotentiometerState[i] = currentPotentiometerState[i];
+        queueAsciiValue(i + NUM_OF_SLIDERS, previousPotentiometerState[i]);
+      }
+      queueLineEnd();
+    }
+
+    void loadDeviceId()
+    {
+      uint8_t crc = 0;
+      uint32_t id = 0;
+      for (uint8_t i = 0; i < 4; i++)
+      {
+        uint8_t value = EEPROM.read(EEPROM_DEVICE_ID_ADDRESS + 1 + i);
+        crc = crc8Update(crc, value);
+        id |= uint32_t(value) << (i * 8);
+      }
+
+      // a blank eeprom reads 0xFF everywhere, which never has the magic
+      if (EEPROM.read(EEPROM_DEVICE_ID_ADDRESS) == EEPROM_DEVICE_ID_MAGIC && EEPROM.read(EEPROM_DEVICE_ID_ADDRESS + 5) == crc)
+      {
+        deviceId = id;
+      }
+    }
+
+    // the low bits of the last scan and when the software first asked differ from board to board
+    void createDeviceId()
+    {
+      uint32_t id = 2166136261UL;
+      for (uint8_t i = 0; i < NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS; i++) id = (id ^ (analogSamples[i] & 0xFF)) * 16777619UL;
+
+      unsigned long now = micros();
+      for (uint8_t i = 0; i < 4; i++) id = (id ^ ((now >> (i * 8)) & 0xFF)) * 16777619UL;
+
+      // 0 means there isn't one
+      deviceId = id ? id : 1;
+
+      uint8_t crc = 0;
+      EEPROM.update(EEPROM_DEVICE_ID_ADDRESS, EEPROM_DEVICE_ID_MAGIC);
+      for (uint8_t i = 0; i < 4; i++)
+      {
+        uint8_t value = (deviceId >> (i * 8)) & 0xFF;
+        crc = crc8Update(crc, value);
+        EEPROM.update(EEPROM_DEVICE_ID_ADDRESS + 1 + i, value);
+      }
+      EEPROM.update(EEPROM_DEVICE_ID_ADDRESS + 5, crc);
+    }
+
+    // one byte of the led state, laid out as described at STATE_STRIP_LENGTH
+    uint8_t stateByte(uint16_t index)
+    {
+      int strip = index / STATE_STRIP_LENGTH;
+      uint8_t offset = index % STATE_STRIP_LENGTH;
+      if (strip >= NUM_OF_LED_STRIPS) return 0;
+
+      if (offset == 0) return isAnimated[strip] ? LED_FRAME_ANIMATED : 0;
+      if (offset == 1) return stripBrightness[strip];
+
+      const CRGB &colour = All_ColorPallete[strip][(offset - 2) / 3];
+      switch ((offset - 2) % 3)
+      {
+        case 0:   return colour.r;
+        case 1:   return colour.g;
+        default:  return colour.b;
+      }
+    }
+
+    void setStateByte(uint16_t index, uint8_t value)
+    {
+      int strip = index / STATE_STRIP_LENGTH;
+      uint8_t offset = index % STATE_STRIP_LENGTH;
+      if (strip >= NUM_OF_LED_STRIPS) return;
+
+      if (offset == 0)        isAnimated[strip] = value & LED_FRAME_ANIMATED;
+      else if (offset == 1)   stripBrightness[strip] = value;
+      else
+      {
+        CRGB &colour = All_ColorPallete[strip][(offset - 2) / 3];
+        switch ((offset - 2) % 3)
+        {
+          case 0:   colour.r = value;   break;
+          case 1:   colour.g = value;   break;
+          default:  colour.b = value;   break;
+        }
+      }
+    }
+
+    // reported at the handshake, the software skips sending palettes that would hash the same
+    uint32_t stateHash()
+    {
+      uint32_t hash = 2166136261UL;
+      for (uint16_t i = 0; i < STATE_LENGTH; i++) hash = (hash ^ stateByte(i)) * 16777619UL;
+      return hash;
+    }
+
+    // takes the newest record with a good crc, a board without one keeps the built in palettes
+    void loadState()
+    {
+      bool found = false;
+
+      for (uint8_t slot = 0; slot < EEPROM_STATE_SLOTS; slot++)
+      {
+        int address = EEPROM_STATE_ADDRESS + slot * EEPROM_STATE_RECORD_LENGTH;
+        if (EEPROM.read(address) != EEPROM_STATE_MAGIC) continue;
+
+        uint8_t crc = 0;
+        for (uint16_t i = 1; i < EEPROM_STATE_RECORD_LENGTH - 1; i++) crc = crc8Update(crc, EEPROM.read(address + i));
+        if (crc != EEPROM.read(address + EEPROM_STATE_RECORD_LENGTH - 1)) continue;
+
+        // the sequence wraps, newer is up to half way round ahead
+        uint8_t sequence = EEPROM.read(address + 1);
+        if (found && (int8_t)(sequence - savedStateSequence) <= 0) continue;
+
+        found = true;
+        savedStateSlot = slot;
+        savedStateSequence = sequence;
+      }
+
+      if (!found) return;
+
+      int address = EEPROM_STATE_ADDRESS + savedStateSlot * EEPROM_STATE_RECORD_LENGTH + 2;
+      for (uint16_t i = 0; i < STATE_LENGTH; i++) setStateByte(i, EEPROM.read(address + i));
+    }
+
+    void markStateChanged()
+    {
+      stateChanged = true;
+      stateChangedAt = millis();
+
+      // a record part way through is left without its magic, the next save starts the same slot again
+      stateSaveIndex = -1;
+    }
+
+    // writes the next byte of the record once the eeprom has finished the last one, a byte takes 3.3ms so this never waits for it
+    void saveState()
+    {
+      if (stateSaveIndex < 0)
+      {
+        if (!stateChanged || millis() - stateChangedAt < STATE_SAVE_DELAY_MS) return;
+
+        stateChanged = false;
+        stateSaveIndex = 0;
+        stateSaveCrc = 0;
+      }
+
+      uint8_t slot = (savedStateSlot + 1) % EEPROM_STATE_SLOTS;
+      uint8_t sequence = savedStateSequence + 1;
+      int address = EEPROM_STATE_ADDRESS + slot * EEPROM_STATE_RECORD_LENGTH;
+
+      // bytes that are already right go straight past, update() only writes the ones that differ
+      // the magic byte is cleared at step 0 and written again as one last step after the crc
+      while (stateSaveIndex <= EEPROM_STATE_RECORD_LENGTH && eeprom_is_ready())
+      {
+        int offset = stateSaveIndex;
+        uint8_t value;
+        if (stateSaveIndex == 0)                                        value = (uint8_t)~EEPROM_STATE_MAGIC;
+        else if (stateSaveIndex == 1)                                   value = sequence;
+        else if (stateSaveIndex < EEPROM_STATE_RECORD_LENGTH - 1)       value = stateByte(stateSaveIndex - 2);
+        else if (stateSaveIndex == EEPROM_STATE_RECORD_LENGTH - 1)      value = stateSaveCrc;
+        else                                                            { value = EEPROM_STATE_MAGIC; offset = 0; }
+
+        if (stateSaveIndex > 0 && stateSaveIndex < EEPROM_STATE_RECORD_LENGTH - 1) stateSaveCrc = crc8Update(stateSaveCrc, value);
+
+        EEPROM.update(address + offset, value);
+        stateSaveIndex++;
+      }
+
+      if (stateSaveIndex <= EEPROM_STATE_RECORD_LENGTH) return;
+
+      savedStateSlot = slot;
+      savedStateSequence = sequence;
+      stateSaveIndex = -1;
+    }
+
+    int freeMemory()
+    {
+#if defined(__AVR__)
+      // the gap between the top of the heap (or its start if nothing has been allocated) and the stack
+      char stackTop;
+      return __brkval ? &stackTop - __brkval : &stackTop - &__heap_start;
+#else
+      return -1;
+#endif
     }
 
     void awaitConnection()
@@ -175,33 +757,12 @@ class mixlit {
             
           if (c == 63)
           {
-              Serial.println("mixlit");
-              FastLED.setBrightness(16);
+              sendHandshake();
+              setBrightness(16);
               delay(200);
 
               needsUpdating = true;
 
-              for (int i = 0; i < NUM_OF_SLIDERS; i++)
-              {
-                currentSliderState[i] = 1023 - analogRead(sliders[i]);
-                previousSliderState[i] = currentSliderState[i];
-                stringToSendToSoftware += i;
-                stringToSendToSoftware += "|";
-                stringToSendToSoftware += previousSliderState[i];
-                stringToSendToSoftware += "|";
-              }
-              for (int i = 0; i < NUM_OF_POTENTIOMETERS; i++)
-              {
-                currentPotentiometerState[i] =  analogRead(potentiometers[i]);
-                previousPotentiometerState[i] = currentPotentiometerState[i];
-                stringToSendToSoftware += (i + NUM_OF_SLIDERS);
-                stringToSendToSoftware += "|";
-                stringToSendToSoftware += previousPotentiometerState[i];
-                stringToSendToSoftware += "|";
-              }
-
-              Serial.println(stringToSendToSoftware);
-
               return;
           }
         }
@@ -220,95 +781,297 @@ class mixlit {
             if (loadingValue == 0) loadingUp = true;
           }
           
-          FastLED.setBrightness(loadingValue/8);
+          setBrightness(loadingValue/8);
           setLEDs(128, i);
         }
-        FastLED.show();
+        showLEDs();
       }
     }
 
     void readStates()
     {
+      // the filters only move on when the adc has finished a new scan, so they always see evenly spaced samples
+      bool newScan = adc.takeScan(analogSamples, analogScannedAt);
+
       for (int i = 0; i < NUM_OF_SLIDERS; i++)
       {
-        currentSliderState[i] = 1023 - analogRead(sliders[i]);
+        // the sliders are wired backwards
+        if (newScan || !filters[i].isPrimed()) currentSliderState[i] = filters[i].update((1023 << FILTER_FRACTION_BITS) - analogSamples[i], SLIDER_HYSTERESIS);
       }
       for (int i = 0; i < NUM_OF_POTENTIOMETERS; i++)
       {
-        currentPotentiometerState[i] =  analogRead(potentiometers[i]);
+        channelFilter &filter = filters[i + NUM_OF_SLIDERS];
+        if (newScan || !filter.isPrimed()) currentPotentiometerState[i] = filter.update(analogSamples[i + NUM_OF_SLIDERS], POTENTIOMETER_HYSTERESIS);
       }
+      buttonReader reader = {buttonReadings};
+      unrolled<NUM_OF_BUTTONS>::run(reader);
+
+      // every button is timed from the same reading of the clock
+      unsigned long now = millis();
       for (int i = 0; i < NUM_OF_BUTTONS; i++)
       {
-        currentButtonState[i] = digitalRead(buttons[i]);
+        uint8_t events[2];
+        uint8_t count = buttons[i].update(buttonReadings[i], now, gestureTimings, events);
+        currentButtonState[i] = buttons[i].isPressed();
+
+        if (!reportGestures) continue;
+        for (uint8_t e = 0; e < count; e++) buttonEvents.push((i << 4) | events[e]);
       }
     }
 
-    void denoiseAndBuildString()
+    void denoiseAndQueueUpdate()
     {
-      stringToSendToSoftware = "";
+      // wait until a whole update fits, the next pass will then send the newest values instead
+      if (outputBuffer.freeSpace() < (useBinaryProtocol ? BINARY_MAX_UPDATE_LENGTH : ASCII_MAX_UPDATE_LENGTH)) return;
+
+      uint8_t changedChannels = 0;
+      uint8_t changedButtons = 0;
 
       for (int i = 0; i < NUM_OF_SLIDERS; i++)
       {
-        if ((abs(currentSliderState[i] - previousSliderState[i]) > 5) || needsUpdating)
+        // the filter's hysteresis has already taken out the noise, any change is a real one
+        if ((currentSliderState[i] != previousSliderState[i]) || needsUpdating)
         {
-          if (currentSliderState[i] > 1020)
-          {
-            currentSliderState[i] = 1023;
-          }
-          else if (currentSliderState[i] < 3)
-          {
-            currentSliderState[i] = 0;
-          }
-
           setLEDs(currentSliderState[i], i);
-        }
 
-        if ((abs(currentSliderState[i] - previousSliderState[i]) > 5) || needsUpdating)
-        {
           previousSliderState[i] = currentSliderState[i];
-          stringToSendToSoftware += i;
-          stringToSendToSoftware += "|";
-          stringToSendToSoftware += previousSliderState[i];
-          stringToSendToSoftware += "|";
+          changedChannels |= (1 << i);
         }
       }
 
       for (int i = 0; i < NUM_OF_POTENTIOMETERS; i++)
       {
-        if ((abs(currentPotentiometerState[i] - previousPotentiometerState[i]) > 5) || needsUpdating)
-        {
-          if (currentPotentiometerState[i] > 1020)
-          {
-            currentPotentiometerState[i] = 1023;
-          }
-          else if (currentPotentiometerState[i] < 3)
-          {
-            currentPotentiometerState[i] = 0;
-          }
-        }
-        if ((abs(currentPotentiometerState[i] - previousPotentiometerState[i]) > 5) || needsUpdating)
+        if ((currentPotentiometerState[i] != previousPotentiometerState[i]) || needsUpdating)
         {
           previousPotentiometerState[i] = currentPotentiometerState[i];
-          stringToSendToSoftware += (i + NUM_OF_SLIDERS);
-          stringToSendToSoftware += "|";
-          stringToSendToSoftware += previousPotentiometerState[i];
-          stringToSendToSoftware += "|";
-          needsUpdating = false;
+          changedChannels |= (1 << (i + NUM_OF_SLIDERS));
         }
       }
 
+      needsUpdating = false;
+
       for (int i = 0; i < NUM_OF_BUTTONS; i++)
       {
         if (currentButtonState[i] != previousButtonState[i])
         {
           previousButtonState[i] = currentButtonState[i];
+          if (!reportGestures) changedButtons |= (1 << i);
+        }
+      }
+
+      // as many gestures as there are buttons fit in an update, anything more waits for the next pass
+      int events = buttonEvents.available();
+      if (events > NUM_OF_BUTTONS) events = NUM_OF_BUTTONS;
+
+      if (useBinaryProtocol)
+      {
+        if (changedChannels != 0)   queueAnalogFrame(changedChannels);
+        if (changedButtons != 0)    queueButtonFrame(changedButtons);
+        for (int i = 0; i < events; i++) queueEventFrame();
+      }
+      else if (changedChannels != 0 || changedButtons != 0 || events != 0)
+      {
+        queueAsciiUpdate(changedChannels, changedButtons, events);
+      }
+    }
+
+    int channelValue(uint8_t channel)
+    {
+      if (channel < NUM_OF_SLIDERS)   return previousSliderState[channel];
+      else                            return previousPotentiometerState[channel - NUM_OF_SLIDERS];
+    }
+
+    // writes as much of the output buffer as the serial transmit buffer has room for
+    void flushOutput()
+    {
+      uint8_t value;
+      int room = Serial.availableForWrite();
 
-          stringToSendToSoftware += buttonNames[i];
-          stringToSendToSoftware += "|";
-          stringToSendToSoftware += int(currentButtonState[i]);
-          stringToSendToSoftware += "|";
+      while (room-- > 0 && outputBuffer.pop(value))
+      {
+        Serial.write(value);
+      }
+    }
+
+    void queueByte(uint8_t value)
+    {
+      // only the handshake can outgrow the buffer, that waits on the serial port rather than dropping bytes
+      if (outputBuffer.isFull())
+      {
+        uint8_t oldest = 0;
+        outputBuffer.pop(oldest);
+        Serial.write(oldest);
+      }
+      outputBuffer.push(value);
+    }
+
+    void queueText(const char *text)
+    {
+      while (*text) queueByte(*text++);
+    }
+
+    void queueNumber(long value)
+    {
+      if (value < 0)
+      {
+        queueByte('-');
+        value = -value;
+      }
+
+      char digits[10];
+      uint8_t count = 0;
+      do
+      {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+      } while (value > 0 && count < sizeof(digits));
+
+      while (count > 0) queueByte(digits[--count]);
+    }
+
+    void queueHex(uint32_t value)
+    {
+      for (int8_t shift = 28; shift >= 0; shift -= 4) queueByte("0123456789ABCDEF"[(value >> shift) & 0xF]);
+    }
+
+    void queueLineEnd()
+    {
+      queueByte('\r');
+      queueByte('\n');
+    }
+
+    void queueAsciiValue(int id, int value)
+    {
+      queueNumber(id);
+      queueByte('|');
+      queueNumber(value);
+      queueByte('|');
+    }
+
+    void queueAsciiUpdate(uint8_t changedChannels, uint8_t changedButtons, int events)
+    {
+      for (uint8_t channel = 0; channel < NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS; channel++)
+      {
+        if (changedChannels & (1 << channel)) queueAsciiValue(channel, channelValue(channel));
+      }
+
+      for (int i = 0; i < NUM_OF_BUTTONS; i++)
+      {
+        if (!(changedButtons & (1 << i))) continue;
+
+        queueByte('A' + i);
+        queueByte('|');
+        queueByte(currentButtonState[i] ? '1' : '0');
+        queueByte('|');
+      }
+
+      // a gesture is "A|<event>|", the same as a state for a press or a release
+      uint8_t event;
+      for (int i = 0; i < events && buttonEvents.pop(event); i++)
+      {
+        queueByte('A' + (event >> 4));
+        queueByte('|');
+        queueByte('0' + (event & 0x0F));
+        queueByte('|');
+      }
+
+      queueLineEnd();
+    }
+
+    void queueFrameByte(uint8_t value)
+    {
+      frameCrc = crc8Update(frameCrc, value);
+      queueByte(value);
+    }
+
+    void beginFrame(uint8_t channelMask, uint8_t sync = FRAME_SYNC)
+    {
+      queueByte(sync);
+
+      // the crc covers everything after the sync byte
+      frameCrc = 0;
+      queueFrameByte(frameSequence++);
+      queueFrameByte(channelMask);
+    }
+
+    void endFrame()
+    {
+      queueByte(frameCrc);
+    }
+
+    void queueAnalogFrame(uint8_t channelMask)
+    {
+      beginFrame(channelMask, traceLatency ? FRAME_SYNC_TRACED : FRAME_SYNC);
+
+      // this packs each 10 bit value LSB first, so 8 channels fit in 10 bytes instead of 16
+      uint32_t bitBuffer = 0;
+      uint8_t bitCount = 0;
+
+      for (uint8_t channel = 0; channel < NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS; channel++)
+      {
+        if (!(channelMask & (1 << channel))) continue;
+
+        bitBuffer |= (uint32_t)(channelValue(channel) & 0x3FF) << bitCount;
+        bitCount += 10;
+
+        while (bitCount >= 8)
+        {
+          queueFrameByte(bitBuffer & 0xFF);
+          bitBuffer >>= 8;
+          bitCount -= 8;
         }
       }
+      if (bitCount > 0) queueFrameByte(bitBuffer & 0xFF);
+
+      if (traceLatency) queueTrace();
+
+      endFrame();
+    }
+
+    void queueTrace()
+    {
+      unsigned long queuedAt = micros();
+      unsigned long scanAge = queuedAt - analogScannedAt;
+      if (scanAge > 0xFFFF) scanAge = 0xFFFF;
+
+      for (uint8_t i = 0; i < 4; i++) queueFrameByte((queuedAt >> (i * 8)) & 0xFF);
+      queueFrameByte(scanAge & 0xFF);
+      queueFrameByte(scanAge >> 8);
+    }
+
+    void queueButtonFrame(uint8_t changedButtons)
+    {
+      beginFrame(0);
+
+      uint8_t buttonStates = 0;
+      for (int i = 0; i < NUM_OF_BUTTONS; i++)
+      {
+        if (currentButtonState[i]) buttonStates |= (1 << i);
+      }
+
+      queueFrameByte(changedButtons);
+      queueFrameByte(buttonStates);
+
+      endFrame();
+    }
+
+    void queueEventFrame()
+    {
+      uint8_t event;
+      if (!buttonEvents.pop(event)) return;
 
+      beginFrame(event, FRAME_SYNC_EVENT);
+      endFrame();
+    }
+
+    // CRC-8, polynomial 0x07, matches SerialProtocol.crc8 in the software
+    uint8_t crc8Update(uint8_t crc, uint8_t value)
+    {
+      crc ^= value;
+      for (uint8_t bit = 0; bit < 8; bit++)
+      {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+      }
+      return crc;
     }
 };
\ No newline at end of file
@@ -0,0 +1,91 @@
+// hardware profiles, what each MixLit is built from
+// the profile is picked from the board being built for, define MIXLIT_PROFILE before this to build another
+// everything sized by the counts (buffers, frames, the pin tables in hardware.hpp) follows at compile time
+
+#define MIXLIT_PROFILE_NANO 1   // Arduino Nano, 5 sliders, 3 dials, 5 led strips and 5 mute buttons
+#define MIXLIT_PROFILE_LITE 2   // Arduino Leonardo, 5 sliders and nothing else
+
+#ifndef MIXLIT_PROFILE
+#if defined(ARDUINO_AVR_LEONARDO)
+#define MIXLIT_PROFILE MIXLIT_PROFILE_LITE
+#else
+#define MIXLIT_PROFILE MIXLIT_PROFILE_NANO
+#endif
+#endif
+
+#if MIXLIT_PROFILE == MIXLIT_PROFILE_NANO
+
+#define NUM_OF_SLIDERS 5
+#define NUM_OF_POTENTIOMETERS 3/*2*/
+#define NUM_OF_LED_STRIPS 5
+#define NUM_OF_LEDS_PER_STRIP 8
+#define NUM_OF_BUTTONS 5
+
+// each list is in channel order, the sliders are wired backwards so the first is the furthest left
+#define PROFILE_SLIDER_PINS A4, A3, A2, A1, A0
+#define PROFILE_POTENTIOMETER_PINS A5, A7, A6
+#define PROFILE_LED_STRIP_PINS 11, 10, 9, 8, 7
+#define PROFILE_BUTTON_PINS 6, 5, 4, 3, 2
+
+#define LED_CHIPSET WS2812
+#define LED_COLOUR_ORDER GRB
+
+// what each strip shows until the software sends its own, or one is loaded from the eeprom
+#define PROFILE_DEFAULT_PALETTES \
+  CRGBPalette16   ( \
+                    0xfffdf0, 0xfffbde, 0xfff8cd,  0xfff5bb, 0xfff3a9, 0xfff096, 0xffed84,  0xffea70, \
+                    0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF \
+                  ), \
+  CRGBPalette16   ( \
+                    0xea81b2, 0xeb7eb1, 0xed7ab0,  0xee77af, 0xef73ae, 0xf170ad, 0xf26cac,  0xf368ab, \
+                    0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF \
+                  ), \
+  CRGBPalette16   ( \
+                    0x917cbb, 0x8a76b9, 0x8371b7,  0x7b6cb5, 0x7367b3, 0x6b62b1, 0x625daf,  0x5958ad, \
+                    0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF \
+                  ), \
+  CRGBPalette16   ( \
+                    0x797edc, 0x6f79d8, 0x6574d4,  0x5a6fcf, 0x4e6acb, 0x4165c7, 0x3260c2,  0x1e5bbe, \
+                    0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF \
+                  ), \
+  CRGBPalette16   ( \
+                    0xa96ae0, 0xa96ae0, 0xa96ae0,  0xa96ae0, 0xa96ae0, 0xa96ae0, 0xa96ae0,  0xa96ae0, \
+                    0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,  0xFFFFFF \
+                  )
+
+#elif MIXLIT_PROFILE == MIXLIT_PROFILE_LITE
+
+// the sliders only, the empty tables take no room at all
+#define NUM_OF_SLIDERS 5
+#define NUM_OF_POTENTIOMETERS 0
+#define NUM_OF_LED_STRIPS 0
+#define NUM_OF_LEDS_PER_STRIP 8
+#define NUM_OF_BUTTONS 0
+
+#define PROFILE_SLIDER_PINS A4, A3, A2, A1, A0
+#define PROFILE_POTENTIOMETER_PINS
+#define PROFILE_LED_STRIP_PINS
+#define PROFILE_BUTTON_PINS
+
+#define LED_CHIPSET WS2812
+#define LED_COLOUR_ORDER GRB
+
+#define PROFILE_DEFAULT_PALETTES
+
+#else
+#error "unknown MIXLIT_PROFILE"
+#endif
+
+// a frame's channel mask, the button bytes and the dirty strip mask are all a byte wide, and a text palette
+// command picks its strip with one hex digit
+#if NUM_OF_SLIDERS < 1 || NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS > 8
+#error "a profile needs between 1 and 8 analog channels"
+#endif
+#if NUM_OF_BUTTONS > 8 || NUM_OF_LED_STRIPS > 8
+#error "a profile can't have more than 8 buttons or led strips"
+#endif
+
+// setLEDs works the lit length out as value * NUM_OF_LEDS_PER_STRIP in 16 bits
+#if NUM_OF_LEDS_PER_STRIP < 1 || NUM_OF_LEDS_PER_STRIP > 64
+#error "a strip needs between 1 and 64 leds"
+#endif
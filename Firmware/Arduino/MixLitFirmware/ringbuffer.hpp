@@ -0,0 +1,37 @@
+// fixed size byte ring buffer, nothing in here touches the heap
+
+template <uint8_t SIZE>
+class ringBuffer {
+  static_assert(SIZE != 0 && (SIZE & (SIZE - 1)) == 0 && SIZE <= 128, "ring buffer size must be a power of two up to 128");
+
+  public:
+    bool push(uint8_t value)
+    {
+      if (isFull()) return false;
+
+      data[head & (SIZE - 1)] = value;
+      head++;
+      return true;
+    }
+
+    bool pop(uint8_t &value)
+    {
+      if (isEmpty()) return false;
+
+      value = data[tail & (SIZE - 1)];
+      tail++;
+      return true;
+    }
+
+    uint8_t available()   { return uint8_t(head - tail); }
+    uint8_t freeSpace()   { return SIZE - available(); }
+    bool isEmpty()        { return head == tail; }
+    bool isFull()         { return available() == SIZE; }
+    void clear()          { head = tail; }
+
+  private:
+    uint8_t data[SIZE];
+    // these wrap at 256, masking with SIZE - 1 gives the index into data
+    volatile uint8_t head = 0;
+    volatile uint8_t tail = 0;
+};
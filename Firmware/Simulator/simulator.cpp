@@ -0,0 +1,884 @@
+// runs the MixLit firmware against the stubs in stubs/ and reports how it performs
+//
+// usage: mixlit_sim [options]
+//   --trace <file>        replay a fader trace, see traces/
+//   --sweep <ms>          move every fader end to end and back over <ms>, in 10ms steps
+//   --duration <ms>       how long to run for, defaults to the end of the trace + 500ms
+//   --binary              switch to binary frames after the handshake
+//   --baud <rate>         move to a faster baud rate after the handshake
+//   --skip-baud-confirm   don't confirm the new baud rate, the firmware should drop back on its own
+//   --expect-baud <rate>  fail unless the firmware ends up at this baud rate
+//   --noise <n>           add +/- n of noise to every analog reading
+//   --animated            turn on the palette animation for every strip
+//   --led-frames          send one of each led frame and check the palettes they leave behind
+//   --latency-trace       turn on latency tracing after switching to binary frames and check the traces
+//   --max-latency <ms>    fail if a fader change takes longer than this to be sent
+//   --max-spurious <n>    fail if more than n updates move a fader away from where it really is
+//   --device-id <hex>     put this device id in the eeprom first, the handshake should report it
+//   --power-cycle         check the led state was saved and that a board starting from the eeprom comes back the same
+//   --torn-save           after --power-cycle, cut the next save short part way through, the board should load the last whole one
+//   --gestures            have the buttons report gestures after the handshake
+//   --button-timings <ms> send "~K<ms>!" with the button timings, eg 10,300,0,0
+//   --bounce <ms>         every button edge in the trace bounces for this long
+//   --expect-buttons <l>  fail unless the button reports are exactly this, eg "A1 A0 A2"
+//   --partial-command     start a text command after everything else and never finish it, the leds should carry on
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "FastLED.h"
+#include "EEPROM.h"
+
+#include "MixLitFirmware.ino"
+#include "trace.hpp"
+
+// the trace starts once the handshake and any protocol changes have gone out
+#define TRACE_START_MS 100
+
+// the hysteresis leaves a fader that has stopped up to a couple of counts short of where it was moved to
+#define REPORT_TOLERANCE 3
+
+struct report {
+  int channel;
+  int value;
+  uint64_t time;
+  bool initial; // sent with the handshake rather than because something changed
+};
+
+struct options {
+  const char *tracePath = nullptr;
+  unsigned long sweepMs = 0;
+  unsigned long durationMs = 0;
+  bool binary = false;
+  unsigned long baud = 0;
+  bool skipBaudConfirm = false;
+  unsigned long expectBaud = 0;
+  int noise = 0;
+  bool animated = false;
+  bool ledFrames = false;
+  bool latencyTrace = false;
+  long maxLatencyMs = -1;
+  long maxSpurious = -1;
+  const char *deviceId = nullptr;
+  bool powerCycle = false;
+  bool tornSave = false;
+  bool gestures = false;
+  const char *buttonTimings = nullptr;
+  unsigned long bounceMs = 0;
+  const char *expectButtons = nullptr;
+  bool partialCommand = false;
+};
+
+// contacts bounce every BOUNCE_FLIP_MICROS for --bounce after each edge, then settle where the trace put them
+#define BOUNCE_FLIP_MICROS 250
+
+static void addBounce(const traceEvent &event, uint64_t at, unsigned long bounceMs, std::vector<traceEvent> &bounces)
+{
+  uint64_t flips = uint64_t(bounceMs) * 1000 / BOUNCE_FLIP_MICROS;
+  for (uint64_t i = 1; i <= flips; i++)
+  {
+    int value = (i == flips || i % 2 == 0) ? event.value : !event.value;
+    bounces.push_back({at + i * BOUNCE_FLIP_MICROS, event.channel, value});
+  }
+}
+
+static void applyEvent(const traceEvent &event)
+{
+  if (event.channel < NUM_OF_SLIDERS)
+  {
+    // the sliders are wired backwards, the firmware reports 1023 - the reading
+    sim::pinValues[hardware::analogPins[event.channel]] = 1023 - event.value;
+  }
+  else if (event.channel < NUM_OF_CHANNELS)
+  {
+    sim::pinValues[hardware::analogPins[event.channel]] = event.value;
+  }
+  else if (event.channel < NUM_OF_CHANNELS + NUM_OF_BUTTONS)
+  {
+    sim::pinValues[hardware::buttons[event.channel - NUM_OF_CHANNELS]] = event.value ? HIGH : LOW;
+  }
+}
+
+// the led frame check drives strips 0 to 4, profiles with fewer strips don't take --led-frames
+#if NUM_OF_LED_STRIPS >= 5
+// builds an led frame the way LEDController does
+static std::string ledFrame(char type, uint8_t strip, const std::vector<uint8_t> &payload)
+{
+  std::string frame(1, type);
+  frame += (char)strip;
+  for (size_t i = 0; i < payload.size(); i++) frame += (char)payload[i];
+
+  uint8_t crc = 0;
+  for (size_t i = 0; i < frame.size(); i++) crc = mixlit.crc8Update(crc, frame[i]);
+
+  return std::string(1, (char)FRAME_SYNC) + frame + (char)crc;
+}
+
+static bool paletteEntryIs(int strip, int entry, uint8_t r, uint8_t g, uint8_t b)
+{
+  const CRGB &colour = mixlit.All_ColorPallete[strip][entry];
+  if (colour.r == r && colour.g == g && colour.b == b) return true;
+
+  fprintf(stderr, "FAIL: strip %d palette entry %d is %d,%d,%d instead of %d,%d,%d\n", strip, entry, colour.r, colour.g, colour.b, r, g, b);
+  return false;
+}
+
+// one of each led frame, then a text command to check the parser is back in step
+static std::string buildLEDFrames(CRGBPalette16 &untouchedPalette)
+{
+  std::string frames;
+
+  // the payload has the handshake, command end and newline bytes in it, none of which should count
+  frames += ledFrame(LED_FRAME_SOLID, 0, {'?', '!', '\n'});
+  frames += ledFrame(LED_FRAME_GRADIENT, 1 | LED_FRAME_ANIMATED, {0, 0, 0, 80, 160, 240});
+
+  std::vector<uint8_t> palette;
+  for (int i = 0; i < 16; i++)
+  {
+    palette.push_back(i * 16);
+    palette.push_back(255 - i * 16);
+    palette.push_back(i);
+  }
+  frames += ledFrame(LED_FRAME_PALETTE, 2, palette);
+  frames += ledFrame(LED_FRAME_BRIGHTNESS, 3, {128});
+
+  // a bad crc leaves the strip as it was
+  untouchedPalette = mixlit.All_ColorPallete[4];
+  std::string corrupt = ledFrame(LED_FRAME_SOLID, 4, {1, 2, 3});
+  corrupt[corrupt.size() - 1] ^= 0xFF;
+  frames += corrupt;
+
+  frames += "3000FF00!";
+  return frames;
+}
+
+static bool checkLEDFrames(const CRGBPalette16 &untouchedPalette)
+{
+  bool passed = true;
+
+  for (int i = 0; i < 16; i++) passed &= paletteEntryIs(0, i, '?', '!', '\n');
+
+  passed &= paletteEntryIs(1, 0, 0, 0, 0);
+  passed &= paletteEntryIs(1, 4, 40, 80, 120);
+  passed &= paletteEntryIs(1, 8, 80, 160, 240);
+  passed &= paletteEntryIs(1, 12, 40, 80, 120);
+  if (!mixlit.isAnimated[1])
+  {
+    fprintf(stderr, "FAIL: the gradient frame didn't turn on the animation\n");
+    passed = false;
+  }
+
+  for (int i = 0; i < 16; i++) passed &= paletteEntryIs(2, i, i * 16, 255 - i * 16, i);
+
+  passed &= paletteEntryIs(3, 0, 0, 255, 0);
+  passed &= paletteEntryIs(3, 1, 0, 0, 0);
+  if (mixlit.stripBrightness[3] != 128)
+  {
+    fprintf(stderr, "FAIL: strip 3 brightness is %d instead of 128\n", mixlit.stripBrightness[3]);
+    passed = false;
+  }
+
+  for (int i = 0; i < 16; i++)
+  {
+    const CRGB &colour = untouchedPalette[i];
+    passed &= paletteEntryIs(4, i, colour.r, colour.g, colour.b);
+  }
+
+  return passed;
+}
+#endif
+
+// splits the captured output the same way SerialPortReader does, binary frames start with FRAME_SYNC
+class outputDecoder {
+  public:
+    std::vector<report> reports;
+    unsigned long updates = 0;
+    unsigned long updateBytes = 0;
+    unsigned long handshakes = 0;
+    unsigned long badFrames = 0;
+    bool afterHandshake = false;
+
+    // every button report as "<button><state or event>", eg "A1 A0 A2"
+    std::string buttons;
+
+    // the "|id" and "|state" fields of every handshake, empty for one without them
+    std::vector<std::string> deviceIds;
+    std::vector<std::string> stateHashes;
+
+    // from FRAME_SYNC_TRACED frames, all in micros
+    unsigned long tracedFrames = 0;
+    unsigned long badTraces = 0;
+    uint64_t scanToQueueTotal = 0;
+    uint64_t scanToQueueMax = 0;
+    uint64_t queueToSentTotal = 0;
+    uint64_t queueToSentMax = 0;
+
+    void decode(const std::vector<HardwareSerial::sentByte> &sent)
+    {
+      size_t start = 0;
+      size_t i = 0;
+
+      while (i < sent.size())
+      {
+        if (i == start && (sent[i].value == FRAME_SYNC || sent[i].value == FRAME_SYNC_TRACED || sent[i].value == FRAME_SYNC_EVENT))
+        {
+          if (i + 2 >= sent.size()) break;
+
+          size_t length = frameLength(sent[i].value, sent[i + 2].value);
+          if (i + length > sent.size()) break;
+
+          if (validFrame(sent, i, length))
+          {
+            decodeFrame(sent, i, length);
+            i += length;
+          }
+          else
+          {
+            badFrames++;
+            i++;
+          }
+          start = i;
+          continue;
+        }
+
+        if (sent[i].value == '\n')
+        {
+          decodeLine(sent, start, i);
+          start = i + 1;
+        }
+        i++;
+      }
+    }
+
+  private:
+    static size_t frameLength(uint8_t sync, uint8_t channelMask)
+    {
+      if (sync == FRAME_SYNC_EVENT) return FRAME_EVENT_LENGTH;
+      if (channelMask == 0) return FRAME_BUTTON_LENGTH;
+
+      int channels = 0;
+      for (uint8_t mask = channelMask; mask; mask &= mask - 1) channels++;
+      size_t length = FRAME_HEADER_LENGTH + (channels * 10 + 7) / 8 + 1;
+      return sync == FRAME_SYNC_TRACED ? length + FRAME_TRACE_LENGTH : length;
+    }
+
+    static bool validFrame(const std::vector<HardwareSerial::sentByte> &sent, size_t start, size_t length)
+    {
+      uint8_t crc = 0;
+      for (size_t i = start + 1; i < start + length - 1; i++) crc = mixlit.crc8Update(crc, sent[i].value);
+      return crc == sent[start + length - 1].value;
+    }
+
+    void decodeFrame(const std::vector<HardwareSerial::sentByte> &sent, size_t start, size_t length)
+    {
+      uint64_t time = sent[start + length - 1].sentAt;
+      uint8_t channelMask = sent[start + 2].value;
+      size_t offset = start + FRAME_HEADER_LENGTH;
+
+      updates++;
+      updateBytes += length;
+
+      if (sent[start].value == FRAME_SYNC_EVENT)
+      {
+        buttonReport(channelMask >> 4, channelMask & 0x0F, time, false);
+        return;
+      }
+
+      if (channelMask == 0)
+      {
+        uint8_t changed = sent[offset].value;
+        uint8_t states = sent[offset + 1].value;
+        for (int i = 0; i < NUM_OF_BUTTONS; i++)
+        {
+          if (changed & (1 << i)) buttonReport(i, (states >> i) & 1, time, false);
+        }
+        return;
+      }
+
+      uint32_t bitBuffer = 0;
+      int bitCount = 0;
+      for (int channel = 0; channel < NUM_OF_CHANNELS; channel++)
+      {
+        if (!(channelMask & (1 << channel))) continue;
+
+        while (bitCount < 10)
+        {
+          bitBuffer |= uint32_t(sent[offset++].value) << bitCount;
+          bitCount += 8;
+        }
+        reports.push_back({channel, int(bitBuffer & 0x3FF), time, false});
+        bitBuffer >>= 10;
+        bitCount -= 10;
+      }
+
+      if (sent[start].value == FRAME_SYNC_TRACED) decodeTrace(sent, start, start + length - 1 - FRAME_TRACE_LENGTH);
+    }
+
+    void decodeTrace(const std::vector<HardwareSerial::sentByte> &sent, size_t start, size_t offset)
+    {
+      uint32_t queuedAt = 0;
+      for (int i = 0; i < 4; i++) queuedAt |= uint32_t(sent[offset + i].value) << (i * 8);
+      uint32_t scanAge = sent[offset + 4].value | (sent[offset + 5].value << 8);
+
+      // micros() is the simulated clock cut down to 32 bits
+      uint32_t sentAt = uint32_t(sent[start + FRAME_HEADER_LENGTH].sentAt);
+      uint32_t queueToSent = sentAt - queuedAt;
+      tracedFrames++;
+
+      // queued after it started going out, or from a scan that hadn't happened yet
+      if (queueToSent > 1000000 || scanAge == 0xFFFF)
+      {
+        badTraces++;
+        return;
+      }
+
+      scanToQueueTotal += scanAge;
+      scanToQueueMax = std::max<uint64_t>(scanToQueueMax, scanAge);
+      queueToSentTotal += queueToSent;
+      queueToSentMax = std::max<uint64_t>(queueToSentMax, queueToSent);
+    }
+
+    static std::string field(const std::string &line, const char *prefix)
+    {
+      size_t start = line.find(prefix);
+      if (start == std::string::npos) return std::string();
+
+      start += strlen(prefix);
+      return line.substr(start, line.find('|', start) - start);
+    }
+
+    void decodeLine(const std::vector<HardwareSerial::sentByte> &sent, size_t start, size_t end)
+    {
+      std::string line;
+      for (size_t i = start; i < end; i++)
+      {
+        if (sent[i].value != '\r') line += char(sent[i].value);
+      }
+      if (line.empty()) return;
+
+      if (line.compare(0, strlen(DEVICE_IDENTIFIER), DEVICE_IDENTIFIER) == 0)
+      {
+        handshakes++;
+        afterHandshake = true;
+
+        deviceIds.push_back(field(line, "|id"));
+        stateHashes.push_back(field(line, "|state"));
+        return;
+      }
+      if (line == "ping" || line.compare(0, 2, "~S") == 0) return;
+
+      // the line after the handshake holds the starting value of every channel
+      bool initial = afterHandshake;
+      afterHandshake = false;
+
+      uint64_t time = sent[end].sentAt;
+      if (!initial)
+      {
+        updates++;
+        updateBytes += end - start + 1;
+      }
+
+      // "id|value|" pairs, buttons use a letter for their id
+      size_t position = 0;
+      while (position < line.size())
+      {
+        size_t idEnd = line.find('|', position);
+        if (idEnd == std::string::npos) break;
+        size_t valueEnd = line.find('|', idEnd + 1);
+        if (valueEnd == std::string::npos) break;
+
+        std::string id = line.substr(position, idEnd - position);
+        int value = atoi(line.substr(idEnd + 1, valueEnd - idEnd - 1).c_str());
+
+        if (!id.empty() && id[0] >= 'A' && id[0] < 'A' + NUM_OF_BUTTONS)   buttonReport(id[0] - 'A', value, time, initial);
+        else if (!id.empty())                                              reports.push_back({atoi(id.c_str()), value, time, initial});
+
+        position = valueEnd + 1;
+      }
+    }
+
+    // presses and releases are matched to the trace like a fader, the other gestures are only logged
+    void buttonReport(int button, int event, uint64_t time, bool initial)
+    {
+      if (!buttons.empty()) buttons += ' ';
+      buttons += char('A' + button);
+      buttons += std::to_string(event);
+
+      if (event == BUTTON_PRESSED || event == BUTTON_RELEASED) reports.push_back({NUM_OF_CHANNELS + button, event, time, initial});
+    }
+};
+
+// every handshake has to carry the same id, the one in the eeprom
+static bool checkDeviceIds(const std::vector<std::string> &ids, const char *expected)
+{
+  uint32_t stored = 0;
+  for (uint8_t i = 0; i < 4; i++) stored |= uint32_t(sim::eeprom[EEPROM_DEVICE_ID_ADDRESS + 1 + i]) << (i * 8);
+
+  for (size_t i = 0; i < ids.size(); i++)
+  {
+    char *end;
+    uint32_t id = strtoul(ids[i].c_str(), &end, 16);
+
+    if (ids[i].size() != 8 || *end != 0 || id == 0)
+    {
+      fprintf(stderr, "FAIL: handshake %lu has the device id \"%s\"\n", (unsigned long)i + 1, ids[i].c_str());
+      return false;
+    }
+    if (id != stored || sim::eeprom[EEPROM_DEVICE_ID_ADDRESS] != EEPROM_DEVICE_ID_MAGIC)
+    {
+      fprintf(stderr, "FAIL: handshake %lu reported %s, the eeprom holds %08X\n", (unsigned long)i + 1, ids[i].c_str(), stored);
+      return false;
+    }
+    if (expected && id != strtoul(expected, nullptr, 16))
+    {
+      fprintf(stderr, "FAIL: reported %s instead of the stored %s\n", ids[i].c_str(), expected);
+      return false;
+    }
+  }
+  return true;
+}
+
+// every handshake reports the hash of the led state as it was then, which the board has to save
+// and load back the same after a power cycle
+static bool checkSavedState(const std::vector<std::string> &hashes, bool powerCycle)
+{
+  for (size_t i = 0; i < hashes.size(); i++)
+  {
+    char *end;
+    strtoul(hashes[i].c_str(), &end, 16);
+    if (hashes[i].size() != 8 || *end != 0)
+    {
+      fprintf(stderr, "FAIL: handshake %lu has the state hash \"%s\"\n", (unsigned long)i + 1, hashes[i].c_str());
+      return false;
+    }
+  }
+  if (!powerCycle) return true;
+
+  if (mixlit.stateChanged || mixlit.stateSaveIndex >= 0)
+  {
+    fprintf(stderr, "FAIL: the led state was still waiting to be saved at the end\n");
+    return false;
+  }
+
+  class mixlit restored;
+  restored.loadState();
+  if (restored.stateHash() != mixlit.stateHash() || restored.savedStateSlot != mixlit.savedStateSlot)
+  {
+    fprintf(stderr, "FAIL: the state loaded from slot %d hashes to %08X, the board had %08X\n",
+            restored.savedStateSlot, restored.stateHash(), mixlit.stateHash());
+    return false;
+  }
+  for (int i = 0; i < NUM_OF_LED_STRIPS; i++)
+  {
+    if (restored.isAnimated[i] != mixlit.isAnimated[i] || restored.stripBrightness[i] != mixlit.stripBrightness[i])
+    {
+      fprintf(stderr, "FAIL: strip %d came back with different animation or brightness\n", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+#if NUM_OF_LED_STRIPS > 0
+// a change part way through a save abandons it, which leaves the slot the same as a power cut
+// would, so a board starting then has to pass over it and load the record saved before
+static bool checkTornSave()
+{
+  uint32_t savedHash = mixlit.stateHash();
+  uint8_t savedSlot = mixlit.savedStateSlot;
+  int tornAddress = EEPROM_STATE_ADDRESS + ((savedSlot + 1) % EEPROM_STATE_SLOTS) * EEPROM_STATE_RECORD_LENGTH;
+
+  mixlit.stripBrightness[0] ^= 0x55;
+  mixlit.markStateChanged();
+  sim::advance(STATE_SAVE_DELAY_MS * 1000UL);
+
+  for (int step = 0; mixlit.stateSaveIndex < EEPROM_STATE_RECORD_LENGTH / 2; step++)
+  {
+    if (step > 2 * EEPROM_STATE_RECORD_LENGTH)
+    {
+      fprintf(stderr, "FAIL: the second save never got going\n");
+      return false;
+    }
+    mixlit.saveState();
+    sim::advance(sim::EEPROM_WRITE_MICROS);
+  }
+  mixlit.stripBrightness[0] ^= 0x55;
+  mixlit.markStateChanged();
+
+  if (sim::eeprom[tornAddress] == EEPROM_STATE_MAGIC)
+  {
+    fprintf(stderr, "FAIL: the half written record in slot %d already has its magic\n", (savedSlot + 1) % EEPROM_STATE_SLOTS);
+    return false;
+  }
+
+  class mixlit restored;
+  restored.loadState();
+  if (restored.stateHash() != savedHash || restored.savedStateSlot != savedSlot)
+  {
+    fprintf(stderr, "FAIL: after a torn save the state loaded from slot %d hashes to %08X, the last whole one in slot %d was %08X\n",
+            restored.savedStateSlot, restored.stateHash(), savedSlot, savedHash);
+    return false;
+  }
+  return true;
+}
+#endif
+
+static bool parseOptions(int argc, char **argv, options &opts)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if (!strcmp(arg, "--trace") && hasValue)              opts.tracePath = argv[++i];
+    else if (!strcmp(arg, "--sweep") && hasValue)         opts.sweepMs = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--duration") && hasValue)      opts.durationMs = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--binary"))                    opts.binary = true;
+    else if (!strcmp(arg, "--baud") && hasValue)          opts.baud = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--skip-baud-confirm"))         opts.skipBaudConfirm = true;
+    else if (!strcmp(arg, "--expect-baud") && hasValue)   opts.expectBaud = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--noise") && hasValue)         opts.noise = atoi(argv[++i]);
+    else if (!strcmp(arg, "--animated"))                  opts.animated = true;
+#if NUM_OF_LED_STRIPS >= 5
+    else if (!strcmp(arg, "--led-frames"))                opts.ledFrames = true;
+#endif
+    else if (!strcmp(arg, "--latency-trace"))             opts.latencyTrace = true;
+    else if (!strcmp(arg, "--max-latency") && hasValue)   opts.maxLatencyMs = atol(argv[++i]);
+    else if (!strcmp(arg, "--max-spurious") && hasValue)  opts.maxSpurious = atol(argv[++i]);
+    else if (!strcmp(arg, "--device-id") && hasValue)     opts.deviceId = argv[++i];
+    else if (!strcmp(arg, "--power-cycle"))               opts.powerCycle = true;
+    else if (!strcmp(arg, "--torn-save"))                 opts.tornSave = true;
+    else if (!strcmp(arg, "--gestures"))                  opts.gestures = true;
+    else if (!strcmp(arg, "--button-timings") && hasValue) opts.buttonTimings = argv[++i];
+    else if (!strcmp(arg, "--bounce") && hasValue)        opts.bounceMs = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--expect-buttons") && hasValue) opts.expectButtons = argv[++i];
+    else if (!strcmp(arg, "--partial-command"))           opts.partialCommand = true;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  options opts;
+  if (!parseOptions(argc, argv, opts)) return 2;
+
+  std::vector<traceEvent> events;
+  if (opts.tracePath && !loadTrace(opts.tracePath, events)) return 2;
+  if (opts.sweepMs) buildSweep(opts.sweepMs, events);
+  std::stable_sort(events.begin(), events.end(), [](const traceEvent &a, const traceEvent &b) { return a.time < b.time; });
+
+  uint64_t duration = uint64_t(opts.durationMs) * 1000;
+  if (duration == 0) duration = (events.empty() ? 0 : events.back().time) + 500000;
+
+  srand(1);
+  sim::analogNoise = opts.noise;
+  for (int i = 0; i < NUM_OF_PINS; i++) sim::pinModes[i] = -1;
+
+  // the faders start wherever the first event for them puts them
+  std::vector<int> lastReported(NUM_OF_CHANNELS + NUM_OF_BUTTONS, 0);
+  for (int channel = 0; channel < NUM_OF_CHANNELS; channel++)
+  {
+    traceEvent start = {0, channel, 0};
+    for (size_t i = 0; i < events.size(); i++)
+    {
+      if (events[i].channel == channel) { start.value = events[i].value; break; }
+    }
+    applyEvent(start);
+    lastReported[channel] = start.value;
+  }
+
+  // where each fader really is, as of the last change that was sent
+  std::vector<int> position = lastReported;
+
+  bool passed = true;
+
+  if (opts.deviceId)
+  {
+    // laid out the way mixlit::createDeviceId stores it
+    uint32_t id = strtoul(opts.deviceId, nullptr, 16);
+    uint8_t crc = 0;
+    sim::eeprom[EEPROM_DEVICE_ID_ADDRESS] = EEPROM_DEVICE_ID_MAGIC;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+      sim::eeprom[EEPROM_DEVICE_ID_ADDRESS + 1 + i] = (id >> (i * 8)) & 0xFF;
+      crc = mixlit.crc8Update(crc, (id >> (i * 8)) & 0xFF);
+    }
+    sim::eeprom[EEPROM_DEVICE_ID_ADDRESS + 5] = crc;
+  }
+
+  // connect like the software does, the handshake is already waiting when the firmware starts
+  Serial.receive("?");
+  setup();
+
+  const int inputModes[] = {INPUT, INPUT_PULLUP};
+  for (int i = 0; i < NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS + NUM_OF_BUTTONS; i++)
+  {
+    int pin;
+    if (i < NUM_OF_CHANNELS)                pin = hardware::analogPins[i];
+    else                                    pin = hardware::buttons[i - NUM_OF_CHANNELS];
+
+    if (sim::pinModes[pin] != inputModes[0] && sim::pinModes[pin] != inputModes[1])
+    {
+      fprintf(stderr, "FAIL: pin %d was never set up as an input by initialize()\n", pin);
+      passed = false;
+    }
+  }
+
+  // like the software, nothing else is sent until a baud rate change has been answered
+  std::string hostInput;
+
+  if (opts.baud)
+  {
+    char command[24];
+    snprintf(command, sizeof(command), "~S%lu!", opts.baud);
+    Serial.receive(command);
+
+    // the software confirms a new rate with a handshake at it
+    if (!opts.skipBaudConfirm) hostInput += "?";
+  }
+
+  if (opts.binary) hostInput += "~B!";
+  if (opts.latencyTrace) hostInput += "~T1!";
+  if (opts.buttonTimings) hostInput += std::string("~K") + opts.buttonTimings + "!";
+  if (opts.gestures) hostInput += "~G1!";
+
+  if (opts.animated)
+  {
+    // "<strip>1" and a red to blue palette
+    for (int strip = 0; strip < NUM_OF_LED_STRIPS; strip++)
+    {
+      char command[] = "01FF00000000FF!";
+      command[0] = '0' + strip;
+      hostInput += command;
+    }
+  }
+
+#if NUM_OF_LED_STRIPS >= 5
+  CRGBPalette16 untouchedPalette;
+  if (opts.ledFrames) hostInput += buildLEDFrames(untouchedPalette);
+#endif
+
+  // the '!' never comes
+  if (opts.partialCommand) hostInput += "0FF";
+
+  // run the main loop, feeding in each trace event once the board's clock reaches it
+  uint64_t loopStart = sim::microsNow;
+  uint64_t traceStart = loopStart + TRACE_START_MS * 1000;
+  unsigned long loops = 0;
+  size_t nextEvent = 0;
+  std::vector<uint64_t> eventTimes(events.size());
+  std::vector<traceEvent> bounces;
+  std::vector<int> channelValues(NUM_OF_CHANNELS + NUM_OF_BUTTONS, 0);
+  unsigned long showsBeforeInput = 0;
+
+  while (sim::microsNow < loopStart + duration)
+  {
+    // the reply to a baud rate change takes a few milliseconds at 38400
+    if (!hostInput.empty() && (!opts.baud || Serial.baudRate() == opts.baud || sim::microsNow >= loopStart + 50000))
+    {
+      for (size_t i = 0; i < hostInput.size(); i++) Serial.receive((uint8_t)hostInput[i]);
+      hostInput.clear();
+      showsBeforeInput = FastLED.showCount + FastLED.stripShowCount;
+    }
+
+    while (nextEvent < events.size() && traceStart + events[nextEvent].time <= sim::microsNow)
+    {
+      const traceEvent &event = events[nextEvent];
+      applyEvent(event);
+      eventTimes[nextEvent] = sim::microsNow;
+
+      // only a button that moves bounces
+      bool edge = channelValues[event.channel] != event.value;
+      channelValues[event.channel] = event.value;
+      if (opts.bounceMs && edge && event.channel >= NUM_OF_CHANNELS) addBounce(event, sim::microsNow, opts.bounceMs, bounces);
+      nextEvent++;
+    }
+
+    // bounces aren't trace events, nothing should ever be sent for them
+    for (size_t i = 0; i < bounces.size();)
+    {
+      if (bounces[i].time > sim::microsNow) { i++; continue; }
+      applyEvent(bounces[i]);
+      bounces.erase(bounces.begin() + i);
+    }
+
+    loop();
+    sim::advance(sim::LOOP_MICROS);
+    loops++;
+  }
+  uint64_t loopEnd = sim::microsNow;
+
+  // bytes still in the output buffer would go out on the next loops, let them drain
+  Serial.flush();
+
+  outputDecoder decoder;
+  decoder.decode(Serial.sent);
+
+  // each report is matched to a change on its channel that it carries the value of, so the
+  // latency is how old the value was when it reached the software. changes that another
+  // change replaced before anything was sent count as overtaken instead
+  std::vector<std::vector<traceEvent> > pending(NUM_OF_CHANNELS + NUM_OF_BUTTONS);
+  std::vector<uint64_t> latencies;
+  unsigned long spurious = 0;
+  unsigned long overtaken = 0;
+  size_t eventIndex = 0;
+
+  for (size_t i = 0; i <= decoder.reports.size(); i++)
+  {
+    // one extra pass with no report picks up the changes made after the last one
+    bool last = i == decoder.reports.size();
+    uint64_t reportTime = last ? UINT64_MAX : decoder.reports[i].time;
+
+    if (!last && (reportTime < loopStart || decoder.reports[i].initial))
+    {
+      lastReported[decoder.reports[i].channel] = decoder.reports[i].value;
+      continue;
+    }
+
+    while (eventIndex < nextEvent && eventTimes[eventIndex] <= reportTime)
+    {
+      traceEvent event = events[eventIndex];
+      event.time = eventTimes[eventIndex];
+      int threshold = event.channel < NUM_OF_CHANNELS ? REPORT_TOLERANCE : 0;
+
+      if (!pending[event.channel].empty() || abs(event.value - lastReported[event.channel]) > threshold)
+      {
+        pending[event.channel].push_back(event);
+      }
+      eventIndex++;
+    }
+    if (last) break;
+
+    const report &r = decoder.reports[i];
+    std::vector<traceEvent> &waiting = pending[r.channel];
+    int tolerance = r.channel < NUM_OF_CHANNELS ? REPORT_TOLERANCE : 0;
+
+    // the oldest match, a fader coming back past a value it has only just left is still waiting
+    size_t match = 0;
+    while (match < waiting.size() && abs(r.value - waiting[match].value) > tolerance) match++;
+
+    if (match < waiting.size())
+    {
+      latencies.push_back(r.time - waiting[match].time);
+      position[r.channel] = waiting[match].value;
+      overtaken += match;
+      waiting.erase(waiting.begin(), waiting.begin() + match + 1);
+    }
+    else if (waiting.empty() && r.value != lastReported[r.channel] &&
+             abs(r.value - position[r.channel]) >= abs(lastReported[r.channel] - position[r.channel]))
+    {
+      // a fader still on its way to a change or settling onto it is fine, and a refresh resends
+      // the same value, anything moving away from where the fader is is noise getting through
+      spurious++;
+    }
+
+    lastReported[r.channel] = r.value;
+  }
+
+  // anything left that moved the channel away from what was last sent never made it out
+  unsigned long unsent = 0;
+  for (size_t channel = 0; channel < pending.size(); channel++)
+  {
+    int threshold = channel < NUM_OF_CHANNELS ? REPORT_TOLERANCE : 0;
+    if (!pending[channel].empty() && abs(pending[channel].back().value - lastReported[channel]) > threshold) unsent++;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  double seconds = double(loopEnd - loopStart) / 1000000.0;
+  double averageLatency = 0;
+  for (size_t i = 0; i < latencies.size(); i++) averageLatency += latencies[i];
+  if (!latencies.empty()) averageLatency /= latencies.size();
+
+  uint64_t p95Latency = latencies.empty() ? 0 : latencies[(latencies.size() * 95) / 100 < latencies.size() ? (latencies.size() * 95) / 100 : latencies.size() - 1];
+  uint64_t maxLatency = latencies.empty() ? 0 : latencies.back();
+
+  printf("protocol            %s @ %lu baud\n", opts.binary ? "binary" : "ascii", Serial.baudRate());
+  printf("simulated time      %.3f s\n", seconds);
+  printf("loop iterations     %lu (%.0f per second, %.0f us each)\n", loops, loops / seconds, loops ? (loopEnd - loopStart) / double(loops) : 0);
+  printf("leds shown          %lu times, %lu single strips\n", FastLED.showCount, FastLED.stripShowCount);
+  printf("bytes sent          %lu\n", (unsigned long)Serial.sent.size());
+  printf("updates             %lu (%.1f bytes per update)\n", decoder.updates, decoder.updates ? double(decoder.updateBytes) / decoder.updates : 0);
+  printf("bad frames          %lu\n", decoder.badFrames);
+  printf("trace events        %lu (%lu overtaken before being sent)\n", (unsigned long)nextEvent, overtaken);
+  printf("change latency      avg %.2f ms, p95 %.2f ms, max %.2f ms over %lu changes\n",
+         averageLatency / 1000.0, p95Latency / 1000.0, maxLatency / 1000.0, (unsigned long)latencies.size());
+  if (opts.latencyTrace)
+  {
+    unsigned long goodTraces = decoder.tracedFrames - decoder.badTraces;
+    printf("traced frames       %lu (%lu bad)\n", decoder.tracedFrames, decoder.badTraces);
+    printf("scan to queue       avg %.2f ms, max %.2f ms\n",
+           goodTraces ? decoder.scanToQueueTotal / 1000.0 / goodTraces : 0, decoder.scanToQueueMax / 1000.0);
+    printf("queue to sent       avg %.2f ms, max %.2f ms\n",
+           goodTraces ? decoder.queueToSentTotal / 1000.0 / goodTraces : 0, decoder.queueToSentMax / 1000.0);
+  }
+  printf("device id           %s (%lu eeprom writes)\n", decoder.deviceIds.empty() ? "-" : decoder.deviceIds[0].c_str(), sim::eepromWrites);
+  printf("led state           %08X, saved as sequence %d in slot %d\n", mixlit.stateHash(), mixlit.savedStateSequence, mixlit.savedStateSlot);
+  printf("spurious updates    %lu\n", spurious);
+  printf("buttons             %s\n", decoder.buttons.empty() ? "-" : decoder.buttons.c_str());
+  printf("changes never sent  %lu\n", unsent);
+
+  if (decoder.handshakes == 0)
+  {
+    fprintf(stderr, "FAIL: no handshake was sent\n");
+    passed = false;
+  }
+  if (!checkDeviceIds(decoder.deviceIds, opts.deviceId)) passed = false;
+  if (opts.expectButtons && decoder.buttons != opts.expectButtons)
+  {
+    fprintf(stderr, "FAIL: the buttons reported \"%s\" instead of \"%s\"\n", decoder.buttons.c_str(), opts.expectButtons);
+    passed = false;
+  }
+  if (!checkSavedState(decoder.stateHashes, opts.powerCycle)) passed = false;
+#if NUM_OF_LED_STRIPS > 0
+  else if (opts.powerCycle && opts.tornSave && !checkTornSave()) passed = false;
+#endif
+  if (opts.partialCommand && FastLED.showCount + FastLED.stripShowCount == showsBeforeInput)
+  {
+    fprintf(stderr, "FAIL: the leds were never shown once an unfinished command had come in\n");
+    passed = false;
+  }
+#if NUM_OF_LED_STRIPS >= 5
+  if (opts.ledFrames && !checkLEDFrames(untouchedPalette)) passed = false;
+#endif
+  if (opts.expectBaud && Serial.baudRate() != opts.expectBaud)
+  {
+    fprintf(stderr, "FAIL: ended up at %lu baud instead of %lu\n", Serial.baudRate(), opts.expectBaud);
+    passed = false;
+  }
+  if (opts.latencyTrace && (decoder.tracedFrames == 0 || decoder.badTraces > 0))
+  {
+    fprintf(stderr, "FAIL: %lu traced frames, %lu with timestamps out of order\n", decoder.tracedFrames, decoder.badTraces);
+    passed = false;
+  }
+  if (decoder.badFrames > 0)
+  {
+    fprintf(stderr, "FAIL: %lu frames failed their crc\n", decoder.badFrames);
+    passed = false;
+  }
+  if (unsent > 0)
+  {
+    fprintf(stderr, "FAIL: %lu changes were never sent\n", unsent);
+    passed = false;
+  }
+  if (opts.maxLatencyMs >= 0 && maxLatency > uint64_t(opts.maxLatencyMs) * 1000)
+  {
+    fprintf(stderr, "FAIL: worst change latency %.2f ms is over %ld ms\n", maxLatency / 1000.0, opts.maxLatencyMs);
+    passed = false;
+  }
+  if (opts.maxSpurious >= 0 && spurious > (unsigned long)opts.maxSpurious)
+  {
+    fprintf(stderr, "FAIL: %lu spurious updates, allowed %ld\n", spurious, opts.maxSpurious);
+    passed = false;
+  }
+
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// Arduino core stub for building the MixLit firmware on a PC
+//
+// Time only moves when the firmware calls something that takes time on the real board
+// (analogRead, delay, serial writes with a full transmit buffer, FastLED.show), so a run
+// is deterministic and the numbers it produces are in board time, not PC time.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+
+#define NUM_OF_PINS 22
+
+namespace sim {
+  // roughly what an ATmega328 at 16 MHz takes, see the README
+  const uint32_t ANALOG_READ_MICROS = 112;
+  const uint32_t ADC_CONVERSION_MICROS = 104;
+  const uint32_t ADC_INTERRUPT_MICROS = 5;
+  const uint32_t DIGITAL_READ_MICROS = 4;
+  // the filters and serial checks of a pass through loop() with nothing to send
+  const uint32_t LOOP_MICROS = 20;
+  const uint8_t SERIAL_TX_BUFFER_SIZE = 64;
+
+  extern uint64_t microsNow;
+
+  // analog pins hold the raw 0 - 1023 reading, digital pins 0 or 1
+  extern int pinValues[NUM_OF_PINS];
+  extern int pinModes[NUM_OF_PINS];
+  extern int analogNoise;
+
+  // interrupts (only the adc's, here) fire while time passes unless they are turned off
+  void advance(uint64_t micros, bool interruptsEnabled = true);
+
+  // the AVR adc: a conversion started on a pin finishes ADC_CONVERSION_MICROS later and calls complete
+  // from "interrupt context", the way ISR(ADC_vect) does on the board
+  void startConversion(uint8_t pin, void (*complete)(uint16_t));
+  int readPin(uint8_t pin);
+  extern unsigned long adcConversions;
+}
+
+int analogRead(uint8_t pin);
+int digitalRead(uint8_t pin);
+void pinMode(uint8_t pin, uint8_t mode);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long millis();
+unsigned long micros();
+
+class HardwareSerial {
+  public:
+    struct sentByte {
+      uint8_t value;
+      uint64_t sentAt; // when the last bit leaves the UART
+    };
+
+    void begin(unsigned long baud);
+    void end();
+
+    int available();
+    int read();
+    int peek();
+    int availableForWrite();
+    void flush();
+
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t print(const char *text);
+    size_t println(const char *text);
+    size_t println();
+
+    operator bool() { return true; }
+
+    // simulator side of the link
+    void receive(const char *text);
+    void receive(uint8_t value);
+    unsigned long baudRate() { return baud; }
+    uint64_t byteMicros() { return baud ? 10000000ULL / baud : 0; }
+
+    std::vector<sentByte> sent;
+
+  private:
+    unsigned long baud = 0;
+    std::deque<uint8_t> incoming;
+    uint64_t lineBusyUntil = 0;
+
+    uint8_t bytesInTransmitBuffer();
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,28 @@
+// EEPROM library stub for building the MixLit firmware on a PC, only what the firmware uses
+
+#pragma once
+
+#include "Arduino.h"
+
+namespace sim {
+  // an ATmega328 has 1KB, blank it reads 0xFF
+  const uint16_t EEPROM_SIZE = 1024;
+  const uint32_t EEPROM_WRITE_MICROS = 3300;
+
+  extern uint8_t eeprom[EEPROM_SIZE];
+  extern unsigned long eepromWrites;
+  extern uint64_t eepromBusyUntil;
+}
+
+// from avr/eeprom.h, false while a write is still going
+bool eeprom_is_ready();
+
+class EEPROMClass {
+  public:
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);
+    uint16_t length() { return sim::EEPROM_SIZE; }
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,93 @@
+// FastLED stub for building the MixLit firmware on a PC, only what the firmware uses
+
+#pragma once
+
+#include "Arduino.h"
+
+struct CRGB {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+
+  CRGB() : r(0), g(0), b(0) {}
+  CRGB(uint8_t red, uint8_t green, uint8_t blue) : r(red), g(green), b(blue) {}
+  CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+
+  bool operator==(const CRGB &other) const { return r == other.r && g == other.g && b == other.b; }
+  bool operator!=(const CRGB &other) const { return !(*this == other); }
+};
+
+class CRGBPalette16 {
+  public:
+    CRGB entries[16];
+
+    CRGBPalette16() {}
+    CRGBPalette16(const CRGB &c00, const CRGB &c01, const CRGB &c02, const CRGB &c03,
+                  const CRGB &c04, const CRGB &c05, const CRGB &c06, const CRGB &c07,
+                  const CRGB &c08, const CRGB &c09, const CRGB &c10, const CRGB &c11,
+                  const CRGB &c12, const CRGB &c13, const CRGB &c14, const CRGB &c15)
+    {
+      const CRGB colours[16] = {c00, c01, c02, c03, c04, c05, c06, c07, c08, c09, c10, c11, c12, c13, c14, c15};
+      for (uint8_t i = 0; i < 16; i++) entries[i] = colours[i];
+    }
+
+    CRGB &operator[](uint8_t index) { return entries[index]; }
+    const CRGB &operator[](uint8_t index) const { return entries[index]; }
+};
+
+enum TBlendType { NOBLEND = 0, LINEARBLEND = 1 };
+
+// same as FastLED: the top 4 bits pick the entry, the bottom 4 blend towards the next one
+CRGB ColorFromPalette(const CRGBPalette16 &palette, uint8_t index, uint8_t brightness = 255, TBlendType blendType = LINEARBLEND);
+
+enum EOrder { RGB = 0012, RBG = 0021, GRB = 0102, GBR = 0120, BRG = 0201, BGR = 0210 };
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER> class WS2812 {};
+template <uint8_t DATA_PIN, EOrder RGB_ORDER> class WS2812B {};
+
+// WS2812 data takes 30us per LED, plus the 50us latch
+#define WS2812_MICROS_PER_LED 30
+#define WS2812_LATCH_MICROS 50
+
+class CLEDController {
+  public:
+    uint8_t pin = 0;
+    CRGB *leds = nullptr;
+    int count = 0;
+
+    void showLeds(uint8_t brightness = 255);
+};
+
+class CFastLED {
+  public:
+    static const uint8_t MAX_STRIPS = 16;
+
+    template <template <uint8_t, EOrder> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+    CLEDController &addLeds(CRGB *data, int count)
+    {
+      CLEDController &controller = controllers[numStrips < MAX_STRIPS - 1 ? numStrips : MAX_STRIPS - 1];
+      if (numStrips < MAX_STRIPS) numStrips++;
+
+      controller.pin = DATA_PIN;
+      controller.leds = data;
+      controller.count = count;
+      return controller;
+    }
+
+    CLEDController &operator[](int index) { return controllers[index]; }
+
+    void setBrightness(uint8_t value) { brightness = value; }
+    uint8_t getBrightness() { return brightness; }
+
+    void show();
+
+    CLEDController controllers[MAX_STRIPS];
+    uint8_t numStrips = 0;
+    uint8_t brightness = 255;
+
+    // whole refreshes from show() and single strips from showLeds()
+    unsigned long showCount = 0;
+    unsigned long stripShowCount = 0;
+};
+
+extern CFastLED FastLED;
@@ -0,0 +1,278 @@
+#include "Arduino.h"
+#include "FastLED.h"
+#include "EEPROM.h"
+
+HardwareSerial Serial;
+CFastLED FastLED;
+EEPROMClass EEPROM;
+
+namespace sim {
+  uint64_t microsNow = 0;
+  int pinValues[NUM_OF_PINS];
+  int pinModes[NUM_OF_PINS];
+  int analogNoise = 0;
+
+  unsigned long adcConversions = 0;
+
+  uint8_t eeprom[EEPROM_SIZE];
+  unsigned long eepromWrites = 0;
+  uint64_t eepromBusyUntil = 0;
+
+  // starts out blank, like a new board
+  static struct blankEeprom {
+    blankEeprom() { memset(eeprom, 0xFF, EEPROM_SIZE); }
+  } eepromBlanker;
+
+  static bool conversionRunning = false;
+  static uint8_t conversionPin = 0;
+  static uint64_t conversionDoneAt = 0;
+  static void (*conversionComplete)(uint16_t) = nullptr;
+
+  static void fireConversion()
+  {
+    conversionRunning = false;
+    adcConversions++;
+
+    // the interrupt's own run time comes out of whatever it interrupted
+    microsNow += ADC_INTERRUPT_MICROS;
+    conversionComplete((uint16_t)readPin(conversionPin));
+  }
+
+  void advance(uint64_t micros, bool interruptsEnabled)
+  {
+    uint64_t target = microsNow + micros;
+
+    while (interruptsEnabled && conversionRunning && conversionDoneAt <= target)
+    {
+      microsNow = conversionDoneAt;
+      fireConversion();
+      target += ADC_INTERRUPT_MICROS;
+    }
+    microsNow = target;
+
+    // one that finished while interrupts were off runs as soon as they are back on
+    if (!interruptsEnabled && conversionRunning && conversionDoneAt <= microsNow) fireConversion();
+  }
+
+  void startConversion(uint8_t pin, void (*complete)(uint16_t))
+  {
+    conversionRunning = true;
+    conversionPin = pin;
+    conversionDoneAt = microsNow + ADC_CONVERSION_MICROS;
+    conversionComplete = complete;
+  }
+
+  int readPin(uint8_t pin)
+  {
+    if (pin >= NUM_OF_PINS) return 0;
+
+    int value = pinValues[pin];
+    if (analogNoise > 0) value += (rand() % (2 * analogNoise + 1)) - analogNoise;
+
+    if (value < 0) return 0;
+    if (value > 1023) return 1023;
+    return value;
+  }
+}
+
+int analogRead(uint8_t pin)
+{
+  sim::advance(sim::ANALOG_READ_MICROS);
+  return sim::readPin(pin);
+}
+
+int digitalRead(uint8_t pin)
+{
+  sim::advance(sim::DIGITAL_READ_MICROS);
+  if (pin >= NUM_OF_PINS) return LOW;
+  return sim::pinValues[pin] ? HIGH : LOW;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin < NUM_OF_PINS) sim::pinModes[pin] = mode;
+}
+
+void delay(unsigned long ms)
+{
+  sim::advance(uint64_t(ms) * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  sim::advance(us);
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(sim::microsNow / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)sim::microsNow;
+}
+
+void HardwareSerial::begin(unsigned long baudRate)
+{
+  baud = baudRate;
+}
+
+void HardwareSerial::end()
+{
+  // like the AVR core, anything still being sent goes out and anything received is dropped
+  flush();
+  incoming.clear();
+}
+
+int HardwareSerial::available()
+{
+  return (int)incoming.size();
+}
+
+int HardwareSerial::read()
+{
+  if (incoming.empty()) return -1;
+
+  uint8_t value = incoming.front();
+  incoming.pop_front();
+  return value;
+}
+
+int HardwareSerial::peek()
+{
+  return incoming.empty() ? -1 : incoming.front();
+}
+
+uint8_t HardwareSerial::bytesInTransmitBuffer()
+{
+  // bytes that have not started shifting out yet
+  if (lineBusyUntil <= sim::microsNow || byteMicros() == 0) return 0;
+
+  uint64_t queued = (lineBusyUntil - sim::microsNow) / byteMicros();
+  return queued > sim::SERIAL_TX_BUFFER_SIZE ? sim::SERIAL_TX_BUFFER_SIZE : (uint8_t)queued;
+}
+
+int HardwareSerial::availableForWrite()
+{
+  return sim::SERIAL_TX_BUFFER_SIZE - bytesInTransmitBuffer();
+}
+
+void HardwareSerial::flush()
+{
+  if (lineBusyUntil > sim::microsNow) sim::microsNow = lineBusyUntil;
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{
+  // like the real core, a full transmit buffer blocks until a byte has gone out
+  while (bytesInTransmitBuffer() >= sim::SERIAL_TX_BUFFER_SIZE)
+  {
+    sim::advance(byteMicros());
+  }
+
+  uint64_t start = lineBusyUntil > sim::microsNow ? lineBusyUntil : sim::microsNow;
+  lineBusyUntil = start + byteMicros();
+
+  sentByte sentValue = {value, lineBusyUntil};
+  sent.push_back(sentValue);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  for (size_t i = 0; i < size; i++) write(buffer[i]);
+  return size;
+}
+
+size_t HardwareSerial::print(const char *text)
+{
+  return write((const uint8_t *)text, strlen(text));
+}
+
+size_t HardwareSerial::println(const char *text)
+{
+  return print(text) + println();
+}
+
+size_t HardwareSerial::println()
+{
+  return print("\r\n");
+}
+
+void HardwareSerial::receive(const char *text)
+{
+  while (*text) incoming.push_back((uint8_t)*text++);
+}
+
+void HardwareSerial::receive(uint8_t value)
+{
+  incoming.push_back(value);
+}
+
+CRGB ColorFromPalette(const CRGBPalette16 &palette, uint8_t index, uint8_t brightness, TBlendType blendType)
+{
+  uint8_t entry = index >> 4;
+  uint8_t blend = (index & 0x0F) << 4;
+
+  CRGB colour = palette[entry];
+
+  if (blendType == LINEARBLEND && blend != 0)
+  {
+    const CRGB &next = palette[(entry + 1) & 0x0F];
+    colour.r = colour.r + (((int)next.r - colour.r) * blend >> 8);
+    colour.g = colour.g + (((int)next.g - colour.g) * blend >> 8);
+    colour.b = colour.b + (((int)next.b - colour.b) * blend >> 8);
+  }
+
+  if (brightness != 255)
+  {
+    colour.r = (colour.r * (brightness + 1)) >> 8;
+    colour.g = (colour.g * (brightness + 1)) >> 8;
+    colour.b = (colour.b * (brightness + 1)) >> 8;
+  }
+
+  return colour;
+}
+
+void CLEDController::showLeds(uint8_t brightness)
+{
+  // the WS2812 timing is bit banged with interrupts off
+  sim::advance(WS2812_LATCH_MICROS + uint64_t(count) * WS2812_MICROS_PER_LED, false);
+  FastLED.stripShowCount++;
+}
+
+void CFastLED::show()
+{
+  int totalLeds = 0;
+  for (uint8_t i = 0; i < numStrips; i++) totalLeds += controllers[i].count;
+
+  sim::advance(WS2812_LATCH_MICROS + uint64_t(totalLeds) * WS2812_MICROS_PER_LED, false);
+  showCount++;
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+  return address >= 0 && address < sim::EEPROM_SIZE ? sim::eeprom[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+  // the AVR starts the write and returns, only a write while the last one is still going waits for it
+  if (address < 0 || address >= sim::EEPROM_SIZE) return;
+  if (!eeprom_is_ready()) sim::advance(sim::eepromBusyUntil - sim::microsNow);
+
+  sim::eeprom[address] = value;
+  sim::eepromWrites++;
+  sim::eepromBusyUntil = sim::microsNow + sim::EEPROM_WRITE_MICROS;
+}
+
+bool eeprom_is_ready()
+{
+  return sim::microsNow >= sim::eepromBusyUntil;
+}
+
+void EEPROMClass::update(int address, uint8_t value)
+{
+  if (read(address) != value) write(address, value);
+}
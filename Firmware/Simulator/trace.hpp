@@ -0,0 +1,90 @@
+// fader traces, shared by the simulator and the virtual device
+//
+// each line of a trace is "<time ms> <channel> <value>", see README.md
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+#include "definitions.h"
+
+#define NUM_OF_CHANNELS (NUM_OF_SLIDERS + NUM_OF_POTENTIOMETERS)
+#define SWEEP_STEP_MS 10
+
+struct traceEvent {
+  uint64_t time; // micros
+  int channel;   // 0 - 7 analog, NUM_OF_CHANNELS + n for button n
+  int value;     // the value the firmware should report, not the raw pin reading
+};
+
+static bool loadTrace(const char *path, std::vector<traceEvent> &events)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+  {
+    fprintf(stderr, "can't open trace %s\n", path);
+    return false;
+  }
+
+  // each line is "<time ms> <channel> <value>", channel is 0 - 7 for faders or A - E for buttons
+  char line[128];
+  int lineNumber = 0;
+  while (fgets(line, sizeof(line), file))
+  {
+    lineNumber++;
+    if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+
+    unsigned long timeMs;
+    char channel[8];
+    int value;
+    if (sscanf(line, "%lu %7s %d", &timeMs, channel, &value) != 3)
+    {
+      fprintf(stderr, "%s:%d: expected \"<time ms> <channel> <value>\"\n", path, lineNumber);
+      fclose(file);
+      return false;
+    }
+
+    traceEvent event;
+    event.time = uint64_t(timeMs) * 1000;
+    event.value = value;
+
+    if (channel[0] >= 'A' && channel[0] < 'A' + NUM_OF_BUTTONS)   event.channel = NUM_OF_CHANNELS + (channel[0] - 'A');
+    else                                                          event.channel = atoi(channel);
+
+    if (event.channel < 0 || event.channel >= NUM_OF_CHANNELS + NUM_OF_BUTTONS)
+    {
+      fprintf(stderr, "%s:%d: unknown channel %s\n", path, lineNumber, channel);
+      fclose(file);
+      return false;
+    }
+    events.push_back(event);
+  }
+
+  fclose(file);
+  std::stable_sort(events.begin(), events.end(), [](const traceEvent &a, const traceEvent &b) { return a.time < b.time; });
+  return true;
+}
+
+static void buildSweep(unsigned long periodMs, std::vector<traceEvent> &events)
+{
+  // every fader goes 0 -> 1023 -> 0, each one starting a little later than the last
+  unsigned long steps = periodMs / SWEEP_STEP_MS;
+  if (steps < 2) steps = 2;
+
+  for (unsigned long step = 0; step <= steps; step++)
+  {
+    for (int channel = 0; channel < NUM_OF_CHANNELS; channel++)
+    {
+      unsigned long phase = (step + channel * steps / NUM_OF_CHANNELS) % steps;
+      unsigned long half = steps / 2;
+      int value = phase <= half ? (int)(1023 * phase / half) : (int)(1023 * (steps - phase) / half);
+
+      traceEvent event = {uint64_t(step) * SWEEP_STEP_MS * 1000, channel, value};
+      events.push_back(event);
+    }
+  }
+}
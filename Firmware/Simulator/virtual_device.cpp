@@ -0,0 +1,819 @@
+// a virtual MixLit on a Linux pseudo-terminal, for load testing the software without a board
+//
+// it answers the handshake, protocol, baud rate, palette and ping commands the way the firmware
+// does and sends fader updates from a trace, but at whatever rate it's told rather than what
+// the board and the baud rate allow. the trace's buttons are clean, so there is no debounce, and
+// with "~G1!" only their presses and releases are sent as events
+//
+// usage: mixlit_vdev [options]
+//   --link <path>         symlink the pty here too, it keeps pointing at the pty across an unplug
+//   --trace <file>        replay a fader trace, see traces/, from the start again once it ends
+//   --sweep <ms>          move every fader end to end and back over <ms>, in 10ms steps
+//   --speed <x>           play the trace x times faster
+//   --rate <hz>           how often an update can be sent, defaults to 250
+//   --all-channels        send every channel in every update, not just the ones that changed
+//   --duration <ms>       stop after this long, defaults to running until interrupted
+//   --dropout <ms>/<ms>   every first ms, send nothing for the second ms
+//   --garbage <n>         send n bytes of noise a second between updates
+//   --corrupt <n>         flip a bit in every nth update
+//   --unplug <ms>/<ms>    every first ms, close the pty and open a new one after the second ms
+//   --loopback            be the software too, check everything sent decodes and exit
+//   --device-id <hex>     the id reported at the handshake, run several with different ones for a desk of units
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.hpp"
+
+#define DEFAULT_RATE_HZ 250
+#define STATS_INTERVAL_MS 1000
+
+// the baud rates the firmware takes, see mixlit::baudRates
+static const uint32_t baudRates[NUM_OF_BAUD_RATES] = {1000000, 500000, 250000, 115200, 57600, 38400};
+
+struct options {
+  const char *linkPath = nullptr;
+  const char *tracePath = nullptr;
+  unsigned long sweepMs = 0;
+  double speed = 1.0;
+  unsigned long rateHz = DEFAULT_RATE_HZ;
+  bool allChannels = false;
+  unsigned long durationMs = 0;
+  unsigned long dropoutEveryMs = 0;
+  unsigned long dropoutForMs = 0;
+  unsigned long garbagePerSecond = 0;
+  unsigned long corruptEvery = 0;
+  unsigned long unplugEveryMs = 0;
+  unsigned long unplugForMs = 0;
+  bool loopback = false;
+  uint32_t deviceId = 0;
+};
+
+struct stats {
+  unsigned long updates = 0;
+  unsigned long bytes = 0;
+  unsigned long unwritten = 0; // bytes the pty had no room for, nobody is reading
+  unsigned long garbage = 0;
+  unsigned long corrupted = 0;
+  unsigned long handshakes = 0;
+  unsigned long pings = 0;
+  unsigned long paletteCommands = 0;
+  unsigned long ledFrames = 0;
+  unsigned long badLedFrames = 0;
+  unsigned long protocolCommands = 0;
+  unsigned long unplugs = 0;
+};
+
+static volatile sig_atomic_t stopping = 0;
+
+static void handleSignal(int)
+{
+  stopping = 1;
+}
+
+static uint64_t nowMicros()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return uint64_t(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+// CRC-8, polynomial 0x07, matches mixlit::crc8Update
+static uint8_t crc8Update(uint8_t crc, uint8_t value)
+{
+  crc ^= value;
+  for (uint8_t bit = 0; bit < 8; bit++)
+  {
+    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+  }
+  return crc;
+}
+
+// one end of a pty, raw so nothing gets echoed or turned into a signal
+class pseudoTerminal {
+  public:
+    int fd = -1;
+    std::string path;
+
+    bool open(const char *linkPath)
+    {
+      fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+      if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+      {
+        perror("can't open a pty");
+        close();
+        return false;
+      }
+
+      termios settings;
+      tcgetattr(fd, &settings);
+      cfmakeraw(&settings);
+      tcsetattr(fd, TCSANOW, &settings);
+
+      path = ptsname(fd);
+
+      // swapped in with a rename so the software never sees the link missing
+      if (linkPath)
+      {
+        std::string temporary = std::string(linkPath) + ".new";
+        unlink(temporary.c_str());
+        if (symlink(path.c_str(), temporary.c_str()) != 0 || rename(temporary.c_str(), linkPath) != 0)
+        {
+          perror("can't link the pty");
+        }
+      }
+      return true;
+    }
+
+    void close()
+    {
+      if (fd >= 0) ::close(fd);
+      fd = -1;
+    }
+};
+
+// the device side of the protocol
+class virtualDevice {
+  public:
+    stats counts;
+
+    // what the faders are at now, and what was last sent
+    int values[NUM_OF_CHANNELS] = {0};
+    int sentValues[NUM_OF_CHANNELS] = {0};
+    bool buttons[NUM_OF_BUTTONS] = {false};
+    bool sentButtons[NUM_OF_BUTTONS] = {false};
+
+    bool connected = false;
+    bool binary = false;
+    bool traceLatency = false;
+    bool gestures = false;
+
+    // stands in for the one a board keeps in its eeprom
+    uint32_t deviceId = 0;
+
+    void reset()
+    {
+      connected = false;
+      binary = false;
+      traceLatency = false;
+      gestures = false;
+      commandLength = 0;
+      receivingFrame = false;
+    }
+
+    void receive(const uint8_t *data, size_t length, std::string &reply)
+    {
+      for (size_t i = 0; i < length; i++) receiveByte(data[i], reply);
+    }
+
+    // the changes since the last update, or everything with allChannels
+    bool buildUpdate(bool allChannels, uint64_t micros, std::string &update)
+    {
+      uint8_t changedChannels = 0;
+      uint8_t changedButtons = 0;
+
+      for (int i = 0; i < NUM_OF_CHANNELS; i++)
+      {
+        if (allChannels || values[i] != sentValues[i]) changedChannels |= 1 << i;
+        sentValues[i] = values[i];
+      }
+      for (int i = 0; i < NUM_OF_BUTTONS; i++)
+      {
+        if (buttons[i] != sentButtons[i]) changedButtons |= 1 << i;
+        sentButtons[i] = buttons[i];
+      }
+
+      if (changedChannels == 0 && changedButtons == 0) return false;
+
+      if (binary)
+      {
+        if (changedChannels) analogFrame(changedChannels, micros, update);
+        if (changedButtons && gestures) eventFrames(changedButtons, update);
+        else if (changedButtons) buttonFrame(changedButtons, update);
+      }
+      else
+      {
+        asciiUpdate(changedChannels, changedButtons, update);
+      }
+      return true;
+    }
+
+  private:
+    char command[COMMAND_BUFFER_SIZE];
+    uint8_t commandLength = 0;
+    bool commandOverflow = false;
+    bool receivingFrame = false;
+    uint8_t frameLength = 0;
+    uint8_t sequence = 0;
+
+    void receiveByte(uint8_t value, std::string &reply)
+    {
+      if (receivingFrame)
+      {
+        receiveFrameByte(value);
+        return;
+      }
+      if (value == FRAME_SYNC)
+      {
+        receivingFrame = true;
+        commandLength = 0;
+        commandOverflow = false;
+        return;
+      }
+
+      if (value == '?')
+      {
+        handshake(reply);
+        return;
+      }
+      if (value == '!')
+      {
+        if (commandOverflow)
+        {
+          // the end of a command that was too long to be valid, drop it
+        }
+        else if (commandLength == 0)
+        {
+          counts.pings++;
+          reply += "ping\r\n";
+        }
+        else if (command[0] == '~')
+        {
+          protocolCommand(reply);
+        }
+        else
+        {
+          counts.paletteCommands++;
+        }
+
+        commandLength = 0;
+        commandOverflow = false;
+      }
+      else if (value != '\n' && value != '\r' && value != ' ' && value != '\t')
+      {
+        if (commandLength < COMMAND_BUFFER_SIZE)   command[commandLength++] = value;
+        else                                       commandOverflow = true;
+      }
+    }
+
+    void receiveFrameByte(uint8_t value)
+    {
+      command[commandLength++] = value;
+
+      if (commandLength == 1)
+      {
+        switch (value)
+        {
+          case LED_FRAME_SOLID:         frameLength = 2 + 3 + 1;        break;
+          case LED_FRAME_GRADIENT:      frameLength = 2 + 6 + 1;        break;
+          case LED_FRAME_BRIGHTNESS:    frameLength = 2 + 1 + 1;        break;
+          case LED_FRAME_PALETTE:       frameLength = 2 + 16 * 3 + 1;   break;
+          default:
+            counts.badLedFrames++;
+            receivingFrame = false;
+            commandLength = 0;
+        }
+        return;
+      }
+
+      if (commandLength < frameLength) return;
+
+      receivingFrame = false;
+      commandLength = 0;
+
+      uint8_t crc = 0;
+      for (uint8_t i = 0; i < frameLength - 1; i++) crc = crc8Update(crc, command[i]);
+
+      if (crc == (uint8_t)command[frameLength - 1])   counts.ledFrames++;
+      else                                            counts.badLedFrames++;
+    }
+
+    void protocolCommand(std::string &reply)
+    {
+      counts.protocolCommands++;
+
+      if (commandLength > 2 && command[1] == 'S')
+      {
+        uint32_t rate = 0;
+        for (uint8_t i = 2; i < commandLength && command[i] >= '0' && command[i] <= '9'; i++) rate = rate * 10 + (command[i] - '0');
+
+        // a pty doesn't care about the rate, so it is taken without waiting for the confirm
+        bool supported = std::find(baudRates, baudRates + NUM_OF_BAUD_RATES, rate) != baudRates + NUM_OF_BAUD_RATES;
+        reply += "~S" + std::to_string(supported ? rate : 0) + "\r\n";
+      }
+      else if (commandLength == 3 && command[1] == 'T')
+      {
+        traceLatency = command[2] == '1';
+      }
+      else if (commandLength == 3 && command[1] == 'G')
+      {
+        gestures = command[2] == '1';
+      }
+      else if (commandLength == 2 && command[1] == 'B')
+      {
+        binary = true;
+        forceUpdate();
+      }
+      else if (commandLength == 2 && command[1] == 'A')
+      {
+        binary = false;
+        forceUpdate();
+      }
+    }
+
+    void forceUpdate()
+    {
+      for (int i = 0; i < NUM_OF_CHANNELS; i++) sentValues[i] = -1;
+    }
+
+    void handshake(std::string &reply)
+    {
+      counts.handshakes++;
+      connected = true;
+      binary = false;
+      traceLatency = false;
+      gestures = false;
+
+      // it keeps no led state, so without "|state" the software always sends its palettes
+      char id[9];
+      snprintf(id, sizeof(id), "%08X", deviceId);
+      reply += DEVICE_IDENTIFIER "|v" + std::to_string(PROTOCOL_VERSION) + "|ram-1|baud" + std::to_string(MAX_BAUD_RATE) + "|id" + id + "\r\n";
+
+      // and the initial values, like mixlit::sendHandshake
+      for (int i = 0; i < NUM_OF_CHANNELS; i++)
+      {
+        reply += std::to_string(i) + "|" + std::to_string(values[i]) + "|";
+        sentValues[i] = values[i];
+      }
+      reply += "\r\n";
+    }
+
+    void asciiUpdate(uint8_t changedChannels, uint8_t changedButtons, std::string &update)
+    {
+      for (int i = 0; i < NUM_OF_CHANNELS; i++)
+      {
+        if (changedChannels & (1 << i)) update += std::to_string(i) + "|" + std::to_string(values[i]) + "|";
+      }
+      for (int i = 0; i < NUM_OF_BUTTONS; i++)
+      {
+        if (!(changedButtons & (1 << i))) continue;
+        update += char('A' + i);
+        update += buttons[i] ? "|1|" : "|0|";
+      }
+      update += "\r\n";
+    }
+
+    void frameByte(uint8_t value, uint8_t &crc, std::string &frame)
+    {
+      crc = crc8Update(crc, value);
+      frame += (char)value;
+    }
+
+    void analogFrame(uint8_t channelMask, uint64_t micros, std::string &frame)
+    {
+      uint8_t crc = 0;
+      frame += (char)(traceLatency ? FRAME_SYNC_TRACED : FRAME_SYNC);
+      frameByte(sequence++, crc, frame);
+      frameByte(channelMask, crc, frame);
+
+      uint32_t bitBuffer = 0;
+      uint8_t bitCount = 0;
+      for (int i = 0; i < NUM_OF_CHANNELS; i++)
+      {
+        if (!(channelMask & (1 << i))) continue;
+
+        bitBuffer |= uint32_t(values[i] & 0x3FF) << bitCount;
+        bitCount += 10;
+        while (bitCount >= 8)
+        {
+          frameByte(bitBuffer & 0xFF, crc, frame);
+          bitBuffer >>= 8;
+          bitCount -= 8;
+        }
+      }
+      if (bitCount > 0) frameByte(bitBuffer & 0xFF, crc, frame);
+
+      if (traceLatency)
+      {
+        // there's no adc here, so the scan is always brand new
+        uint32_t queuedAt = uint32_t(micros);
+        for (int i = 0; i < 4; i++) frameByte((queuedAt >> (i * 8)) & 0xFF, crc, frame);
+        frameByte(0, crc, frame);
+        frameByte(0, crc, frame);
+      }
+
+      frame += (char)crc;
+    }
+
+    // BUTTON_PRESSED and BUTTON_RELEASED are the same as the state
+    void eventFrames(uint8_t changedButtons, std::string &frame)
+    {
+      for (int i = 0; i < NUM_OF_BUTTONS; i++)
+      {
+        if (!(changedButtons & (1 << i))) continue;
+
+        uint8_t crc = 0;
+        frame += (char)FRAME_SYNC_EVENT;
+        frameByte(sequence++, crc, frame);
+        frameByte((i << 4) | (buttons[i] ? BUTTON_PRESSED : BUTTON_RELEASED), crc, frame);
+        frame += (char)crc;
+      }
+    }
+
+    void buttonFrame(uint8_t changedButtons, std::string &frame)
+    {
+      uint8_t states = 0;
+      for (int i = 0; i < NUM_OF_BUTTONS; i++)
+      {
+        if (buttons[i]) states |= 1 << i;
+      }
+
+      uint8_t crc = 0;
+      frame += (char)FRAME_SYNC;
+      frameByte(sequence++, crc, frame);
+      frameByte(0, crc, frame);
+      frameByte(changedButtons, crc, frame);
+      frameByte(states, crc, frame);
+      frame += (char)crc;
+    }
+};
+
+// the software's side for --loopback, splits the output the way SerialPortReader does
+class loopbackHost {
+  public:
+    int fd = -1;
+    unsigned long lines = 0;
+    unsigned long frames = 0;
+    unsigned long badFrames = 0;
+    unsigned long handshakes = 0;
+
+    bool open(const std::string &path)
+    {
+      fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+      if (fd < 0)
+      {
+        perror("can't open the pty for --loopback");
+        return false;
+      }
+
+      termios settings;
+      tcgetattr(fd, &settings);
+      cfmakeraw(&settings);
+      tcsetattr(fd, TCSANOW, &settings);
+      return true;
+    }
+
+    void send(const char *text)
+    {
+      if (write(fd, text, strlen(text)) < 0) perror("loopback write");
+    }
+
+    void read()
+    {
+      uint8_t chunk[4096];
+      ssize_t length;
+      while ((length = ::read(fd, chunk, sizeof(chunk))) > 0) buffer.insert(buffer.end(), chunk, chunk + length);
+
+      size_t start = 0;
+      while (start < buffer.size())
+      {
+        uint8_t first = buffer[start];
+        if (first == FRAME_SYNC || first == FRAME_SYNC_TRACED || first == FRAME_SYNC_EVENT)
+        {
+          if (start + FRAME_HEADER_LENGTH > buffer.size()) break;
+
+          size_t length = frameLength(first, buffer[start + 2]);
+          if (start + length > buffer.size()) break;
+
+          uint8_t crc = 0;
+          for (size_t i = start + 1; i < start + length - 1; i++) crc = crc8Update(crc, buffer[i]);
+          if (crc == buffer[start + length - 1])
+          {
+            frames++;
+            start += length;
+          }
+          else
+          {
+            badFrames++;
+            start++;
+          }
+          continue;
+        }
+
+        size_t end = start;
+        while (end < buffer.size() && buffer[end] != '\n' && buffer[end] != FRAME_SYNC && buffer[end] != FRAME_SYNC_TRACED && buffer[end] != FRAME_SYNC_EVENT) end++;
+        if (end == buffer.size()) break;
+
+        std::string line(buffer.begin() + start, buffer.begin() + end);
+        if (line.find(DEVICE_IDENTIFIER) != std::string::npos) handshakes++;
+        else if (line.find('|') != std::string::npos) lines++;
+        start = buffer[end] == '\n' ? end + 1 : end;
+      }
+      buffer.erase(buffer.begin(), buffer.begin() + start);
+    }
+
+  private:
+    std::vector<uint8_t> buffer;
+
+    static size_t frameLength(uint8_t sync, uint8_t channelMask)
+    {
+      if (sync == FRAME_SYNC_EVENT) return FRAME_EVENT_LENGTH;
+      if (channelMask == 0) return FRAME_BUTTON_LENGTH;
+
+      int channels = 0;
+      for (uint8_t mask = channelMask; mask; mask &= mask - 1) channels++;
+      size_t length = FRAME_HEADER_LENGTH + (channels * 10 + 7) / 8 + 1;
+      return sync == FRAME_SYNC_TRACED ? length + FRAME_TRACE_LENGTH : length;
+    }
+};
+
+static bool parsePair(const char *text, unsigned long &first, unsigned long &second)
+{
+  char *end;
+  first = strtoul(text, &end, 10);
+  if (*end != '/') return false;
+  second = strtoul(end + 1, &end, 10);
+  return *end == 0 && first > 0;
+}
+
+static bool parseOptions(int argc, char **argv, options &opts)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if (!strcmp(arg, "--link") && hasValue)               opts.linkPath = argv[++i];
+    else if (!strcmp(arg, "--trace") && hasValue)         opts.tracePath = argv[++i];
+    else if (!strcmp(arg, "--sweep") && hasValue)         opts.sweepMs = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--speed") && hasValue)         opts.speed = atof(argv[++i]);
+    else if (!strcmp(arg, "--rate") && hasValue)          opts.rateHz = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--all-channels"))              opts.allChannels = true;
+    else if (!strcmp(arg, "--duration") && hasValue)      opts.durationMs = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--garbage") && hasValue)       opts.garbagePerSecond = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--corrupt") && hasValue)       opts.corruptEvery = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--loopback"))                  opts.loopback = true;
+    else if (!strcmp(arg, "--device-id") && hasValue)     opts.deviceId = strtoul(argv[++i], nullptr, 16);
+    else if (!strcmp(arg, "--dropout") && hasValue && parsePair(argv[i + 1], opts.dropoutEveryMs, opts.dropoutForMs))   i++;
+    else if (!strcmp(arg, "--unplug") && hasValue && parsePair(argv[i + 1], opts.unplugEveryMs, opts.unplugForMs))      i++;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return false;
+    }
+  }
+
+  if (opts.rateHz == 0 || opts.speed <= 0)
+  {
+    fprintf(stderr, "--rate and --speed have to be more than 0\n");
+    return false;
+  }
+  if (opts.loopback && opts.unplugEveryMs)
+  {
+    fprintf(stderr, "--loopback can't follow the device through an unplug\n");
+    return false;
+  }
+  return true;
+}
+
+// whether [every, every + length) repeating from the start covers elapsed
+static bool inWindow(uint64_t elapsedMicros, unsigned long everyMs, unsigned long forMs)
+{
+  if (everyMs == 0) return false;
+
+  uint64_t period = uint64_t(everyMs + forMs) * 1000;
+  return elapsedMicros % period >= uint64_t(everyMs) * 1000;
+}
+
+static void printStats(const stats &counts, const stats &last, double seconds)
+{
+  printf("updates %lu (%.0f/s), bytes %lu (%.0f/s), unwritten %lu, garbage %lu, corrupted %lu | "
+         "handshakes %lu, pings %lu, palettes %lu, led frames %lu (%lu bad), protocol %lu, unplugs %lu\n",
+         counts.updates, (counts.updates - last.updates) / seconds, counts.bytes, (counts.bytes - last.bytes) / seconds,
+         counts.unwritten, counts.garbage, counts.corrupted, counts.handshakes, counts.pings, counts.paletteCommands,
+         counts.ledFrames, counts.badLedFrames, counts.protocolCommands, counts.unplugs);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+  options opts;
+  if (!parseOptions(argc, argv, opts)) return 2;
+
+  std::vector<traceEvent> events;
+  if (opts.tracePath && !loadTrace(opts.tracePath, events)) return 2;
+  if (opts.sweepMs) buildSweep(opts.sweepMs, events);
+  std::stable_sort(events.begin(), events.end(), [](const traceEvent &a, const traceEvent &b) { return a.time < b.time; });
+
+  // the trace starts again once it's played, a little after its last event
+  uint64_t traceLength = (events.empty() ? 0 : events.back().time) + SWEEP_STEP_MS * 1000;
+
+  signal(SIGINT, handleSignal);
+  signal(SIGTERM, handleSignal);
+  signal(SIGPIPE, SIG_IGN);
+  srand(1);
+
+  pseudoTerminal pty;
+  if (!pty.open(opts.linkPath)) return 1;
+  virtualDevice device;
+  stats lastStats;
+
+  // one id per process unless it's given, so several run side by side are told apart, it stays the same across an unplug
+  device.deviceId = opts.deviceId ? opts.deviceId : 0x7D000000 | (uint32_t(getpid()) & 0xFFFFFF);
+
+  printf("virtual MixLit %08X on %s%s%s\n", device.deviceId, pty.path.c_str(), opts.linkPath ? " linked from " : "", opts.linkPath ? opts.linkPath : "");
+  fflush(stdout);
+
+  loopbackHost host;
+  if (opts.loopback)
+  {
+    if (!host.open(pty.path)) return 1;
+    host.send("?~B!");
+  }
+
+  const uint64_t interval = 1000000 / opts.rateHz;
+  const uint64_t start = nowMicros();
+  const uint64_t end = opts.durationMs ? start + uint64_t(opts.durationMs) * 1000 : UINT64_MAX;
+  uint64_t nextUpdate = start;
+  uint64_t nextStats = start + STATS_INTERVAL_MS * 1000;
+  uint64_t lastGarbage = start;
+  size_t nextEvent = 0;
+  uint64_t traceStart = start;
+  bool unplugged = false;
+  bool hungUp = false;
+
+  std::string output;
+
+  while (!stopping)
+  {
+    uint64_t now = nowMicros();
+    if (now >= end) break;
+    uint64_t elapsed = now - start;
+
+    // unplugging closes the pty, the software sees its port go away and a new one turn up
+    bool shouldUnplug = inWindow(elapsed, opts.unplugEveryMs, opts.unplugForMs);
+    if (shouldUnplug != unplugged)
+    {
+      unplugged = shouldUnplug;
+      if (unplugged)
+      {
+        pty.close();
+        if (opts.linkPath) unlink(opts.linkPath);
+        device.reset();
+        device.counts.unplugs++;
+        hungUp = false;
+      }
+      else if (pty.open(opts.linkPath))
+      {
+        printf("plugged back in on %s\n", pty.path.c_str());
+      }
+    }
+
+    while (!events.empty() && traceStart + uint64_t(events[nextEvent].time / opts.speed) <= now)
+    {
+      const traceEvent &event = events[nextEvent];
+      if (event.channel < NUM_OF_CHANNELS)    device.values[event.channel] = event.value;
+      else                                    device.buttons[event.channel - NUM_OF_CHANNELS] = event.value != 0;
+
+      if (++nextEvent == events.size())
+      {
+        nextEvent = 0;
+        traceStart += uint64_t(traceLength / opts.speed);
+      }
+    }
+
+    if (pty.fd >= 0)
+    {
+      pollfd watch = {pty.fd, POLLIN, 0};
+      poll(&watch, 1, 0);
+
+      // with nothing on the other end the master reads EIO, and like a Nano the device resets
+      // when the port is opened again
+      bool nowHungUp = (watch.revents & POLLHUP) != 0;
+      if (hungUp && !nowHungUp) device.reset();
+      hungUp = nowHungUp;
+
+      if (watch.revents & POLLIN)
+      {
+        uint8_t chunk[512];
+        ssize_t length = read(pty.fd, chunk, sizeof(chunk));
+        if (length > 0) device.receive(chunk, length, output);
+      }
+    }
+
+    bool quiet = inWindow(elapsed, opts.dropoutEveryMs, opts.dropoutForMs);
+    if (now >= nextUpdate)
+    {
+      // a slow loop skips the updates it missed rather than bursting to catch up
+      nextUpdate += interval;
+      if (nextUpdate < now) nextUpdate = now + interval;
+
+      if (device.connected && !quiet && !hungUp)
+      {
+        std::string update;
+        if (device.buildUpdate(opts.allChannels, now - start, update))
+        {
+          device.counts.updates++;
+          if (opts.corruptEvery && device.counts.updates % opts.corruptEvery == 0)
+          {
+            // never the sync byte, so the software has to catch it with the crc or the parser
+            size_t at = update.size() > 1 ? 1 + rand() % (update.size() - 1) : 0;
+            update[at] ^= 1 << (rand() % 8);
+            device.counts.corrupted++;
+          }
+          output += update;
+        }
+      }
+    }
+
+    if (opts.garbagePerSecond && !quiet)
+    {
+      unsigned long count = (unsigned long)((now - lastGarbage) * opts.garbagePerSecond / 1000000);
+      if (count > 0)
+      {
+        for (unsigned long i = 0; i < count; i++) output += (char)(rand() & 0xFF);
+        device.counts.garbage += count;
+        lastGarbage = now;
+      }
+    }
+    else
+    {
+      lastGarbage = now;
+    }
+
+    if (!output.empty())
+    {
+      ssize_t written = pty.fd >= 0 && !hungUp ? write(pty.fd, output.data(), output.size()) : -1;
+      if (written < 0) written = 0;
+      device.counts.bytes += written;
+      device.counts.unwritten += output.size() - written;
+      output.clear();
+    }
+
+    if (opts.loopback) host.read();
+
+    if (now >= nextStats)
+    {
+      printStats(device.counts, lastStats, STATS_INTERVAL_MS / 1000.0);
+      lastStats = device.counts;
+      nextStats += STATS_INTERVAL_MS * 1000;
+    }
+
+    // wake for the next update, or for anything the software sends
+    uint64_t after = nowMicros();
+    if (after < nextUpdate && pty.fd >= 0 && !hungUp)
+    {
+      // ppoll rather than poll, at the faster rates an update is due well inside a millisecond
+      pollfd watch = {pty.fd, POLLIN, 0};
+      timespec timeout = {time_t((nextUpdate - after) / 1000000), long((nextUpdate - after) % 1000000) * 1000};
+      ppoll(&watch, 1, &timeout, nullptr);
+    }
+    else if (after < nextUpdate)
+    {
+      usleep(std::min<uint64_t>(nextUpdate - after, 10000));
+    }
+  }
+
+  double seconds = (nowMicros() - start) / 1000000.0;
+  printf("ran for %.3f s\n", seconds);
+  printStats(device.counts, stats(), seconds);
+
+  if (opts.loopback) host.read();
+  pty.close();
+  if (opts.linkPath) unlink(opts.linkPath);
+
+  if (!opts.loopback) return 0;
+
+  printf("loopback: %lu handshakes, %lu lines, %lu frames, %lu bad frames\n", host.handshakes, host.lines, host.frames, host.badFrames);
+
+  bool passed = true;
+  if (host.handshakes == 0 || host.frames == 0)
+  {
+    fprintf(stderr, "FAIL: the loopback host got %lu handshakes and %lu frames\n", host.handshakes, host.frames);
+    passed = false;
+  }
+  if (!opts.corruptEvery && !opts.garbagePerSecond && (host.badFrames > 0 || device.counts.unwritten > 0))
+  {
+    fprintf(stderr, "FAIL: %lu bad frames and %lu bytes unwritten with no faults injected\n", host.badFrames, device.counts.unwritten);
+    passed = false;
+  }
+  if (opts.corruptEvery && device.counts.corrupted > 0 && host.badFrames == 0)
+  {
+    fprintf(stderr, "FAIL: %lu updates were corrupted but none failed their crc\n", device.counts.corrupted);
+    passed = false;
+  }
+  return passed ? 0 : 1;
+}
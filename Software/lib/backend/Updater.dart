@@ -3,6 +3,7 @@ import 'dart:io';
 import 'package:flutter/material.dart';
 import 'package:http/http.dart' as http;
 import 'package:mixlit/frontend/menus/dialog/Update.dart';
+import 'package:mixlit/backend/application/data/StorageManager.dart';
 import 'package:path_provider/path_provider.dart';
 import 'package:package_info_plus/package_info_plus.dart';
 import 'package:version/version.dart';
@@ -134,7 +135,8 @@ class Updater {
           mode: ProcessStartMode.detached,
         );
 
-        Future.delayed(const Duration(milliseconds: 500), () {
+        Future.delayed(const Duration(milliseconds: 500), () async {
+          await StorageManager.instance.flush();
           exit(0);
         });
 
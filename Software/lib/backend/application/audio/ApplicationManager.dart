@@ -1,14 +1,19 @@
 import 'dart:async';
 import 'dart:io';
+import 'dart:typed_data';
 
+import 'package:mixlit/backend/application/audio/AudioBackend.dart';
+import 'package:mixlit/backend/application/audio/AudioSessionIndex.dart';
+import 'package:mixlit/backend/application/audio/VolumeDispatcher.dart';
 import 'package:mixlit/backend/application/data/ConfigManager.dart';
 import 'package:mixlit/backend/application/data/StorageManager.dart';
+import 'package:mixlit/backend/application/serial/SliderAddress.dart';
 import 'package:win32audio/win32audio.dart';
 
 class MissingApp {
   final String processName;
   final String? processPath;
-  final String? cachedIconPath;
+  final Uint8List? cachedIcon;
   final String displayName;
   final double volumeValue;
   final bool isMuted;
@@ -16,7 +21,7 @@ class MissingApp {
   MissingApp({
     required this.processName,
     this.processPath,
-    this.cachedIconPath,
+    this.cachedIcon,
     required this.displayName,
     required this.volumeValue,
     required this.isMuted,
@@ -26,26 +31,14 @@ class MissingApp {
 class ApplicationManager {
   Map<int, ProcessVolume> assignedApplications = {};
   Map<int, MissingApp> missingApplications = {};
-  List<double> sliderValues = List.filled(8, 0.5);
-  List<String> sliderTags = List.filled(8, 'defaultDevice');
-  List<bool> muteStates = List.filled(8, false);
+  List<double> sliderValues = List.filled(SliderAddress.COUNT, 0.5);
+  List<String> sliderTags = List.filled(SliderAddress.COUNT, 'defaultDevice');
+  List<bool> muteStates = List.filled(SliderAddress.COUNT, false);
 
-  //Audio session monitoring
-  Timer? _audioSessionMonitor;
-  static const Duration _monitorInterval = Duration(seconds: 2);
-
-  final Map<int, DateTime> _recentlyRestoredApps = {};
-  static const Duration _restorationGracePeriod = Duration(seconds: 5);
-
-  final Map<int, int> _failedValidationCounts = {};
-  static const int _maxFailedValidations = 3;
-
-  // rate limiting due to windows buffering volume requests
-  static const int RATE_LIMIT_MS = 40;
-  DateTime _lastVolumeAdjustment = DateTime.now();
-  Timer? _pendingVolumeTimer;
-  final Map<int, double> _pendingAppVolumes = {};
-  double? _pendingDeviceVolume;
+  //Audio session tracking
+  StreamSubscription<AudioSessionChanges>? _sessionChanges;
+  final StreamController<int> _sliderAppChanges =
+      StreamController<int>.broadcast();
 
   bool _isConfigLoaded = false;
   final Completer<void> _configLoadCompleter = Completer<void>();
@@ -56,19 +49,29 @@ class ApplicationManager {
   bool _deviceJustConnected = false;
 
   final ConfigManager _configManager = ConfigManager.instance;
+  final AudioSessionIndex _sessionIndex = AudioSessionIndex.instance;
+  final VolumeDispatcher _volumeDispatcher = VolumeDispatcher.instance;
+  final AudioBackend _audioBackend = AudioBackend.instance;
 
   ApplicationManager() {
     _loadSavedConfiguration();
-    _startAudioSessionMonitoring();
+    _startAudioSessionTracking();
   }
 
   Future<void> get configLoaded => _configLoadCompleter.future;
 
+  /// The index of a slider whose app has just gone missing or come back
+  Stream<int> get sliderAppChanges => _sliderAppChanges.stream;
+
   void enableVolumeRestorationOnDeviceConnect() {
     print('Device connected - enabling volume restoration');
     _deviceJustConnected = true;
     _allowVolumeRestoration = true;
     _isInitialStartup = false;
+
+    // the levels may have been changed some other way while it was away, so
+    // the restored ones go out even if they match what was last sent
+    _volumeDispatcher.forgetApplied();
   }
 
   void enableVolumeRestorationForUserAction() {
@@ -77,129 +80,57 @@ class ApplicationManager {
     }
   }
 
-  void _startAudioSessionMonitoring() {
-    _audioSessionMonitor = Timer.periodic(_monitorInterval, (timer) async {
-      await _monitorAudioSessions();
-    });
-    print('Audio session monitoring started');
+  void _startAudioSessionTracking() {
+    _sessionChanges = _sessionIndex.changes.listen(_onAudioSessionsChanged);
+    _sessionIndex.startTracking();
+    print('Audio session tracking started');
   }
 
-  Future<void> _monitorAudioSessions() async {
+  Future<void> _onAudioSessionsChanged(AudioSessionChanges changes) async {
     try {
-      final now = DateTime.now();
-      _recentlyRestoredApps.removeWhere((sliderIndex, restorationTime) =>
-          now.difference(restorationTime) > _restorationGracePeriod);
+      if (changes.stopped.isNotEmpty) {
+        await _moveStoppedAppsToMissing(changes.stopped);
+      }
 
-      if (missingApplications.isNotEmpty) {
+      if (changes.started.isNotEmpty && missingApplications.isNotEmpty) {
         await _checkForMissingAudioSessions();
       }
-
-      await _validateAssignedApplications();
     } catch (e) {
-      print('Error monitoring audio sessions: $e');
+      print('Error handling audio session changes: $e');
     }
   }
 
-  Future<void> _validateAssignedApplications() async {
-    final List<int> potentiallyMissingApps = [];
+  // an app with another instance still playing keeps its slider, it moves to
+  // that instance the next time it's assigned or restored
+  Future<void> _moveStoppedAppsToMissing(Set<String> stopped) async {
+    final List<int> stoppedSliders = [];
 
     for (var entry in assignedApplications.entries) {
-      final sliderIndex = entry.key;
       final app = entry.value;
-
-      if (_recentlyRestoredApps.containsKey(sliderIndex)) {
+      if (!stopped.contains(_sessionIndex.normalizedName(app.processPath))) {
         continue;
       }
 
-      final isStillControllable = await _testAudioSessionControl(app);
-
-      if (!isStillControllable) {
-        _failedValidationCounts[sliderIndex] =
-            (_failedValidationCounts[sliderIndex] ?? 0) + 1;
-
-        print(
-            'App ${app.processPath} failed audio session validation (attempt ${_failedValidationCounts[sliderIndex]})');
-
-        if (_failedValidationCounts[sliderIndex]! >= _maxFailedValidations) {
-          print(
-              'App ${app.processPath} failed validation $_maxFailedValidations times, marking as missing');
-          potentiallyMissingApps.add(sliderIndex);
-        }
-      } else {
-        _failedValidationCounts.remove(sliderIndex);
+      if (!await _isAppInAudioEnumeration(app)) {
+        print('App ${app.processPath} (PID: ${app.processId}) stopped');
+        stoppedSliders.add(entry.key);
       }
     }
 
-    for (var sliderIndex in potentiallyMissingApps) {
+    for (var sliderIndex in stoppedSliders) {
       await _moveAppToMissing(sliderIndex);
     }
   }
 
-  Future<bool> _testAudioSessionControl(ProcessVolume app) async {
-    try {
-      if (!await _isAppInAudioEnumeration(app)) {
-        print(
-            'App ${app.processPath} (PID: ${app.processId}) not found in audio enumeration');
-        return false;
-      }
-
-      return await _testVolumeControl(app);
-    } catch (e) {
-      print('Audio session control test failed for ${app.processPath}: $e');
-      return false;
-    }
-  }
-
   Future<bool> _isAppInAudioEnumeration(ProcessVolume app) async {
     try {
-      final allApps = await Audio.enumAudioMixer() ?? [];
-
-      final matchingApp =
-          allApps.where((a) => a.processId == app.processId).firstOrNull;
-
-      if (matchingApp != null) {
-        final normalizedStoredPath = _configManager.normalizeProcessName(
-            _configManager.extractProcessName(app.processPath));
-        final normalizedFoundPath = _configManager.normalizeProcessName(
-            _configManager.extractProcessName(matchingApp.processPath));
-
-        return normalizedStoredPath == normalizedFoundPath;
-      }
-
-      return false;
+      return await _sessionIndex.isLive(app.processId, app.processPath);
     } catch (e) {
       print('Error checking app in audio enumeration: $e');
       return false;
     }
   }
 
-  Future<bool> _testVolumeControl(ProcessVolume app) async {
-    try {
-      final sliderIndex = _getSliderIndexForApp(app);
-      if (sliderIndex == -1) return false;
-
-      final currentStoredVolume = sliderValues[sliderIndex] / 1024;
-
-      if (_allowVolumeRestoration) {
-        Audio.setAudioMixerVolume(app.processId, currentStoredVolume);
-      }
-
-      return true;
-    } catch (e) {
-      print('Volume control test failed for ${app.processPath}: $e');
-      return false;
-    }
-  }
-
-  int _getSliderIndexForApp(ProcessVolume app) {
-    for (var entry in assignedApplications.entries) {
-      if (entry.value.processId == app.processId) {
-        return entry.key;
-      }
-    }
-    return -1;
-  }
-
   Future<void> _moveAppToMissing(int sliderIndex) async {
     final app = assignedApplications[sliderIndex];
     if (app == null) return;
@@ -211,7 +142,7 @@ class ApplicationManager {
     final missingApp = MissingApp(
       processName: _configManager.extractProcessName(app.processPath),
       processPath: app.processPath,
-      cachedIconPath: await _configManager.getCachedIconPath(app.processPath),
+      cachedIcon: await _configManager.getCachedIcon(app.processPath),
       displayName: _createDisplayName(
           _configManager.extractProcessName(app.processPath)),
       volumeValue: sliderValues[sliderIndex],
@@ -220,7 +151,7 @@ class ApplicationManager {
 
     missingApplications[sliderIndex] = missingApp;
     assignedApplications.remove(sliderIndex);
-    _failedValidationCounts.remove(sliderIndex);
+    _sliderAppChanges.add(sliderIndex);
   }
 
   Future<void> _checkForMissingAudioSessions() async {
@@ -240,8 +171,7 @@ class ApplicationManager {
               'Found missing app ${missingApp.processName} for slider $sliderIndex');
 
           assignedApplications[sliderIndex] = matchingApp;
-
-          _recentlyRestoredApps[sliderIndex] = DateTime.now();
+          _sliderAppChanges.add(sliderIndex);
 
           final currentSliderValue = sliderValues[sliderIndex];
           final isMuted = missingApp.isMuted;
@@ -250,10 +180,8 @@ class ApplicationManager {
               'Found app restoration: currentSliderValue=$currentSliderValue, muted=$isMuted, allowVolumeRestoration=$_allowVolumeRestoration');
 
           if (_allowVolumeRestoration) {
-            Timer(const Duration(milliseconds: 500), () async {
-              await _restoreVolumeForApp(
-                  sliderIndex, matchingApp, currentSliderValue, isMuted);
-            });
+            _restoreVolumeForApp(
+                sliderIndex, matchingApp, currentSliderValue, isMuted);
           } else {
             print('Skipping volume restoration during startup for found app');
           }
@@ -319,7 +247,7 @@ class ApplicationManager {
         print(
             'Failed to restore volume after $maxAttempts attempts, trying direct fallback');
         try {
-          Audio.setAudioMixerVolume(app.processId, targetVolume);
+          await _audioBackend.setSessionVolume(app.processId, targetVolume);
           print('Fallback volume setting succeeded');
         } catch (e) {
           print('Fallback volume setting also failed: $e');
@@ -404,7 +332,6 @@ class ApplicationManager {
 
           if (matchingApp != null) {
             assignedApplications[i] = matchingApp;
-            _recentlyRestoredApps[i] = DateTime.now();
             print(
                 'Found and assigned app ${matchingApp.processPath} to slider $i (NO volume restoration during startup)');
 
@@ -455,24 +382,21 @@ class ApplicationManager {
     final volumeValue = sliderValues[sliderIndex];
     final isMuted = muteStates[sliderIndex];
 
-    String? cachedIconPath;
     String? fullProcessPath;
-
     if (config.containsKey('processPath')) {
       fullProcessPath = config['processPath'];
-      cachedIconPath =
-          await _configManager.getCachedIconPath(fullProcessPath.toString());
-    } else {
-      cachedIconPath =
-          await _configManager.getCachedIconByProcessName(processName);
     }
 
+    // the icon is kept by process name either way
+    final cachedIcon =
+        await _configManager.getCachedIconByProcessName(processName);
+
     final displayName = _createDisplayName(processName);
 
     final missingApp = MissingApp(
       processName: processName,
       processPath: fullProcessPath,
-      cachedIconPath: cachedIconPath,
+      cachedIcon: cachedIcon,
       displayName: displayName,
       volumeValue: volumeValue,
       isMuted: isMuted,
@@ -482,8 +406,8 @@ class ApplicationManager {
     sliderTags[sliderIndex] = ConfigManager.TAG_APP;
 
     print('Created missing app entry for slider $sliderIndex: $displayName');
-    if (cachedIconPath != null) {
-      print('Found cached icon at: $cachedIconPath');
+    if (cachedIcon != null) {
+      print('Found cached icon for $processName');
     }
   }
 
@@ -499,7 +423,7 @@ class ApplicationManager {
         'processName': processName,
         'processPath': app.processPath,
         'isActive': true,
-        'cachedIconPath': null,
+        'cachedIcon': null,
       };
     }
 
@@ -511,7 +435,7 @@ class ApplicationManager {
         'processName': missingApp.processName,
         'processPath': missingApp.processPath,
         'isActive': false,
-        'cachedIconPath': missingApp.cachedIconPath,
+        'cachedIcon': missingApp.cachedIcon,
       };
     }
 
@@ -544,7 +468,9 @@ class ApplicationManager {
   }
 
   Future<List<ProcessVolume>> getRunningApplicationsWithAudio() async {
-    final apps = await Audio.enumAudioMixer() ?? [];
+    // the picker should show what is running right now
+    await _sessionIndex.refresh();
+    final apps = await _sessionIndex.allSessions();
 
     // filter duplicate applications based on process name
     final filteredApps = _configManager.filterDuplicateApps(
@@ -560,10 +486,6 @@ class ApplicationManager {
 
     missingApplications.remove(sliderIndex);
 
-    _recentlyRestoredApps[sliderIndex] = DateTime.now();
-
-    _failedValidationCounts.remove(sliderIndex);
-
     print('Assigned app ${processVolume.processPath} to slider $sliderIndex');
 
     await _configManager.cacheAppIcon(processVolume.processPath);
@@ -581,8 +503,6 @@ class ApplicationManager {
   void assignSpecialFeatureToSlider(int sliderIndex, String featureTag) {
     assignedApplications.remove(sliderIndex);
     missingApplications.remove(sliderIndex);
-    _recentlyRestoredApps.remove(sliderIndex);
-    _failedValidationCounts.remove(sliderIndex);
 
     sliderTags[sliderIndex] = featureTag;
     print('Assigned special feature "$featureTag" to slider $sliderIndex');
@@ -597,12 +517,11 @@ class ApplicationManager {
       {bool fromRestore = false}) {
     sliderValues[sliderIndex] = sliderValue;
 
-    if (_allowVolumeRestoration || _deviceJustConnected) {
-      _pendingAppVolumes[sliderIndex] = sliderValue;
-      _scheduleVolumeUpdate();
+    final app = assignedApplications[sliderIndex];
+    if (app != null && (_allowVolumeRestoration || _deviceJustConnected)) {
+      _volumeDispatcher.setAppVolume(app, sliderValue / 1024);
     }
 
-    final app = assignedApplications[sliderIndex];
     if (app != null) {
       //auto-detect mute state if NOT restoring
       bool muteState =
@@ -623,56 +542,10 @@ class ApplicationManager {
     enableVolumeRestorationForUserAction();
   }
 
-  void _scheduleVolumeUpdate() {
-    if (_pendingVolumeTimer != null && _pendingVolumeTimer!.isActive) {
-      return;
-    }
-
-    final now = DateTime.now();
-    final timeSinceLastUpdate =
-        now.difference(_lastVolumeAdjustment).inMilliseconds;
-
-    if (timeSinceLastUpdate < RATE_LIMIT_MS) {
-      final delayMs = RATE_LIMIT_MS - timeSinceLastUpdate;
-      _pendingVolumeTimer =
-          Timer(Duration(milliseconds: delayMs), _applyPendingVolumeChanges);
-    } else {
-      _applyPendingVolumeChanges();
-    }
-  }
-
-  void _applyPendingVolumeChanges() {
-    _lastVolumeAdjustment = DateTime.now();
-
-    _pendingAppVolumes.forEach((sliderIndex, sliderValue) {
-      ProcessVolume? appProcess = assignedApplications[sliderIndex];
-      if (appProcess != null) {
-        double volumeLevel = sliderValue / 1024;
-        _configManager.adjustVolumeForAllInstances(appProcess, volumeLevel);
-      }
-    });
-    _pendingAppVolumes.clear();
-
-    if (_pendingDeviceVolume != null) {
-      int volumeLevel = ((_pendingDeviceVolume! / 1024) * 100).round();
-      Audio.setVolume(volumeLevel / 100, AudioDeviceType.output);
-      _pendingDeviceVolume = null;
-
-      for (var i = 0; i < sliderTags.length; i++) {
-        if (sliderTags[i] == ConfigManager.TAG_DEFAULT_DEVICE ||
-            sliderTags[i] == ConfigManager.TAG_MASTER_VOLUME) {
-          _configManager.updateSliderConfig(
-              i, null, sliderTags[i], muteStates[i]);
-          break;
-        }
-      }
-    }
-  }
-
   void adjustDeviceVolume(double sliderValue, {bool fromRestore = false}) {
     if (_allowVolumeRestoration || _deviceJustConnected) {
-      _pendingDeviceVolume = sliderValue;
-      _scheduleVolumeUpdate();
+      int volumeLevel = ((sliderValue / 1024) * 100).round();
+      _volumeDispatcher.setDeviceVolume(volumeLevel / 100);
     }
 
     for (var i = 0; i < sliderTags.length; i++) {
@@ -724,8 +597,6 @@ class ApplicationManager {
   void resetSliderConfiguration(int sliderIndex) {
     assignedApplications.remove(sliderIndex);
     missingApplications.remove(sliderIndex);
-    _recentlyRestoredApps.remove(sliderIndex);
-    _failedValidationCounts.remove(sliderIndex);
 
     sliderValues[sliderIndex] = 0;
     sliderTags[sliderIndex] = ConfigManager.TAG_UNASSIGNED;
@@ -741,11 +612,10 @@ class ApplicationManager {
   void clearAllConfigurations() {
     assignedApplications.clear();
     missingApplications.clear();
-    _recentlyRestoredApps.clear();
-    _failedValidationCounts.clear();
-    sliderValues = List.filled(8, 0.5);
-    sliderTags = List.filled(8, ConfigManager.TAG_DEFAULT_DEVICE);
-    muteStates = List.filled(8, false);
+    sliderValues = List.filled(SliderAddress.COUNT, 0.5);
+    sliderTags =
+        List.filled(SliderAddress.COUNT, ConfigManager.TAG_DEFAULT_DEVICE);
+    muteStates = List.filled(SliderAddress.COUNT, false);
 
     StorageManager.instance
       ..removeData('sliderValues')
@@ -761,13 +631,16 @@ class ApplicationManager {
   }
 
   void dispose() {
-    _audioSessionMonitor?.cancel();
-    _pendingVolumeTimer?.cancel();
-    _configManager.saveApplicationState(
-        sliderValues,
-        assignedApplications.entries.map((e) => e.value).toList(),
-        sliderTags,
-        muteStates);
+    _sessionChanges?.cancel();
+    _sessionIndex.stopTracking();
+    _volumeDispatcher.dispose();
+    _configManager
+        .saveApplicationState(
+            sliderValues,
+            assignedApplications.entries.map((e) => e.value).toList(),
+            sliderTags,
+            muteStates)
+        .then((_) => StorageManager.instance.flush());
 
     print('!!!!!! Attempted save on close????');
   }
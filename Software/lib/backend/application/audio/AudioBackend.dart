@@ -0,0 +1,27 @@
+import 'dart:io';
+import 'package:flutter/services.dart';
+import 'package:mixlit/backend/application/audio/PulseAudioBackend.dart';
+import 'package:mixlit/backend/application/audio/WindowsAudioBackend.dart';
+import 'package:win32audio/win32audio.dart';
+
+/// The system mixer, everything that reads or sets a volume goes through
+/// this rather than calling the platform's audio API directly. Volumes are
+/// 0 to 1.
+abstract class AudioBackend {
+  static final AudioBackend instance =
+      Platform.isLinux ? PulseAudioBackend() : WindowsAudioBackend();
+
+  /// Both runners send an event here when sessions start or stop
+  static const EventChannel SESSION_EVENTS =
+      EventChannel('mixlit/audio/sessions');
+
+  /// Every app currently playing through the mixer
+  Future<List<ProcessVolume>> enumSessions();
+
+  Future<void> setSessionVolume(int processId, double volumeLevel);
+
+  Future<void> setOutputVolume(double volumeLevel);
+
+  /// Fires whenever sessions start or stop
+  Stream<void> get sessionChanges;
+}
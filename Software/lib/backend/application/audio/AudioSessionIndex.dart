@@ -0,0 +1,199 @@
+import 'dart:async';
+import 'package:mixlit/backend/application/audio/AudioBackend.dart';
+import 'package:mixlit/backend/application/data/ConfigManager.dart';
+import 'package:win32audio/win32audio.dart';
+
+/// The live table of audio sessions, grouped by normalized process name so a
+/// volume change is one lookup rather than enumerating and normalizing the
+/// whole mixer. The backend announces sessions starting and stopping, each
+/// announcement refreshes the table and anything that changed goes out on
+/// [changes]. A slow consistency check catches anything it missed, and a
+/// failed volume change marks the table stale.
+class AudioSessionIndex {
+  static final AudioSessionIndex _instance = AudioSessionIndex._internal();
+  static AudioSessionIndex get instance => _instance;
+  AudioSessionIndex._internal() {
+    _backend.sessionChanges.listen((_) => _onSessionsChanged(),
+        onError: (e) => print('Audio session events unavailable: $e'));
+  }
+
+  final ConfigManager _configManager = ConfigManager.instance;
+  final AudioBackend _backend = AudioBackend.instance;
+
+  // sessions by normalized process name, rebuilt on every refresh
+  final Map<String, List<ProcessVolume>> _sessionsByName = {};
+
+  // the normalized name of each process id and the path it was worked out
+  // from, a refresh only normalizes sessions it hasn't seen before
+  final Map<int, String> _pathByProcessId = {};
+  final Map<int, String> _nameByProcessId = {};
+
+  final StreamController<AudioSessionChanges> _changes =
+      StreamController<AudioSessionChanges>.broadcast();
+
+  DateTime? _lastRefresh;
+  bool _isStale = true;
+  int _generation = 0;
+  Future<void>? _refreshInProgress;
+  bool _refreshQueued = false;
+  Timer? _consistencyCheck;
+
+  // only matters if the backend missed an announcement
+  static const maxAge = Duration(seconds: 10);
+
+  /// Goes up whenever a refresh finds sessions have started or stopped
+  int get generation => _generation;
+
+  /// Sessions that started or stopped, as found by each refresh
+  Stream<AudioSessionChanges> get changes => _changes.stream;
+
+  String normalizedName(String processPath) => _configManager
+      .normalizeProcessName(_configManager.extractProcessName(processPath));
+
+  /// Refreshes the table now and then every [maxAge], in case the backend
+  /// misses something
+  void startTracking() {
+    _consistencyCheck ??= Timer.periodic(maxAge, (_) => refresh());
+    refresh();
+  }
+
+  void stopTracking() {
+    _consistencyCheck?.cancel();
+    _consistencyCheck = null;
+  }
+
+  /// Enumerates the mixer again, concurrent callers share the one enumeration
+  Future<void> refresh() {
+    return _refreshInProgress ??= _refresh().whenComplete(() {
+      _refreshInProgress = null;
+
+      if (_refreshQueued) {
+        _refreshQueued = false;
+        refresh();
+      }
+    });
+  }
+
+  void _onSessionsChanged() {
+    invalidate();
+
+    // the refresh already running may have listed the sessions before this
+    if (_refreshInProgress != null) {
+      _refreshQueued = true;
+    } else {
+      refresh();
+    }
+  }
+
+  Future<void> _refresh() async {
+    try {
+      final sessions = await _backend.enumSessions();
+      final seen = <int>{};
+      final started = <String>{};
+
+      _sessionsByName.clear();
+      for (final session in sessions) {
+        final processId = session.processId;
+        seen.add(processId);
+
+        var name = _nameByProcessId[processId];
+        if (name == null ||
+            _pathByProcessId[processId] != session.processPath) {
+          name = normalizedName(session.processPath);
+          _nameByProcessId[processId] = name;
+          _pathByProcessId[processId] = session.processPath;
+          started.add(name);
+        }
+
+        _sessionsByName.putIfAbsent(name, () => []).add(session);
+      }
+
+      final stopped = <String>{};
+      if (_nameByProcessId.length != seen.length) {
+        _nameByProcessId.removeWhere((processId, name) {
+          if (seen.contains(processId)) return false;
+          stopped.add(name);
+          return true;
+        });
+        _pathByProcessId
+            .removeWhere((processId, _) => !seen.contains(processId));
+      }
+
+      _lastRefresh = DateTime.now();
+      _isStale = false;
+
+      if (started.isNotEmpty || stopped.isNotEmpty) {
+        _generation++;
+        _changes.add(AudioSessionChanges(started, stopped));
+      }
+    } catch (e) {
+      print('Error refreshing audio session index: $e');
+    }
+  }
+
+  Future<void> _refreshIfNeeded() async {
+    if (_isStale ||
+        _lastRefresh == null ||
+        DateTime.now().difference(_lastRefresh!) > maxAge) {
+      await refresh();
+    }
+  }
+
+  void invalidate() {
+    _isStale = true;
+  }
+
+  /// Every live session running under the same executable as [processPath]
+  Future<List<ProcessVolume>> sessionsFor(String processPath) async {
+    await _refreshIfNeeded();
+    return List.unmodifiable(
+        _sessionsByName[normalizedName(processPath)] ?? const []);
+  }
+
+  Future<Map<String, List<ProcessVolume>>> sessionGroups() async {
+    await _refreshIfNeeded();
+    return {
+      for (final entry in _sessionsByName.entries)
+        entry.key: List.unmodifiable(entry.value)
+    };
+  }
+
+  Future<List<ProcessVolume>> allSessions() async {
+    await _refreshIfNeeded();
+    return [for (final sessions in _sessionsByName.values) ...sessions];
+  }
+
+  /// Whether [processId] is still a live session of the same executable
+  Future<bool> isLive(int processId, String processPath) async {
+    await _refreshIfNeeded();
+    return _nameByProcessId[processId] == normalizedName(processPath);
+  }
+
+  /// Sets the volume of every session of the executable, returns false and
+  /// marks the index stale if any of them couldn't be set
+  Future<bool> setVolume(String processPath, double volumeLevel) async {
+    final sessions = await sessionsFor(processPath);
+    var succeeded = true;
+
+    await Future.wait(sessions.map((session) async {
+      try {
+        await _backend.setSessionVolume(session.processId, volumeLevel);
+      } catch (e) {
+        print('Failed to set volume for ${session.processPath}: $e');
+        succeeded = false;
+      }
+    }));
+
+    if (!succeeded) invalidate();
+    return succeeded;
+  }
+}
+
+/// Normalized names of the apps whose sessions started or stopped. An app
+/// that restarted between two refreshes is in both.
+class AudioSessionChanges {
+  final Set<String> started;
+  final Set<String> stopped;
+
+  AudioSessionChanges(this.started, this.stopped);
+}
@@ -1,6 +1,7 @@
 import 'dart:async';
 import 'package:flutter/material.dart';
 import 'package:mixlit/backend/application/audio/VolumeController.dart';
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
 
 class MuteButtonController {
   final List<bool> muteStates;
@@ -11,8 +12,14 @@ class MuteButtonController {
   final List<bool> wasUnmutedBeforeLongPress;
   final List<double> previousVolumeValues;
 
-  static const Duration longPressDuration = Duration(milliseconds: 500);
+  /// The firmware sends BUTTON_LONG_PRESS after this, it is only timed here
+  /// for firmware that just reports presses and releases
+  static const Duration longPressDuration =
+      Duration(milliseconds: SerialProtocol.BUTTON_LONG_PRESS_MS);
   static const double muteVolume = 0.0001;
+
+  /// Only for firmware older than PROTOCOL_VERSION_BUTTON_EVENTS, which sends
+  /// every bounce of the contacts
   static const Duration debounceDelay = Duration(milliseconds: 50);
 
   final Function(int, double) onVolumeAdjustment;
@@ -21,7 +28,6 @@ class MuteButtonController {
   VolumeController? _volumeController;
 
   final Map<int, Timer> _debounceTimers = {};
-  final Map<int, Timer> _longPressTimers = {};
   final Map<int, bool> _processingMute = {};
   final Map<int, bool> _wasToggledMute = {};
 
@@ -163,19 +169,24 @@ class MuteButtonController {
     onVolumeAdjustment(sliderIndex, value);
   }
 
-  void handleButtonDown(int buttonIndex) {
+  /// [debounced] is false for firmware that sends the raw button state, the
+  /// press then only counts once it has lasted [debounceDelay]
+  void handleButtonDown(int buttonIndex, {bool debounced = true}) {
     print('Button $buttonIndex pressed down');
 
-    _debounceTimers[buttonIndex]?.cancel();
+    _debounceTimers.remove(buttonIndex)?.cancel();
+    if (debounced) {
+      _processButtonDown(buttonIndex);
+      return;
+    }
 
     _debounceTimers[buttonIndex] = Timer(debounceDelay, () {
+      _debounceTimers.remove(buttonIndex);
       _processButtonDown(buttonIndex);
     });
   }
 
   void _processButtonDown(int buttonIndex) {
-    print('Processing button down for $buttonIndex (debounced)');
-
     buttonPressStartTimes[buttonIndex] = DateTime.now();
     wasUnmutedBeforeLongPress[buttonIndex] = !muteStates[buttonIndex];
     isLongPressing[buttonIndex] = false;
@@ -192,14 +203,9 @@ class MuteButtonController {
     } else if (_wasToggledMute[buttonIndex] == true) {
       unmuteAudio(buttonIndex);
     }
-
-    _longPressTimers[buttonIndex]?.cancel();
-    _longPressTimers[buttonIndex] = Timer(longPressDuration, () {
-      _handleLongPress(buttonIndex);
-    });
   }
 
-  void _handleLongPress(int buttonIndex) {
+  void handleLongPress(int buttonIndex) {
     print('Long press detected for button $buttonIndex');
     isLongPressing[buttonIndex] = true;
   }
@@ -207,9 +213,7 @@ class MuteButtonController {
   void handleButtonUp(int buttonIndex) {
     print('Button $buttonIndex released');
 
-    _debounceTimers[buttonIndex]?.cancel();
-
-    _longPressTimers[buttonIndex]?.cancel();
+    _debounceTimers.remove(buttonIndex)?.cancel();
 
     final pressStartTime = buttonPressStartTimes[buttonIndex];
     if (pressStartTime == null) {
@@ -219,7 +223,9 @@ class MuteButtonController {
 
     buttonPressStartTimes[buttonIndex] = null;
 
-    if (isLongPressing[buttonIndex]) {
+    // older firmware never sends the long press
+    if (isLongPressing[buttonIndex] ||
+        DateTime.now().difference(pressStartTime) >= longPressDuration) {
       _handleLongPressRelease(buttonIndex);
     } else {
       _handleShortPressRelease(buttonIndex);
@@ -246,20 +252,11 @@ class MuteButtonController {
     }
   }
 
-  Future<void> checkLongPress(int buttonIndex) async {
-    //TODO: remove this lol
-  }
-
   void dispose() {
     for (var timer in _debounceTimers.values) {
       timer.cancel();
     }
-    for (var timer in _longPressTimers.values) {
-      timer.cancel();
-    }
     _debounceTimers.clear();
-    _longPressTimers.clear();
-
     for (var controller in buttonAnimControllers) {
       controller.dispose();
     }
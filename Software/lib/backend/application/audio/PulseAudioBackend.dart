@@ -0,0 +1,51 @@
+import 'package:flutter/services.dart';
+import 'package:mixlit/backend/application/audio/AudioBackend.dart';
+import 'package:win32audio/win32audio.dart';
+
+/// PulseAudio, or PipeWire through pipewire-pulse. The runner keeps one
+/// connection to the server open (linux/audio/) and caches the streams from
+/// its events, so listing sessions doesn't wait on the server and setting an
+/// app's volume is one message per stream.
+class PulseAudioBackend implements AudioBackend {
+  static const MethodChannel _methods = MethodChannel('mixlit/audio');
+
+  @override
+  late final Stream<void> sessionChanges =
+      AudioBackend.SESSION_EVENTS.receiveBroadcastStream().map((_) {});
+
+  @override
+  Future<List<ProcessVolume>> enumSessions() async {
+    final sessions = await _methods.invokeListMethod<Map>('enumSessions') ?? [];
+
+    return [
+      for (final session in sessions)
+        ProcessVolume()
+          ..processId = session['processId'] as int
+          ..processPath = session['processPath'] as String
+          ..maxVolume = (session['volume'] as num).toDouble()
+    ];
+  }
+
+  @override
+  Future<void> setSessionVolume(int processId, double volumeLevel) async {
+    final sent = await _methods.invokeMethod<bool>('setSessionVolume', {
+      'processId': processId,
+      'volume': volumeLevel,
+    });
+
+    // the stream has gone since the sessions were last listed
+    if (sent != true) {
+      throw StateError('No audio stream for process $processId');
+    }
+  }
+
+  @override
+  Future<void> setOutputVolume(double volumeLevel) async {
+    final sent = await _methods
+        .invokeMethod<bool>('setOutputVolume', {'volume': volumeLevel});
+
+    if (sent != true) {
+      throw StateError('Not connected to the audio server');
+    }
+  }
+}
@@ -1,6 +1,5 @@
-import 'dart:async';
 import 'package:mixlit/backend/application/audio/ApplicationManager.dart';
-import 'package:mixlit/backend/application/audio/AppInstanceManager.dart';
+import 'package:mixlit/backend/application/audio/VolumeDispatcher.dart';
 import 'package:mixlit/backend/application/data/ConfigManager.dart';
 import 'package:win32audio/win32audio.dart';
 
@@ -8,12 +7,7 @@ class VolumeController {
   final ApplicationManager applicationManager;
   List<String> sliderTags;
   List<ProcessVolume?> assignedApps;
-  final AppInstanceManager _appInstanceManager = AppInstanceManager.instance;
-
-  static const int RATE_LIMIT_MS = 10;
-  DateTime _lastVolumeUpdate = DateTime.now();
-  Timer? _pendingVolumeTimer;
-  final Map<int, double> _pendingVolumeChanges = {};
+  final VolumeDispatcher _volumeDispatcher = VolumeDispatcher.instance;
 
   final Map<int, double> _storedVolumeValues = {};
   final Map<int, bool> _muteStates = {};
@@ -68,48 +62,21 @@ class VolumeController {
       return;
     }
 
-    if (value <= muteVolume || bypassRateLimit) {
-      directVolumeAdjustment(sliderId, value, fromRestore: fromRestore);
-      return;
-    }
+    _queueVolume(sliderId, value, fromRestore: fromRestore);
 
-    _pendingVolumeChanges[sliderId] = value;
-    _scheduleVolumeUpdate();
-  }
-
-  void _scheduleVolumeUpdate() {
-    if (_pendingVolumeTimer?.isActive ?? false) return;
-
-    final now = DateTime.now();
-    final timeSinceLastUpdate =
-        now.difference(_lastVolumeUpdate).inMilliseconds;
-
-    if (timeSinceLastUpdate < RATE_LIMIT_MS) {
-      final delayMs = RATE_LIMIT_MS - timeSinceLastUpdate;
-      _pendingVolumeTimer =
-          Timer(Duration(milliseconds: delayMs), _applyPendingChanges);
-    } else {
-      _applyPendingChanges();
+    // muting shouldn't wait for the next tick
+    if (value <= muteVolume || bypassRateLimit) {
+      _volumeDispatcher.flush();
     }
   }
 
-  void _applyPendingChanges() {
-    _lastVolumeUpdate = DateTime.now();
-
-    final changes = Map<int, double>.from(_pendingVolumeChanges);
-    _pendingVolumeChanges.clear();
-
-    changes.forEach((sliderId, value) {
-      if (!isSliderMuted(sliderId) || value <= muteVolume) {
-        directVolumeAdjustment(sliderId, value, fromRestore: false);
-      } else {
-        storeVolumeValue(sliderId, value);
-      }
-    });
-  }
-
   Future<void> directVolumeAdjustment(int sliderId, double value,
       {bool fromRestore = false}) async {
+    _queueVolume(sliderId, value, fromRestore: fromRestore);
+    await _volumeDispatcher.flush();
+  }
+
+  void _queueVolume(int sliderId, double value, {bool fromRestore = false}) {
     final tag = sliderTags[sliderId];
 
     applicationManager.sliderValues[sliderId] = value;
@@ -118,32 +85,11 @@ class VolumeController {
         tag == ConfigManager.TAG_MASTER_VOLUME) {
       int volumeLevel = ((value / 1024) * 100).round();
 
-      Audio.setVolume(volumeLevel / 100, AudioDeviceType.output);
+      _volumeDispatcher.setDeviceVolume(volumeLevel / 100);
     } else if (tag == ConfigManager.TAG_APP && assignedApps[sliderId] != null) {
       final app = assignedApps[sliderId];
       if (app != null) {
-        double volumeLevel = value / 1024;
-        if (volumeLevel <= 0.009) {
-          volumeLevel = 0.0001;
-        }
-
-        try {
-          bool hasMultipleInstances =
-              await _appInstanceManager.hasMultipleInstances(app);
-          if (hasMultipleInstances) {
-            await _appInstanceManager.setVolumeForAllInstances(
-                app, volumeLevel);
-          } else {
-            Audio.setAudioMixerVolume(app.processId, volumeLevel);
-          }
-        } catch (e) {
-          print('Error adjusting app volume: $e');
-          try {
-            Audio.setAudioMixerVolume(app.processId, volumeLevel);
-          } catch (fallbackError) {
-            print('Fallback volume adjustment failed: $fallbackError');
-          }
-        }
+        _volumeDispatcher.setAppVolume(app, value / 1024);
       }
     } else if (tag == ConfigManager.TAG_ACTIVE_APP) {}
 
@@ -175,8 +121,6 @@ class VolumeController {
   }
 
   void dispose() {
-    _pendingVolumeTimer?.cancel();
-    _pendingVolumeChanges.clear();
     _storedVolumeValues.clear();
     _muteStates.clear();
   }
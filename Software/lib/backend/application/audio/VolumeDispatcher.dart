@@ -0,0 +1,242 @@
+import 'dart:async';
+import 'dart:developer';
+import 'package:mixlit/backend/application/audio/AudioBackend.dart';
+import 'package:mixlit/backend/application/audio/AudioSessionIndex.dart';
+import 'package:mixlit/backend/application/util/LatencyTracer.dart';
+import 'package:win32audio/win32audio.dart';
+
+/// Every volume change is sent to the mixer from here. Callers queue the
+/// latest level for a target, the first change after a quiet spell goes out
+/// straight away and starts a fixed tick, and each tick sends whatever has
+/// changed since. The tick stops again once a tick finds nothing to send.
+class VolumeDispatcher {
+  static final VolumeDispatcher _instance = VolumeDispatcher._internal();
+  static VolumeDispatcher get instance => _instance;
+  VolumeDispatcher._internal();
+
+  // windows buffers volume requests that come faster than this
+  static const Duration TICK = Duration(milliseconds: 10);
+  static const double MIN_APP_VOLUME = 0.0001;
+  static const String _DEVICE_TARGET = '#device';
+
+  final AudioSessionIndex _sessionIndex = AudioSessionIndex.instance;
+  final AudioBackend _backend = AudioBackend.instance;
+
+  final Map<String, _VolumeChange> _pending = {};
+  final Map<String, _AppliedVolume> _applied = {};
+
+  Timer? _ticker;
+  Future<void>? _inFlight;
+
+  int _ticks = 0;
+  int _maxQueueDepth = 0;
+  int _dispatched = 0;
+  int _coalesced = 0;
+  int _skipped = 0;
+
+  VolumeDispatchStats get stats => VolumeDispatchStats(
+        tick: TICK,
+        isTicking: _ticker != null,
+        ticks: _ticks,
+        queueDepth: _pending.length,
+        maxQueueDepth: _maxQueueDepth,
+        dispatched: _dispatched,
+        coalesced: _coalesced,
+        skipped: _skipped,
+      );
+
+  /// Queues [volumeLevel] (0 to 1) for every instance of [app]
+  void setAppVolume(ProcessVolume app, double volumeLevel) {
+    if (volumeLevel <= 0.009) {
+      volumeLevel = MIN_APP_VOLUME;
+    }
+    _queue(_sessionIndex.normalizedName(app.processPath),
+        _VolumeChange(app.processPath, volumeLevel));
+  }
+
+  /// Queues [volumeLevel] (0 to 1) for the default output device
+  void setDeviceVolume(double volumeLevel) {
+    _queue(_DEVICE_TARGET, _VolumeChange(null, volumeLevel));
+  }
+
+  /// Sends everything queued now rather than on the next tick, after anything
+  /// already being sent
+  Future<void> flush() async {
+    while (_inFlight != null) {
+      await _inFlight;
+    }
+    if (_pending.isNotEmpty) {
+      await _dispatch();
+    }
+  }
+
+  /// Forgets what was last sent, so the next change to each target goes out
+  /// even if it's the same level
+  void forgetApplied() {
+    _applied.clear();
+  }
+
+  void _queue(String target, _VolumeChange change) {
+    if (LatencyTracer.enabled) {
+      change.traceSequence = LatencyTracer.instance.activeSequence;
+      change.queuedAt = Timeline.now;
+    }
+
+    final replaced = _pending[target];
+    if (replaced != null) {
+      _coalesced++;
+      if (LatencyTracer.enabled) {
+        LatencyTracer.instance.volumeDropped(replaced.traceSequence);
+      }
+    }
+    _pending[target] = change;
+
+    if (_pending.length > _maxQueueDepth) {
+      _maxQueueDepth = _pending.length;
+    }
+
+    if (_ticker == null) {
+      _ticker = Timer.periodic(TICK, (_) => _tick());
+      _tick();
+    }
+  }
+
+  void _tick() {
+    _ticks++;
+
+    // the last tick's changes are still being applied, let this one coalesce
+    if (_inFlight != null) return;
+
+    if (_pending.isEmpty) {
+      _ticker?.cancel();
+      _ticker = null;
+      return;
+    }
+
+    _dispatch();
+  }
+
+  Future<void> _dispatch() {
+    final changes = Map<String, _VolumeChange>.from(_pending);
+    _pending.clear();
+
+    final inFlight = Future.wait([
+      for (var entry in changes.entries) _apply(entry.key, entry.value)
+    ]).whenComplete(() => _inFlight = null);
+
+    _inFlight = inFlight;
+    return inFlight;
+  }
+
+  Future<void> _apply(String target, _VolumeChange change) async {
+    // an instance starting or stopping means the last level may not be on
+    // every session of the app any more
+    final generation = _sessionIndex.generation;
+    final last = _applied[target];
+    if (last != null &&
+        last.volumeLevel == change.volumeLevel &&
+        (change.processPath == null || last.generation == generation)) {
+      _skipped++;
+      if (LatencyTracer.enabled) {
+        LatencyTracer.instance.volumeDropped(change.traceSequence);
+      }
+      return;
+    }
+
+    final traced = LatencyTracer.enabled && change.traceSequence >= 0;
+    final sentAt = traced ? Timeline.now : 0;
+    if (traced) {
+      LatencyTracer.instance
+          .volumeDispatched(change.traceSequence, change.queuedAt, sentAt);
+    }
+
+    var succeeded = true;
+    if (change.processPath == null) {
+      try {
+        await _backend.setOutputVolume(change.volumeLevel);
+      } catch (e) {
+        print('Failed to set device volume: $e');
+        succeeded = false;
+      }
+    } else {
+      succeeded = await _sessionIndex.setVolume(
+          change.processPath!, change.volumeLevel);
+    }
+    _dispatched++;
+
+    if (traced) {
+      LatencyTracer.instance
+          .volumeApplied(change.traceSequence, sentAt, succeeded: succeeded);
+    }
+
+    if (succeeded) {
+      _applied[target] = _AppliedVolume(change.volumeLevel, generation);
+    } else {
+      _applied.remove(target);
+    }
+  }
+
+  void dispose() {
+    _ticker?.cancel();
+    _ticker = null;
+    _pending.clear();
+    _applied.clear();
+  }
+}
+
+class VolumeDispatchStats {
+  final Duration tick;
+  final bool isTicking;
+  final int ticks;
+  final int queueDepth;
+  final int maxQueueDepth;
+  final int dispatched;
+  final int coalesced;
+  final int skipped;
+
+  const VolumeDispatchStats({
+    required this.tick,
+    required this.isTicking,
+    required this.ticks,
+    required this.queueDepth,
+    required this.maxQueueDepth,
+    required this.dispatched,
+    required this.coalesced,
+    required this.skipped,
+  });
+
+  Map<String, dynamic> toJson() => {
+        'tickMs': tick.inMilliseconds,
+        'ticking': isTicking,
+        'ticks': ticks,
+        'queueDepth': queueDepth,
+        'maxQueueDepth': maxQueueDepth,
+        'dispatched': dispatched,
+        'coalesced': coalesced,
+        'skipped': skipped,
+      };
+
+  @override
+  String toString() => 'tick ${tick.inMilliseconds}ms '
+      '(${isTicking ? 'running' : 'idle'}, $ticks so far), '
+      'queue $queueDepth (max $maxQueueDepth), dispatched $dispatched, '
+      'coalesced $coalesced, skipped $skipped';
+}
+
+class _VolumeChange {
+  final String? processPath; // null for the output device
+  final double volumeLevel;
+
+  // the frame this came from when LatencyTracer is on, or -1
+  int traceSequence = -1;
+  int queuedAt = 0;
+
+  _VolumeChange(this.processPath, this.volumeLevel);
+}
+
+class _AppliedVolume {
+  final double volumeLevel;
+  final int generation;
+
+  _AppliedVolume(this.volumeLevel, this.generation);
+}
@@ -0,0 +1,25 @@
+import 'package:mixlit/backend/application/audio/AudioBackend.dart';
+import 'package:win32audio/win32audio.dart';
+
+class WindowsAudioBackend implements AudioBackend {
+  @override
+  Future<List<ProcessVolume>> enumSessions() async {
+    return await Audio.enumAudioMixer() ?? [];
+  }
+
+  @override
+  Future<void> setSessionVolume(int processId, double volumeLevel) async {
+    await Audio.setAudioMixerVolume(processId, volumeLevel);
+  }
+
+  @override
+  Future<void> setOutputVolume(double volumeLevel) async {
+    await Audio.setVolume(volumeLevel, AudioDeviceType.output);
+  }
+
+  // win32audio has no session notifications, the runner watches the
+  // sessions itself (windows/runner/audio/)
+  @override
+  late final Stream<void> sessionChanges =
+      AudioBackend.SESSION_EVENTS.receiveBroadcastStream().map((_) {});
+}
@@ -1,9 +1,12 @@
 import 'dart:io';
 import 'dart:typed_data';
+import 'package:mixlit/backend/application/audio/VolumeDispatcher.dart';
+import 'package:mixlit/backend/application/serial/SliderAddress.dart';
 import 'package:mixlit/backend/application/util/IconExtractor.dart';
 import 'package:path/path.dart' as path;
 import 'package:win32audio/win32audio.dart';
 import 'package:mixlit/backend/application/data/StorageManager.dart';
+import 'package:mixlit/backend/application/data/IconStore.dart';
 
 class ConfigManager {
   static final ConfigManager _instance = ConfigManager._internal();
@@ -12,9 +15,14 @@ class ConfigManager {
   ConfigManager._internal();
 
   final _storageManager = StorageManager.instance;
-  List<Map<String, dynamic>?> _sliderConfigsCache = List.filled(8, null);
+  List<Map<String, dynamic>?> _sliderConfigsCache =
+      List.filled(SliderAddress.COUNT, null);
   bool _sliderConfigsDirty = false;
 
+  // devices connect in parallel, every change to 'devices' reads, changes and
+  // saves it back one after the other
+  Future<void> _deviceUpdates = Future.value();
+
   static const String TAG_APP = 'app';
   static const String TAG_DEFAULT_DEVICE = 'defaultDevice';
   static const String TAG_MASTER_VOLUME = 'mixlit.master';
@@ -23,7 +31,7 @@ class ConfigManager {
 
   //icon caching
   String? _iconCachePath;
-  final Map<String, String> _iconPathCache = {};
+  final IconStore _iconStore = IconStore.instance;
 
   Future<String> get _getIconCachePath async {
     if (_iconCachePath != null) return _iconCachePath!;
@@ -40,32 +48,29 @@ class ConfigManager {
     return _iconCachePath!;
   }
 
+  Future<String> getIconCachePath() => _getIconCachePath;
+
+  Future<IconStore> get _openIconStore async {
+    await _iconStore.open(await _getIconCachePath);
+    return _iconStore;
+  }
+
   Future<void> cacheAppIcon(String processPath) async {
     try {
       final processName = extractProcessName(processPath);
       final normalizedName = normalizeProcessName(processName);
+      final iconStore = await _openIconStore;
 
-      if (_iconPathCache.containsKey(normalizedName)) {
+      if (iconStore.contains(normalizedName)) {
         print('Icon already cached for $processName');
         return;
       }
 
-      final cachePath = await _getIconCachePath;
-      final iconFileName = '${normalizedName}_icon.ico';
-      final cachedIconPath = path.join(cachePath, iconFileName);
-
-      if (await File(cachedIconPath).exists()) {
-        _iconPathCache[normalizedName] = cachedIconPath;
-        print('Found existing cached icon for $processName at $cachedIconPath');
-        return;
-      }
-
       if (Platform.isWindows && await File(processPath).exists()) {
-        final iconData = await _extractWindowsIcon(processPath);
+        final iconData = await IconExtractor.extractIcon(processPath);
         if (iconData != null) {
-          await File(cachedIconPath).writeAsBytes(iconData);
-          _iconPathCache[normalizedName] = cachedIconPath;
-          print('Cached icon for $processName at $cachedIconPath');
+          await iconStore.put(normalizedName, iconData);
+          print('Cached icon for $processName');
         }
       }
     } catch (e) {
@@ -73,92 +78,25 @@ class ConfigManager {
     }
   }
 
-  Future<Uint8List?> _extractWindowsIcon(String executablePath) async {
-    try {
-      final processName = extractProcessName(executablePath);
-      final normalizedName = normalizeProcessName(processName);
-      final cachePath = await _getIconCachePath;
-      final iconFileName = '${normalizedName}_icon.ico';
-      final cachedIconPath = path.join(cachePath, iconFileName);
-
-      final success =
-          await IconExtractor.extractIconToFile(executablePath, cachedIconPath);
-
-      if (success) {
-        final iconData = await File(cachedIconPath).readAsBytes();
-        return Uint8List.fromList(iconData);
-      }
+  Future<Uint8List?> getCachedIcon(String processPath) async {
+    return getCachedIconByProcessName(extractProcessName(processPath));
+  }
 
-      return null;
+  Future<Uint8List?> getCachedIconByProcessName(String processName) async {
+    try {
+      final iconStore = await _openIconStore;
+      return await iconStore.get(normalizeProcessName(processName));
     } catch (e) {
-      print('Error extracting icon from $executablePath: $e');
+      print('Error loading cached icon for $processName: $e');
       return null;
     }
   }
 
-  Future<String?> getCachedIconPath(String processPath) async {
-    final processName = extractProcessName(processPath);
-    final normalizedName = normalizeProcessName(processName);
-
-    if (_iconPathCache.containsKey(normalizedName)) {
-      final cachedPath = _iconPathCache[normalizedName]!;
-      if (await File(cachedPath).exists()) {
-        return cachedPath;
-      } else {
-        _iconPathCache.remove(normalizedName);
-      }
-    }
-
-    final cachePath = await _getIconCachePath;
-    final iconFileName = '${normalizedName}_icon.ico';
-    final cachedIconPath = path.join(cachePath, iconFileName);
-
-    if (await File(cachedIconPath).exists()) {
-      _iconPathCache[normalizedName] = cachedIconPath;
-      return cachedIconPath;
-    }
-
-    return null;
-  }
-
-  Future<String?> getCachedIconByProcessName(String processName) async {
-    final normalizedName = normalizeProcessName(processName);
-
-    if (_iconPathCache.containsKey(normalizedName)) {
-      final cachedPath = _iconPathCache[normalizedName]!;
-      if (await File(cachedPath).exists()) {
-        return cachedPath;
-      } else {
-        _iconPathCache.remove(normalizedName);
-      }
-    }
-
-    final cachePath = await _getIconCachePath;
-    final iconFileName = '${normalizedName}_icon.ico';
-    final cachedIconPath = path.join(cachePath, iconFileName);
-
-    if (await File(cachedIconPath).exists()) {
-      _iconPathCache[normalizedName] = cachedIconPath;
-      return cachedIconPath;
-    }
-
-    return null;
-  }
-
   Future<void> clearIconCache() async {
     try {
-      final cachePath = await _getIconCachePath;
-      final cacheDir = Directory(cachePath);
-
-      if (await cacheDir.exists()) {
-        await for (final entity in cacheDir.list()) {
-          if (entity is File && entity.path.endsWith('_icon.ico')) {
-            await entity.delete();
-          }
-        }
-        _iconPathCache.clear();
-        print('Icon cache cleared');
-      }
+      final iconStore = await _openIconStore;
+      await iconStore.clear();
+      print('Icon cache cleared');
     } catch (e) {
       print('Error clearing icon cache: $e');
     }
@@ -170,44 +108,87 @@ class ConfigManager {
           .map((path) => normalizeProcessName(extractProcessName(path)))
           .toSet();
 
-      final cachePath = await _getIconCachePath;
-      final cacheDir = Directory(cachePath);
-
-      if (await cacheDir.exists()) {
-        await for (final entity in cacheDir.list()) {
-          if (entity is File && entity.path.endsWith('_icon.ico')) {
-            final fileName = path.basenameWithoutExtension(entity.path);
-            final processName = fileName.replaceAll('_icon', '');
-
-            if (!activeProcessNames.contains(processName)) {
-              await entity.delete();
-              _iconPathCache.remove(processName);
-              print('Removed unused icon cache for $processName');
-            }
-          }
-        }
-      }
+      final iconStore = await _openIconStore;
+      await iconStore.retainOnly(activeProcessNames);
     } catch (e) {
       print('Error cleaning up unused icons: $e');
     }
   }
 
-  Future<void> saveLastComPort(String portName) async {
-    await _storageManager.saveData('last-com-port', portName);
-    print('Saved last COM port: $portName');
-  }
+  /// Every MixLit seen so far in slot order, each {'id', 'port', 'baudRate'}.
+  /// Before there were device ids only the last port and baud rate were
+  /// kept, they become slot 0 for the first device to connect.
+  Future<List<Map<String, dynamic>>> getKnownDevices() async {
+    final stored = await _storageManager.getData('devices');
+    if (stored is List) {
+      return [for (final device in stored) Map<String, dynamic>.from(device)];
+    }
 
-  Future<String?> getLastComPort() async {
     final port = await _storageManager.getData('last-com-port');
-    print('Found last COM port on: $port');
-    return port;
+    if (port == null) return [];
+
+    final baudRate = await _storageManager.getData('baud-rate');
+    return [
+      {'id': null, 'port': port, 'baudRate': baudRate is int ? baudRate : null}
+    ];
+  }
+
+  /// The slot [deviceId] keeps its sliders in, a new device gets the next
+  /// free one. Null once every slot is taken.
+  Future<int?> deviceSlot(String deviceId) =>
+      _updateDevices(() => _deviceSlot(deviceId));
+
+  Future<int?> _deviceSlot(String deviceId) async {
+    final devices = await getKnownDevices();
+
+    var slot = devices.indexWhere((device) => device['id'] == deviceId);
+    if (slot == -1) {
+      slot = devices.indexWhere((device) => device['id'] == null);
+    }
+    if (slot == -1) {
+      if (devices.length >= SliderAddress.MAX_DEVICES) return null;
+      slot = devices.length;
+      devices.add({'port': null, 'baudRate': null});
+    }
+
+    if (devices[slot]['id'] != deviceId) {
+      devices[slot]['id'] = deviceId;
+      await _storageManager.saveData('devices', devices);
+      print('Device $deviceId has slot $slot');
+    }
+    return slot;
+  }
+
+  Future<void> saveDevicePort(String deviceId, String portName, int baudRate) =>
+      _updateDevices(() => _saveDevicePort(deviceId, portName, baudRate));
+
+  Future<void> _saveDevicePort(
+      String deviceId, String portName, int baudRate) async {
+    final devices = await getKnownDevices();
+    final slot = devices.indexWhere((device) => device['id'] == deviceId);
+    if (slot == -1) return;
+
+    if (devices[slot]['port'] == portName &&
+        devices[slot]['baudRate'] == baudRate) {
+      return;
+    }
+    devices[slot]['port'] = portName;
+    devices[slot]['baudRate'] = baudRate;
+    await _storageManager.saveData('devices', devices);
+    print('Saved $portName at $baudRate baud for device $deviceId');
+  }
+
+  Future<T> _updateDevices<T>(Future<T> Function() update) {
+    final result = _deviceUpdates.then((_) => update());
+    _deviceUpdates = result.then((_) {}, onError: (_) {});
+    return result;
   }
 
   void updateSliderConfig(
       int sliderIndex, String? processPath, String sliderTag, bool isMuted,
       {double? volumeValue}) {
     if (_sliderConfigsCache.length <= sliderIndex) {
-      _sliderConfigsCache = List.filled(8, null);
+      _sliderConfigsCache = List.filled(SliderAddress.COUNT, null);
     }
 
     String? processName;
@@ -261,7 +242,7 @@ class ConfigManager {
 
   Future<void> _loadSliderConfigsFromDisk() async {
     try {
-      _sliderConfigsCache = List.filled(8, null);
+      _sliderConfigsCache = List.filled(SliderAddress.COUNT, null);
 
       final storedConfigs = await _storageManager.getData('sliderConfigs');
       print('Loaded raw slider configs from disk: $storedConfigs');
@@ -270,7 +251,7 @@ class ConfigManager {
 
       for (final config in storedConfigs) {
         final index = config['index'];
-        if (index != null && index >= 0 && index < 8) {
+        if (index != null && index >= 0 && index < SliderAddress.COUNT) {
           _sliderConfigsCache[index] = Map<String, dynamic>.from(config);
           _sliderConfigsCache[index]!.remove('index');
           print(
@@ -318,9 +299,10 @@ class ConfigManager {
       await _loadSliderConfigsFromDisk();
     }
 
-    final sliderValues = List<double>.filled(8, 100.0);
-    final sliderTags = List<String>.filled(8, TAG_UNASSIGNED);
-    final muteStates = List<bool>.filled(8, false);
+    final sliderValues = List<double>.filled(SliderAddress.COUNT, 100.0);
+    final sliderTags =
+        List<String>.filled(SliderAddress.COUNT, TAG_UNASSIGNED);
+    final muteStates = List<bool>.filled(SliderAddress.COUNT, false);
 
     for (var i = 0; i < _sliderConfigsCache.length; i++) {
       final config = _sliderConfigsCache[i];
@@ -418,23 +400,13 @@ class ConfigManager {
   Future<void> adjustVolumeForAllInstances(
       ProcessVolume targetApp, double volumeLevel) async {
     try {
-      final allRunningApps = await Audio.enumAudioMixer() ?? [];
-
-      final targetName =
-          normalizeProcessName(extractProcessName(targetApp.processPath));
-
-      for (var app in allRunningApps) {
-        final appName =
-            normalizeProcessName(extractProcessName(app.processPath));
-
-        if (appName == targetName) {
-          if (volumeLevel <= 0.009) {
-            volumeLevel = 0.0001;
-          }
-
-          Audio.setAudioMixerVolume(app.processId, volumeLevel);
-        }
+      if (volumeLevel <= 0.009) {
+        volumeLevel = 0.0001;
       }
+
+      final dispatcher = VolumeDispatcher.instance;
+      dispatcher.setAppVolume(targetApp, volumeLevel);
+      await dispatcher.flush();
     } catch (e) {
       print('Error adjusting volume for all instances: $e');
     }
@@ -445,7 +417,9 @@ class ConfigManager {
       List<ProcessVolume?> assignedApps,
       List<String> sliderTags,
       List<bool> muteStates) async {
-    for (var i = 0; i < sliderTags.length && i < 8; i++) {
+    for (var i = 0;
+        i < sliderTags.length && i < SliderAddress.COUNT;
+        i++) {
       final tag = sliderTags[i];
       String? processPath;
 
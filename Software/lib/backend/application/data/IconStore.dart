@@ -0,0 +1,285 @@
+import 'dart:async';
+import 'dart:convert';
+import 'dart:io';
+import 'dart:typed_data';
+import 'package:path/path.dart' as path;
+
+/// Cached app icons, packed end to end in one file with a manifest of where
+/// each one is. The manifest is read once and the pack is opened once, so
+/// finding an icon is a map lookup and reading it is one positioned read.
+/// Past [MAX_PACK_BYTES] the least recently used icons are dropped, and the
+/// pack is rewritten without them once they take up more room than the
+/// icons still in it.
+class IconStore {
+  static final IconStore _instance = IconStore._internal();
+  static IconStore get instance => _instance;
+  IconStore._internal();
+
+  static const int MANIFEST_VERSION = 1;
+  static const int MAX_PACK_BYTES = 4 * 1024 * 1024;
+  static const int MIN_COMPACT_BYTES = 256 * 1024;
+  static const Duration SAVE_DELAY = Duration(seconds: 1);
+
+  static const String _PACK_FILE = 'icons.pack';
+  static const String _MANIFEST_FILE = 'icons.index';
+  static const String _LEGACY_SUFFIX = '_icon.ico';
+
+  final Map<String, _PackedIcon> _icons = {};
+  String? _cachePath;
+  RandomAccessFile? _pack;
+  int _packLength = 0;
+  int _liveBytes = 0;
+  int _clock = 0;
+
+  Future<void>? _opened;
+  Timer? _saveTimer;
+
+  // pack reads and writes can't overlap on the one open file
+  Future<void> _io = Future.value();
+
+  /// Reads the manifest and opens the pack in [cachePath], every other call
+  /// waits for this
+  Future<void> open(String cachePath) => _opened ??= _open(cachePath);
+
+  Future<void> _open(String cachePath) async {
+    _cachePath = cachePath;
+
+    final manifest = File(path.join(cachePath, _MANIFEST_FILE));
+    final hasManifest = await manifest.exists();
+    if (hasManifest) {
+      try {
+        _readManifest(jsonDecode(await manifest.readAsString()));
+      } catch (e) {
+        print('Error reading icon manifest, starting an empty one: $e');
+        _icons.clear();
+      }
+    }
+
+    _pack = await File(path.join(cachePath, _PACK_FILE))
+        .open(mode: FileMode.append);
+    _packLength = await _pack!.length();
+
+    // the manifest is saved after the pack, anything it lists past the end
+    // never made it to disk
+    _icons.removeWhere((name, icon) => icon.offset + icon.length > _packLength);
+    _liveBytes =
+        _icons.values.fold<int>(0, (total, icon) => total + icon.length);
+
+    if (!hasManifest) {
+      await _importLegacyIcons(cachePath);
+    }
+  }
+
+  void _readManifest(dynamic saved) {
+    if (saved is! Map || saved['version'] != MANIFEST_VERSION) return;
+
+    _clock = saved['clock'] ?? 0;
+    final icons = saved['icons'];
+    if (icons is Map) {
+      icons.forEach((name, icon) {
+        _icons[name.toString()] = _PackedIcon(
+            icon['offset'], icon['length'], icon['hash'], icon['used']);
+      });
+    }
+  }
+
+  // icons used to be one file each, they're moved into the pack once
+  Future<void> _importLegacyIcons(String cachePath) async {
+    final legacy = <File>[];
+    await for (final entity in Directory(cachePath).list()) {
+      if (entity is File && entity.path.endsWith(_LEGACY_SUFFIX)) {
+        legacy.add(entity);
+      }
+    }
+
+    for (final file in legacy) {
+      final name = path.basename(file.path);
+      await put(name.substring(0, name.length - _LEGACY_SUFFIX.length),
+          await file.readAsBytes());
+      await file.delete();
+    }
+
+    if (legacy.isNotEmpty) {
+      print('Moved ${legacy.length} cached icons into $_PACK_FILE');
+    }
+  }
+
+  bool contains(String name) => _icons.containsKey(name);
+
+  Iterable<String> get names => _icons.keys;
+
+  Future<Uint8List?> get(String name) async {
+    final icon = _icons[name];
+    if (icon == null) return null;
+
+    icon.used = ++_clock;
+    _scheduleSave();
+
+    final bytes = await _serialised(() async {
+      await _pack!.setPosition(icon.offset);
+      return await _pack!.read(icon.length);
+    });
+
+    // left over from a pack rewrite the manifest never caught up with
+    if (bytes.length != icon.length || contentHash(bytes) != icon.hash) {
+      print('Cached icon for $name is damaged, dropping it');
+      _drop(name);
+      return null;
+    }
+    return bytes;
+  }
+
+  Future<void> put(String name, Uint8List bytes) async {
+    final hash = contentHash(bytes);
+    final existing = _icons[name];
+    if (existing != null && existing.hash == hash) {
+      existing.used = ++_clock;
+      _scheduleSave();
+      return;
+    }
+
+    await _serialised(() async {
+      final offset = _packLength;
+      await _pack!.setPosition(offset);
+      await _pack!.writeFrom(bytes);
+      await _pack!.flush();
+      _packLength += bytes.length;
+
+      // in the same step as the write, so a pack rewrite can't miss it
+      _drop(name);
+      _icons[name] = _PackedIcon(offset, bytes.length, hash, ++_clock);
+      _liveBytes += bytes.length;
+    });
+
+    _evictIfNeeded();
+    _scheduleSave();
+    await _compactIfNeeded();
+  }
+
+  /// Drops every icon not in [names]
+  Future<void> retainOnly(Set<String> names) async {
+    final unused = _icons.keys.where((name) => !names.contains(name)).toList();
+    for (final name in unused) {
+      _drop(name);
+      print('Removed unused icon cache for $name');
+    }
+
+    if (unused.isNotEmpty) {
+      _scheduleSave();
+      await _compactIfNeeded();
+    }
+  }
+
+  Future<void> clear() async {
+    _icons.clear();
+    _liveBytes = 0;
+    await _compact();
+  }
+
+  void _drop(String name) {
+    final icon = _icons.remove(name);
+    if (icon != null) _liveBytes -= icon.length;
+  }
+
+  void _evictIfNeeded() {
+    while (_liveBytes > MAX_PACK_BYTES && _icons.length > 1) {
+      final oldest = _icons.entries
+          .reduce((a, b) => a.value.used <= b.value.used ? a : b)
+          .key;
+      print('Icon cache is full, dropping $oldest');
+      _drop(oldest);
+    }
+  }
+
+  Future<void> _compactIfNeeded() async {
+    final deadBytes = _packLength - _liveBytes;
+    if (deadBytes > MIN_COMPACT_BYTES && deadBytes > _liveBytes) {
+      await _compact();
+    }
+  }
+
+  // copies the live icons into a new pack and swaps it in with the manifest
+  Future<void> _compact() async {
+    await _serialised(() async {
+      final packPath = path.join(_cachePath!, _PACK_FILE);
+      final temp = await File('$packPath.tmp').open(mode: FileMode.write);
+
+      var offset = 0;
+      for (final icon in _icons.values.toList()) {
+        await _pack!.setPosition(icon.offset);
+        await temp.writeFrom(await _pack!.read(icon.length));
+        icon.offset = offset;
+        offset += icon.length;
+      }
+      await temp.flush();
+      await temp.close();
+
+      await _pack!.close();
+      await File('$packPath.tmp').rename(packPath);
+      _pack = await File(packPath).open(mode: FileMode.append);
+      _packLength = offset;
+    });
+
+    _saveTimer?.cancel();
+    _saveTimer = null;
+    await _saveManifest();
+  }
+
+  Future<T> _serialised<T>(Future<T> Function() operation) {
+    final result = _io.then((_) => operation());
+    _io = result.then((_) {}, onError: (_) {});
+    return result;
+  }
+
+  void _scheduleSave() {
+    _saveTimer ??= Timer(SAVE_DELAY, () {
+      _saveTimer = null;
+      _saveManifest();
+    });
+  }
+
+  Future<void> _saveManifest() async {
+    try {
+      final manifest = File(path.join(_cachePath!, _MANIFEST_FILE));
+      final temp = File('${manifest.path}.tmp');
+
+      await temp.writeAsString(
+          jsonEncode({
+            'version': MANIFEST_VERSION,
+            'clock': _clock,
+            'icons': {
+              for (final entry in _icons.entries)
+                entry.key: {
+                  'offset': entry.value.offset,
+                  'length': entry.value.length,
+                  'hash': entry.value.hash,
+                  'used': entry.value.used,
+                }
+            },
+          }),
+          flush: true);
+      await temp.rename(manifest.path);
+    } catch (e) {
+      print('Error saving icon manifest: $e');
+    }
+  }
+
+  /// 64 bit FNV-1a plus the length, cheap next to decoding an icon
+  static String contentHash(Uint8List bytes) {
+    int hash = 0xcbf29ce484222325;
+    for (final byte in bytes) {
+      hash ^= byte;
+      hash *= 0x100000001b3;
+    }
+    return '${hash.toUnsigned(64).toRadixString(16)}-${bytes.length}';
+  }
+}
+
+class _PackedIcon {
+  int offset;
+  final int length;
+  final String hash;
+  int used;
+
+  _PackedIcon(this.offset, this.length, this.hash, this.used);
+}
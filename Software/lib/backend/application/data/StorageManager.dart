@@ -1,14 +1,52 @@
+import 'dart:async';
+import 'dart:convert';
 import 'dart:io';
+import 'package:flutter/foundation.dart' show visibleForTesting;
 import 'package:yaml/yaml.dart' as yaml;
-import 'package:yaml_writer/yaml_writer.dart';
 import 'package:path/path.dart' as path;
 
+/// Stored settings, kept in memory once loaded so reads never touch the disk.
+/// Writes are batched for [WRITE_DELAY] and appended to a journal, which is
+/// folded into a new snapshot (written to a temp file, synced, then renamed
+/// over the old one) once it passes [MAX_JOURNAL_ENTRIES] or on [flush].
+/// Loading replays the journal over the snapshot, so a crash loses at most
+/// the batch that hadn't been written yet. Each snapshot has a generation and
+/// journal entries carry the one they were written on top of, so a journal
+/// left behind by a crash after a new snapshot is never replayed over it.
 class StorageManager {
   static final StorageManager _instance = StorageManager._internal();
   static StorageManager get instance => _instance;
   StorageManager._internal();
 
+  /// A store of its own in [configPath], for tests that load the same files
+  /// more than once
+  @visibleForTesting
+  StorageManager.at(String configPath) : _configPath = configPath;
+
+  static const Duration WRITE_DELAY = Duration(milliseconds: 250);
+  static const int MAX_JOURNAL_ENTRIES = 64;
+
+  static const String _SNAPSHOT_FILE = 'data.json';
+  static const String _JOURNAL_FILE = 'data.journal';
+  static const String _LEGACY_FILE = 'data.yml';
+
+  final Map<String, dynamic> _data = {};
+
+  // keys changed since the last write, [_REMOVED] marks a removed key
+  final Map<String, Object?> _pending = {};
+  static const Object _REMOVED = Object();
+  bool _clearPending = false;
+
+  String? _configPath;
+  Future<void>? _loaded;
+  Timer? _writeTimer;
+  Future<void> _writing = Future.value();
+  int _journalEntries = 0;
+  int _generation = 0;
+
   Future<String> get _localPath async {
+    if (_configPath != null) return _configPath!;
+
     String appDataPath;
 
     if (Platform.isWindows) {
@@ -28,121 +66,229 @@ class StorageManager {
       await directory.create(recursive: true);
     }
 
-    return mixlitPath;
+    return _configPath = mixlitPath;
   }
 
-  Future<String> get _localFile async {
-    final configPath = await _localPath;
-    return path.join(configPath, 'data.yml');
-  }
+  Future<File> _file(String name) async =>
+      File(path.join(await _localPath, name));
 
-  Future<void> saveData(String key, dynamic data) async {
+  /// Reads the stored data into memory, everything else waits for this
+  Future<void> load() => _loaded ??= _load();
+
+  Future<void> _ensureLoaded() => load();
+
+  Future<void> _load() async {
     try {
-      final file = File(await _localFile);
-      print('Saving data to ${file.path}');
-      Map<String, dynamic> existingData = {};
-      if (await file.exists()) {
-        final contents = await file.readAsString();
+      final snapshot = await _file(_SNAPSHOT_FILE);
+      if (await snapshot.exists()) {
+        final contents = await snapshot.readAsString();
         if (contents.isNotEmpty) {
-          existingData =
-              Map<String, dynamic>.from(yaml.loadYaml(contents) ?? {});
+          _readSnapshot(Map<String, dynamic>.from(jsonDecode(contents)));
         }
+      } else {
+        await _migrateLegacyFile();
       }
-
-      existingData[key] = data;
-      final yamlWriter = YamlWriter();
-      final yamlString = yamlWriter.write(existingData);
-      await file.writeAsString(yamlString);
     } catch (e) {
-      print('Error saving data to storage: $e');
-      rethrow;
+      print('Error loading stored data, starting from the journal: $e');
     }
-  }
 
-  Future<dynamic> getData(String key, {dynamic defaultValue}) async {
-    try {
-      final file = File(await _localFile);
-      if (!await file.exists()) {
-        print('File does not exist, returning default value');
-        return defaultValue;
-      }
+    final journal = await _file(_JOURNAL_FILE);
+    if (!await journal.exists()) return;
 
-      final contents = await file.readAsString();
-      if (contents.isEmpty) {
-        print('File is empty, returning default value');
-        return defaultValue;
+    var torn = false;
+    var stale = false;
+    for (final line in await journal.readAsLines()) {
+      if (line.isEmpty) continue;
+      try {
+        final entry = jsonDecode(line);
+        // already in the snapshot, which was written after it
+        if ((entry['gen'] ?? 0) < _generation) {
+          stale = true;
+          continue;
+        }
+        _replay(entry);
+        _journalEntries++;
+      } catch (e) {
+        // a write cut short by a crash, anything after it can't be trusted
+        print('Ignoring the end of the storage journal: $e');
+        torn = true;
+        break;
       }
+    }
 
-      final data = yaml.loadYaml(contents);
-      final result =
-          data != null && data[key] != null ? data[key] : defaultValue;
-      return result;
-    } catch (e) {
-      print('Error reading data from storage: $e');
-      return defaultValue;
+    if (torn || stale) {
+      await _writeSnapshot();
     }
   }
 
-  Future<void> removeData(String key) async {
-    try {
-      final file = File(await _localFile);
-      if (!await file.exists()) {
-        print('Cannot remove key $key - file does not exist');
-        return;
-      }
+  void _readSnapshot(Map<String, dynamic> snapshot) {
+    final data = Map<String, dynamic>.from(snapshot['data'] as Map);
+    _generation = snapshot['generation'] as int;
+    _data.addAll(data);
+  }
 
-      final contents = await file.readAsString();
-      Map<String, dynamic> existingData = {};
-      if (contents.isNotEmpty) {
-        existingData = Map<String, dynamic>.from(yaml.loadYaml(contents) ?? {});
-      }
+  Future<void> _migrateLegacyFile() async {
+    final legacy = await _file(_LEGACY_FILE);
+    if (!await legacy.exists()) return;
 
-      existingData.remove(key);
-      final yamlWriter = YamlWriter();
-      await file.writeAsString(yamlWriter.write(existingData));
-    } catch (e) {
-      print('Error removing data from storage: $e');
-      rethrow;
+    final contents = await legacy.readAsString();
+    if (contents.isEmpty) return;
+
+    final data = yaml.loadYaml(contents);
+    if (data is Map) {
+      _data.addAll(_copy(data));
+      await _writeSnapshot();
+      print('Moved stored data from ${legacy.path} to $_SNAPSHOT_FILE');
+    }
+  }
+
+  void _replay(Map<String, dynamic> entry) {
+    if (entry['clear'] == true) {
+      _data.clear();
+    } else if (entry.containsKey('remove')) {
+      _data.remove(entry['remove']);
+    } else {
+      _data[entry['key']] = entry['value'];
     }
   }
 
+  // stored values are plain maps, lists and scalars that belong to the store
+  static dynamic _copy(dynamic value) {
+    if (value is Map) {
+      return <String, dynamic>{
+        for (final entry in value.entries)
+          entry.key.toString(): _copy(entry.value)
+      };
+    }
+    if (value is List) {
+      return [for (final item in value) _copy(item)];
+    }
+    return value;
+  }
+
+  Future<void> saveData(String key, dynamic data) async {
+    await _ensureLoaded();
+
+    final value = _copy(data);
+    _data[key] = value;
+    _pending[key] = value;
+    _scheduleWrite();
+  }
+
+  Future<dynamic> getData(String key, {dynamic defaultValue}) async {
+    await _ensureLoaded();
+
+    final value = _data[key];
+    return value != null ? _copy(value) : defaultValue;
+  }
+
+  Future<void> removeData(String key) async {
+    await _ensureLoaded();
+
+    if (!_data.containsKey(key)) return;
+    _data.remove(key);
+    _pending[key] = _REMOVED;
+    _scheduleWrite();
+  }
+
   Future<void> clearStorage() async {
-    try {
-      final file = File(await _localFile);
-      if (await file.exists()) {
-        await file.delete();
-        print('Storage cleared - file deleted');
-      }
-    } catch (e) {
-      print('Error clearing storage: $e');
-      rethrow;
+    await _ensureLoaded();
+
+    _data.clear();
+    _pending.clear();
+    _clearPending = true;
+    await flush();
+    print('Storage cleared');
+  }
+
+  /// Writes anything still waiting and folds the journal into the snapshot,
+  /// call before the app exits
+  Future<void> flush() async {
+    await _ensureLoaded();
+
+    _writeTimer?.cancel();
+    _writeTimer = null;
+    await _enqueueWrite(compact: true);
+  }
+
+  void _scheduleWrite() {
+    _writeTimer ??= Timer(WRITE_DELAY, () {
+      _writeTimer = null;
+      _enqueueWrite();
+    });
+  }
+
+  // one write at a time, in the order they were asked for
+  Future<void> _enqueueWrite({bool compact = false}) {
+    return _writing = _writing.then((_) => _write(compact)).catchError((e) {
+      print('Error saving data to storage: $e');
+    });
+  }
+
+  Future<void> _write(bool compact) async {
+    final entries = <Map<String, dynamic>>[
+      if (_clearPending) {'gen': _generation, 'clear': true},
+      for (final change in _pending.entries)
+        if (identical(change.value, _REMOVED))
+          {'gen': _generation, 'remove': change.key}
+        else
+          {'gen': _generation, 'key': change.key, 'value': change.value}
+    ];
+    _pending.clear();
+    _clearPending = false;
+
+    if (compact || _journalEntries + entries.length > MAX_JOURNAL_ENTRIES) {
+      if (entries.isEmpty && _journalEntries == 0) return;
+      await _writeSnapshot();
+      return;
     }
+    if (entries.isEmpty) return;
+
+    final journal = await _file(_JOURNAL_FILE);
+    await journal.writeAsString(
+        entries.map((entry) => '${jsonEncode(entry)}\n').join(),
+        mode: FileMode.append,
+        flush: true);
+    _journalEntries += entries.length;
   }
 
-  Future<void> dumpStorageContents() async {
-    try {
-      final file = File(await _localFile);
-      if (!await file.exists()) {
-        print('Storage file does not exist');
-        return;
-      }
+  Future<void> _writeSnapshot() async {
+    final snapshot = await _file(_SNAPSHOT_FILE);
+    final temp = await _file('$_SNAPSHOT_FILE.tmp');
 
-      final contents = await file.readAsString();
-      if (contents.isEmpty) {
-        print('Storage file is empty');
-        return;
-      }
+    // the journal is older than this from the moment it's renamed into place
+    _generation++;
+    await temp.writeAsString(
+        jsonEncode({'generation': _generation, 'data': _data}),
+        flush: true);
+    await temp.rename(snapshot.path);
 
-      print('==== CONFIG CONTENTS ====');
-      print('Location: ${file.path}');
-      print(contents);
-      print('==== END OF CONFIG CONTENTS ====');
-    } catch (e) {
-      print('Error dumping storage contents: $e');
+    // everything in the journal is in the snapshot now
+    final journal = await _file(_JOURNAL_FILE);
+    if (await journal.exists()) {
+      await journal.delete();
     }
+    _journalEntries = 0;
+  }
+
+  Future<void> dumpStorageContents() async {
+    await _ensureLoaded();
+
+    print('==== CONFIG CONTENTS ====');
+    print('Location: ${(await _file(_SNAPSHOT_FILE)).path}');
+    print(const JsonEncoder.withIndent('  ').convert(_data));
+    print('==== END OF CONFIG CONTENTS ====');
   }
 
   Future<String> getConfigPath() async {
     return await _localPath;
   }
+
+  /// Keeps everything in [configPath] instead of the user's config folder,
+  /// for tests and benchmarks. Has to be called before anything is loaded.
+  @visibleForTesting
+  void useConfigPath(String configPath) {
+    assert(_loaded == null, 'storage has already been loaded');
+    _configPath = configPath;
+  }
 }
@@ -1,12 +1,28 @@
 import 'dart:async';
+import 'package:flutter/foundation.dart' show listEquals;
 import 'package:flutter/services.dart';
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
 import 'package:mixlit/backend/application/serial/SerialWorker.dart';
+import 'package:mixlit/backend/application/serial/SliderAddress.dart';
 import 'package:mixlit/backend/application/util/IconColourExtractor.dart';
 import 'package:mixlit/backend/application/data/ConfigManager.dart';
 import 'package:mixlit/backend/application/audio/ApplicationManager.dart';
 import 'package:mixlit/frontend/components/util/rate_limit_updates.dart';
 import 'package:win32audio/win32audio.dart';
 
+/// What the device was last sent for one strip
+class _StripState {
+  final List<int> palette;
+  final int brightness;
+  final bool animated;
+
+  _StripState(this.palette, this.brightness, this.animated);
+
+  /// As the firmware hashes it, see SerialProtocol.stateHash
+  List<int> get stored =>
+      SerialProtocol.stripState(animated, brightness, palette);
+}
+
 /// LED controller for setting LEDs
 class LEDController {
   final SerialWorker _serialWorker;
@@ -16,11 +32,23 @@ class LEDController {
   final List<double> _sliderValues;
   final List<String> _sliderTags;
   final Map<String, Uint8List?> _appIcons;
+
+  // worked out whenever the icons change, so picking a slider's colour never
+  // waits on an icon
+  final Map<String, Color> _appColours = {};
+  int _appColoursGeneration = 0;
   bool _isAnimated = false;
 
   late final RateLimitedUpdater _ledUpdater;
   final Map<int, bool> _pendingSliderUpdates = {};
 
+  // only what changed since this is sent, by SliderAddress, a device that
+  // connects again is taken to show what it reports at its handshake
+  final Map<int, _StripState> _sentStrips = {};
+  Set<int> _connectedDevices = {};
+  StreamSubscription? _connectionStateSubscription;
+  StreamSubscription<int>? _sliderAppChangesSubscription;
+
   static const int LED_UPDATE_INTERVAL_MS = 100; // Reduced from 50ms
 
   LEDController({
@@ -41,7 +69,69 @@ class LEDController {
       _processPendingUpdates,
     );
 
+    _connectionStateSubscription = _serialWorker.connectionState
+        .listen((_) => _updateConnectedDevices());
+
+    // an app going missing or coming back changes its slider's colour
+    _sliderAppChangesSubscription =
+        _applicationManager.sliderAppChanges.listen(updateSliderLEDs);
+
     _startUpdateTimer();
+    _extractAppColours();
+  }
+
+  void _updateConnectedDevices() {
+    final devices = _serialWorker.connectedDevices.toSet();
+    for (final device in _connectedDevices.union(devices)) {
+      if (devices.contains(device) && _connectedDevices.contains(device)) {
+        continue;
+      }
+      _sentStrips.removeWhere(
+          (address, _) => SliderAddress.deviceOf(address) == device);
+      if (devices.contains(device)) _adoptDeviceState(device);
+    }
+    _connectedDevices = devices;
+  }
+
+  /// A device that kept its palettes through a power cycle or sleep, and
+  /// reports the same state this would send, doesn't need any of it again
+  void _adoptDeviceState(int device) {
+    final hash = _serialWorker.stateHashOf(device);
+    final last = SliderAddress.of(device, SerialProtocol.NUM_OF_LED_STRIPS - 1);
+    if (hash == null || last >= _sliderTags.length) return;
+
+    final states = [
+      for (int strip = 0; strip < SerialProtocol.NUM_OF_LED_STRIPS; strip++)
+        _stateForSlider(SliderAddress.of(device, strip))
+    ];
+    if (SerialProtocol.stateHash(states.map((state) => state.stored)) != hash) {
+      return;
+    }
+
+    print('Device $device already shows its palettes, nothing to send');
+    for (int strip = 0; strip < states.length; strip++) {
+      _sentStrips[SliderAddress.of(device, strip)] = states[strip];
+    }
+  }
+
+  Future<void> _extractAppColours() async {
+    final generation = ++_appColoursGeneration;
+    final colours = <String, Color>{};
+    for (final entry in Map.of(_appIcons).entries) {
+      final iconData = entry.value;
+      if (iconData != null) {
+        colours[entry.key] = await IconColorExtractor.extractDominantColor(
+            iconData, defaultColor: _defaultAppColor);
+      }
+    }
+
+    // the icons changed again while these were being worked out
+    if (generation != _appColoursGeneration) return;
+
+    _appColours
+      ..clear()
+      ..addAll(colours);
+    _requestAllLEDUpdate();
   }
 
   void _startUpdateTimer() {
@@ -86,7 +176,9 @@ class LEDController {
     }
 
     for (int i = 0; i < _sliderValues.length; i++) {
-      await _updateSingleSliderLED(i);
+      if (_serialWorker.isConnectedTo(SliderAddress.deviceOf(i))) {
+        await _updateSingleSliderLED(i);
+      }
     }
   }
 
@@ -101,92 +193,120 @@ class LEDController {
   }
 
   Future<void> _updateSingleSliderLED(int sliderIndex) async {
-    if (!_serialWorker.isDeviceConnected ||
+    final device = SliderAddress.deviceOf(sliderIndex);
+    if (!_serialWorker.isConnectedTo(device) ||
         sliderIndex >= _sliderValues.length) {
       return;
     }
+    final strip = SliderAddress.channelOf(sliderIndex);
+    if (strip >= SerialProtocol.NUM_OF_LED_STRIPS) return;
 
-    Color sliderColor = await _getColorForSlider(sliderIndex);
-    _currentSliderColors[sliderIndex] = sliderColor;
+    final state = _stateForSlider(sliderIndex);
+    final sent = _sentStrips[sliderIndex];
 
-    final command = _generateLEDCommand(sliderIndex, sliderColor);
-    await _serialWorker.sendCommand(command);
-  }
-
-  String _generateLEDCommand(int sliderIndex, Color color) {
-    StringBuffer command = StringBuffer();
-
-    command.write(sliderIndex.toRadixString(16));
-    command.write(_isAnimated ? '1' : '0');
+    if (sent != null &&
+        sent.brightness == state.brightness &&
+        sent.animated == state.animated &&
+        listEquals(sent.palette, state.palette)) {
+      return;
+    }
 
-    final colorHex = _colorToHex(color);
+    if (_serialWorker.protocolVersionOf(device) <
+        SerialProtocol.PROTOCOL_VERSION_LED_FRAMES) {
+      // older firmware only takes the full text palette, with the brightness
+      // baked into it
+      final scaledPalette = state.palette
+          .map((value) => (value * state.brightness) ~/ 255)
+          .toList();
+      await _serialWorker.sendCommand(
+          SerialProtocol.paletteCommand(strip, state.animated, scaledPalette),
+          device: device);
+      _sentStrips[sliderIndex] = state;
+      return;
+    }
 
-    for (int i = 0; i < 8; i++) {
-      command.write(colorHex);
+    for (final frame in _generateLEDFrames(strip, state, sent)) {
+      if (!await _serialWorker.sendLEDFrame(frame, device: device)) return;
     }
+    _sentStrips[sliderIndex] = state;
+  }
 
-    Color animationColor = _isAnimated
-        ? Color.fromARGB(color.alpha, (color.red + 128) % 255,
-            (color.green + 128) % 255, (color.blue + 128) % 255)
-        : color;
+  _StripState _stateForSlider(int sliderIndex) {
+    Color sliderColor = _getColorForSlider(sliderIndex);
+    _currentSliderColors[sliderIndex] = sliderColor;
 
-    final animationColorHex = _colorToHex(animationColor);
+    return _StripState(
+        _generatePalette(sliderColor), sliderColor.alpha, _isAnimated);
+  }
 
-    for (int i = 0; i < 8; i++) {
-      command.write(animationColorHex);
+  /// 16 rgb triples, one colour or a gradient out to its opposite and back
+  /// when animated
+  List<int> _generatePalette(Color color) {
+    final rgb = [color.red, color.green, color.blue];
+    if (!_isAnimated) {
+      return [for (int i = 0; i < SerialProtocol.PALETTE_SIZE; i++) ...rgb];
     }
 
-    return command.toString();
+    final animationRgb = rgb.map((value) => (value + 128) % 255).toList();
+    return SerialProtocol.gradientPalette(rgb, animationRgb);
   }
 
-  String _colorToHex(Color color) {
-    String red = color.red.toRadixString(16).padLeft(2, '0').toUpperCase();
-    String green = color.green.toRadixString(16).padLeft(2, '0').toUpperCase();
-    String blue = color.blue.toRadixString(16).padLeft(2, '0').toUpperCase();
-    return red + green + blue;
-  }
+  /// The smallest frames that take the strip from [sent] to [state], every
+  /// frame carries the animation flag
+  List<Uint8List> _generateLEDFrames(
+      int strip, _StripState state, _StripState? sent) {
+    final frames = <Uint8List>[];
+    final palette = state.palette;
+
+    if (sent == null || !listEquals(sent.palette, palette)) {
+      final first = palette.sublist(0, 3);
+      final middle = palette.sublist(8 * 3, 8 * 3 + 3);
+
+      if (listEquals(palette, SerialProtocol.gradientPalette(first, first))) {
+        frames.add(SerialProtocol.ledFrame(SerialProtocol.LED_FRAME_SOLID,
+            strip, state.animated, first));
+      } else if (listEquals(
+          palette, SerialProtocol.gradientPalette(first, middle))) {
+        frames.add(SerialProtocol.ledFrame(SerialProtocol.LED_FRAME_GRADIENT,
+            strip, state.animated, [...first, ...middle]));
+      } else {
+        frames.add(SerialProtocol.ledFrame(SerialProtocol.LED_FRAME_PALETTE,
+            strip, state.animated, palette));
+      }
+    }
 
-  Future<Color> _getColorForSlider(int sliderIndex) async {
-    final sliderTag = _sliderTags[sliderIndex];
+    // a brightness frame is also the smallest way to change only the animation
+    if (sent == null ||
+        sent.brightness != state.brightness ||
+        frames.isEmpty) {
+      frames.add(SerialProtocol.ledFrame(SerialProtocol.LED_FRAME_BRIGHTNESS,
+          strip, state.animated, [state.brightness]));
+    }
 
-    const Color deviceColor = Color.fromARGB(255, 129, 191, 205);
-    const Color masterColor = Color.fromARGB(255, 255, 255, 255);
-    const Color activeAppColor = Color.fromARGB(255, 69, 205, 255);
-    const Color unassignedColor = Color.fromARGB(255, 51, 51, 51);
-    const Color defaultAppColor = Color.fromARGB(255, 243, 237, 191);
+    return frames;
+  }
 
-    switch (sliderTag) {
+  static const Color _deviceColor = Color.fromARGB(255, 129, 191, 205);
+  static const Color _masterColor = Color.fromARGB(255, 255, 255, 255);
+  static const Color _activeAppColor = Color.fromARGB(255, 69, 205, 255);
+  static const Color _unassignedColor = Color.fromARGB(255, 51, 51, 51);
+  static const Color _defaultAppColor = Color.fromARGB(255, 243, 237, 191);
+
+  Color _getColorForSlider(int sliderIndex) {
+    switch (_sliderTags[sliderIndex]) {
       case ConfigManager.TAG_DEFAULT_DEVICE:
-        return deviceColor;
+        return _deviceColor;
       case ConfigManager.TAG_MASTER_VOLUME:
-        return masterColor;
+        return _masterColor;
       case ConfigManager.TAG_ACTIVE_APP:
-        return activeAppColor;
+        return _activeAppColor;
       case ConfigManager.TAG_UNASSIGNED:
-        return unassignedColor;
+        return _unassignedColor;
       case ConfigManager.TAG_APP:
         final app = _getAppForSlider(sliderIndex);
-        if (app != null) {
-          final appPath = app.processPath;
-          if (_appIcons.containsKey(appPath)) {
-            final iconData = _appIcons[appPath];
-            if (iconData != null) {
-              try {
-                return await IconColorExtractor.extractDominantColor(
-                  iconData,
-                  appPath,
-                  defaultColor: defaultAppColor,
-                );
-              } catch (e) {
-                print('Error extracting color: $e');
-                return defaultAppColor;
-              }
-            }
-          }
-        }
-        return defaultAppColor;
+        return _appColours[app?.processPath] ?? _defaultAppColor;
       default:
-        return defaultAppColor;
+        return _defaultAppColor;
     }
   }
 
@@ -232,7 +352,7 @@ class LEDController {
   void updateAppIcons(Map<String, Uint8List?> appIcons) {
     _appIcons.clear();
     _appIcons.addAll(appIcons);
-    _requestAllLEDUpdate();
+    _extractAppColours();
   }
 
   void updateSliderTags(List<String> sliderTags) {
@@ -251,6 +371,8 @@ class LEDController {
 
   void dispose() {
     _updateTimer?.cancel();
+    _connectionStateSubscription?.cancel();
+    _sliderAppChangesSubscription?.cancel();
     _ledUpdater.dispose();
     _pendingSliderUpdates.clear();
   }
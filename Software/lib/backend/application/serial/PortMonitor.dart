@@ -0,0 +1,72 @@
+import 'dart:async';
+import 'dart:io' show Platform;
+import 'package:flutter/services.dart';
+
+class PortEvent {
+  final bool added;
+  final String path;
+  final int vendorId; // 0 when the port isn't on usb
+  final int productId;
+
+  const PortEvent(this.added, this.path, this.vendorId, this.productId);
+}
+
+/// Serial ports being plugged in and taken away, from udev on Linux (see
+/// linux/serial/). Everywhere else, or where udev can't be reached, [start]
+/// returns false and the ports have to be polled for.
+class PortMonitor {
+  static const MethodChannel _methods = MethodChannel('mixlit/serial');
+  static const EventChannel _events = EventChannel('mixlit/serial/ports');
+
+  StreamSubscription? _subscription;
+
+  bool get isActive => _subscription != null;
+
+  /// [onFailed] is called if the monitor stops after it has started
+  Future<bool> start(void Function(PortEvent) onEvent,
+      {void Function()? onFailed}) async {
+    if (_subscription != null) return true;
+    if (!Platform.isLinux) return false;
+
+    // listening first, so nothing between the two is missed
+    _subscription = _events.receiveBroadcastStream().listen(
+      (event) {
+        final values = event as Map;
+        onEvent(PortEvent(
+          values['added'] as bool,
+          values['path'] as String,
+          values['vendorId'] as int,
+          values['productId'] as int,
+        ));
+      },
+      onError: (error) {
+        print('Port monitor stopped: $error');
+        stop();
+        onFailed?.call();
+      },
+    );
+
+    try {
+      if (await _methods.invokeMethod<bool>('startPortMonitor') == true) {
+        return true;
+      }
+    } catch (e) {
+      // a runner without the plugin, such as flutter test
+      print('Port monitor unavailable: $e');
+    }
+
+    await stop();
+    return false;
+  }
+
+  Future<void> stop() async {
+    final subscription = _subscription;
+    if (subscription == null) return;
+    _subscription = null;
+
+    await subscription.cancel();
+    try {
+      await _methods.invokeMethod('stopPortMonitor');
+    } catch (_) {}
+  }
+}
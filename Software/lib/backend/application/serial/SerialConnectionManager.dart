@@ -1,59 +1,69 @@
 import 'dart:async';
-import 'dart:io' show Platform;
+import 'dart:io' show File, Platform;
 import 'dart:typed_data';
 
 import 'package:flutter_libserialport/flutter_libserialport.dart'
-    show SerialPort, SerialPortConfig, SerialPortParity;
+    show SerialPort, SerialPortTransport;
 import 'package:mixlit/backend/application/data/ConfigManager.dart';
+import 'package:mixlit/backend/application/serial/PortMonitor.dart';
+import 'package:mixlit/backend/application/serial/SerialDeviceConnection.dart';
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
 import 'package:mixlit/backend/application/serial/SerialPortReader.dart'
     show SerialPortReader;
+import 'package:mixlit/backend/application/util/LatencyTracer.dart';
 
+/// Finds every MixLit plugged in and keeps a SerialDeviceConnection to each,
+/// in the slot ConfigManager keeps for its device id.
 class SerialConnectionManager {
-  static const int BAUD_RATE = 38400;
   static const int SCAN_TIMEOUT_MS = 200;
-  static const String DEVICE_IDENTIFIER = "mixlit";
+  static const String DEVICE_IDENTIFIER = SerialProtocol.DEVICE_IDENTIFIER;
   static Uint8List DEVICE_IDENTIFICATION_REQUEST =
-      Uint8List.fromList('?\n'.codeUnits);
+      SerialDeviceConnection.DEVICE_IDENTIFICATION_REQUEST;
   static const int DEVICE_IDENTIFICATION_RESPONSE_TIMEOUT = 200;
 
-  SerialPort? _port;
-  SerialPortReader? _reader;
-  bool _isConnected = false;
-  bool _isInitializing = false;
+  /// Ports the system doesn't list, such as the pty links from mixlit_vdev
+  /// in Firmware/Simulator, to try before the others. Separated like PATH.
+  static const String PORT_OVERRIDE_VARIABLE = 'MIXLIT_PORT';
+
+  // a port has this long to answer once it's open, which covers a Nano's
+  // bootloader handing over after the open reset it
+  static const Duration PROBE_TIMEOUT = Duration(milliseconds: 2500);
+  static const Duration PROBE_INTERVAL = Duration(milliseconds: 50);
+  // the values line comes straight after the handshake
+  static const Duration PROBE_VALUES_WAIT = Duration(milliseconds: 50);
+  // the saved ports are probed on their own this long before the others are
+  // opened, opening them would reset any other Arduino plugged in
+  static const Duration SAVED_PORT_HEAD_START = Duration(milliseconds: 150);
+
+  final PortMonitor _portMonitor = PortMonitor();
+  bool _isScanning = false;
+  bool _rescanPending = false;
+  bool _isDisposed = false;
+
+  // ports with a usb id the boards don't use that didn't answer, left alone
+  // until they're plugged in again
+  final Set<String> _rejectedPorts = {};
+
+  // while polling, only ports that weren't listed last time are probed once
+  // a device is connected
+  Set<String> _listedPorts = {};
+
+  final Map<int, SerialDeviceConnection> _connections = {};
   Timer? _reconnectTimer;
-  String? _lastKnownPort;
-  StreamSubscription? _readerSubscription;
 
-  Timer? _connectionHealthCheckTimer;
-  int _connectionHealthCheckFailures = 0;
-  static const int MAX_CONNECTION_HEALTH_FAILURES = 3;
-
-  DateTime? _lastDataReceived;
-  DateTime? _lastSuccessfulWrite;
-  static const Duration DATA_TIMEOUT = Duration(seconds: 30);
-
-  bool _awaitingInitialValues = false;
-  final Completer<Map<int, int>?> _initialValuesCompleter =
-      Completer<Map<int, int>?>();
-  Timer? _initialValuesTimeout;
+  // from ConfigManager.getKnownDevices, the port and baud rate each device
+  // was last connected on
+  Map<String, int?> _savedPorts = {};
 
   final StreamController<bool> _connectionStateController;
-  final void Function(List<int>) onDataReceived;
+  final void Function(int, List<int>) onDataReceived;
   final void Function(dynamic) onError;
-  final void Function(Map<int, int>)? onInitialHardwareValues;
+  final void Function(int, Map<int, int>)? onInitialHardwareValues;
 
-  final ConfigManager _configManager = ConfigManager.instance;
+  /// Called with the slot of every device that connects or goes away
+  final void Function(int, bool)? onDeviceStateChanged;
 
-  final _portConfig = SerialPortConfig()
-    ..baudRate = BAUD_RATE
-    ..bits = 8
-    ..parity = SerialPortParity.none
-    ..stopBits = 1
-    ..xonXoff = 0
-    ..rts = 1
-    ..cts = 0
-    ..dsr = 0
-    ..dtr = 1;
+  final ConfigManager _configManager = ConfigManager.instance;
 
   final Completer<void> _initCompleter = Completer<void>();
   Future<void> get initialized => _initCompleter.future;
@@ -63,609 +73,476 @@ class SerialConnectionManager {
     required this.onDataReceived,
     required this.onError,
     this.onInitialHardwareValues,
+    this.onDeviceStateChanged,
   }) : _connectionStateController = connectionStateController {
     Future.delayed(Duration(milliseconds: 100), () {
       _initializeConnection();
     });
   }
 
-  Future<Map<int, int>?> getInitialHardwareValues() async {
-    if (!_isConnected || _port == null) {
-      print('Cannot get hardware values: not connected');
-      return null;
-    }
-
-    if (_awaitingInitialValues) {
-      print('Already waiting for initial values');
-      return await _initialValuesCompleter.future;
-    }
+  Stream<bool> get connectionState => _connectionStateController.stream;
 
-    _awaitingInitialValues = true;
-    print('Requesting initial hardware values...');
+  /// True while any device is connected
+  bool get isConnected => _connections.isNotEmpty;
 
-    try {
-      _port!.write(DEVICE_IDENTIFICATION_REQUEST);
-      _port!.flush();
+  /// Slots with a device connected, lowest first
+  List<int> get connectedSlots => _connections.keys.toList()..sort();
 
-      _initialValuesTimeout = Timer(const Duration(seconds: 3), () {
-        if (!_initialValuesCompleter.isCompleted) {
-          print('Timeout waiting for initial hardware values');
-          _initialValuesCompleter.complete(null);
-        }
-        _awaitingInitialValues = false;
-      });
+  SerialDeviceConnection? connection(int slot) => _connections[slot];
 
-      final result = await _initialValuesCompleter.future;
-      print('Received initial hardware values: $result');
-      return result;
-    } catch (e) {
-      print('Error getting initial hardware values: $e');
-      _awaitingInitialValues = false;
-      return null;
-    }
-  }
-
-  void _startConnectionHealthCheck() {
-    _connectionHealthCheckTimer?.cancel();
-
-    _connectionHealthCheckTimer = Timer.periodic(
-        const Duration(seconds: 2), (_) => _checkConnectionHealth());
+  /// The device LatencyTracer follows, the one in the lowest slot
+  SerialDeviceConnection? get _tracedConnection {
+    final slots = connectedSlots;
+    return slots.isEmpty ? null : _connections[slots.first];
   }
 
-  Future<void> _checkConnectionHealth() async {
-    if (_isInitializing || !_isConnected || _port == null) {
-      return;
+  /// Slot of the device whose frames are timestamped, if tracing is on
+  int? get tracedSlot {
+    for (final connection in _connections.values) {
+      if (connection.tracesLatency) return connection.slot;
     }
+    return null;
+  }
 
-    try {
-      //port still exists on system?
-      if (!await _isPortAvailableInSystem()) {
-        print('Port no longer available in system');
-        await _handleDisconnection();
-        return;
-      }
-
-      //port handle is still open?
-      if (!_port!.isOpen) {
-        print('Port handle is no longer open');
-        await _handleDisconnection();
-        return;
-      }
-
-      //port writable?
-      final healthCheckSuccessful = await _performDeviceHealthCheck();
-
-      if (!healthCheckSuccessful) {
-        _connectionHealthCheckFailures++;
-        print(
-            'Health check failed (${_connectionHealthCheckFailures}/${MAX_CONNECTION_HEALTH_FAILURES})');
-
-        if (_connectionHealthCheckFailures >= MAX_CONNECTION_HEALTH_FAILURES) {
-          print(
-              'Device health check failed multiple times. Triggering disconnection.');
-          await _handleDisconnection();
-        }
-      } else {
-        _connectionHealthCheckFailures = 0;
-      }
-
-      //data timeout
-    } catch (e) {
-      print('Connection health check error: $e');
-      _connectionHealthCheckFailures++;
-
-      if (_connectionHealthCheckFailures >= MAX_CONNECTION_HEALTH_FAILURES) {
-        await _handleDisconnection();
+  /// Turns frame timestamps on or off on the device in the lowest slot, and
+  /// off on any other that had them
+  Future<bool> setLatencyTracing(bool enabled) async {
+    final traced = _tracedConnection;
+    for (final connection in _connections.values.toList()) {
+      final traces = enabled && connection == traced;
+      if (connection.tracesLatency && !traces) {
+        await connection.setLatencyTracing(false);
       }
+      connection.tracesLatency = traces;
     }
+    return await traced?.setLatencyTracing(enabled) ?? false;
   }
 
-  Future<bool> _isPortAvailableInSystem() async {
-    if (_lastKnownPort == null) return false;
+  List<String> get _overridePorts {
+    final override = Platform.environment[PORT_OVERRIDE_VARIABLE];
+    if (override == null) return [];
 
-    try {
-      final availablePorts = SerialPort.availablePorts;
-      final exists = availablePorts.contains(_lastKnownPort);
+    return override
+        .split(Platform.isWindows ? ';' : ':')
+        .where((port) => port.isNotEmpty && File(port).existsSync())
+        .toList();
+  }
 
-      if (!exists) {
-        print('Port $_lastKnownPort no longer in available ports list');
-      }
+  bool _isPortListed(String name) {
+    if (_portMonitor.isActive) return true;
 
-      return exists;
+    try {
+      final listed = SerialPort.availablePorts.contains(name) ||
+          _overridePorts.contains(name);
+      if (!listed) print('Port $name no longer in available ports list');
+      return listed;
     } catch (e) {
       print('Error checking available ports: $e');
       return false;
     }
   }
 
-  Future<bool> _performDeviceHealthCheck() async {
-    if (_port == null || !_port!.isOpen) return false;
-
+  Future<void> _initializeConnection() async {
     try {
-      if (!_port!.isOpen) {
-        print('Port is not open');
-        return false;
-      }
+      print('Starting serial port initialization...');
+      await _loadSavedPorts();
 
-      try {
-        _port!.write(Uint8List.fromList([]));
-        _port!.flush();
-        _lastSuccessfulWrite = DateTime.now();
-        return true;
-      } catch (writeError) {
-        print('Write test failed: $writeError');
-        return false;
+      if (await _portMonitor.start(_handlePortEvent,
+          onFailed: _handlePortMonitorFailed)) {
+        print('Watching udev for serial ports');
       }
     } catch (e) {
-      print('Device health check failed: $e');
-      return false;
+      print('Error during initialization: $e');
     }
+
+    await _scanAndConnect();
+    if (!_initCompleter.isCompleted) _initCompleter.complete();
+  }
+
+  Future<void> _loadSavedPorts() async {
+    final devices = await _configManager.getKnownDevices();
+    _savedPorts = {
+      for (final device in devices)
+        if (device['port'] is String)
+          device['port'] as String: device['baudRate'] as int?,
+    };
+    print('Saved device ports: $_savedPorts');
   }
 
-  void _checkDataTimeout() {
-    if (_lastDataReceived == null) return;
+  void _handlePortEvent(PortEvent event) {
+    if (event.added) {
+      print('Serial port plugged in: ${event.path}');
+      _rejectedPorts.remove(event.path);
+      _scanAndConnect(pluggedIn: event.path);
+      return;
+    }
 
-    final timeSinceLastData = DateTime.now().difference(_lastDataReceived!);
-    if (timeSinceLastData > DATA_TIMEOUT) {
-      print('Data timeout: ${timeSinceLastData.inSeconds}s since last data');
-      _handleDisconnection();
+    print('Serial port taken away: ${event.path}');
+    for (final connection in _connections.values.toList()) {
+      if (connection.portName == event.path) connection.close();
     }
   }
 
-  Stream<bool> get connectionState => _connectionStateController.stream;
-  bool get isConnected => _isConnected;
+  void _handlePortMonitorFailed() {
+    print('Polling for serial ports instead');
+    _startReconnectionTimer();
+  }
 
-  Future<void> _initializeConnection() async {
-    if (_isInitializing) return;
-    _isInitializing = true;
+  Future<void> _scanAndConnect({String? pluggedIn}) async {
+    if (_isDisposed) return;
+    if (_isScanning) {
+      // a port turned up part way through, it gets its own scan after this one
+      _rescanPending = true;
+      return;
+    }
+    _isScanning = true;
 
     try {
-      print('Starting serial port initialization...');
-
-      _lastKnownPort = await _configManager.getLastComPort();
-      print('Retrieved last known port from config: $_lastKnownPort');
-
-      if (_lastKnownPort != null) {
-        try {
-          print('Attempting to connect to last known port: $_lastKnownPort');
-          final port = SerialPort(_lastKnownPort!);
-
-          if (!port.openReadWrite()) {
-            print('Failed to open $_lastKnownPort for read/write');
-            _lastKnownPort = null;
-          } else {
-            try {
-              port.config = _portConfig;
-              await Future.delayed(const Duration(milliseconds: 100));
-              port.flush();
-            } catch (e) {
-              print('Error configuring port: $e');
-              _lastKnownPort = null;
-              if (port.isOpen) port.close();
-            }
-
-            if (_lastKnownPort != null) {
-              if (await _verifyDevice(port)) {
-                print('Device verified on port: $_lastKnownPort');
-                await _establishConnection(port);
-                _isInitializing = false;
-                if (!_initCompleter.isCompleted) _initCompleter.complete();
-                return;
-              } else {
-                print('Device verification failed on port: $_lastKnownPort');
-                if (port.isOpen) port.close();
-                _lastKnownPort = null;
-              }
-            }
-          }
-        } catch (e) {
-          print('Failed to reconnect to last known port: $e');
-          _lastKnownPort = null;
-        }
-      }
-
-      await _scanAndConnect();
+      do {
+        _rescanPending = false;
+        await _scanOnce(pluggedIn);
+        pluggedIn = null;
+      } while (_rescanPending);
     } catch (e) {
-      print('Error during initialization: $e');
-      _startReconnectionTimer();
+      print('Error during port scanning: $e');
     } finally {
-      _isInitializing = false;
-      if (!_initCompleter.isCompleted) _initCompleter.complete();
+      _isScanning = false;
+      _startReconnectionTimer();
     }
   }
 
-  Future<void> _scanAndConnect() async {
+  /// Probes every port without a device on it yet, each device found is
+  /// connected as soon as it answers rather than when the scan ends
+  Future<void> _scanOnce(String? pluggedIn) async {
     print('Starting device scan...');
-    final availablePorts = SerialPort.availablePorts;
-    print('Available ports: $availablePorts');
+    final candidates = _candidatePorts(pluggedIn);
+    print('Probing ports: ${candidates.likely}, then ${candidates.unlikely}');
 
-    if (availablePorts.isEmpty) {
-      print('No serial ports available');
-      _startReconnectionTimer();
+    if (candidates.likely.isEmpty && candidates.unlikely.isEmpty) {
+      print('No serial ports to probe');
       return;
     }
 
-    try {
-      await _cleanupExistingConnection();
+    final found = <Future<void>>[];
+    void connect(_ProbedDevice device) => found.add(_connect(device));
 
-      for (final portName in availablePorts) {
-        print('Attempting to connect to $portName...');
-        final result = await _attemptConnection(portName);
+    await _probePorts(candidates.likely, connect, headStart: true);
+    await _probePorts(candidates.unlikely, connect, rejectFailures: true);
+    await Future.wait(found);
 
-        if (result != null) {
-          _lastKnownPort = portName;
-          print('Found device on port: $_lastKnownPort');
+    if (found.isEmpty) print('No new MixLit device found');
+  }
 
-          await _configManager.saveLastComPort(portName);
+  /// Ports worth probing, best first. Ports on usb with an id the boards
+  /// don't use are left for a second round, and ports that aren't on usb
+  /// (onboard uarts) are only probed if they were a saved port or in
+  /// MIXLIT_PORT. Ports a device is already connected on are skipped.
+  ({List<String> likely, List<String> unlikely}) _candidatePorts(
+      String? pluggedIn) {
+    final available = SerialPort.availablePorts;
+    _rejectedPorts.retainAll(available);
+    _listedPorts = available.toSet();
+
+    final connected = {
+      for (final connection in _connections.values) connection.portName
+    };
+    final likely = <String>[];
+    final unlikely = <String>[];
+
+    for (final name in _overridePorts) {
+      if (!connected.contains(name) && !likely.contains(name)) likely.add(name);
+    }
 
-          await _establishConnection(result);
-          return;
-        }
+    for (final name in [
+      if (pluggedIn != null) pluggedIn,
+      ..._savedPorts.keys,
+      ...available,
+    ]) {
+      if (likely.contains(name) || unlikely.contains(name)) continue;
+      if (!available.contains(name) || connected.contains(name)) continue;
+
+      final usbId = _usbId(name);
+      if (usbId != null &&
+          SerialProtocol.isKnownUsbId(usbId >> 16, usbId & 0xFFFF)) {
+        likely.add(name);
+      } else if (_savedPorts.containsKey(name) || name == pluggedIn) {
+        // it has worked before, or was just plugged in
+        likely.add(name);
+      } else if (usbId != null && !_rejectedPorts.contains(name)) {
+        unlikely.add(name);
       }
+    }
 
-      print('No MixLit device found on any available port');
-      _startReconnectionTimer();
+    // the saved ports go first so they can have their head start
+    final saved = likely.where(_savedPorts.containsKey).toList();
+    return (
+      likely: [...saved, ...likely.where((name) => !saved.contains(name))],
+      unlikely: unlikely
+    );
+  }
+
+  // vendor id << 16 | product id, 0 for a usb port that didn't say, null if
+  // the port isn't on usb
+  static int? _usbId(String name) {
+    final port = SerialPort(name);
+    try {
+      if (port.transport != SerialPortTransport.usb) return null;
+      return ((port.vendorId ?? 0) << 16) | (port.productId ?? 0);
     } catch (e) {
-      print('Error during port scanning: $e');
-      _startReconnectionTimer();
+      return 0;
+    } finally {
+      port.dispose();
     }
   }
 
-  Future<bool> _verifyDevice(SerialPort port) async {
-    if (!port.isOpen) return false;
+  /// Probes every port at once, [onFound] is called for each that answers as
+  /// soon as it does. With [headStart] the saved ports at the front get a
+  /// moment on their own first. Completes once every probe has finished.
+  Future<void> _probePorts(
+      List<String> names, void Function(_ProbedDevice) onFound,
+      {bool headStart = false, bool rejectFailures = false}) async {
+    if (names.isEmpty) return;
+
+    final probes = <Future<void>>[];
+
+    Future<void> probe(String name) async {
+      final device = await _probe(name);
+      if (device == null) {
+        if (rejectFailures) _rejectedPorts.add(name);
+        return;
+      }
+      onFound(device);
+    }
+
+    final first = headStart
+        ? names.takeWhile(_savedPorts.containsKey).length
+        : names.length;
+    probes.addAll(names.take(first).map(probe));
+    if (first > 0 && first < names.length) {
+      await Future.any(
+          [Future.wait(probes), Future.delayed(SAVED_PORT_HEAD_START)]);
+    }
+    probes.addAll(names.skip(first).map(probe));
+
+    await Future.wait(probes);
+  }
 
-    final completer = Completer<bool>();
-    Timer? timeoutTimer;
-    SerialPortReader? verificationReader;
+  /// Opens [name] and asks for a handshake until something answers.
+  /// Alternates with the saved rate on a saved port, a device that wasn't
+  /// reset when it opened is still at the rate it was moved to last time.
+  Future<_ProbedDevice?> _probe(String name) async {
+    final port = SerialPort(name);
+    SerialPortReader? reader;
     StreamSubscription? subscription;
-    bool receivedInitialData = false;
+    _ProbedDevice? device;
 
     try {
-      print('Verifying device on port ${port.name}...');
+      if (!port.openReadWrite()) {
+        print('Failed to open $name for read/write');
+        return null;
+      }
+
+      final savedBaudRate = _savedPorts[name];
+      final baudRates = [
+        SerialProtocol.DEFAULT_BAUD_RATE,
+        if (savedBaudRate != null &&
+            savedBaudRate != SerialProtocol.DEFAULT_BAUD_RATE)
+          savedBaudRate,
+      ];
+
+      var baudRate = baudRates.first;
+      port.config = SerialDeviceConnection.createPortConfig(baudRate);
       port.flush();
-      await Future.delayed(const Duration(milliseconds: 50));
 
-      verificationReader = SerialPortReader(port);
+      String? handshake;
+      var handshakeBaudRate = baudRate;
+      Map<int, int>? values;
+      final answered = Completer<void>();
+      final valuesReceived = Completer<void>();
 
-      subscription = verificationReader.stream.listen(
+      reader = SerialPortReader(port);
+      subscription = reader.stream.listen(
         (data) {
-          try {
-            final response = String.fromCharCodes(data).trim();
-            print('Received verification response: "$response"');
-
-            // Check for device identifier
-            if (response.contains(DEVICE_IDENTIFIER) &&
-                !completer.isCompleted) {
-              print('Device identified as a MixLit - yippee!');
-              completer.complete(true);
-              return;
+          final response = String.fromCharCodes(data).trim();
+          if (handshake == null) {
+            if (response.contains(DEVICE_IDENTIFIER)) {
+              print('Device on $name identified as a MixLit - yippee!');
+              handshake = response;
+              handshakeBaudRate = baudRate;
+              if (!answered.isCompleted) answered.complete();
             }
+            return;
+          }
 
-            if (response.contains('|') && !receivedInitialData) {
-              receivedInitialData = true;
-              print('Received initial data during verification: $response');
-
-              if (_awaitingInitialValues) {
-                final parsedData = _parseSliderData(response);
-                if (parsedData.isNotEmpty &&
-                    !_initialValuesCompleter.isCompleted) {
-                  _initialValuesCompleter.complete(parsedData);
-                  _initialValuesTimeout?.cancel();
-                  _awaitingInitialValues = false;
-                }
-              }
-            }
-          } catch (e) {
-            print('Error processing verification data: $e');
+          if (values == null && response.contains('|')) {
+            values = SerialDeviceConnection.parseSliderData(response);
+            if (!valuesReceived.isCompleted) valuesReceived.complete();
           }
         },
         onError: (error) {
-          print('Verification stream error: $error');
-          if (!completer.isCompleted) completer.complete(false);
+          print('Probe stream error on $name: $error');
+          if (!answered.isCompleted) answered.complete();
         },
         cancelOnError: false,
       );
 
-      for (var i = 0; i < 3 && !completer.isCompleted; i++) {
-        print('Sending verification request attempt ${i + 1}...');
+      final stopwatch = Stopwatch()..start();
+      for (var attempt = 0;
+          !answered.isCompleted &&
+              !_isDisposed &&
+              stopwatch.elapsed < PROBE_TIMEOUT;
+          attempt++) {
+        final nextBaudRate = baudRates[attempt % baudRates.length];
+        if (nextBaudRate != baudRate) {
+          baudRate = nextBaudRate;
+          port.config = SerialDeviceConnection.createPortConfig(baudRate);
+        }
+
         port.write(DEVICE_IDENTIFICATION_REQUEST);
         port.flush();
-        await Future.delayed(const Duration(milliseconds: 200));
+        await Future.any([answered.future, Future.delayed(PROBE_INTERVAL)]);
       }
 
-      timeoutTimer = Timer(const Duration(milliseconds: 2000), () {
-        if (!completer.isCompleted) {
-          print('Verification timed out');
-          completer.complete(false);
-        }
-      });
+      if (handshake == null || _isDisposed) return null;
 
-      final result = await completer.future;
-      print('Verification result: ${result ? "success" : "failed"}');
-      return result;
+      await Future.any(
+          [valuesReceived.future, Future.delayed(PROBE_VALUES_WAIT)]);
+      device = _ProbedDevice(port, handshake!, handshakeBaudRate, values);
+      return device;
     } catch (e) {
-      print('Exception during verification: $e');
-      return false;
+      print('Error probing $name: $e');
+      return null;
     } finally {
-      timeoutTimer?.cancel();
       await subscription?.cancel();
-      await verificationReader?.dispose();
+      await reader?.dispose();
+      if (device == null) _ProbedDevice.closePort(port);
     }
   }
 
-  Map<int, int> _parseSliderData(String data) {
-    final Map<int, int> sliderData = {};
-
-    try {
-      final parts = data.split('|');
-
-      for (var i = 0; i < parts.length - 1; i += 2) {
-        if (parts[i].isEmpty || parts[i + 1].isEmpty) continue;
-
-        try {
-          final sliderId = int.parse(parts[i].trim());
-          final sliderValue = int.parse(parts[i + 1].trim());
-
-          if (sliderId >= 0 && sliderId <= 4) {
-            sliderData[sliderId] = sliderValue;
-          }
-        } catch (e) {
-          continue;
-        }
-      }
-    } catch (e) {
-      print('Error parsing slider data: $e');
-    }
-
-    return sliderData;
-  }
-
-  Future<void> _setupPortReader() async {
-    if (_port == null || !_port!.isOpen) {
-      print('Port not ready for reader setup');
+  Future<void> _connect(_ProbedDevice device) async {
+    final name = device.port.name ?? '';
+    print('Found device on port: $name');
+
+    // firmware from before device ids is told apart by its port
+    final deviceId = SerialProtocol.deviceIdFromHandshake(device.handshake) ??
+        'port:$name';
+    print(
+        'Device $deviceId protocol version: ${SerialProtocol.protocolVersionFromHandshake(device.handshake)}, free RAM: ${SerialProtocol.freeRamFromHandshake(device.handshake) ?? "unknown"} bytes, max baud rate: ${SerialProtocol.maxBaudRateFromHandshake(device.handshake)}');
+
+    // ConfigManager hands slots out one at a time
+    final slot = await _configManager.deviceSlot(deviceId);
+    if (slot == null || _connections.containsKey(slot) || _isDisposed) {
+      print(slot == null
+          ? 'No slot left for device $deviceId'
+          : 'Device $deviceId is already connected');
+      device.close();
       return;
     }
 
-    await _readerSubscription?.cancel();
-    await _reader?.dispose();
-
-    try {
-      _reader = SerialPortReader(_port!);
-
-      _readerSubscription = _reader!.stream.listen(
-        (data) {
-          _lastDataReceived = DateTime.now();
-          _connectionHealthCheckFailures = 0;
-
-          if (_awaitingInitialValues) {
-            final response = String.fromCharCodes(data).trim();
-            if (response.contains('|')) {
-              final parsedData = _parseSliderData(response);
-              if (parsedData.isNotEmpty &&
-                  !_initialValuesCompleter.isCompleted) {
-                print('Received initial hardware values: $parsedData');
-                _initialValuesCompleter.complete(parsedData);
-                _initialValuesTimeout?.cancel();
-                _awaitingInitialValues = false;
-
-                if (onInitialHardwareValues != null) {
-                  onInitialHardwareValues!(parsedData);
-                }
-                return;
-              }
-            }
-          }
-
-          onDataReceived(data);
-        },
-        onError: (error) {
-          print('Reader error (disconnection detected): $error');
-          onError(error);
-          _handleDisconnection();
-        },
-        cancelOnError: false,
-      );
+    final connection = SerialDeviceConnection(
+      device.port,
+      slot: slot,
+      deviceId: deviceId,
+      handshake: device.handshake,
+      onDataReceived: (connection, data) =>
+          onDataReceived(connection.slot, data),
+      onError: onError,
+      onInitialHardwareValues: (connection, values) =>
+          onInitialHardwareValues?.call(connection.slot, values),
+      onDisconnected: _handleDisconnection,
+      isPortListed: _isPortListed,
+    );
+    _connections[slot] = connection;
 
-      print('Port reader setup complete');
-    } catch (e, stack) {
-      print('Error setting up port reader: $e');
-      print('Stack trace: $stack');
-      rethrow;
+    if (!await connection.start(
+        baudRate: device.baudRate,
+        savedBaudRate: _savedPorts[name],
+        initialValues: device.values)) {
+      if (_connections[slot] == connection) _connections.remove(slot);
+      return;
     }
-  }
-
-  Future<void> _handleDisconnection({bool notify = true}) async {
-    if (_isInitializing) return;
-
-    final wasConnected = _isConnected;
-    _isConnected = false;
-    _isInitializing = true;
+    _savedPorts[name] = connection.baudRate;
 
-    _connectionHealthCheckTimer?.cancel();
-    _initialValuesTimeout?.cancel();
-
-    if (_awaitingInitialValues && !_initialValuesCompleter.isCompleted) {
-      _initialValuesCompleter.complete(null);
-      _awaitingInitialValues = false;
+    if (LatencyTracer.enabled && connection == _tracedConnection) {
+      await setLatencyTracing(true);
     }
 
-    try {
-      if (_readerSubscription != null) {
-        await _readerSubscription?.cancel();
-        _readerSubscription = null;
-      }
+    onDeviceStateChanged?.call(slot, true);
+    _connectionStateController.add(true);
+  }
 
-      if (_reader != null) {
-        await _reader!.dispose();
-        _reader = null;
-      }
+  void _handleDisconnection(SerialDeviceConnection connection) {
+    if (_connections[connection.slot] != connection) return;
+    _connections.remove(connection.slot);
 
-      if (_port?.isOpen ?? false) {
-        try {
-          _port!.flush();
-          _port!.close();
-        } catch (e) {
-          print('Error closing port: $e');
-        }
-      }
-      _port = null;
+    onDeviceStateChanged?.call(connection.slot, false);
+    _connectionStateController.add(isConnected);
+    if (_isDisposed) return;
 
-      await Future.delayed(const Duration(milliseconds: 500));
-    } catch (e) {
-      print('Error during disconnection cleanup: $e');
-    } finally {
-      _isInitializing = false;
-
-      if (wasConnected && notify) {
-        _connectionStateController.add(false);
-        print('Device disconnected, starting continuous port scanning...');
-        Timer(const Duration(seconds: 1), () {
-          _startReconnectionTimer();
-        });
-      }
-    }
+    print('Device in slot ${connection.slot} disconnected, scanning again...');
+    Timer(const Duration(seconds: 1), () {
+      // it may have gone for some reason other than being unplugged
+      _listedPorts.remove(connection.portName);
+      _scanAndConnect();
+    });
   }
 
   Future<void> dispose() async {
     print('Disposing SerialConnectionManager...');
+    _isDisposed = true;
+    await _portMonitor.stop();
     _reconnectTimer?.cancel();
-    _connectionHealthCheckTimer?.cancel();
-    _initialValuesTimeout?.cancel();
 
-    if (_awaitingInitialValues && !_initialValuesCompleter.isCompleted) {
-      _initialValuesCompleter.complete(null);
+    for (final connection in _connections.values.toList()) {
+      await connection.close();
     }
-
-    await _handleDisconnection();
-    await _readerSubscription?.cancel();
-    await _reader?.dispose();
     print('SerialConnectionManager disposal complete');
   }
 
-  Future<void> _cleanupExistingConnection() async {
-    try {
-      await _handleDisconnection(notify: false);
-      await Future.delayed(const Duration(milliseconds: 100));
-    } catch (e) {
-      print('Error cleaning up existing connection: $e');
-    }
-  }
-
-  Future<SerialPort?> _attemptConnection(String portName) async {
-    SerialPort? port;
-    bool verificationSuccess = false;
-
-    try {
-      port = SerialPort(portName);
-
-      if (port.isOpen) {
-        port.close();
-        await Future.delayed(const Duration(milliseconds: 100));
-      }
-
-      if (!port.openReadWrite()) {
-        print('Failed to open $portName for read/write');
-        return null;
-      }
-
-      try {
-        port.config = _portConfig;
-        await Future.delayed(const Duration(milliseconds: 100));
-        port.flush();
-      } catch (e) {
-        print('Error configuring port: $e');
-        return null;
-      }
-
-      verificationSuccess = await _verifyDevice(port);
-      return verificationSuccess ? port : null;
-    } catch (e) {
-      print('Error during connection attempt: $e');
-      return null;
-    } finally {
-      if (port != null && port.isOpen && !verificationSuccess) {
-        try {
-          port.close();
-        } catch (e) {
-          print('Error closing port: $e');
-        }
-      }
+  void _startReconnectionTimer() {
+    _reconnectTimer?.cancel();
+    if (_isDisposed) return;
+    if (_portMonitor.isActive) {
+      // nothing to poll for, the next port plugged in starts a scan
+      print('Waiting for a serial port to be plugged in...');
+      return;
     }
-  }
 
-  void _startReconnectionTimer() {
     print('Starting reconnection timer...');
-    _reconnectTimer?.cancel();
     _reconnectTimer = Timer.periodic(
       const Duration(seconds: 2),
       (_) async {
-        if (!_isConnected && !_isInitializing) {
-          await _scanAndConnect();
+        if (_isScanning) return;
+
+        // with a device connected, opening the other ports again would reset
+        // them, so only ports that have turned up since are worth a look
+        final available = SerialPort.availablePorts;
+        if (isConnected && available.every(_listedPorts.contains)) {
+          _listedPorts = available.toSet();
+          return;
         }
+        await _scanAndConnect();
       },
     );
   }
+}
 
-  Future<void> _establishConnection(SerialPort port) async {
-    if (_isConnected) return;
-
-    try {
-      await _cleanupExistingConnection();
-
-      _port = port;
-
-      try {
-        _port!.config = _portConfig;
-        await Future.delayed(const Duration(milliseconds: 100));
-      } catch (e) {
-        print('Error configuring port during establishment: $e');
-        throw e;
-      }
-
-      await _setupPortReader();
-
-      _isConnected = true;
-      _connectionStateController.add(true);
-
-      _reconnectTimer?.cancel();
-
-      _connectionHealthCheckFailures = 0;
-      _lastDataReceived = DateTime.now();
-      _startConnectionHealthCheck();
-
-      print('Connection established successfully on port: ${port.name}');
-
-      _lastKnownPort = port.name;
-      await _configManager.saveLastComPort(_lastKnownPort!);
+class _ProbedDevice {
+  final SerialPort port;
+  final String handshake;
+  final int baudRate;
+  final Map<int, int>? values;
 
-      Future.delayed(const Duration(milliseconds: 500), () {
-        getInitialHardwareValues();
-      });
-    } catch (e) {
-      print('Error establishing connection: $e');
-      _isConnected = false;
-      await _handleDisconnection(notify: false);
-    }
-  }
+  _ProbedDevice(this.port, this.handshake, this.baudRate, this.values);
 
-  Future<bool> writeToPort(List<int> data) async {
-    if (!isConnected || _port == null || !_port!.isOpen) {
-      print('Cannot write to port: Not connected');
-      return false;
-    }
+  void close() => closePort(port);
 
+  static void closePort(SerialPort port) {
     try {
-      _port!.write(Uint8List.fromList(data));
-      _port!.flush();
-
-      _connectionHealthCheckFailures = 0;
-      _lastSuccessfulWrite = DateTime.now();
-
-      return true;
+      if (port.isOpen) port.close();
+      port.dispose();
     } catch (e) {
-      print('Error writing to port (disconnection detected): $e');
-      await _handleDisconnection();
-      return false;
+      print('Error closing port: $e');
     }
   }
 }
@@ -0,0 +1,652 @@
+import 'dart:async';
+import 'dart:typed_data';
+
+import 'package:flutter_libserialport/flutter_libserialport.dart'
+    show SerialPort, SerialPortConfig, SerialPortParity;
+import 'package:mixlit/backend/application/data/ConfigManager.dart';
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
+import 'package:mixlit/backend/application/serial/SerialPortReader.dart'
+    show SerialPortReader;
+import 'package:mixlit/backend/application/util/LatencyTracer.dart';
+
+/// The connection to a single MixLit, from the handshake that identified it
+/// until its port goes away. Every device has its own port,
+/// reader isolate, baud rate and health check, so one that is slow or
+/// failing doesn't hold up the others.
+class SerialDeviceConnection {
+  static Uint8List DEVICE_IDENTIFICATION_REQUEST =
+      Uint8List.fromList('?\n'.codeUnits);
+
+  static const int MAX_CONNECTION_HEALTH_FAILURES = 3;
+  static const Duration DATA_TIMEOUT = Duration(seconds: 30);
+  static const int MAX_CONSECUTIVE_FRAME_ERRORS = 5;
+  static const Duration BAUD_RATE_REPLY_TIMEOUT = Duration(milliseconds: 200);
+
+  /// Where this device's sliders start, see SliderAddress
+  final int slot;
+
+  /// From the handshake, or made up from the port for older firmware
+  final String deviceId;
+
+  SerialPort? _port;
+  final String portName;
+  SerialPortReader? _reader;
+  StreamSubscription? _readerSubscription;
+  bool _isConnected = false;
+  bool _isClosing = false;
+
+  Timer? _connectionHealthCheckTimer;
+  int _connectionHealthCheckFailures = 0;
+
+  DateTime? _lastDataReceived;
+  DateTime? _lastSuccessfulWrite;
+
+  bool _awaitingInitialValues = false;
+  Completer<Map<int, int>?> _initialValuesCompleter =
+      Completer<Map<int, int>?>();
+  Timer? _initialValuesTimeout;
+
+  // binary frames are negotiated after every handshake, ascii is the fallback
+  int _protocolVersion;
+  int? _stateHash;
+  bool _binaryProtocolActive = false;
+  bool _binaryProtocolFailed = false;
+  int _consecutiveFrameErrors = 0;
+
+  // every connection starts at the default rate and moves to the fastest one
+  // both sides manage, stepping down again if frames start failing
+  int _baudRate = SerialProtocol.DEFAULT_BAUD_RATE;
+  final int _deviceMaxBaudRate;
+  bool _isNegotiatingBaudRate = false;
+  Completer<String>? _baudRateReply;
+  Completer<String>? _baudRateHandshake;
+
+  /// Only one device at a time timestamps its frames, LatencyTracer follows
+  /// a single link
+  bool tracesLatency = false;
+
+  final void Function(SerialDeviceConnection, List<int>) onDataReceived;
+  final void Function(dynamic) onError;
+  final void Function(SerialDeviceConnection, Map<int, int>)?
+      onInitialHardwareValues;
+
+  /// Called once, when the port has gone
+  final void Function(SerialDeviceConnection) onDisconnected;
+
+  /// Whether the system still lists [portName]
+  final bool Function(String) isPortListed;
+
+  final ConfigManager _configManager = ConfigManager.instance;
+
+  SerialDeviceConnection(
+    SerialPort port, {
+    required this.slot,
+    required this.deviceId,
+    required String handshake,
+    required this.onDataReceived,
+    required this.onError,
+    required this.onDisconnected,
+    required this.isPortListed,
+    this.onInitialHardwareValues,
+  })  : _port = port,
+        portName = port.name ?? '',
+        _protocolVersion =
+            SerialProtocol.protocolVersionFromHandshake(handshake),
+        _stateHash = SerialProtocol.stateHashFromHandshake(handshake),
+        _deviceMaxBaudRate =
+            SerialProtocol.maxBaudRateFromHandshake(handshake);
+
+  static SerialPortConfig createPortConfig(int baudRate) => SerialPortConfig()
+    ..baudRate = baudRate
+    ..bits = 8
+    ..parity = SerialPortParity.none
+    ..stopBits = 1
+    ..xonXoff = 0
+    ..rts = 1
+    ..cts = 0
+    ..dsr = 0
+    ..dtr = 1;
+
+  void _configurePort(SerialPort port, int baudRate) {
+    port.config = createPortConfig(baudRate);
+    _baudRate = baudRate;
+  }
+
+  bool get isConnected => _isConnected;
+  int get protocolVersion => _protocolVersion;
+
+  /// The led state the device reported at its last handshake, null if it
+  /// doesn't keep one
+  int? get stateHash => _stateHash;
+  int get baudRate => _baudRate;
+
+  /// Timeline.now when the read that brought in the data being handed to
+  /// onDataReceived returned
+  int get lastReadAt => _reader?.lastReadAt ?? 0;
+
+  bool get supportsLatencyTrace =>
+      _protocolVersion >= SerialProtocol.PROTOCOL_VERSION_LATENCY_TRACE;
+
+  /// Takes over the port the device answered on, at the rate it answered at.
+  /// [initialValues] are the faders from its handshake. Returns false if the
+  /// port was lost on the way.
+  Future<bool> start(
+      {required int baudRate,
+      int? savedBaudRate,
+      Map<int, int>? initialValues}) async {
+    // the faders came with the handshake, so they go out straight away rather
+    // than waiting behind the baud rate negotiation
+    final hasInitialValues = initialValues != null && initialValues.isNotEmpty;
+    if (hasInitialValues) onInitialHardwareValues?.call(this, initialValues!);
+
+    try {
+      _configurePort(_port!, baudRate);
+      await _setupPortReader();
+
+      _isConnected = true;
+
+      // the saved rate goes first, it is the one that worked last time
+      final baudRates = [
+        if (savedBaudRate != null &&
+            SerialProtocol.SUPPORTED_BAUD_RATES.contains(savedBaudRate))
+          savedBaudRate,
+        ...SerialProtocol.SUPPORTED_BAUD_RATES
+            .where((rate) => rate != savedBaudRate),
+      ];
+      await _negotiateBaudRate(baudRates);
+      if (_port == null) throw 'Port lost while negotiating the baud rate';
+
+      _connectionHealthCheckFailures = 0;
+      _lastDataReceived = DateTime.now();
+      _startConnectionHealthCheck();
+
+      print('Device $deviceId connected on $portName in slot $slot');
+
+      if (!hasInitialValues) {
+        Future.delayed(const Duration(milliseconds: 500), () {
+          getInitialHardwareValues();
+        });
+      }
+      return true;
+    } catch (e) {
+      print('Error establishing connection to $deviceId: $e');
+      await close(notify: false);
+      return false;
+    }
+  }
+
+  Future<Map<int, int>?> getInitialHardwareValues() async {
+    if (!_isConnected || _port == null) {
+      print('Cannot get hardware values: not connected');
+      return null;
+    }
+
+    if (_awaitingInitialValues) {
+      print('Already waiting for initial values');
+      return await _initialValuesCompleter.future;
+    }
+
+    _awaitingInitialValues = true;
+    if (_initialValuesCompleter.isCompleted) {
+      _initialValuesCompleter = Completer<Map<int, int>?>();
+    }
+    print('Requesting initial hardware values from $deviceId...');
+
+    try {
+      _port!.write(DEVICE_IDENTIFICATION_REQUEST);
+      _port!.flush();
+
+      _initialValuesTimeout = Timer(const Duration(seconds: 3), () {
+        if (!_initialValuesCompleter.isCompleted) {
+          print('Timeout waiting for initial hardware values');
+          _initialValuesCompleter.complete(null);
+        }
+        _awaitingInitialValues = false;
+      });
+
+      final result = await _initialValuesCompleter.future;
+      print('Received initial hardware values: $result');
+      return result;
+    } catch (e) {
+      print('Error getting initial hardware values: $e');
+      _awaitingInitialValues = false;
+      return null;
+    }
+  }
+
+  void _startConnectionHealthCheck() {
+    _connectionHealthCheckTimer?.cancel();
+
+    _connectionHealthCheckTimer = Timer.periodic(
+        const Duration(seconds: 2), (_) => _checkConnectionHealth());
+  }
+
+  Future<void> _checkConnectionHealth() async {
+    if (_isClosing || !_isConnected || _port == null) {
+      return;
+    }
+
+    try {
+      //port still exists on system?
+      if (!isPortListed(portName)) {
+        print('Port $portName no longer available in system');
+        await close();
+        return;
+      }
+
+      //port handle is still open?
+      if (!_port!.isOpen) {
+        print('Port handle is no longer open');
+        await close();
+        return;
+      }
+
+      //port writable?
+      final healthCheckSuccessful = await _performDeviceHealthCheck();
+
+      if (!healthCheckSuccessful) {
+        _connectionHealthCheckFailures++;
+        print(
+            'Health check failed on $portName (${_connectionHealthCheckFailures}/${MAX_CONNECTION_HEALTH_FAILURES})');
+
+        if (_connectionHealthCheckFailures >= MAX_CONNECTION_HEALTH_FAILURES) {
+          print(
+              'Device health check failed multiple times. Triggering disconnection.');
+          await close();
+        }
+      } else {
+        _connectionHealthCheckFailures = 0;
+      }
+
+      //data timeout
+    } catch (e) {
+      print('Connection health check error: $e');
+      _connectionHealthCheckFailures++;
+
+      if (_connectionHealthCheckFailures >= MAX_CONNECTION_HEALTH_FAILURES) {
+        await close();
+      }
+    }
+  }
+
+  Future<bool> _performDeviceHealthCheck() async {
+    if (_port == null || !_port!.isOpen) return false;
+
+    try {
+      _port!.write(Uint8List.fromList([]));
+      _port!.flush();
+      _lastSuccessfulWrite = DateTime.now();
+      return true;
+    } catch (writeError) {
+      print('Write test failed: $writeError');
+      return false;
+    }
+  }
+
+  void _checkDataTimeout() {
+    if (_lastDataReceived == null) return;
+
+    final timeSinceLastData = DateTime.now().difference(_lastDataReceived!);
+    if (timeSinceLastData > DATA_TIMEOUT) {
+      print('Data timeout: ${timeSinceLastData.inSeconds}s since last data');
+      close();
+    }
+  }
+
+  /// Turns the device's frame timestamps on or off, they are turned on again
+  /// after every handshake while [tracesLatency] is set
+  Future<bool> setLatencyTracing(bool enabled) async {
+    if (!_binaryProtocolActive || !supportsLatencyTrace) return false;
+
+    final sent = await writeToPort((enabled
+            ? SerialProtocol.LATENCY_TRACE_ON_COMMAND
+            : SerialProtocol.LATENCY_TRACE_OFF_COMMAND)
+        .codeUnits);
+    if (sent && enabled) LatencyTracer.instance.restartLink(_baudRate);
+    return sent;
+  }
+
+  static Map<int, int> parseSliderData(String data) {
+    final Map<int, int> sliderData = {};
+
+    try {
+      final parts = data.split('|');
+
+      for (var i = 0; i < parts.length - 1; i += 2) {
+        if (parts[i].isEmpty || parts[i + 1].isEmpty) continue;
+
+        try {
+          final sliderId = int.parse(parts[i].trim());
+          final sliderValue = int.parse(parts[i + 1].trim());
+
+          if (sliderId >= 0 && sliderId <= 4) {
+            sliderData[sliderId] = sliderValue;
+          }
+        } catch (e) {
+          continue;
+        }
+      }
+    } catch (e) {
+      print('Error parsing slider data: $e');
+    }
+
+    return sliderData;
+  }
+
+  Future<void> _setupPortReader() async {
+    if (_port == null || !_port!.isOpen) {
+      print('Port not ready for reader setup');
+      return;
+    }
+
+    await _readerSubscription?.cancel();
+    await _reader?.dispose();
+
+    try {
+      _reader = SerialPortReader(_port!, onFrameError: _handleFrameError);
+
+      _readerSubscription = _reader!.stream.listen(
+        (data) {
+          _lastDataReceived = DateTime.now();
+          _connectionHealthCheckFailures = 0;
+
+          if (SerialProtocol.isFrame(data)) {
+            _consecutiveFrameErrors = 0;
+            onDataReceived(this, data);
+            return;
+          }
+
+          final response = String.fromCharCodes(data).trim();
+          if (response.startsWith(SerialProtocol.BAUD_RATE_REPLY)) {
+            if (_baudRateReply != null && !_baudRateReply!.isCompleted) {
+              _baudRateReply!.complete(response);
+            }
+            return;
+          }
+
+          if (response.contains(SerialProtocol.DEVICE_IDENTIFIER)) {
+            _handleHandshake(response);
+            return;
+          }
+
+          if (_awaitingInitialValues) {
+            if (response.contains('|')) {
+              final parsedData = parseSliderData(response);
+              if (parsedData.isNotEmpty &&
+                  !_initialValuesCompleter.isCompleted) {
+                print('Received initial hardware values: $parsedData');
+                _initialValuesCompleter.complete(parsedData);
+                _initialValuesTimeout?.cancel();
+                _awaitingInitialValues = false;
+
+                if (onInitialHardwareValues != null) {
+                  onInitialHardwareValues!(this, parsedData);
+                }
+                return;
+              }
+            }
+          }
+
+          onDataReceived(this, data);
+        },
+        onError: (error) {
+          print('Reader error on $portName (disconnection detected): $error');
+          onError(error);
+          close();
+        },
+        cancelOnError: false,
+      );
+
+      print('Port reader setup complete');
+    } catch (e, stack) {
+      print('Error setting up port reader: $e');
+      print('Stack trace: $stack');
+      rethrow;
+    }
+  }
+
+  void _handleHandshake(String response) {
+    // the device drops back to ascii on every handshake
+    _protocolVersion = SerialProtocol.protocolVersionFromHandshake(response);
+    _stateHash = SerialProtocol.stateHashFromHandshake(response);
+    _binaryProtocolActive = false;
+    _consecutiveFrameErrors = 0;
+
+    // a handshake at a new baud rate confirms it, the protocol is picked once
+    // the negotiation is over
+    if (_isNegotiatingBaudRate) {
+      if (_baudRateHandshake != null && !_baudRateHandshake!.isCompleted) {
+        _baudRateHandshake!.complete(response);
+      }
+      return;
+    }
+
+    if (_protocolVersion >= SerialProtocol.PROTOCOL_VERSION_BINARY &&
+        !_binaryProtocolFailed) {
+      _selectProtocol(binary: true);
+    }
+  }
+
+  void _handleFrameError() {
+    _consecutiveFrameErrors++;
+    if (tracesLatency && LatencyTracer.enabled) {
+      LatencyTracer.instance.frameError();
+    }
+
+    if (!_binaryProtocolActive ||
+        _isNegotiatingBaudRate ||
+        _consecutiveFrameErrors < MAX_CONSECUTIVE_FRAME_ERRORS) {
+      return;
+    }
+
+    if (_baudRate > SerialProtocol.DEFAULT_BAUD_RATE) {
+      print(
+          'Binary frames failed crc $_consecutiveFrameErrors times in a row at $_baudRate baud on $portName, stepping down');
+      _consecutiveFrameErrors = 0;
+      _negotiateBaudRate(SerialProtocol.SUPPORTED_BAUD_RATES
+          .where((rate) => rate < _baudRate)
+          .toList());
+    } else {
+      print(
+          'Binary frames failed crc $_consecutiveFrameErrors times in a row on $portName, falling back to ascii');
+      _binaryProtocolFailed = true;
+      _selectProtocol(binary: false);
+    }
+  }
+
+  /// Moves the device to the first of [baudRates] that works, each one has to
+  /// be acknowledged at the old rate and then answer a handshake at the new one
+  Future<void> _negotiateBaudRate(List<int> baudRates) async {
+    if (_isNegotiatingBaudRate || _port == null) return;
+    _isNegotiatingBaudRate = true;
+
+    try {
+      for (final baudRate in baudRates) {
+        if (baudRate > _deviceMaxBaudRate) continue;
+        if (baudRate == _baudRate) break;
+
+        if (baudRate == SerialProtocol.DEFAULT_BAUD_RATE) {
+          // asking for the default is how the device is moved back to it
+          await _switchBaudRate(baudRate);
+          break;
+        }
+
+        if (await _switchBaudRate(baudRate)) break;
+        if (_port == null) return;
+      }
+
+      print('Serial link to $deviceId running at $_baudRate baud');
+      await _configManager.saveDevicePort(deviceId, portName, _baudRate);
+    } catch (e) {
+      print('Error negotiating baud rate: $e');
+    } finally {
+      _isNegotiatingBaudRate = false;
+    }
+
+    if (_protocolVersion >= SerialProtocol.PROTOCOL_VERSION_BINARY &&
+        !_binaryProtocolFailed &&
+        !_binaryProtocolActive) {
+      await _selectProtocol(binary: true);
+    }
+  }
+
+  Future<bool> _switchBaudRate(int baudRate) async {
+    print('Switching $portName to $baudRate baud...');
+
+    _baudRateReply = Completer<String>();
+    _writeCommand(SerialProtocol.selectBaudRateCommand(baudRate));
+    final reply = await _baudRateReply!.future
+        .timeout(BAUD_RATE_REPLY_TIMEOUT, onTimeout: () => '');
+    _baudRateReply = null;
+    if (_port == null) return false;
+
+    final acceptedBaudRate = SerialProtocol.baudRateFromReply(reply);
+    if (acceptedBaudRate == 0) {
+      print('Device refused $baudRate baud');
+      return false;
+    }
+
+    if (acceptedBaudRate == baudRate) {
+      _baudRateHandshake = Completer<String>();
+      _configurePort(_port!, baudRate);
+
+      for (var i = 0; i < 3 && !_baudRateHandshake!.isCompleted; i++) {
+        _writeCommand('?');
+        await Future.any([
+          _baudRateHandshake!.future,
+          Future.delayed(const Duration(milliseconds: 200)),
+        ]);
+      }
+
+      final confirmed = _baudRateHandshake!.isCompleted;
+      _baudRateHandshake = null;
+
+      if (confirmed) {
+        print('Switched to $baudRate baud');
+        return true;
+      }
+    }
+
+    // whatever state the device was left in, it ends up back at the default
+    // once its confirm timeout passes
+    print('No answer at $baudRate baud, reverting to the default');
+    if (_port == null) return false;
+    _configurePort(_port!, SerialProtocol.DEFAULT_BAUD_RATE);
+    await Future.delayed(const Duration(
+        milliseconds: SerialProtocol.BAUD_CONFIRM_TIMEOUT_MS + 200));
+    _port?.flush();
+    return false;
+  }
+
+  // goes around writeToPort, which is closed to everything else while the
+  // baud rate is changing
+  void _writeCommand(String command) {
+    _port?.write(Uint8List.fromList(command.codeUnits));
+    _port?.flush();
+  }
+
+  Future<void> _selectProtocol({required bool binary}) async {
+    final command = binary
+        ? SerialProtocol.SELECT_BINARY_COMMAND
+        : SerialProtocol.SELECT_ASCII_COMMAND;
+
+    if (await writeToPort(command.codeUnits)) {
+      _binaryProtocolActive = binary;
+      _consecutiveFrameErrors = 0;
+      print('Selected ${binary ? "binary" : "ascii"} serial protocol');
+
+      if (binary && tracesLatency && LatencyTracer.enabled) {
+        await setLatencyTracing(true);
+      }
+      await _enableButtonEvents();
+    }
+  }
+
+  /// The firmware times the buttons itself from PROTOCOL_VERSION_BUTTON_EVENTS,
+  /// a handshake puts it back to sending their state with its own timings
+  Future<void> _enableButtonEvents() async {
+    if (_protocolVersion < SerialProtocol.PROTOCOL_VERSION_BUTTON_EVENTS) {
+      return;
+    }
+
+    await writeToPort(SerialProtocol.buttonTimingsCommand(
+            SerialProtocol.BUTTON_DEBOUNCE_MS,
+            SerialProtocol.BUTTON_LONG_PRESS_MS,
+            SerialProtocol.BUTTON_DOUBLE_CLICK_MS,
+            SerialProtocol.BUTTON_REPEAT_MS)
+        .codeUnits);
+    await writeToPort(SerialProtocol.BUTTON_EVENTS_ON_COMMAND.codeUnits);
+  }
+
+  /// Closes the port, [onDisconnected] is called unless [notify] is false
+  Future<void> close({bool notify = true}) async {
+    if (_isClosing) return;
+    _isClosing = true;
+
+    final wasConnected = _isConnected;
+    _isConnected = false;
+
+    _binaryProtocolActive = false;
+    _consecutiveFrameErrors = 0;
+
+    _connectionHealthCheckTimer?.cancel();
+    _initialValuesTimeout?.cancel();
+
+    if (_awaitingInitialValues && !_initialValuesCompleter.isCompleted) {
+      _initialValuesCompleter.complete(null);
+      _awaitingInitialValues = false;
+    }
+
+    try {
+      await _readerSubscription?.cancel();
+      _readerSubscription = null;
+
+      await _reader?.dispose();
+      _reader = null;
+
+      if (_port?.isOpen ?? false) {
+        try {
+          _port!.flush();
+          _port!.close();
+        } catch (e) {
+          print('Error closing port: $e');
+        }
+      }
+      _port?.dispose();
+      _port = null;
+    } catch (e) {
+      print('Error during disconnection cleanup: $e');
+    }
+
+    if (wasConnected && notify) {
+      print('Device $deviceId on $portName disconnected');
+      onDisconnected(this);
+    }
+  }
+
+  Future<bool> writeToPort(List<int> data) async {
+    if (!_isConnected || _port == null || !_port!.isOpen) {
+      print('Cannot write to port: Not connected');
+      return false;
+    }
+
+    if (_isNegotiatingBaudRate) {
+      print('Cannot write to port: baud rate is changing');
+      return false;
+    }
+
+    try {
+      _port!.write(Uint8List.fromList(data));
+      _port!.flush();
+
+      _connectionHealthCheckFailures = 0;
+      _lastSuccessfulWrite = DateTime.now();
+
+      return true;
+    } catch (e) {
+      print('Error writing to port (disconnection detected): $e');
+      await close();
+      return false;
+    }
+  }
+}
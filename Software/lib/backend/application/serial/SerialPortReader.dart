@@ -1,95 +1,81 @@
 import 'dart:async';
+import 'dart:developer';
+import 'dart:isolate';
+import 'dart:math' show min;
 import 'dart:typed_data';
+import 'package:flutter/foundation.dart' show visibleForTesting;
 import 'package:flutter_libserialport/flutter_libserialport.dart';
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
 
+/// Reads the port from its own isolate, which sleeps in a blocking read until
+/// bytes arrive and splits them into lines and binary frames there. Each
+/// batch comes back as one transferable buffer and is handed out as views
+/// into it.
 class SerialPortReader {
-  static const int CHUNK_SIZE = 256;
-  static const int READ_INTERVAL_MS = 10;
+  // the read wakes up this often with nothing to read, so the isolate can be
+  // stopped before the port is closed
+  static const int READ_TIMEOUT_MS = 100;
+  static const int RING_SIZE = 1024; // power of two
+  static const Duration STOP_TIMEOUT = Duration(seconds: 1);
 
   final SerialPort _port;
   final StreamController<List<int>> _controller = StreamController<List<int>>();
-  final List<int> _buffer = [];
-  Timer? _readTimer;
-  bool _isReading = false;
+  Isolate? _isolate;
+  ReceivePort? _receivePort;
+  ReceivePort? _exitPort;
   bool _isClosed = false;
 
-  SerialPortReader(this._port) {
+  /// Called for every binary frame that fails its crc check
+  final void Function()? onFrameError;
+
+  /// Timeline.now when the read behind the messages being handed out
+  /// returned, for LatencyTracer
+  int lastReadAt = 0;
+
+  SerialPortReader(this._port, {this.onFrameError}) {
     _controller.onListen = _startReading;
-    _controller.onPause = _stopReading;
-    _controller.onResume = _startReading;
     _controller.onCancel = _cleanup;
   }
 
   Stream<List<int>> get stream => _controller.stream;
 
-  void _startReading() {
-    if (_isReading || _isClosed) return;
-    _isReading = true;
-
-    _readTimer =
-        Timer.periodic(Duration(milliseconds: READ_INTERVAL_MS), (timer) {
-      if (!_isReading || _isClosed) {
-        timer.cancel();
-        return;
-      }
-      _readChunk();
-    });
-  }
-
-  void _stopReading() {
-    _isReading = false;
-    _readTimer?.cancel();
-    _readTimer = null;
-  }
+  Future<void> _startReading() async {
+    if (_isolate != null || _isClosed) return;
 
-  void _readChunk() {
-    if (!_port.isOpen || _controller.isClosed) {
-      _cleanup();
-      return;
-    }
+    _receivePort = ReceivePort();
+    _exitPort = ReceivePort();
+    _receivePort!.listen(_handleMessage);
 
     try {
-      final available = _port.bytesAvailable;
-      if (available <= 0) return;
-
-      final toRead = available.clamp(0, CHUNK_SIZE);
-      final data = _port.read(toRead);
-      if (data.isEmpty) return;
-
-      _processData(data);
+      _isolate = await Isolate.spawn(
+        _readIsolate,
+        _ReaderArgs(_receivePort!.sendPort, _port.address),
+        onExit: _exitPort!.sendPort,
+        errorsAreFatal: true,
+      );
+      if (_isClosed) await _stopIsolate();
     } catch (e) {
       _handleError(e);
     }
   }
 
-  void _processData(Uint8List data) {
-    try {
-      _buffer.addAll(data);
+  void _handleMessage(dynamic message) {
+    if (_isClosed || _controller.isClosed) return;
 
-      var start = 0;
-      for (var i = 0; i < _buffer.length; i++) {
-        if (_buffer[i] == 10) {
-          // newline character
-          if (i > start) {
-            final message = _buffer.sublist(start, i);
-            if (!_controller.isClosed && _controller.hasListener) {
-              _controller.add(Uint8List.fromList(message));
-            }
-          }
-          start = i + 1;
-        }
+    if (message is _ReaderBatch) {
+      lastReadAt = message.readAt;
+      for (var i = 0; i < message.frameErrors; i++) {
+        onFrameError?.call();
       }
 
-      if (start > 0) {
-        _buffer.removeRange(0, start);
-      }
-
-      if (_buffer.length > 1024) {
-        _buffer.clear();
+      final data = message.data.materialize().asUint8List();
+      var start = 0;
+      for (final end in message.ends) {
+        _controller.add(Uint8List.sublistView(data, start, end));
+        start = end;
       }
-    } catch (e) {
-      print('Error processing data: $e');
-      _handleError(e);
+    } else if (message is String) {
+      _handleError(message);
     }
   }
 
@@ -100,11 +86,27 @@ class SerialPortReader {
     _cleanup();
   }
 
+  // the isolate may be part way through a read, the port can only be closed
+  // once it has gone
+  Future<void> _stopIsolate() async {
+    final isolate = _isolate;
+    _isolate = null;
+    if (isolate == null) return;
+
+    final exited = _exitPort!.first;
+    isolate.kill(priority: Isolate.immediate);
+    await exited.timeout(STOP_TIMEOUT, onTimeout: () {
+      print('Serial reader isolate did not stop in time');
+    });
+  }
+
   Future<void> _cleanup() async {
     if (_isClosed) return;
     _isClosed = true;
-    _stopReading();
-    _buffer.clear();
+
+    await _stopIsolate();
+    _receivePort?.close();
+    _exitPort?.close();
 
     // Ensure we're not adding events to a closed controller
     if (!_controller.isClosed) {
@@ -115,4 +117,160 @@ class SerialPortReader {
   Future<void> dispose() async {
     await _cleanup();
   }
+
+  static void _readIsolate(_ReaderArgs args) {
+    final port = SerialPort.fromAddress(args.portAddress);
+    final framer = SerialFramer();
+
+    while (true) {
+      try {
+        // blocks until the first byte, then takes whatever else has arrived
+        final first = port.read(1, timeout: READ_TIMEOUT_MS);
+        if (first.isEmpty) continue;
+        final readAt = Timeline.now;
+        framer.add(first);
+
+        final available = port.bytesAvailable;
+        if (available > 0) {
+          framer.add(port.read(available.clamp(0, RING_SIZE - 1)));
+        }
+
+        final batch = framer.takeBatch(readAt);
+        if (batch != null) args.sendPort.send(batch);
+      } catch (e) {
+        args.sendPort.send('$e');
+        return;
+      }
+    }
+  }
+}
+
+class _ReaderArgs {
+  final SendPort sendPort;
+  final int portAddress;
+
+  _ReaderArgs(this.sendPort, this.portAddress);
+}
+
+/// Lines and frames that came out of one read, [ends] marks where each one
+/// finishes in [data]
+class _ReaderBatch {
+  final TransferableTypedData data;
+  final List<int> ends;
+  final int frameErrors;
+  final int readAt;
+
+  _ReaderBatch(this.data, this.ends, this.frameErrors, this.readAt);
+}
+
+/// Splits the byte stream into newline terminated lines and binary frames
+/// sized by their channel mask, in a fixed ring buffer. Complete messages are
+/// copied once, straight into the outgoing batch.
+@visibleForTesting
+class SerialFramer {
+  static const int MASK = SerialPortReader.RING_SIZE - 1;
+
+  final Uint8List _ring = Uint8List(SerialPortReader.RING_SIZE);
+
+  // a batch can finish a message left over from the last read as well as a
+  // whole ring of new ones
+  final Uint8List _out = Uint8List(SerialPortReader.RING_SIZE * 2);
+
+  // positions only ever grow, they are masked to index the ring
+  int _head = 0; // start of the message being collected
+  int _scan = 0; // next byte to look at
+  int _tail = 0; // end of the received bytes
+
+  int _outLength = 0;
+  final List<int> _ends = [];
+  int _frameErrors = 0;
+
+  void add(Uint8List data) {
+    var offset = 0;
+
+    // copied in no more than the ring has room for at a time and framed
+    // straight away, so a full ring only ever holds bytes that were scanned
+    while (offset < data.length) {
+      var free = SerialPortReader.RING_SIZE - (_tail - _head);
+      if (free == 0) {
+        // nothing has ended for a whole buffer, it's noise
+        _head = _tail;
+        _scan = _tail;
+        free = SerialPortReader.RING_SIZE;
+      }
+
+      final end = min(offset + free, data.length);
+      for (var i = offset; i < end; i++) {
+        _ring[_tail++ & MASK] = data[i];
+      }
+      offset = end;
+      _frame();
+    }
+  }
+
+  _ReaderBatch? takeBatch(int readAt) {
+    if (_ends.isEmpty && _frameErrors == 0) return null;
+
+    final batch = _ReaderBatch(
+      TransferableTypedData.fromList(
+          [Uint8List.sublistView(_out, 0, _outLength)]),
+      List<int>.from(_ends),
+      _frameErrors,
+      readAt,
+    );
+
+    _outLength = 0;
+    _ends.clear();
+    _frameErrors = 0;
+    return batch;
+  }
+
+  int _at(int position) => _ring[position & MASK];
+
+  void _frame() {
+    var i = _scan;
+
+    while (i < _tail) {
+      if (SerialProtocol.isFrameSync(_at(i))) {
+        // ascii lines never contain a sync byte, anything before it is noise
+        _head = i;
+
+        if (i + SerialProtocol.FRAME_HEADER_LENGTH > _tail) break;
+        final frameLength = SerialProtocol.frameLength(_at(i), _at(i + 2));
+        if (i + frameLength > _tail) break;
+
+        // copied out before it's checked, only kept if the crc matches
+        _copyOut(i, i + frameLength);
+        if (SerialProtocol.isValidFrame(_out, _outLength, frameLength)) {
+          _outLength += frameLength;
+          _ends.add(_outLength);
+          i += frameLength;
+        } else {
+          _frameErrors++;
+          i++;
+        }
+        _head = i;
+        continue;
+      }
+
+      if (_at(i) == 10) {
+        // newline character
+        if (i > _head) {
+          _copyOut(_head, i);
+          _outLength += i - _head;
+          _ends.add(_outLength);
+        }
+        _head = i + 1;
+      }
+      i++;
+    }
+
+    _scan = i;
+  }
+
+  void _copyOut(int start, int end) {
+    for (var i = start; i < end; i++) {
+      _out[_outLength + i - start] = _at(i);
+    }
+  }
 }
@@ -0,0 +1,344 @@
+import 'dart:typed_data';
+
+/// Wire format shared with the firmware, see definitions.h
+///
+/// Binary frame: [FRAME_SYNC][sequence][channel mask][payload][crc8]
+/// A non zero channel mask is followed by the packed 10 bit value of every set
+/// channel (LSB first). A channel mask of 0 is a button frame with the payload
+/// [changed buttons][button states].
+///
+/// With latency tracing on (protocol version 4, "~T1!") analog frames start
+/// with FRAME_SYNC_TRACED and carry [queued at, uint32 micros][scan age,
+/// uint16 micros] after the values, before the crc.
+///
+/// From protocol version 5 the handshake ends with "|id" and a device id,
+/// 8 hex digits the firmware keeps in its eeprom. From version 6 "|state"
+/// follows with the hash of the palettes the device is showing, which it
+/// keeps across power cycles, see stateHash.
+///
+/// From protocol version 7 the firmware debounces the buttons itself, and
+/// BUTTON_EVENTS_ON_COMMAND has it send gestures (BUTTON_CLICK and on) as
+/// well as presses and releases, as "A|<event>|" or an event frame:
+/// [FRAME_SYNC_EVENT][sequence][button << 4 | event][crc8]. buttonTimings
+/// sets how long each gesture takes.
+///
+/// LED frame to the firmware: [FRAME_SYNC][type][strip][payload][crc8]
+/// The strip byte carries LED_FRAME_ANIMATED when the palette should scroll.
+class SerialProtocol {
+  static const String DEVICE_IDENTIFIER = 'mixlit';
+  static const int PROTOCOL_VERSION_ASCII = 1;
+  static const int PROTOCOL_VERSION_BINARY = 2;
+  static const int PROTOCOL_VERSION_LED_FRAMES = 3;
+  static const int PROTOCOL_VERSION_LATENCY_TRACE = 4;
+  static const int PROTOCOL_VERSION_DEVICE_ID = 5;
+  static const int PROTOCOL_VERSION_STATE_HASH = 6;
+  static const int PROTOCOL_VERSION_BUTTON_EVENTS = 7;
+
+  static const String SELECT_BINARY_COMMAND = '~B!';
+  static const String SELECT_ASCII_COMMAND = '~A!';
+  static const String LATENCY_TRACE_ON_COMMAND = '~T1!';
+  static const String LATENCY_TRACE_OFF_COMMAND = '~T0!';
+  static const String BUTTON_EVENTS_ON_COMMAND = '~G1!';
+
+  /// What a button report carries, 0 and 1 are also the state firmware older
+  /// than PROTOCOL_VERSION_BUTTON_EVENTS reports
+  static const int BUTTON_RELEASED = 0;
+  static const int BUTTON_PRESSED = 1;
+  static const int BUTTON_CLICK = 2;
+  static const int BUTTON_DOUBLE_CLICK = 3;
+  static const int BUTTON_LONG_PRESS = 4;
+  static const int BUTTON_REPEAT = 5;
+
+  /// Sent after every handshake, in ms. Mute only needs presses, releases
+  /// and long presses, so double clicks and repeats are off. With double
+  /// clicks on the firmware would hold every click back to wait for one.
+  static const int BUTTON_DEBOUNCE_MS = 10;
+  static const int BUTTON_LONG_PRESS_MS = 500;
+  static const int BUTTON_DOUBLE_CLICK_MS = 0;
+  static const int BUTTON_REPEAT_MS = 0;
+
+  static String buttonTimingsCommand(
+          int debounce, int longPress, int doubleClick, int repeat) =>
+      '~K$debounce,$longPress,$doubleClick,$repeat!';
+
+  /// The firmware always starts at the default rate, "~S<rate>!" moves it to
+  /// another and it replies "~S<rate>" at the old rate, or "~S0" if it can't.
+  /// It drops back to the default unless a handshake follows within
+  /// BAUD_CONFIRM_TIMEOUT_MS at the new rate.
+  static const int DEFAULT_BAUD_RATE = 38400;
+  static const List<int> SUPPORTED_BAUD_RATES = [
+    1000000,
+    500000,
+    250000,
+    115200,
+    57600,
+    38400
+  ];
+  static const String BAUD_RATE_REPLY = '~S';
+  static const int BAUD_CONFIRM_TIMEOUT_MS = 1000;
+
+  static String selectBaudRateCommand(int baudRate) => '~S$baudRate!';
+
+  /// USB serial chips the boards are built with, as vendor id << 16 |
+  /// product id. Any product from USB_VENDOR_ARDUINO counts too.
+  static const List<int> USB_IDS = [
+    0x1A867523, // CH340, most Nano clones
+    0x04036001, // FT232R, older Nanos
+    0x10C4EA60, // CP2102
+  ];
+  static const int USB_VENDOR_ARDUINO = 0x2341;
+
+  static bool isKnownUsbId(int vendorId, int productId) =>
+      vendorId == USB_VENDOR_ARDUINO ||
+      USB_IDS.contains((vendorId << 16) | productId);
+
+  /// Rate accepted in a "~S<rate>" reply, 0 if the firmware refused it
+  static int? baudRateFromReply(String response) {
+    if (!response.startsWith(BAUD_RATE_REPLY)) return null;
+    return int.tryParse(response.substring(BAUD_RATE_REPLY.length).trim());
+  }
+
+  static const int FRAME_SYNC = 0xA5;
+  static const int FRAME_SYNC_TRACED = 0xA6;
+  static const int FRAME_SYNC_EVENT = 0xA7;
+  static const int FRAME_HEADER_LENGTH = 3;
+  static const int FRAME_TRACE_LENGTH = 6;
+  static const int FRAME_EVENT_LENGTH = FRAME_HEADER_LENGTH + 1;
+  static const int BUTTON_PAYLOAD_LENGTH = 2;
+  static const int NUM_OF_BUTTONS = 5;
+
+  static const int LED_FRAME_SOLID = 0x53; // 'S', [r][g][b]
+  static const int LED_FRAME_GRADIENT = 0x47; // 'G', [r][g][b][r][g][b]
+  static const int LED_FRAME_BRIGHTNESS = 0x4C; // 'L', [brightness]
+  static const int LED_FRAME_PALETTE = 0x50; // 'P', 16 * [r][g][b]
+  static const int LED_FRAME_ANIMATED = 0x80;
+  static const int PALETTE_SIZE = 16;
+  static const int NUM_OF_LED_STRIPS = 5;
+
+  static bool isFrameSync(int value) =>
+      value == FRAME_SYNC ||
+      value == FRAME_SYNC_TRACED ||
+      value == FRAME_SYNC_EVENT;
+
+  static bool isFrame(List<int> data) =>
+      data.isNotEmpty && isFrameSync(data[0]);
+
+  /// Reads the protocol version from a handshake reply such as
+  /// "mixlit|v2|ram1234", older firmware only replies with "mixlit"
+  static int protocolVersionFromHandshake(String response) {
+    return _handshakeField(response, 'v') ?? PROTOCOL_VERSION_ASCII;
+  }
+
+  /// Free RAM in bytes reported by the firmware at the handshake
+  static int? freeRamFromHandshake(String response) {
+    return _handshakeField(response, 'ram');
+  }
+
+  /// Fastest rate the firmware supports, older firmware only runs at 38400
+  static int maxBaudRateFromHandshake(String response) {
+    return _handshakeField(response, 'baud') ?? DEFAULT_BAUD_RATE;
+  }
+
+  /// The id the device keeps across power cycles, null from firmware older
+  /// than PROTOCOL_VERSION_DEVICE_ID
+  static String? deviceIdFromHandshake(String response) {
+    final id = _handshakeText(response, 'id');
+    if (id == null || int.tryParse(id, radix: 16) == null) return null;
+    return id.toUpperCase();
+  }
+
+  /// Hash of the led state the device is showing, null from firmware older
+  /// than PROTOCOL_VERSION_STATE_HASH
+  static int? stateHashFromHandshake(String response) {
+    final hash = _handshakeText(response, 'state');
+    return hash == null ? null : int.tryParse(hash, radix: 16);
+  }
+
+  /// What the firmware hashes for one strip, [flags][brightness][palette]
+  static List<int> stripState(
+          bool animated, int brightness, List<int> palette) =>
+      [animated ? LED_FRAME_ANIMATED : 0, brightness, ...palette];
+
+  /// 32 bit FNV-1a over the stripState of every strip in order, matches
+  /// mixlit::stateHash in the firmware
+  static int stateHash(Iterable<List<int>> strips) {
+    var hash = 0x811C9DC5;
+    for (final strip in strips) {
+      for (final value in strip) {
+        hash = ((hash ^ value) * 0x01000193) & 0xFFFFFFFF;
+      }
+    }
+    return hash;
+  }
+
+  static int? _handshakeField(String response, String prefix) {
+    final index = response.indexOf(DEVICE_IDENTIFIER);
+    if (index == -1) return null;
+
+    final fields = response.substring(index).trim().split('|');
+    for (final field in fields.skip(1)) {
+      if (field.startsWith(prefix)) {
+        final value = int.tryParse(field.substring(prefix.length));
+        if (value != null) return value;
+      }
+    }
+    return null;
+  }
+
+  static String? _handshakeText(String response, String prefix) {
+    final index = response.indexOf(DEVICE_IDENTIFIER);
+    if (index == -1) return null;
+
+    final fields = response.substring(index).trim().split('|');
+    for (final field in fields.skip(1)) {
+      if (field.startsWith(prefix)) return field.substring(prefix.length);
+    }
+    return null;
+  }
+
+  static int payloadLength(int channelMask) {
+    if (channelMask == 0) return BUTTON_PAYLOAD_LENGTH;
+
+    var channels = 0;
+    for (var mask = channelMask; mask != 0; mask &= mask - 1) {
+      channels++;
+    }
+    return (channels * 10 + 7) >> 3;
+  }
+
+  /// Total frame length including the sync, trace and crc bytes
+  static int frameLength(int sync, int channelMask) {
+    if (sync == FRAME_SYNC_EVENT) return FRAME_EVENT_LENGTH;
+
+    final traced = sync == FRAME_SYNC_TRACED && channelMask != 0;
+    return FRAME_HEADER_LENGTH +
+        payloadLength(channelMask) +
+        (traced ? FRAME_TRACE_LENGTH : 0) +
+        1;
+  }
+
+  /// CRC-8, polynomial 0x07, matches mixlit::crc8 in the firmware
+  static int crc8(List<int> data, int start, int end) {
+    var crc = 0;
+    for (var i = start; i < end; i++) {
+      crc ^= data[i];
+      for (var bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x80) != 0 ? ((crc << 1) ^ 0x07) & 0xFF : (crc << 1) & 0xFF;
+      }
+    }
+    return crc;
+  }
+
+  /// Checks the crc of the frame starting at [start], which must already hold
+  /// [length] bytes
+  static bool isValidFrame(List<int> data, int start, int length) {
+    final end = start + length - 1;
+    return crc8(data, start + 1, end) == data[end];
+  }
+
+  static int frameSequence(Uint8List data, int start) => data[start + 1];
+
+  static int frameChannelMask(Uint8List data, int start) => data[start + 2];
+
+  static bool isTracedFrame(Uint8List data, int start) =>
+      data[start] == FRAME_SYNC_TRACED && data[start + 2] != 0;
+
+  static int _traceOffset(Uint8List data, int start) =>
+      start + FRAME_HEADER_LENGTH + payloadLength(data[start + 2]);
+
+  /// The firmware's micros() when a traced frame was queued
+  static int traceQueuedAt(Uint8List data, int start) {
+    final offset = _traceOffset(data, start);
+    return data[offset] |
+        (data[offset + 1] << 8) |
+        (data[offset + 2] << 16) |
+        (data[offset + 3] << 24);
+  }
+
+  /// How long before a traced frame was queued its adc scan finished, micros
+  static int traceScanAge(Uint8List data, int start) {
+    final offset = _traceOffset(data, start);
+    return data[offset + 4] | (data[offset + 5] << 8);
+  }
+
+  static Uint8List ledFrame(
+      int type, int strip, bool animated, List<int> payload) {
+    final frame = Uint8List(payload.length + 4);
+    frame[0] = FRAME_SYNC;
+    frame[1] = type;
+    frame[2] = strip | (animated ? LED_FRAME_ANIMATED : 0);
+    frame.setRange(3, 3 + payload.length, payload);
+    frame[frame.length - 1] = crc8(frame, 1, frame.length - 1);
+    return frame;
+  }
+
+  /// The palette the firmware builds from a LED_FRAME_GRADIENT, [from] at
+  /// entry 0 out to [to] at entry 8 and back again, as 16 rgb triples
+  static List<int> gradientPalette(List<int> from, List<int> to) {
+    final palette = <int>[];
+    for (var i = 0; i < PALETTE_SIZE; i++) {
+      final distance = i <= 8 ? i : PALETTE_SIZE - i;
+      for (var c = 0; c < 3; c++) {
+        palette.add(from[c] + ((to[c] - from[c]) * distance) ~/ 8);
+      }
+    }
+    return palette;
+  }
+
+  /// Text palette command understood by every firmware version,
+  /// "<strip><animated><16 RRGGBB colours>!"
+  static String paletteCommand(int strip, bool animated, List<int> palette) {
+    final command = StringBuffer()
+      ..write(strip.toRadixString(16))
+      ..write(animated ? '1' : '0');
+
+    for (final value in palette) {
+      command.write(value.toRadixString(16).padLeft(2, '0').toUpperCase());
+    }
+    command.write('!');
+    return command.toString();
+  }
+
+  /// Decodes an already validated frame starting at [start], calling
+  /// [onChannel] for every analog value and [onButton] for every button that
+  /// changed or event frame, without allocating
+  static void decodeFrame(Uint8List data, int start,
+      void Function(int channel, int value) onChannel,
+      void Function(int button, int event) onButton) {
+    final channelMask = data[start + 2];
+    var offset = start + FRAME_HEADER_LENGTH;
+
+    if (data[start] == FRAME_SYNC_EVENT) {
+      onButton(channelMask >> 4, channelMask & 0x0F);
+      return;
+    }
+
+    if (channelMask == 0) {
+      final changedButtons = data[offset];
+      final buttonStates = data[offset + 1];
+
+      for (var i = 0; i < NUM_OF_BUTTONS; i++) {
+        if ((changedButtons & (1 << i)) != 0) {
+          onButton(i, (buttonStates >> i) & 1);
+        }
+      }
+      return;
+    }
+
+    var bitBuffer = 0;
+    var bitCount = 0;
+
+    for (var channel = 0; channel < 8; channel++) {
+      if ((channelMask & (1 << channel)) == 0) continue;
+
+      while (bitCount < 10) {
+        bitBuffer |= data[offset++] << bitCount;
+        bitCount += 8;
+      }
+
+      onChannel(channel, bitBuffer & 0x3FF);
+      bitBuffer >>= 10;
+      bitCount -= 10;
+    }
+  }
+}
@@ -1,8 +1,20 @@
 import 'dart:async';
+import 'dart:developer';
 import 'dart:isolate';
+import 'dart:typed_data';
+import 'package:flutter/foundation.dart' show visibleForTesting;
 import 'package:mixlit/backend/application/serial/SerialConnectionManager.dart';
-
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
+import 'package:mixlit/backend/application/serial/SliderAddress.dart';
+import 'package:mixlit/backend/application/util/LatencyTracer.dart';
+
+/// Every MixLit connected feeds the same streams, sliders are keyed by
+/// SliderAddress and buttons by SliderAddress.buttonName. Each device gets
+/// its own decoder and emit timer in the decode isolate, so a busy one never
+/// holds back another's updates.
 class SerialWorker {
+  static const Duration DECODE_EMIT_INTERVAL = Duration(milliseconds: 5);
+
   final _sliderDataController = StreamController<Map<int, int>>.broadcast();
   final _buttonDataController = StreamController<Map<String, int>>.broadcast();
   final _rawDataController = StreamController<String>.broadcast();
@@ -15,10 +27,26 @@ class SerialWorker {
   ReceivePort? _receivePort;
   SendPort? _isolateSendPort;
   StreamSubscription? _connectionStateSubscription;
+  final Map<int, List<Uint8List>> _pendingMessages = {};
+  final Map<int, SerialDecodeStats> _decodeStats = {};
+
+  /// Fader updates the decode isolate has replaced with a newer value before
+  /// they were passed on, and messages it couldn't use, over every device
+  SerialDecodeStats get decodeStats {
+    var received = 0, coalesced = 0, dropped = 0;
+    for (final stats in _decodeStats.values) {
+      received += stats.received;
+      coalesced += stats.coalesced;
+      dropped += stats.dropped;
+    }
+    return SerialDecodeStats(received, coalesced, dropped);
+  }
   final Completer<void> _initCompleter = Completer<void>();
   Future<void> get initialized => _initCompleter.future;
 
   Stream<Map<int, int>> get sliderData => _sliderDataController.stream;
+  /// Each button report on its own, by SliderAddress.buttonName, with the
+  /// SerialProtocol.BUTTON_ event it carries
   Stream<Map<String, int>> get buttonData => _buttonDataController.stream;
   Stream<String> get rawData => _rawDataController.stream;
   Stream<bool> get connectionState => _connectionStateController.stream;
@@ -31,6 +59,7 @@ class SerialWorker {
       onDataReceived: _handleData,
       onError: _handleError,
       onInitialHardwareValues: _handleInitialHardwareValues,
+      onDeviceStateChanged: _handleDeviceStateChanged,
     );
     _connectionManager.initialized.then((_) {
       _connectionStateSubscription =
@@ -38,7 +67,8 @@ class SerialWorker {
         print('Connection state changed: $connected');
         if (!connected) {
           _cleanupDataProcessing();
-        } else {
+        } else if (_receivePort == null) {
+          // the first device to connect starts the isolate, the rest share it
           _initializeDataProcessing().then((_) {
             print('SerialWorker initialization complete');
             if (!_initCompleter.isCompleted) {
@@ -48,7 +78,7 @@ class SerialWorker {
         }
       });
 
-      if (_connectionManager.isConnected) {
+      if (_connectionManager.isConnected && _receivePort == null) {
         _initializeDataProcessing().then((_) {
           print('SerialWorker initialization complete');
           if (!_initCompleter.isCompleted) {
@@ -59,15 +89,41 @@ class SerialWorker {
     });
   }
 
-  void _handleInitialHardwareValues(Map<int, int> values) {
-    print('SerialWorker: Received initial hardware values: $values');
-    _initialHardwareValuesController.add(values);
+  void _handleInitialHardwareValues(int device, Map<int, int> values) {
+    print(
+        'SerialWorker: Received initial hardware values from device $device: $values');
+    _initialHardwareValuesController.add({
+      for (final entry in values.entries)
+        SliderAddress.of(device, entry.key): entry.value
+    });
   }
 
+  // a device that comes back starts counting its frames again
+  void _handleDeviceStateChanged(int device, bool connected) {
+    if (!connected) {
+      _decodeStats.remove(device);
+      _isolateSendPort?.send(_DeviceGone(device));
+    }
+  }
+
+  /// The faders of every connected device, by SliderAddress
   Future<Map<int, int>?> requestInitialHardwareValues() async {
-    return await _connectionManager.getInitialHardwareValues();
+    final values = <int, int>{};
+    for (final device in connectedDevices) {
+      final connection = _connectionManager.connection(device);
+      final deviceValues = await connection?.getInitialHardwareValues();
+      if (deviceValues == null) continue;
+
+      for (final entry in deviceValues.entries) {
+        values[SliderAddress.of(device, entry.key)] = entry.value;
+      }
+    }
+    return values.isEmpty ? null : values;
   }
 
+  /// Slots of the devices connected now, see SliderAddress
+  List<int> get connectedDevices => _connectionManager.connectedSlots;
+
   void _cleanupDataProcessing() {
     print('Cleaning up data processing...');
     _dataProcessingIsolate?.kill();
@@ -77,13 +133,29 @@ class SerialWorker {
     _isolateSendPort = null;
   }
 
-  void _handleData(List<int> data) {
+  void _handleData(int device, List<int> data) {
+    if (_isolateSendPort == null) return;
+
+    // everything that arrives in one event goes to the isolate together
+    if (_pendingMessages.isEmpty) scheduleMicrotask(_sendPendingMessages);
+    _pendingMessages
+        .putIfAbsent(device, () => [])
+        .add(data is Uint8List ? data : Uint8List.fromList(data));
+  }
+
+  void _sendPendingMessages() {
     if (_isolateSendPort != null) {
-      final line = String.fromCharCodes(data).trim();
-      if (line.isNotEmpty) {
-        _isolateSendPort!.send(line);
-      }
+      _pendingMessages.forEach((device, messages) {
+        _isolateSendPort!.send(_DecodeBatch(
+          device,
+          TransferableTypedData.fromList(messages),
+          [for (final message in messages) message.length],
+          _connectionManager.connection(device)?.lastReadAt ?? 0,
+          Timeline.now,
+        ));
+      });
     }
+    _pendingMessages.clear();
   }
 
   void _handleError(dynamic error) {
@@ -117,10 +189,23 @@ class SerialWorker {
           print('Received isolate send port');
           _isolateSendPort = message;
           if (!completer.isCompleted) completer.complete();
-        } else if (message is Map<int, int>) {
-          _sliderDataController.add(message);
-        } else if (message is Map<String, int>) {
-          _buttonDataController.add(message);
+        } else if (message is _DecodeSnapshot) {
+          _decodeStats[message.device] = message.stats;
+          if (message.trace != null &&
+              LatencyTracer.enabled &&
+              message.device == _connectionManager.tracedSlot) {
+            LatencyTracer.instance.frameDecoded(message.trace!, Timeline.now);
+          }
+
+          if (message.sliderData.isNotEmpty) {
+            _sliderDataController.add(message.sliderData);
+          }
+          // button presses are never coalesced, each one is passed on in order
+          for (final event in message.buttonEvents) {
+            _buttonDataController.add({
+              SliderAddress.buttonName(message.device, event >> 3): event & 7
+            });
+          }
         } else if (message is String) {
           _rawDataController.add(message);
         }
@@ -155,75 +240,41 @@ class SerialWorker {
 
   static void _processDataIsolate(SendPort mainSendPort) {
     final receivePort = ReceivePort();
-    bool isProcessing = false;
+    final decoders = <int, _DeviceDecoder>{};
 
     mainSendPort.send(receivePort.sendPort);
 
-    receivePort.listen((message) async {
-      if (isProcessing) return;
-      isProcessing = true;
-
-      try {
-        if (message is String && message.isNotEmpty) {
-          await _parseAndSendData(message, mainSendPort);
-        }
-      } catch (e) {
-        print('Isolate: Error processing data: $e');
-      } finally {
-        isProcessing = false;
-      }
-    });
-  }
-
-  static Future<void> _parseAndSendData(
-      String line, SendPort mainSendPort) async {
-    try {
-      final parts = line.split('|');
-      if (parts.isEmpty) return;
-
-      if (parts.isNotEmpty &&
-          parts[0].length == 1 &&
-          parts[0].codeUnitAt(0) >= 'A'.codeUnitAt(0) &&
-          parts[0].codeUnitAt(0) <= 'E'.codeUnitAt(0)) {
-        try {
-          if (parts.length >= 2) {
-            final buttonId = parts[0];
-            final buttonState = int.parse(parts[1].trim());
-
-            final buttonData = <String, int>{};
-            buttonData[buttonId] = buttonState;
-            mainSendPort.send(buttonData);
-          }
-        } catch (e) {
-          print('Error parsing button data: $e');
-        }
+    receivePort.listen((message) {
+      if (message is _DeviceGone) {
+        decoders.remove(message.device)?.emitTimer?.cancel();
         return;
       }
+      if (message is! _DecodeBatch) return;
 
-      final sliderData = <int, int>{};
+      final device = decoders.putIfAbsent(
+          message.device, () => _DeviceDecoder(message.device, mainSendPort));
+      final decoder = device.decoder;
 
-      for (var i = 0; i < parts.length - 1; i += 2) {
-        if (parts[i].isEmpty || parts[i + 1].isEmpty) continue;
-
-        try {
-          final sliderId = int.parse(parts[i].trim());
-          final sliderValue = int.parse(parts[i + 1].trim());
-          sliderData[sliderId] = sliderValue;
-        } catch (e) {
-          continue;
+      try {
+        final data = message.data.materialize().asUint8List();
+        decoder.readAt = message.readAt;
+        decoder.handedAt = message.handedAt;
+        var start = 0;
+        for (final length in message.lengths) {
+          decoder.decode(data, start, start + length);
+          start += length;
         }
+      } catch (e) {
+        print('Isolate: Error processing data: $e');
       }
 
-      if (sliderData.isNotEmpty) {
-        mainSendPort.send(sliderData);
-      }
-    } catch (e) {
-      print('Isolate: Error parsing data: $e');
-    }
+      if (device.emitTimer == null) device.emit();
+    });
   }
 
-  Future<void> sendCommand(String command) async {
-    if (!isDeviceConnected) {
+  /// Sends a text command to [device], see SliderAddress
+  Future<void> sendCommand(String command, {int device = 0}) async {
+    if (!isConnectedTo(device)) {
       print('Cannot send command: device not connected');
       return;
     }
@@ -237,19 +288,60 @@ class SerialWorker {
       print(command);
       _rawDataController.add(command);
 
-      await _sendToDevice(command);
+      await _sendToDevice(device, command);
     } catch (e) {
       print('Error sending command to MixLit: $e');
     }
   }
 
-  Future<void> _sendToDevice(String data) async {
+  /// Sends a binary LED frame to [device], see SerialProtocol.ledFrame
+  Future<bool> sendLEDFrame(Uint8List frame, {int device = 0}) async {
+    final connection = _connectionManager.connection(device);
+    if (connection == null) {
+      print('Cannot send LED frame: device not connected');
+      return false;
+    }
+
+    _rawDataController.add(frame
+        .map((value) => value.toRadixString(16).padLeft(2, '0'))
+        .join(' '));
+
     try {
-      data = "0$data";
+      return await connection.writeToPort(frame);
+    } catch (e) {
+      print('Error sending LED frame to MixLit: $e');
+      return false;
+    }
+  }
+
+  /// Protocol version [device] reported at its last handshake
+  int protocolVersionOf(int device) =>
+      _connectionManager.connection(device)?.protocolVersion ??
+      SerialProtocol.PROTOCOL_VERSION_ASCII;
+
+  /// Starts or stops LatencyTracer, returns false if the device couldn't be
+  /// asked to timestamp its frames
+  Future<bool> setLatencyTracing(bool enabled) async {
+    if (enabled && !LatencyTracer.enabled) LatencyTracer.instance.reset();
+    LatencyTracer.enabled = enabled;
+
+    try {
+      return await _connectionManager.setLatencyTracing(enabled);
+    } catch (e) {
+      print('Error setting latency tracing: $e');
+      return false;
+    }
+  }
+
+  Future<void> _sendToDevice(int device, String data) async {
+    try {
+      // every text command ends with '!'
+      if (!data.endsWith('!')) data = '$data!';
       final bytes = data.codeUnits;
 
-      if (_connectionManager.isConnected) {
-        final success = await _connectionManager.writeToPort(bytes);
+      final connection = _connectionManager.connection(device);
+      if (connection != null) {
+        final success = await connection.writeToPort(bytes);
         if (success) {
           print('Data sent to device: $data');
         } else {
@@ -264,8 +356,258 @@ class SerialWorker {
     }
   }
 
+  /// True while any device is connected
   bool get isDeviceConnected {
     bool connected = _connectionManager.isConnected;
     return connected;
   }
+
+  bool isConnectedTo(int device) =>
+      _connectionManager.connection(device) != null;
+
+  /// See SerialDeviceConnection.stateHash
+  int? stateHashOf(int device) =>
+      _connectionManager.connection(device)?.stateHash;
+}
+
+class SerialDecodeStats {
+  final int received;
+  final int coalesced;
+  final int dropped;
+
+  const SerialDecodeStats(this.received, this.coalesced, this.dropped);
+
+  @override
+  String toString() =>
+      'received $received, coalesced $coalesced, dropped $dropped';
+}
+
+class _DecodeBatch {
+  final int device;
+  final TransferableTypedData data;
+  final List<int> lengths;
+  final int readAt; // Timeline.now when the serial read returned
+  final int handedAt; // Timeline.now when this was sent to the isolate
+
+  _DecodeBatch(
+      this.device, this.data, this.lengths, this.readAt, this.handedAt);
+}
+
+class _DeviceGone {
+  final int device;
+
+  _DeviceGone(this.device);
+}
+
+class _DecodeSnapshot {
+  final int device;
+  final Map<int, int> sliderData; // by SliderAddress
+  final List<int> buttonEvents; // (button << 3) | SerialProtocol.BUTTON_ event
+  final SerialDecodeStats stats;
+  final FrameTrace? trace; // the newest traced frame, if there was one
+
+  _DecodeSnapshot(this.device, this.sliderData, this.buttonEvents, this.stats,
+      this.trace);
+}
+
+/// A device's decoder in the decode isolate and its own emit timer
+class _DeviceDecoder {
+  final SerialDecoder decoder;
+  final SendPort _mainSendPort;
+  Timer? emitTimer;
+
+  _DeviceDecoder(int device, this._mainSendPort)
+      : decoder = SerialDecoder(device: device);
+
+  // the first change goes out straight away, anything after it waits for
+  // the interval, so a sweep can't flood the ui but the last position is
+  // always sent
+  void emit() {
+    if (!decoder.hasChanges) {
+      emitTimer = null;
+      return;
+    }
+    _mainSendPort.send(decoder.takeSnapshot());
+    emitTimer = Timer(SerialWorker.DECODE_EMIT_INTERVAL, emit);
+  }
+}
+
+/// Parses lines and frames straight from the bytes into the newest value of
+/// each channel, nothing is allocated until a snapshot is taken
+@visibleForTesting
+class SerialDecoder {
+  static const int NUM_OF_CHANNELS = SliderAddress.CHANNELS_PER_DEVICE;
+  static const int PIPE = 0x7C; // '|'
+
+  /// Slot of the device being decoded, snapshots key its channels by
+  /// SliderAddress
+  final int device;
+  final int _firstAddress;
+
+  SerialDecoder({this.device = 0})
+      : _firstAddress = SliderAddress.of(device, 0);
+
+  final Int32List _values = Int32List(NUM_OF_CHANNELS);
+  int _changedChannels = 0;
+  final List<int> _buttonEvents = [];
+  int? _lastFrameSequence;
+
+  int _received = 0;
+  int _coalesced = 0;
+  int _dropped = 0;
+
+  // the batch being decoded, and the newest traced frame since the last
+  // snapshot
+  int readAt = 0;
+  int handedAt = 0;
+  int _traceSequence = -1;
+  int _traceQueuedAt = 0;
+  int _traceScanAge = 0;
+  int _traceLength = 0;
+  int _traceReadAt = 0;
+  int _traceHandedAt = 0;
+  int _tracesOvertaken = 0;
+
+  late final void Function(int, int) _onChannel = _setChannel;
+  late final void Function(int, int) _onButton = _addButtonEvent;
+
+  // the field _readField last read, and where it ended
+  int _fieldValue = 0;
+  bool _fieldIsButton = false;
+  int _fieldEnd = 0;
+
+  bool get hasChanges => _changedChannels != 0 || _buttonEvents.isNotEmpty;
+
+  void decode(Uint8List data, int start, int end) {
+    if (end <= start) return;
+    _received++;
+
+    if (SerialProtocol.isFrameSync(data[start])) {
+      final sequence = SerialProtocol.frameSequence(data, start);
+      if (_lastFrameSequence != null) {
+        _dropped += (sequence - _lastFrameSequence! - 1) & 0xFF;
+      }
+      _lastFrameSequence = sequence;
+
+      if (SerialProtocol.isTracedFrame(data, start)) {
+        _keepTrace(data, start, end, sequence);
+      }
+      SerialProtocol.decodeFrame(data, start, _onChannel, _onButton);
+      return;
+    }
+
+    if (!_decodeLine(data, start, end)) _dropped++;
+  }
+
+  void _keepTrace(Uint8List data, int start, int end, int sequence) {
+    if (_traceSequence >= 0) _tracesOvertaken++;
+    _traceSequence = sequence;
+    _traceQueuedAt = SerialProtocol.traceQueuedAt(data, start);
+    _traceScanAge = SerialProtocol.traceScanAge(data, start);
+    _traceLength = end - start;
+    _traceReadAt = readAt;
+    _traceHandedAt = handedAt;
+  }
+
+  /// "<id>|<value>|" pairs, the id is a channel number or a button letter
+  bool _decodeLine(Uint8List data, int start, int end) {
+    var position = start;
+    var decodedAny = false;
+
+    while (position < end) {
+      if (!_readField(data, position, end)) break;
+      final id = _fieldValue;
+      final isButton = _fieldIsButton;
+
+      if (!_readField(data, _fieldEnd, end) || _fieldIsButton) break;
+      position = _fieldEnd;
+
+      if (isButton) {
+        _addButtonEvent(id, _fieldValue);
+      } else {
+        _setChannel(id, _fieldValue);
+      }
+      decodedAny = true;
+    }
+
+    return decodedAny;
+  }
+
+  bool _readField(Uint8List data, int start, int end) {
+    var position = start;
+    while (position < end && _isSpace(data[position])) {
+      position++;
+    }
+    if (position >= end) return false;
+
+    final first = data[position];
+    if (first >= 0x41 && first < 0x41 + SerialProtocol.NUM_OF_BUTTONS) {
+      _fieldIsButton = true;
+      _fieldValue = first - 0x41;
+      position++;
+    } else {
+      _fieldIsButton = false;
+      _fieldValue = 0;
+      final digitsStart = position;
+      while (position < end &&
+          data[position] >= 0x30 &&
+          data[position] <= 0x39) {
+        _fieldValue = _fieldValue * 10 + data[position] - 0x30;
+        position++;
+      }
+      if (position == digitsStart) return false;
+    }
+
+    while (position < end && _isSpace(data[position])) {
+      position++;
+    }
+    // the last field on a line may have lost its '|' to the line ending
+    if (position < end && data[position] != PIPE) return false;
+
+    _fieldEnd = position + 1;
+    return true;
+  }
+
+  static bool _isSpace(int value) =>
+      value == 0x20 || value == 0x0D || value == 0x09;
+
+  void _setChannel(int channel, int value) {
+    if (channel < 0 || channel >= NUM_OF_CHANNELS) return;
+
+    final bit = 1 << channel;
+    if ((_changedChannels & bit) != 0) _coalesced++;
+    _values[channel] = value;
+    _changedChannels |= bit;
+  }
+
+  void _addButtonEvent(int button, int event) {
+    _buttonEvents.add((button << 3) | (event & 7));
+  }
+
+  _DecodeSnapshot takeSnapshot() {
+    final sliderData = <int, int>{};
+    for (var channel = 0; channel < NUM_OF_CHANNELS; channel++) {
+      if ((_changedChannels & (1 << channel)) != 0) {
+        sliderData[_firstAddress + channel] = _values[channel];
+      }
+    }
+    _changedChannels = 0;
+
+    FrameTrace? trace;
+    if (_traceSequence >= 0) {
+      trace = FrameTrace(_traceSequence, _traceQueuedAt, _traceScanAge,
+          _traceLength, _traceReadAt, _traceHandedAt, _tracesOvertaken);
+      _traceSequence = -1;
+      _tracesOvertaken = 0;
+    }
+
+    final snapshot = _DecodeSnapshot(
+        device,
+        sliderData,
+        List<int>.from(_buttonEvents),
+        SerialDecodeStats(_received, _coalesced, _dropped),
+        trace);
+    _buttonEvents.clear();
+    return snapshot;
+  }
 }
@@ -0,0 +1,48 @@
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
+
+/// Sliders, dials and buttons are numbered across every MixLit connected,
+/// CHANNELS_PER_DEVICE to a device in the order of its slot (see
+/// ConfigManager.deviceSlot). The first device keeps the numbers a single
+/// MixLit has always had, so its config carries straight over.
+class SliderAddress {
+  static const int MAX_DEVICES = 4;
+  static const int CHANNELS_PER_DEVICE = 8;
+  static const int COUNT = MAX_DEVICES * CHANNELS_PER_DEVICE;
+
+  // a device's sliders come first, then its dials
+  static const int SLIDERS_PER_DEVICE = 5;
+  static const int DIALS_PER_DEVICE = 3;
+
+  static int of(int device, int channel) =>
+      device * CHANNELS_PER_DEVICE + channel;
+
+  static int dialChannel(int dial) => SLIDERS_PER_DEVICE + dial;
+
+  static int deviceOf(int address) => address ~/ CHANNELS_PER_DEVICE;
+
+  static int channelOf(int address) => address % CHANNELS_PER_DEVICE;
+
+  /// 'A' to 'E' on the first device, the way the firmware names them, then
+  /// '2A' to '2E' and so on
+  static String buttonName(int device, int button) {
+    final letter = String.fromCharCode(0x41 + button);
+    return device == 0 ? letter : '${device + 1}$letter';
+  }
+
+  /// The address of the slider under the button [name], or null if it isn't
+  /// one
+  static int? buttonAddress(String name) {
+    if (name.isEmpty) return null;
+
+    final button = name.codeUnitAt(name.length - 1) - 0x41;
+    if (button < 0 || button >= SerialProtocol.NUM_OF_BUTTONS) return null;
+
+    var device = 0;
+    if (name.length > 1) {
+      final number = int.tryParse(name.substring(0, name.length - 1));
+      if (number == null || number < 2 || number > MAX_DEVICES) return null;
+      device = number - 1;
+    }
+    return of(device, button);
+  }
+}
@@ -1,67 +1,101 @@
+import 'dart:async';
+import 'dart:convert';
+import 'dart:io';
 import 'dart:typed_data';
 import 'dart:ui' as ui;
+import 'package:flutter/foundation.dart';
 import 'package:flutter/material.dart';
-
+import 'package:mixlit/backend/application/data/ConfigManager.dart';
+import 'package:mixlit/backend/application/data/IconStore.dart';
+import 'package:path/path.dart' as path;
+
+/// Works out the colour an app's slider shows from its icon. Colours are kept
+/// by a hash of the icon's bytes and saved next to the icon cache, so an icon
+/// is only ever looked at once. Each icon is decoded once, straight to 32x32,
+/// and the pixels are quantised off the UI isolate.
 class IconColorExtractor {
-  static final Map<String, Color> _colourCache = {};
-  static const int MAX_CACHE_SIZE = 50;
-  static int _lastCacheClean = 0;
+  // bump when the quantiser changes, saved colours from older versions are
+  // thrown away
+  static const int QUANTISER_VERSION = 1;
+  static const int MAX_CACHE_SIZE = 512;
+  static const int SAMPLE_SIZE = 32;
+  static const Duration SAVE_DELAY = Duration(seconds: 2);
+  static const String _CACHE_FILE = 'icon_colours.json';
+
+  // argb by icon hash, oldest first
+  static final Map<String, int> _colourCache = {};
+  static final Map<String, Future<int?>> _extracting = {};
+  static Future<void>? _loaded;
+  static Timer? _saveTimer;
+
+  /// Reads the saved colours, every other call waits for this
+  static Future<void> load() => _loaded ??= _load();
+
+  static Future<void> _load() async {
+    try {
+      final file = await _cacheFile;
+      if (!await file.exists()) return;
 
-  static Future<Color> extractDominantColor(
-      Uint8List iconData, String identifier, // Use path as identifier
-      {Color defaultColor = Colors.blue}) async {
-    // Check cache first
-    if (_colourCache.containsKey(identifier)) {
-      return _colourCache[identifier]!;
+      final saved = jsonDecode(await file.readAsString());
+      if (saved is! Map || saved['version'] != QUANTISER_VERSION) return;
+
+      final colours = saved['colours'];
+      if (colours is Map) {
+        colours.forEach((hash, argb) {
+          if (argb is int) _colourCache[hash.toString()] = argb;
+        });
+      }
+    } catch (e) {
+      print('Error loading icon colours: $e');
     }
-    _cleanCacheIfNeeded();
+  }
 
-    try {
-      final codec = await ui.instantiateImageCodec(iconData);
-      final frameInfo = await codec.getNextFrame();
-      final image = frameInfo.image;
-      final resizedCodec = await ui.instantiateImageCodec(
-        iconData,
-        targetHeight: 32,
-        targetWidth: 32,
-      );
-      final resizedFrameInfo = await resizedCodec.getNextFrame();
-      final resizedImage = resizedFrameInfo.image;
+  static Future<File> get _cacheFile async {
+    final cachePath = await ConfigManager.instance.getIconCachePath();
+    return File(path.join(cachePath, _CACHE_FILE));
+  }
 
-      final byteData =
-          await resizedImage.toByteData(format: ui.ImageByteFormat.rawRgba);
-      if (byteData == null) {
-        return defaultColor;
-      }
+  /// The colour already worked out for [iconData], if there is one
+  static Color? cachedColor(Uint8List iconData) {
+    final argb = _colourCache[IconStore.contentHash(iconData)];
+    return argb != null ? Color(argb) : null;
+  }
 
-      final pixels = byteData.buffer.asUint8List();
-      final Map<int, int> colourCount = {};
+  static Future<Color> extractDominantColor(Uint8List iconData,
+      {Color defaultColor = Colors.blue}) async {
+    await load();
 
-      for (int i = 0; i < pixels.length; i += 16) {
-        // Increased step from 4 to 16
-        final r = pixels[i];
-        final g = pixels[i + 1];
-        final b = pixels[i + 2];
-        final a = pixels[i + 3];
+    final hash = IconStore.contentHash(iconData);
+    final cached = _colourCache[hash];
+    if (cached != null) return Color(cached);
 
-        if (a < 128) continue;
+    final argb = await (_extracting[hash] ??=
+        _extract(iconData).whenComplete(() => _extracting.remove(hash)));
+    if (argb == null) return defaultColor;
 
-        final colourKey = (r << 16) | (g << 8) | b;
-        colourCount[colourKey] = (colourCount[colourKey] ?? 0) + 1;
-      }
+    _remember(hash, argb);
+    return Color(argb);
+  }
 
-      if (colourCount.isEmpty) {
-        return defaultColor;
-      }
+  static Future<int?> _extract(Uint8List iconData) async {
+    try {
+      final codec = await ui.instantiateImageCodec(
+        iconData,
+        targetHeight: SAMPLE_SIZE,
+        targetWidth: SAMPLE_SIZE,
+      );
+      final frameInfo = await codec.getNextFrame();
+      final byteData =
+          await frameInfo.image.toByteData(format: ui.ImageByteFormat.rawRgba);
+      frameInfo.image.dispose();
+      codec.dispose();
 
-      int dominantColorKey =
-          colourCount.entries.reduce((a, b) => a.value > b.value ? a : b).key;
+      if (byteData == null) return null;
 
-      final r = (dominantColorKey >> 16) & 0xFF;
-      final g = (dominantColorKey >> 8) & 0xFF;
-      final b = dominantColorKey & 0xFF;
+      final rgb = await compute(dominantRgb, byteData.buffer.asUint8List());
+      if (rgb == null) return null;
 
-      final dominantColor = Color.fromRGBO(r, g, b, 1.0);
+      final dominantColor = Color(0xFF000000 | rgb);
 
       final HSLColor hslColor = HSLColor.fromColor(dominantColor);
       final adjustedColor = hslColor
@@ -71,29 +105,89 @@ class IconColorExtractor {
           .withSaturation(hslColor.saturation < 0.4 ? 0.6 : hslColor.saturation)
           .toColor();
 
-      _colourCache[identifier] = adjustedColor;
-      return adjustedColor;
+      return adjustedColor.value;
     } catch (e) {
       print('Error extracting colour: $e');
-      return defaultColor;
+      return null;
+    }
+  }
+
+  /// Histogram over a 4 bit per channel colour space, weighted toward
+  /// saturated colours so an icon's white or black background doesn't win.
+  /// Gives the average of the pixels in the winning bucket rather than the
+  /// bucket's centre.
+  @visibleForTesting
+  static int? dominantRgb(Uint8List pixels) {
+    const int buckets = 16 * 16 * 16;
+    final counts = Int32List(buckets);
+    final sums = Int32List(buckets * 3);
+    final weights = Float64List(buckets);
+
+    for (int i = 0; i + 3 < pixels.length; i += 4) {
+      if (pixels[i + 3] < 128) continue;
+
+      final r = pixels[i];
+      final g = pixels[i + 1];
+      final b = pixels[i + 2];
+      final bucket = ((r >> 4) << 8) | ((g >> 4) << 4) | (b >> 4);
+
+      final high = r > g ? (r > b ? r : b) : (g > b ? g : b);
+      final low = r < g ? (r < b ? r : b) : (g < b ? g : b);
+
+      counts[bucket]++;
+      sums[bucket * 3] += r;
+      sums[bucket * 3 + 1] += g;
+      sums[bucket * 3 + 2] += b;
+      weights[bucket] += 0.2 + (high - low) / 255;
+    }
+
+    int best = -1;
+    for (int bucket = 0; bucket < buckets; bucket++) {
+      if (counts[bucket] > 0 &&
+          (best == -1 || weights[bucket] > weights[best])) {
+        best = bucket;
+      }
     }
+    if (best == -1) return null;
+
+    final count = counts[best];
+    final r = sums[best * 3] ~/ count;
+    final g = sums[best * 3 + 1] ~/ count;
+    final b = sums[best * 3 + 2] ~/ count;
+    return (r << 16) | (g << 8) | b;
   }
 
-  static void _cleanCacheIfNeeded() {
-    final currentTime = DateTime.now().millisecondsSinceEpoch;
-    if (_colourCache.length > MAX_CACHE_SIZE &&
-        currentTime - _lastCacheClean > 30000) {
-      final entries = _colourCache.entries.take(MAX_CACHE_SIZE ~/ 2).toList();
-      _colourCache.clear();
-      _colourCache.addAll(Map.fromEntries(entries));
+  static void _remember(String hash, int argb) {
+    _colourCache[hash] = argb;
+    while (_colourCache.length > MAX_CACHE_SIZE) {
+      _colourCache.remove(_colourCache.keys.first);
+    }
 
-      _lastCacheClean = currentTime;
+    _saveTimer ??= Timer(SAVE_DELAY, () {
+      _saveTimer = null;
+      _save();
+    });
+  }
+
+  static Future<void> _save() async {
+    try {
+      final file = await _cacheFile;
+      final temp = File('${file.path}.tmp');
+
+      await temp.writeAsString(
+          jsonEncode({'version': QUANTISER_VERSION, 'colours': _colourCache}),
+          flush: true);
+      await temp.rename(file.path);
+    } catch (e) {
+      print('Error saving icon colours: $e');
     }
   }
 
   static void clearCache() {
     _colourCache.clear();
-    _lastCacheClean = DateTime.now().millisecondsSinceEpoch;
+    _saveTimer?.cancel();
+    _saveTimer = null;
+    _save();
   }
 
   static int get cacheSize => _colourCache.length;
@@ -9,12 +9,11 @@ class IconExtractor {
   static const int SHGFI_LARGEICON = 0x000000000;
   static const int SHGFI_SMALLICON = 0x000000001;
 
-  /// Extracts an icon from the given executable path and saves it as an ICO file
-  static Future<bool> extractIconToFile(
-      String executablePath, String outputPath) async {
+  /// Extracts an icon from the given executable path as ICO file data
+  static Future<Uint8List?> extractIcon(String executablePath) async {
     if (!Platform.isWindows) {
       print('Icon extraction is only supported on Windows');
-      return false;
+      return null;
     }
 
     try {
@@ -34,7 +33,7 @@ class IconExtractor {
         print('Failed to get file info for $executablePath');
         calloc.free(pathPtr);
         calloc.free(shFileInfo);
-        return false;
+        return null;
       }
 
       final hIcon = shFileInfo.ref.hIcon;
@@ -42,7 +41,7 @@ class IconExtractor {
         print('No icon found for $executablePath');
         calloc.free(pathPtr);
         calloc.free(shFileInfo);
-        return false;
+        return null;
       }
 
       // Convert HICON to ICO file data
@@ -53,17 +52,10 @@ class IconExtractor {
       calloc.free(pathPtr);
       calloc.free(shFileInfo);
 
-      if (iconData != null) {
-        // Write the ICO data to file
-        await File(outputPath).writeAsBytes(iconData);
-        print('Successfully extracted icon to $outputPath');
-        return true;
-      }
-
-      return false;
+      return iconData;
     } catch (e) {
       print('Error extracting icon: $e');
-      return false;
+      return null;
     }
   }
 
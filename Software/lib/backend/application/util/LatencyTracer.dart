@@ -0,0 +1,329 @@
+import 'dart:async';
+import 'dart:convert';
+import 'dart:developer';
+import 'dart:io';
+import 'dart:typed_data';
+import 'package:mixlit/backend/application/audio/VolumeDispatcher.dart';
+import 'package:mixlit/backend/application/data/StorageManager.dart';
+import 'package:path/path.dart' as path;
+
+/// Stages a fader move goes through on its way to the mixer, every time is in
+/// microseconds
+class LatencyStage {
+  /// adc scan finished to analog frame queued, measured by the firmware
+  static const int SCAN = 0;
+
+  /// frame queued to the read that brought it in returning
+  static const int LINK = 1;
+
+  /// read returned to the frame being handed to the decode isolate
+  static const int READER = 2;
+
+  /// handed to the decode isolate to its snapshot arriving back, this
+  /// includes the time a change waits to be coalesced
+  static const int DECODE = 3;
+
+  /// snapshot arriving to the HomePage listener running
+  static const int LISTENER = 4;
+
+  /// queued in VolumeDispatcher to being sent
+  static const int DISPATCH = 5;
+
+  /// how long the audio backend took to apply it
+  static const int BACKEND = 6;
+
+  /// adc scan finished to the volume being applied
+  static const int TOTAL = 7;
+
+  static const int COUNT = 8;
+
+  static const List<String> NAMES = [
+    'scan',
+    'link',
+    'reader',
+    'decode',
+    'listener',
+    'dispatch',
+    'backend',
+    'total',
+  ];
+}
+
+/// Timings the firmware and the decode isolate attach to the newest traced
+/// frame in a snapshot
+class FrameTrace {
+  final int sequence;
+  final int queuedAt; // the device's micros(), 32 bits
+  final int scanAge;
+  final int frameLength;
+  final int readAt; // Timeline.now
+  final int handedAt; // Timeline.now
+  final int overtaken; // traced frames replaced before this one was passed on
+
+  const FrameTrace(this.sequence, this.queuedAt, this.scanAge,
+      this.frameLength, this.readAt, this.handedAt, this.overtaken);
+}
+
+/// Latencies in buckets that get 4 to each doubling, so a percentile is
+/// never more than about 20% out. Recording doesn't allocate.
+class LatencyHistogram {
+  static const int SUB_BUCKETS = 4;
+  // anything over 2^26 us (about 67s) goes in the last bucket
+  static const int BUCKETS = 26 * SUB_BUCKETS;
+
+  final Uint32List _counts = Uint32List(BUCKETS);
+  int _count = 0;
+  int _total = 0;
+  int _max = 0;
+
+  int get count => _count;
+  int get max => _max;
+  int get mean => _count > 0 ? _total ~/ _count : 0;
+
+  void record(int micros) {
+    if (micros < 0) micros = 0;
+    _count++;
+    _total += micros;
+    if (micros > _max) _max = micros;
+    _counts[_bucket(micros)]++;
+  }
+
+  /// The upper edge of the bucket the [fraction] point falls in
+  int percentile(double fraction) {
+    if (_count == 0) return 0;
+
+    final target = (_count * fraction).ceil().clamp(1, _count);
+    var seen = 0;
+    for (var i = 0; i < BUCKETS; i++) {
+      seen += _counts[i];
+      if (seen >= target) {
+        final upper = _upperEdge(i);
+        return upper < _max ? upper : _max;
+      }
+    }
+    return _max;
+  }
+
+  void clear() {
+    _counts.fillRange(0, BUCKETS, 0);
+    _count = 0;
+    _total = 0;
+    _max = 0;
+  }
+
+  static int _bucket(int micros) {
+    if (micros < SUB_BUCKETS) return micros;
+
+    // the top bit picks the doubling, the two under it the bucket within it
+    final exponent = micros.bitLength - 1;
+    final sub = (micros >> (exponent - 2)) & (SUB_BUCKETS - 1);
+    final index = (exponent - 1) * SUB_BUCKETS + sub;
+    return index < BUCKETS ? index : BUCKETS - 1;
+  }
+
+  static int _upperEdge(int bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+
+    final exponent = bucket ~/ SUB_BUCKETS + 1;
+    final sub = bucket % SUB_BUCKETS;
+    final width = 1 << (exponent - 2);
+    return ((SUB_BUCKETS + sub) * width) + width - 1;
+  }
+}
+
+/// Follows traced frames (see SerialProtocol.FRAME_SYNC_TRACED) from the adc
+/// to the mixer and keeps a histogram of each stage. Nothing is recorded
+/// unless [enabled] is set, and every caller checks it first so the hot path
+/// is untouched when tracing is off.
+///
+/// The device and host clocks aren't synced, so the link stage is the wire
+/// time for the frame plus however much longer it took than the quickest
+/// frame of the last couple of seconds.
+class LatencyTracer {
+  static final LatencyTracer _instance = LatencyTracer._internal();
+  static LatencyTracer get instance => _instance;
+  LatencyTracer._internal();
+
+  static bool enabled = false;
+
+  static const String _DUMP_FILE = 'latency_trace.json';
+  static const int _LINK_WINDOW_US = 1000000;
+
+  final List<LatencyHistogram> _histograms = [
+    for (var i = 0; i < LatencyStage.COUNT; i++) LatencyHistogram()
+  ];
+  final List<int> _drops = List<int>.filled(LatencyStage.COUNT, 0);
+  int _traced = 0;
+  int _startedAt = Timeline.now;
+
+  // frames still on their way to the mixer, by sequence number
+  final List<int> _readAt = List<int>.filled(256, 0);
+  final List<int> _deviceLatency = List<int>.filled(256, 0);
+
+  // the frame the slider listeners are currently being handed
+  int _activeSequence = -1;
+  int _deliveredAt = 0;
+  bool _listenerRecorded = false;
+  bool _clearScheduled = false;
+
+  // the device's micros() carried past 32 bits
+  int? _deviceClock;
+
+  // smallest read time minus device time this window and last
+  int? _offsetMin;
+  int? _previousOffsetMin;
+  int _offsetWindowStart = 0;
+
+  int _baudRate = 38400;
+
+  /// Sequence number of the frame being delivered, or -1
+  int get activeSequence => _activeSequence;
+
+  LatencyHistogram histogram(int stage) => _histograms[stage];
+  int drops(int stage) => _drops[stage];
+  int get tracedFrames => _traced;
+
+  /// Forgets everything recorded so far
+  void reset() {
+    for (final histogram in _histograms) {
+      histogram.clear();
+    }
+    _drops.fillRange(0, LatencyStage.COUNT, 0);
+    _traced = 0;
+    _startedAt = Timeline.now;
+    _activeSequence = -1;
+    restartLink(_baudRate);
+  }
+
+  /// The device has just turned tracing on, its clock may have restarted
+  void restartLink(int baudRate) {
+    _baudRate = baudRate;
+    _deviceClock = null;
+    _offsetMin = null;
+    _previousOffsetMin = null;
+    _offsetWindowStart = Timeline.now;
+  }
+
+  /// A binary frame failed its crc before it could be traced
+  void frameError() {
+    _drops[LatencyStage.LINK]++;
+  }
+
+  /// A snapshot with a traced frame has come back from the decode isolate
+  void frameDecoded(FrameTrace trace, int receivedAt) {
+    _traced++;
+    _drops[LatencyStage.DECODE] += trace.overtaken;
+
+    final link = _linkLatency(trace);
+    _histograms[LatencyStage.SCAN].record(trace.scanAge);
+    _histograms[LatencyStage.LINK].record(link);
+    _histograms[LatencyStage.READER].record(trace.handedAt - trace.readAt);
+    _histograms[LatencyStage.DECODE].record(receivedAt - trace.handedAt);
+
+    final slot = trace.sequence & 0xFF;
+    _readAt[slot] = trace.readAt;
+    _deviceLatency[slot] = trace.scanAge + link;
+
+    // listeners are called in microtasks, so once the event loop moves on
+    // anything else that changes a volume wasn't caused by this frame
+    _activeSequence = trace.sequence;
+    _deliveredAt = receivedAt;
+    _listenerRecorded = false;
+    if (!_clearScheduled) {
+      _clearScheduled = true;
+      Timer.run(_clearActive);
+    }
+  }
+
+  void _clearActive() {
+    _clearScheduled = false;
+    _activeSequence = -1;
+  }
+
+  /// A slider listener has been handed the active frame's values
+  void listenerReached() {
+    if (_activeSequence < 0 || _listenerRecorded) return;
+    _listenerRecorded = true;
+    _histograms[LatencyStage.LISTENER].record(Timeline.now - _deliveredAt);
+  }
+
+  /// A traced volume change was replaced or skipped before reaching the mixer
+  void volumeDropped(int sequence) {
+    if (sequence >= 0) _drops[LatencyStage.DISPATCH]++;
+  }
+
+  /// A traced volume change queued at [queuedAt] is being sent
+  void volumeDispatched(int sequence, int queuedAt, int sentAt) {
+    if (sequence < 0) return;
+    _histograms[LatencyStage.DISPATCH].record(sentAt - queuedAt);
+  }
+
+  /// The backend has finished applying a traced volume change sent at [sentAt]
+  void volumeApplied(int sequence, int sentAt, {bool succeeded = true}) {
+    if (sequence < 0) return;
+    if (!succeeded) {
+      _drops[LatencyStage.BACKEND]++;
+      return;
+    }
+
+    final now = Timeline.now;
+    final slot = sequence & 0xFF;
+    _histograms[LatencyStage.BACKEND].record(now - sentAt);
+    _histograms[LatencyStage.TOTAL]
+        .record(_deviceLatency[slot] + now - _readAt[slot]);
+  }
+
+  int _linkLatency(FrameTrace trace) {
+    // micros() wraps every 71 minutes
+    final last = _deviceClock;
+    final deviceTime = last == null
+        ? trace.queuedAt
+        : last + ((trace.queuedAt - last) & 0xFFFFFFFF);
+    _deviceClock = deviceTime;
+
+    final offset = trace.readAt - deviceTime;
+    if (trace.readAt - _offsetWindowStart > _LINK_WINDOW_US) {
+      _previousOffsetMin = _offsetMin;
+      _offsetMin = null;
+      _offsetWindowStart = trace.readAt;
+    }
+    if (_offsetMin == null || offset < _offsetMin!) _offsetMin = offset;
+
+    var baseline = _offsetMin!;
+    if (_previousOffsetMin != null && _previousOffsetMin! < baseline) {
+      baseline = _previousOffsetMin!;
+    }
+
+    // 10 bits a byte with the start and stop bits
+    final wireTime = trace.frameLength * 10 * 1000000 ~/ _baudRate;
+    return offset - baseline + wireTime;
+  }
+
+  Map<String, dynamic> toJson() => {
+        'enabled': enabled,
+        'durationMs': (Timeline.now - _startedAt) ~/ 1000,
+        'baudRate': _baudRate,
+        'tracedFrames': _traced,
+        'stages': {
+          for (var stage = 0; stage < LatencyStage.COUNT; stage++)
+            LatencyStage.NAMES[stage]: {
+              'count': _histograms[stage].count,
+              'meanUs': _histograms[stage].mean,
+              'p50Us': _histograms[stage].percentile(0.5),
+              'p99Us': _histograms[stage].percentile(0.99),
+              'maxUs': _histograms[stage].max,
+              'drops': _drops[stage],
+            }
+        },
+        'volumeDispatch': VolumeDispatcher.instance.stats.toJson(),
+      };
+
+  /// Writes [toJson] next to the config and returns where it went
+  Future<String> dump() async {
+    final configPath = await StorageManager.instance.getConfigPath();
+    final file = File(path.join(configPath, _DUMP_FILE));
+    await file
+        .writeAsString(const JsonEncoder.withIndent('  ').convert(toJson()));
+    return file.path;
+  }
+}
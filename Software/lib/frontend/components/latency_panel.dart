@@ -0,0 +1,198 @@
+import 'dart:async';
+import 'package:flutter/material.dart';
+import 'package:mixlit/backend/application/audio/VolumeDispatcher.dart';
+import 'package:mixlit/backend/application/util/LatencyTracer.dart';
+
+/// Shows what LatencyTracer has recorded for each stage, refreshed twice a
+/// second while it's open
+class LatencyPanel extends StatefulWidget {
+  final Future<bool> Function(bool)? onTracingChanged;
+
+  const LatencyPanel({super.key, this.onTracingChanged});
+
+  @override
+  _LatencyPanelState createState() => _LatencyPanelState();
+}
+
+class _LatencyPanelState extends State<LatencyPanel> {
+  static const Duration REFRESH_INTERVAL = Duration(milliseconds: 500);
+
+  Timer? _refreshTimer;
+  String? _status;
+
+  @override
+  void initState() {
+    super.initState();
+    _refreshTimer = Timer.periodic(REFRESH_INTERVAL, (_) {
+      if (mounted && LatencyTracer.enabled) setState(() {});
+    });
+  }
+
+  @override
+  void dispose() {
+    _refreshTimer?.cancel();
+    super.dispose();
+  }
+
+  Future<void> _setTracing(bool enabled) async {
+    final callback = widget.onTracingChanged;
+    if (callback == null) return;
+
+    final deviceTracing = await callback(enabled);
+    if (!mounted) return;
+    setState(() {
+      _status = enabled && !deviceTracing
+          ? 'The device didn\'t take the trace command, it needs firmware with protocol v4 and binary frames'
+          : null;
+    });
+  }
+
+  Future<void> _dump() async {
+    try {
+      final dumpPath = await LatencyTracer.instance.dump();
+      if (mounted) setState(() => _status = 'Saved to $dumpPath');
+    } catch (e) {
+      if (mounted) setState(() => _status = 'Couldn\'t save: $e');
+    }
+  }
+
+  static String _formatMicros(int micros) =>
+      (micros / 1000).toStringAsFixed(micros < 10000 ? 2 : 1);
+
+  @override
+  Widget build(BuildContext context) {
+    final bool isDarkMode = Theme.of(context).brightness == Brightness.dark;
+    final tracer = LatencyTracer.instance;
+
+    final headerColor = isDarkMode
+        ? Colors.white.withOpacity(0.9)
+        : Colors.black.withOpacity(0.9);
+    final cellStyle = TextStyle(
+      fontFamily: 'Courier New',
+      fontSize: 12,
+      color: isDarkMode
+          ? Colors.green.withOpacity(0.9)
+          : Colors.black.withOpacity(0.8),
+    );
+
+    TableRow row(List<String> cells, {bool header = false}) => TableRow(
+          children: [
+            for (final cell in cells)
+              Padding(
+                padding: const EdgeInsets.symmetric(vertical: 2, horizontal: 4),
+                child: Text(
+                  cell,
+                  style: header
+                      ? cellStyle.copyWith(
+                          color: headerColor, fontWeight: FontWeight.bold)
+                      : cellStyle,
+                ),
+              ),
+          ],
+        );
+
+    return Container(
+      decoration: BoxDecoration(
+        color: isDarkMode ? const Color(0xFF1A1A1A) : const Color(0xFFF8F8F8),
+        borderRadius: BorderRadius.circular(8),
+        border: Border.all(
+          color: isDarkMode
+              ? Colors.white.withOpacity(0.1)
+              : Colors.black.withOpacity(0.1),
+        ),
+      ),
+      child: Column(
+        crossAxisAlignment: CrossAxisAlignment.stretch,
+        children: [
+          Container(
+            padding: const EdgeInsets.symmetric(horizontal: 12, vertical: 4),
+            decoration: BoxDecoration(
+              color: isDarkMode
+                  ? const Color(0xFF2A2A2A)
+                  : const Color(0xFFE8E8E8),
+              borderRadius: const BorderRadius.only(
+                topLeft: Radius.circular(8),
+                topRight: Radius.circular(8),
+              ),
+            ),
+            child: Row(
+              children: [
+                Icon(
+                  Icons.timer,
+                  size: 16,
+                  color: isDarkMode
+                      ? Colors.white.withOpacity(0.7)
+                      : Colors.black.withOpacity(0.7),
+                ),
+                const SizedBox(width: 8),
+                Text(
+                  'Latency (ms), ${tracer.tracedFrames} traced frames',
+                  style: TextStyle(
+                    fontFamily: 'BitstreamVeraSans',
+                    fontSize: 14,
+                    fontWeight: FontWeight.w500,
+                    color: headerColor,
+                  ),
+                ),
+                const Spacer(),
+                IconButton(
+                  icon: const Icon(Icons.save_alt, size: 16),
+                  tooltip: 'Save as JSON',
+                  onPressed: _dump,
+                  padding: EdgeInsets.zero,
+                  constraints:
+                      const BoxConstraints(minWidth: 24, minHeight: 24),
+                ),
+                IconButton(
+                  icon: const Icon(Icons.clear, size: 16),
+                  tooltip: 'Reset',
+                  onPressed: () => setState(tracer.reset),
+                  padding: EdgeInsets.zero,
+                  constraints:
+                      const BoxConstraints(minWidth: 24, minHeight: 24),
+                ),
+                Switch(
+                  value: LatencyTracer.enabled,
+                  onChanged: widget.onTracingChanged == null
+                      ? null
+                      : (value) => _setTracing(value),
+                ),
+              ],
+            ),
+          ),
+          Padding(
+            padding: const EdgeInsets.all(8),
+            child: Table(
+              defaultColumnWidth: const IntrinsicColumnWidth(),
+              children: [
+                row(['stage', 'count', 'p50', 'p99', 'max', 'drops'],
+                    header: true),
+                for (var stage = 0; stage < LatencyStage.COUNT; stage++)
+                  row([
+                    LatencyStage.NAMES[stage],
+                    '${tracer.histogram(stage).count}',
+                    _formatMicros(tracer.histogram(stage).percentile(0.5)),
+                    _formatMicros(tracer.histogram(stage).percentile(0.99)),
+                    _formatMicros(tracer.histogram(stage).max),
+                    '${tracer.drops(stage)}',
+                  ]),
+              ],
+            ),
+          ),
+          Padding(
+            padding: const EdgeInsets.fromLTRB(12, 0, 12, 8),
+            child: Text(
+              'volume dispatch: ${VolumeDispatcher.instance.stats}',
+              style: cellStyle,
+            ),
+          ),
+          if (_status != null)
+            Padding(
+              padding: const EdgeInsets.fromLTRB(12, 0, 12, 8),
+              child: Text(_status!, style: cellStyle),
+            ),
+        ],
+      ),
+    );
+  }
+}
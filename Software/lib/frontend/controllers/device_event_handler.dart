@@ -1,12 +1,13 @@
 import 'dart:async';
 import 'package:flutter/material.dart';
 import 'package:mixlit/backend/application/serial/SerialWorker.dart';
+import 'package:mixlit/backend/application/serial/SliderAddress.dart';
 import 'package:mixlit/backend/application/audio/MuteState.dart';
 
 class DeviceEventHandler {
   final SerialWorker worker;
   final Function(Map<int, int>) onSliderDataReceived;
-  final Function(int, bool, bool) onButtonEvent;
+  final Function(int, int) onButtonEvent; // slider, SerialProtocol.BUTTON_ event
   final Function(bool) onConnectionStateChanged;
 
   final List<StreamSubscription> _subscriptions = [];
@@ -51,17 +52,10 @@ class DeviceEventHandler {
   void _setupButtonListener() {
     final subscription = worker.buttonData.listen(
       (data) {
-        data.forEach((buttonId, state) {
-          // Parse button (A-E) (0-4)
-          if (buttonId.length == 1 &&
-              buttonId.codeUnitAt(0) >= 'A'.codeUnitAt(0) &&
-              buttonId.codeUnitAt(0) <= 'E'.codeUnitAt(0)) {
-            final index = buttonId.codeUnitAt(0) - 'A'.codeUnitAt(0);
-            final isPressed = state == 1;
-            final isReleased = state == 0;
-
-            onButtonEvent(index, isPressed, isReleased);
-          }
+        data.forEach((buttonId, event) {
+          // Parse button (A-E, 2A-2E...) to the slider it mutes
+          final index = SliderAddress.buttonAddress(buttonId);
+          if (index != null) onButtonEvent(index, event);
         });
       },
       onError: (error) {
@@ -5,6 +5,7 @@ import 'package:flutter/material.dart';
 import 'package:shared_preferences/shared_preferences.dart';
 import 'package:launch_at_startup/launch_at_startup.dart';
 import 'package:mixlit/backend/application/data/ConfigManager.dart';
+import 'package:mixlit/frontend/components/latency_panel.dart';
 import 'package:window_manager/window_manager.dart';
 
 class SettingsManager {
@@ -289,6 +290,7 @@ Future<void> showSettingsDialog(
   Stream<Map<int, int>>? sliderDataStream,
   Stream<Map<String, int>>? buttonDataStream,
   Function(bool)? onThemeChanged,
+  Future<bool> Function(bool)? onLatencyTracingChanged,
 }) async {
   const String noiseTextureBase64 =
       'PHN2ZyB3aWR0aD0iMjAwIiBoZWlnaHQ9IjIwMCIgeG1sbnM9Imh0dHA6Ly93d3cudzMub3JnLzIwMDAvc3ZnIj4KICA8ZGVmcz4KICAgIDxmaWx0ZXIgaWQ9Im5vaXNlIj4KICAgICAgPGZlVHVyYnVsZW5jZSBiYXNlRnJlcXVlbmN5PSIwLjkiIG51bU9jdGF2ZXM9IjQiIHNlZWQ9IjIiLz4KICAgICAgPGZlQ29sb3JNYXRyaXggdHlwZT0ic2F0dXJhdGUiIHZhbHVlcz0iMCIvPgogICAgPC9maWx0ZXI+CiAgPC9kZWZzPgogIDxyZWN0IHdpZHRoPSIxMDAlIiBoZWlnaHQ9IjEwMCUiIGZpbHRlcj0idXJsKCNub2lzZSkiIG9wYWNpdHk9IjAuMDUiLz4KPC9zdmc+';
@@ -304,6 +306,7 @@ Future<void> showSettingsDialog(
         sliderDataStream: sliderDataStream,
         buttonDataStream: buttonDataStream,
         onThemeChanged: onThemeChanged,
+        onLatencyTracingChanged: onLatencyTracingChanged,
       );
     },
   );
@@ -315,6 +318,7 @@ class SettingsDialog extends StatefulWidget {
   final Stream<Map<int, int>>? sliderDataStream;
   final Stream<Map<String, int>>? buttonDataStream;
   final Function(bool)? onThemeChanged;
+  final Future<bool> Function(bool)? onLatencyTracingChanged;
 
   const SettingsDialog({
     super.key,
@@ -323,6 +327,7 @@ class SettingsDialog extends StatefulWidget {
     this.sliderDataStream,
     this.buttonDataStream,
     this.onThemeChanged,
+    this.onLatencyTracingChanged,
   });
 
   @override
@@ -339,6 +344,7 @@ class _SettingsDialogState extends State<SettingsDialog> {
   bool _updateNotifications = true;
   bool _saveLastComPort = true;
   bool _showTerminal = false;
+  bool _showLatency = false;
 
   @override
   void initState() {
@@ -831,6 +837,8 @@ class _SettingsDialogState extends State<SettingsDialog> {
                                       sliderDataStream: widget.sliderDataStream,
                                       buttonDataStream: widget.buttonDataStream,
                                       onThemeChanged: widget.onThemeChanged,
+                                      onLatencyTracingChanged:
+                                          widget.onLatencyTracingChanged,
                                     );
                                   });
                                 },
@@ -954,6 +962,27 @@ class _SettingsDialogState extends State<SettingsDialog> {
                                   buttonDataStream: widget.buttonDataStream,
                                 ),
                               ],
+                              const SizedBox(height: 8),
+                              _buildActionItem(
+                                title: _showLatency
+                                    ? 'Hide Latency Diagnostics'
+                                    : 'Show Latency Diagnostics',
+                                subtitle:
+                                    'Time every fader move from the device to the mixer',
+                                onTap: () {
+                                  setState(() => _showLatency = !_showLatency);
+                                },
+                                icon: Icons.timer,
+                                iconColor:
+                                    const Color.fromARGB(222, 254, 255, 210),
+                              ),
+                              if (_showLatency) ...[
+                                const SizedBox(height: 16),
+                                LatencyPanel(
+                                  onTracingChanged:
+                                      widget.onLatencyTracingChanged,
+                                ),
+                              ],
                             ],
                           ),
                         ],
@@ -1,5 +1,4 @@
 import 'dart:async';
-import 'dart:io';
 import 'dart:typed_data';
 import 'package:flutter/material.dart';
 import 'package:mixlit/backend/application/audio/VolumeController.dart';
@@ -9,8 +8,11 @@ import 'package:win32audio/win32audio.dart';
 //import 'package:mixlit/backend/application/LEDController.dart';
 import 'package:mixlit/backend/Updater.dart';
 import 'package:mixlit/backend/application/serial/SerialWorker.dart';
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
+import 'package:mixlit/backend/application/serial/SliderAddress.dart';
 import 'package:mixlit/backend/application/audio/ApplicationManager.dart';
 import 'package:mixlit/backend/application/data/ConfigManager.dart';
+import 'package:mixlit/backend/application/data/StorageManager.dart';
 import 'package:mixlit/frontend/menus/SettingsMenu.dart';
 import 'package:mixlit/backend/application/audio/MuteState.dart';
 import 'package:mixlit/frontend/controllers/connection_handler.dart';
@@ -19,6 +21,7 @@ import 'package:mixlit/frontend/components/VerticalSliderCard.dart';
 import 'package:mixlit/frontend/components/HorizontalDialCard.dart';
 import 'package:mixlit/frontend/components/application_icon.dart';
 import 'package:mixlit/backend/application/util/IconColourExtractor.dart';
+import 'package:mixlit/backend/application/util/LatencyTracer.dart';
 import 'package:mixlit/frontend/menus/AssignApplicationMenu.dart';
 import 'package:mixlit/frontend/Theme.dart'; // Import the theme
 import 'package:window_manager/window_manager.dart';
@@ -46,14 +49,18 @@ class _HomePageState extends State<HomePage>
   late final ConnectionHandler _connectionHandler;
   late final DeviceEventHandler _deviceEventHandler;
   StreamSubscription? _initialHardwareValuesSubscription;
+  StreamSubscription<int>? _sliderAppChangesSubscription;
 
-  final List<double> _sliderValues = List.filled(8, 0.1);
-  List<ProcessVolume?> _assignedApps = List.filled(8, null);
+  final List<double> _sliderValues = List.filled(SliderAddress.COUNT, 0.1);
+  List<ProcessVolume?> _assignedApps = List.filled(SliderAddress.COUNT, null);
   final Map<String, Uint8List?> _appIcons = {};
   final Map<String, Uint8List?> _cachedAppIcons = {};
-  List<String> _sliderTags = List.filled(8, 'unassigned');
+  List<String> _sliderTags = List.filled(SliderAddress.COUNT, 'unassigned');
   bool _configLoaded = false;
 
+  // the slot of the MixLit whose faders are on screen
+  int _shownDevice = 0;
+
   late final RateLimitedUpdater _uiUpdater;
   late final BatchedValueUpdater<double> _sliderUpdater;
 
@@ -82,7 +89,7 @@ class _HomePageState extends State<HomePage>
     );
 
     _muteButtonController = MuteButtonController(
-      buttonCount: 8,
+      buttonCount: SliderAddress.COUNT,
       vsync: this,
       onVolumeAdjustment: _handleDirectVolumeAdjustment,
       onSliderValueUpdated: _updateSliderValue,
@@ -138,20 +145,13 @@ class _HomePageState extends State<HomePage>
 
       _checkForUpdates();
 
-      _startPeriodicUIUpdates();
+      _sliderAppChangesSubscription = _applicationManager.sliderAppChanges
+          .listen((_) => _updateSliderStatesFromApplicationManager());
     });
 
     _debugPrintSerialData();
   }
 
-  void _startPeriodicUIUpdates() {
-    Timer.periodic(const Duration(seconds: 2), (timer) {
-      if (mounted && _configLoaded) {
-        _updateSliderStatesFromApplicationManager();
-      }
-    });
-  }
-
   void _createPulseAnimation(int sliderIndex) {
     if (_pulseControllers.containsKey(sliderIndex)) return;
 
@@ -187,6 +187,8 @@ class _HomePageState extends State<HomePage>
   }
 
   void _updateSliderStatesFromApplicationManager() {
+    if (!mounted || !_configLoaded) return;
+
     bool needsUpdate = false;
 
     for (int i = 0; i < _sliderTags.length; i++) {
@@ -243,7 +245,8 @@ class _HomePageState extends State<HomePage>
     windowManager.focus();
   }
 
-  void _exitApp() {
+  Future<void> _exitApp() async {
+    await StorageManager.instance.flush();
     trayManager.destroy();
     windowManager.destroy();
   }
@@ -270,17 +273,6 @@ class _HomePageState extends State<HomePage>
     }
   }
 
-  Future<Uint8List?> _loadCachedIcon(String cachedIconPath) async {
-    try {
-      if (await File(cachedIconPath).exists()) {
-        return await File(cachedIconPath).readAsBytes();
-      }
-    } catch (e) {
-      print('Error loading cached icon: $e');
-    }
-    return null;
-  }
-
   Future<void> _loadIconsForAssignedApps() async {
     for (int i = 0; i < _assignedApps.length; i++) {
       final app = _assignedApps[i];
@@ -298,10 +290,12 @@ class _HomePageState extends State<HomePage>
         if (app != null) {
           await _loadIconForApp(app.processPath);
 
-          if (_appIcons[app.processPath] != null) {
-            _sliderColors[i] = await IconColorExtractor.extractDominantColor(
-                _appIcons[app.processPath]!, app.processPath,
-                defaultColor: AppTheme.defaultAppColor);
+          final icon = _appIcons[app.processPath];
+          if (icon != null) {
+            // only waits for an icon whose colour hasn't been worked out yet
+            _sliderColors[i] = IconColorExtractor.cachedColor(icon) ??
+                await IconColorExtractor.extractDominantColor(icon,
+                    defaultColor: AppTheme.defaultAppColor);
           } else {
             _sliderColors[i] = AppTheme.defaultAppColor;
           }
@@ -310,17 +304,13 @@ class _HomePageState extends State<HomePage>
           if (missingApp != null) {
             _sliderColors[i] = AppTheme.missingAppColor;
 
-            if (missingApp.cachedIconPath != null) {
-              final cachedIcon =
-                  await _loadCachedIcon(missingApp.cachedIconPath!);
-              if (cachedIcon != null) {
-                _cachedAppIcons[missingApp.processName] = cachedIcon;
-
-                _sliderColors[i] =
-                    await IconColorExtractor.extractDominantColor(
-                        cachedIcon, missingApp.processName,
-                        defaultColor: AppTheme.missingAppColor);
-              }
+            final cachedIcon = missingApp.cachedIcon;
+            if (cachedIcon != null) {
+              _cachedAppIcons[missingApp.processName] = cachedIcon;
+
+              _sliderColors[i] = IconColorExtractor.cachedColor(cachedIcon) ??
+                  await IconColorExtractor.extractDominantColor(cachedIcon,
+                      defaultColor: AppTheme.missingAppColor);
             }
           } else {
             _sliderColors[i] = AppTheme.defaultAppColor;
@@ -367,6 +357,7 @@ class _HomePageState extends State<HomePage>
 
   void _handleSliderData(Map<int, int> data) {
     if (!_configLoaded) return;
+    if (LatencyTracer.enabled) LatencyTracer.instance.listenerReached();
 
     _applicationManager.enableVolumeRestorationForUserAction();
 
@@ -403,24 +394,41 @@ class _HomePageState extends State<HomePage>
     }
   }
 
-  void _handleButtonEvent(int buttonIndex, bool isPressed, bool isReleased) {
+  void _handleButtonEvent(int buttonIndex, int event) {
     if (!_configLoaded) return;
 
-    if (isPressed) {
-      _muteButtonController.handleButtonDown(buttonIndex);
-      _muteButtonController.checkLongPress(buttonIndex);
-
-      _uiUpdater.requestUpdate();
-    } else if (isReleased) {
-      _muteButtonController.handleButtonUp(buttonIndex);
-      _uiUpdater.requestUpdate();
+    // firmware with button events has already debounced and timed these
+    switch (event) {
+      case SerialProtocol.BUTTON_PRESSED:
+        _muteButtonController.handleButtonDown(buttonIndex,
+            debounced: _worker.protocolVersionOf(
+                    SliderAddress.deviceOf(buttonIndex)) >=
+                SerialProtocol.PROTOCOL_VERSION_BUTTON_EVENTS);
+        break;
+      case SerialProtocol.BUTTON_RELEASED:
+        _muteButtonController.handleButtonUp(buttonIndex);
+        break;
+      case SerialProtocol.BUTTON_LONG_PRESS:
+        _muteButtonController.handleLongPress(buttonIndex);
+        break;
+      default:
+        // clicks, the press and release already did the work. Double clicks
+        // and repeats are turned off, see BUTTON_DOUBLE_CLICK_MS
+        return;
     }
+    _uiUpdater.requestUpdate();
   }
 
   void _handleConnectionStateChanged(bool connected) {
     if (mounted) {
       _connectionHandler.showConnectionNotification(context, connected);
 
+      final devices = _worker.connectedDevices;
+      if (devices.isNotEmpty && !devices.contains(_shownDevice)) {
+        _shownDevice = devices.first;
+      }
+      _uiUpdater.requestUpdate();
+
       if (connected && _configLoaded) {
         _applicationManager.enableVolumeRestorationOnDeviceConnect();
 
@@ -528,6 +536,7 @@ class _HomePageState extends State<HomePage>
     _uiUpdater.dispose();
     _sliderUpdater.dispose();
     _initialHardwareValuesSubscription?.cancel();
+    _sliderAppChangesSubscription?.cancel();
 
     _worker.dispose();
     _muteButtonController.dispose();
@@ -589,10 +598,11 @@ class _HomePageState extends State<HomePage>
       if (app != null) {
         await _loadIconForApp(app.processPath);
 
-        if (_appIcons[app.processPath] != null) {
-          _sliderColors[index] = await IconColorExtractor.extractDominantColor(
-              _appIcons[app.processPath]!, app.processPath,
-              defaultColor: AppTheme.defaultAppColor);
+        final icon = _appIcons[app.processPath];
+        if (icon != null) {
+          _sliderColors[index] = IconColorExtractor.cachedColor(icon) ??
+              await IconColorExtractor.extractDominantColor(icon,
+                  defaultColor: AppTheme.defaultAppColor);
         } else {
           _sliderColors[index] = AppTheme.defaultAppColor;
         }
@@ -762,6 +772,7 @@ class _HomePageState extends State<HomePage>
       sliderDataStream: _worker.sliderData,
       buttonDataStream: _worker.buttonData,
       onThemeChanged: widget.onThemeChanged,
+      onLatencyTracingChanged: _worker.setLatencyTracing,
     );
   }
 
@@ -783,6 +794,41 @@ class _HomePageState extends State<HomePage>
     windowManager.hide();
   }
 
+  /// Picks which MixLit's faders are shown, only there with more than one
+  /// connected
+  Widget _buildDeviceSelector(bool isDarkMode) {
+    final devices = _worker.connectedDevices;
+    if (devices.length < 2) return const SizedBox.shrink();
+
+    return Padding(
+      padding: EdgeInsets.only(top: AppTheme.spacingSmall),
+      child: Center(
+        child: Wrap(
+          spacing: AppTheme.spacingSmall,
+          children: [
+            for (final device in devices)
+              ChoiceChip(
+                label: Text(
+                  'MixLit ${device + 1}',
+                  style: TextStyle(
+                    // the accent is light in both themes
+                    color: device == _shownDevice
+                        ? AppTheme.lightTextPrimary
+                        : AppTheme.getPrimaryTextColor(isDarkMode),
+                  ),
+                ),
+                selected: device == _shownDevice,
+                selectedColor: AppTheme.getAccentColor(isDarkMode),
+                backgroundColor: AppTheme.getCardColor(isDarkMode),
+                checkmarkColor: AppTheme.lightTextPrimary,
+                onSelected: (_) => setState(() => _shownDevice = device),
+              ),
+          ],
+        ),
+      ),
+    );
+  }
+
   @override
   Widget build(BuildContext context) {
     final bool isDarkMode = Theme.of(context).brightness == Brightness.dark;
@@ -961,15 +1007,18 @@ class _HomePageState extends State<HomePage>
                   ],
                 ),
 
+                _buildDeviceSelector(isDarkMode),
+
                 SizedBox(height: AppTheme.spacingLarge),
 
                 //dial cards
                 SizedBox(
                   height: AppTheme.dialCardHeight,
                   child: Row(
-                    children: List.generate(3, (index) {
-                      final dialIndex = index +
-                          5; //TODO: Indices 5, 6, 7 for dials - make dynamic instead (firmware update needed)
+                    children:
+                        List.generate(SliderAddress.DIALS_PER_DEVICE, (dial) {
+                      final dialIndex = SliderAddress.of(
+                          _shownDevice, SliderAddress.dialChannel(dial));
                       final int volumePercentage =
                           (_sliderValues[dialIndex] / 1024 * 100).round();
 
@@ -1034,7 +1083,9 @@ class _HomePageState extends State<HomePage>
                   child: Row(
                     mainAxisAlignment: MainAxisAlignment.center,
                     crossAxisAlignment: CrossAxisAlignment.center,
-                    children: List.generate(5, (index) {
+                    children: List.generate(SliderAddress.SLIDERS_PER_DEVICE,
+                        (channel) {
+                      final index = SliderAddress.of(_shownDevice, channel);
                       final bool isMuted =
                           _muteButtonController.muteStates[index];
                       final int volumePercentage =
@@ -3,6 +3,7 @@ import 'package:flutter/material.dart';
 import 'package:mixlit/frontend/pages/HomePage.dart';
 import 'package:mixlit/frontend/Theme.dart';
 import 'package:mixlit/frontend/menus/SettingsMenu.dart';
+import 'package:mixlit/backend/application/data/StorageManager.dart';
 import 'package:tray_manager/tray_manager.dart';
 import 'package:window_manager/window_manager.dart';
 import 'package:launch_at_startup/launch_at_startup.dart';
@@ -41,6 +42,7 @@ class StartupConfig {
 Future<void> main(List<String> args) async {
   WidgetsFlutterBinding.ensureInitialized();
   await windowManager.ensureInitialized();
+  await StorageManager.instance.load();
 
   final bool isAutoStarted = args.contains('--auto-start');
   final bool hideOnStartup = await StartupConfig.hideOnStartup;
@@ -126,6 +128,7 @@ class _MyAppState extends State<MyApp> with WindowListener {
     if (minimizeToTray) {
       await windowManager.hide();
     } else {
+      await StorageManager.instance.flush();
       trayManager.destroy();
       windowManager.destroy();
     }
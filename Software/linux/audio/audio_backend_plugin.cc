@@ -0,0 +1,159 @@
+#include "audio_backend_plugin.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+#include "pulse_audio_backend.h"
+
+namespace {
+
+struct AudioBackendPlugin {
+  FlMethodChannel* methods = nullptr;
+  FlEventChannel* events = nullptr;
+  bool listening = false;
+
+  // set from the backend's thread, one event goes out per main loop pass
+  std::atomic<bool> change_pending{false};
+
+  std::unique_ptr<PulseAudioBackend> backend;
+};
+
+bool LookupNumber(FlValue* args, const char* key, double* number) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return false;
+  }
+
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr) return false;
+
+  switch (fl_value_get_type(value)) {
+    case FL_VALUE_TYPE_FLOAT:
+      *number = fl_value_get_float(value);
+      return true;
+    case FL_VALUE_TYPE_INT:
+      *number = static_cast<double>(fl_value_get_int(value));
+      return true;
+    default:
+      return false;
+  }
+}
+
+FlValue* SessionList(const PulseAudioBackend& backend) {
+  FlValue* sessions = fl_value_new_list();
+
+  for (const AudioSession& session : backend.Sessions()) {
+    FlValue* entry = fl_value_new_map();
+    fl_value_set_string_take(entry, "processId",
+                             fl_value_new_int(session.process_id));
+    fl_value_set_string_take(entry, "processPath",
+                             fl_value_new_string(session.process_path.c_str()));
+    fl_value_set_string_take(entry, "volume",
+                             fl_value_new_float(session.volume));
+    fl_value_append_take(sessions, entry);
+  }
+  return sessions;
+}
+
+void HandleMethodCall(FlMethodChannel* channel,
+                      FlMethodCall* method_call,
+                      gpointer user_data) {
+  auto* plugin = static_cast<AudioBackendPlugin*>(user_data);
+  const gchar* method = fl_method_call_get_name(method_call);
+  FlValue* args = fl_method_call_get_args(method_call);
+
+  g_autoptr(FlMethodResponse) response = nullptr;
+  double process_id = 0;
+  double volume = 0;
+
+  if (strcmp(method, "enumSessions") == 0) {
+    g_autoptr(FlValue) sessions = SessionList(*plugin->backend);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(sessions));
+  } else if (strcmp(method, "setSessionVolume") == 0) {
+    if (LookupNumber(args, "processId", &process_id) &&
+        LookupNumber(args, "volume", &volume)) {
+      const int sent = plugin->backend->SetSessionVolume(
+          static_cast<int64_t>(process_id), volume);
+      g_autoptr(FlValue) result = fl_value_new_bool(sent > 0);
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+    } else {
+      response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "bad-args", "expected processId and volume", nullptr));
+    }
+  } else if (strcmp(method, "setOutputVolume") == 0) {
+    if (LookupNumber(args, "volume", &volume)) {
+      g_autoptr(FlValue) result =
+          fl_value_new_bool(plugin->backend->SetOutputVolume(volume));
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+    } else {
+      response = FL_METHOD_RESPONSE(
+          fl_method_error_response_new("bad-args", "expected volume", nullptr));
+    }
+  } else {
+    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+  }
+
+  g_autoptr(GError) error = nullptr;
+  if (!fl_method_call_respond(method_call, response, &error)) {
+    g_warning("Failed to respond to %s: %s", method, error->message);
+  }
+}
+
+FlMethodErrorResponse* OnListen(FlEventChannel* channel,
+                                FlValue* args,
+                                gpointer user_data) {
+  static_cast<AudioBackendPlugin*>(user_data)->listening = true;
+  return nullptr;
+}
+
+FlMethodErrorResponse* OnCancel(FlEventChannel* channel,
+                                FlValue* args,
+                                gpointer user_data) {
+  static_cast<AudioBackendPlugin*>(user_data)->listening = false;
+  return nullptr;
+}
+
+gboolean SendSessionsChanged(gpointer user_data) {
+  auto* plugin = static_cast<AudioBackendPlugin*>(user_data);
+  plugin->change_pending = false;
+
+  if (plugin->listening) {
+    g_autoptr(FlValue) event = fl_value_new_null();
+    g_autoptr(GError) error = nullptr;
+    if (!fl_event_channel_send(plugin->events, event, nullptr, &error)) {
+      g_warning("Failed to send audio session event: %s", error->message);
+    }
+  }
+  return G_SOURCE_REMOVE;
+}
+
+}  // namespace
+
+void audio_backend_plugin_register_with_registrar(
+    FlPluginRegistrar* registrar) {
+  // lives as long as the application, like the engine it talks to
+  auto* plugin = new AudioBackendPlugin();
+
+  FlBinaryMessenger* messenger = fl_plugin_registrar_get_messenger(registrar);
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+
+  plugin->methods = fl_method_channel_new(messenger, "mixlit/audio",
+                                          FL_METHOD_CODEC(codec));
+  fl_method_channel_set_method_call_handler(plugin->methods, HandleMethodCall,
+                                            plugin, nullptr);
+
+  plugin->events = fl_event_channel_new(messenger, "mixlit/audio/sessions",
+                                        FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(plugin->events, OnListen, OnCancel,
+                                       plugin, nullptr);
+
+  plugin->backend = std::make_unique<PulseAudioBackend>([plugin]() {
+    if (!plugin->change_pending.exchange(true)) {
+      g_idle_add(SendSessionsChanged, plugin);
+    }
+  });
+
+  if (!plugin->backend->Start()) {
+    g_warning("Failed to start the PulseAudio backend");
+  }
+}
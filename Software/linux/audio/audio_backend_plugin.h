@@ -0,0 +1,12 @@
+#ifndef MIXLIT_AUDIO_AUDIO_BACKEND_PLUGIN_H_
+#define MIXLIT_AUDIO_AUDIO_BACKEND_PLUGIN_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+// Exposes the PulseAudio backend to Dart:
+//   mixlit/audio           enumSessions, setSessionVolume, setOutputVolume
+//   mixlit/audio/sessions  an event whenever sessions start or stop
+// The backend stays connected for as long as the application runs.
+void audio_backend_plugin_register_with_registrar(FlPluginRegistrar* registrar);
+
+#endif  // MIXLIT_AUDIO_AUDIO_BACKEND_PLUGIN_H_
@@ -0,0 +1,412 @@
+#include "pulse_audio_backend.h"
+
+#include <limits.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+namespace {
+
+void Release(pa_operation* operation) {
+  if (operation != nullptr) {
+    pa_operation_unref(operation);
+  }
+}
+
+pa_volume_t ToVolume(double volume) {
+  if (volume < 0) volume = 0;
+  if (volume > 1) volume = 1;
+  return static_cast<pa_volume_t>(std::lround(volume * PA_VOLUME_NORM));
+}
+
+double FromVolume(const pa_cvolume& volume) {
+  return static_cast<double>(pa_cvolume_avg(&volume)) / PA_VOLUME_NORM;
+}
+
+int64_t ProcessId(const pa_sink_input_info* info) {
+  const char* value =
+      pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_PROCESS_ID);
+  if (value != nullptr) {
+    char* end = nullptr;
+    const long long process_id = std::strtoll(value, &end, 10);
+    if (end != value && process_id > 0) {
+      return process_id;
+    }
+  }
+  return -static_cast<int64_t>(info->index) - 1;
+}
+
+// The executable's full path where the process can be seen, so the host
+// matches apps by file name the same way it does on Windows.
+std::string ProcessPath(int64_t process_id, const pa_sink_input_info* info) {
+  if (process_id > 0) {
+    char link[64];
+    std::snprintf(link, sizeof(link), "/proc/%lld/exe",
+                  static_cast<long long>(process_id));
+
+    char path[PATH_MAX];
+    const ssize_t length = readlink(link, path, sizeof(path) - 1);
+    if (length > 0) {
+      return std::string(path, length);
+    }
+  }
+
+  const char* binary =
+      pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_PROCESS_BINARY);
+  if (binary != nullptr) return binary;
+
+  const char* name = pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_NAME);
+  if (name != nullptr) return name;
+
+  return info->name != nullptr ? info->name : "";
+}
+
+}  // namespace
+
+PulseAudioBackend::PulseAudioBackend(ChangeCallback on_change)
+    : on_change_(std::move(on_change)) {}
+
+PulseAudioBackend::~PulseAudioBackend() {
+  Stop();
+}
+
+bool PulseAudioBackend::Start() {
+  if (mainloop_ != nullptr) return true;
+
+  mainloop_ = pa_threaded_mainloop_new();
+  if (mainloop_ == nullptr) return false;
+
+  pa_threaded_mainloop_lock(mainloop_);
+  stopping_ = false;
+  Connect();
+  pa_threaded_mainloop_unlock(mainloop_);
+
+  if (pa_threaded_mainloop_start(mainloop_) < 0) {
+    pa_threaded_mainloop_lock(mainloop_);
+    Disconnect();
+    pa_threaded_mainloop_unlock(mainloop_);
+    pa_threaded_mainloop_free(mainloop_);
+    mainloop_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void PulseAudioBackend::Stop() {
+  if (mainloop_ == nullptr) return;
+
+  pa_threaded_mainloop_lock(mainloop_);
+  stopping_ = true;
+  if (reconnect_event_ != nullptr) {
+    pa_mainloop_api* api = pa_threaded_mainloop_get_api(mainloop_);
+    api->time_free(reconnect_event_);
+    reconnect_event_ = nullptr;
+  }
+  Disconnect();
+  pa_threaded_mainloop_unlock(mainloop_);
+
+  pa_threaded_mainloop_stop(mainloop_);
+  pa_threaded_mainloop_free(mainloop_);
+  mainloop_ = nullptr;
+}
+
+bool PulseAudioBackend::IsReady() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return ready_;
+}
+
+std::vector<AudioSession> PulseAudioBackend::Sessions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::vector<AudioSession> sessions;
+  sessions.reserve(sessions_.size());
+  for (const auto& entry : sessions_) {
+    sessions.push_back(entry.second);
+  }
+  return sessions;
+}
+
+double PulseAudioBackend::OutputVolume() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return output_volume_;
+}
+
+int PulseAudioBackend::SetSessionVolume(int64_t process_id, double volume) {
+  if (mainloop_ == nullptr) return 0;
+
+  const pa_volume_t level = ToVolume(volume);
+  int sent = 0;
+
+  pa_threaded_mainloop_lock(mainloop_);
+
+  std::vector<std::pair<uint32_t, uint8_t>> streams;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ready_) {
+      for (const auto& entry : sessions_) {
+        if (entry.second.process_id == process_id &&
+            entry.second.channels > 0) {
+          streams.emplace_back(entry.first, entry.second.channels);
+        }
+      }
+    }
+  }
+
+  for (const auto& stream : streams) {
+    pa_cvolume cvolume;
+    pa_cvolume_set(&cvolume, stream.second, level);
+
+    pa_operation* operation = pa_context_set_sink_input_volume(
+        context_, stream.first, &cvolume, nullptr, nullptr);
+    if (operation != nullptr) {
+      pa_operation_unref(operation);
+      sent++;
+    }
+  }
+
+  pa_threaded_mainloop_unlock(mainloop_);
+  return sent;
+}
+
+bool PulseAudioBackend::SetOutputVolume(double volume) {
+  if (mainloop_ == nullptr) return false;
+
+  bool sent = false;
+  pa_threaded_mainloop_lock(mainloop_);
+
+  std::string sink;
+  uint8_t channels = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ready_) {
+      sink = default_sink_;
+      channels = default_sink_channels_;
+    }
+  }
+
+  if (!sink.empty() && channels > 0) {
+    pa_cvolume cvolume;
+    pa_cvolume_set(&cvolume, channels, ToVolume(volume));
+
+    pa_operation* operation = pa_context_set_sink_volume_by_name(
+        context_, sink.c_str(), &cvolume, nullptr, nullptr);
+    if (operation != nullptr) {
+      pa_operation_unref(operation);
+      sent = true;
+    }
+  }
+
+  pa_threaded_mainloop_unlock(mainloop_);
+  return sent;
+}
+
+void PulseAudioBackend::Connect() {
+  pa_mainloop_api* api = pa_threaded_mainloop_get_api(mainloop_);
+
+  pa_proplist* properties = pa_proplist_new();
+  pa_proplist_sets(properties, PA_PROP_APPLICATION_NAME, "MixLit");
+  context_ = pa_context_new_with_proplist(api, "MixLit", properties);
+  pa_proplist_free(properties);
+
+  if (context_ == nullptr) return;
+
+  pa_context_set_state_callback(context_, OnContextState, this);
+  pa_context_set_subscribe_callback(context_, OnSubscription, this);
+
+  // waits for a server that isn't up yet rather than failing straight away
+  if (pa_context_connect(context_, nullptr, PA_CONTEXT_NOFAIL, nullptr) < 0) {
+    ScheduleReconnect();
+  }
+}
+
+void PulseAudioBackend::Disconnect() {
+  if (context_ != nullptr) {
+    pa_context_set_state_callback(context_, nullptr, nullptr);
+    pa_context_set_subscribe_callback(context_, nullptr, nullptr);
+    pa_context_disconnect(context_);
+    pa_context_unref(context_);
+    context_ = nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  ready_ = false;
+  sessions_.clear();
+  default_sink_.clear();
+  default_sink_channels_ = 0;
+}
+
+void PulseAudioBackend::ScheduleReconnect() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready_ = false;
+    sessions_.clear();
+  }
+  NotifyChange();
+
+  if (stopping_ || reconnect_event_ != nullptr) return;
+
+  // the context can't be released from inside its own callback, the timer
+  // replaces it
+  struct timeval when;
+  pa_gettimeofday(&when);
+  pa_timeval_add(&when, kReconnectDelayUsec);
+
+  pa_mainloop_api* api = pa_threaded_mainloop_get_api(mainloop_);
+  reconnect_event_ = api->time_new(api, &when, OnReconnect, this);
+}
+
+bool PulseAudioBackend::UpdateSession(const pa_sink_input_info* info) {
+  const int64_t process_id = ProcessId(info);
+
+  std::string process_path;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto existing = sessions_.find(info->index);
+    if (existing != sessions_.end() &&
+        existing->second.process_id == process_id) {
+      // only the volume changes once a stream is running
+      existing->second.volume = FromVolume(info->volume);
+      existing->second.channels = info->volume.channels;
+      return false;
+    }
+  }
+  process_path = ProcessPath(process_id, info);
+
+  AudioSession session;
+  session.index = info->index;
+  session.process_id = process_id;
+  session.process_path = process_path;
+  session.volume = FromVolume(info->volume);
+  session.channels = info->volume.channels;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  sessions_[info->index] = session;
+  return true;
+}
+
+void PulseAudioBackend::NotifyChange() {
+  if (on_change_) {
+    on_change_();
+  }
+}
+
+void PulseAudioBackend::OnContextState(pa_context* context, void* userdata) {
+  auto* self = static_cast<PulseAudioBackend*>(userdata);
+
+  switch (pa_context_get_state(context)) {
+    case PA_CONTEXT_READY: {
+      const auto mask = static_cast<pa_subscription_mask_t>(
+          PA_SUBSCRIPTION_MASK_SINK_INPUT | PA_SUBSCRIPTION_MASK_SINK |
+          PA_SUBSCRIPTION_MASK_SERVER);
+      Release(pa_context_subscribe(context, mask, nullptr, nullptr));
+      Release(pa_context_get_server_info(context, OnServerInfo, self));
+      Release(
+          pa_context_get_sink_input_info_list(context, OnSinkInputInfo, self));
+
+      {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        self->ready_ = true;
+      }
+      self->NotifyChange();
+      break;
+    }
+    case PA_CONTEXT_FAILED:
+    case PA_CONTEXT_TERMINATED:
+      self->ScheduleReconnect();
+      break;
+    default:
+      break;
+  }
+}
+
+void PulseAudioBackend::OnSubscription(pa_context* context,
+                                       pa_subscription_event_type_t type,
+                                       uint32_t index,
+                                       void* userdata) {
+  auto* self = static_cast<PulseAudioBackend*>(userdata);
+  const int facility = type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+  const int kind = type & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+
+  if (facility == PA_SUBSCRIPTION_EVENT_SINK_INPUT) {
+    if (kind == PA_SUBSCRIPTION_EVENT_REMOVE) {
+      size_t removed;
+      {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        removed = self->sessions_.erase(index);
+      }
+      if (removed > 0) self->NotifyChange();
+    } else {
+      Release(pa_context_get_sink_input_info(context, index, OnSinkInputInfo,
+                                             self));
+    }
+  } else if (facility == PA_SUBSCRIPTION_EVENT_SERVER) {
+    // the default sink may have changed
+    Release(pa_context_get_server_info(context, OnServerInfo, self));
+  } else if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
+    std::string sink;
+    {
+      std::lock_guard<std::mutex> lock(self->mutex_);
+      sink = self->default_sink_;
+    }
+    if (!sink.empty()) {
+      Release(pa_context_get_sink_info_by_name(context, sink.c_str(),
+                                               OnSinkInfo, self));
+    }
+  }
+}
+
+void PulseAudioBackend::OnSinkInputInfo(pa_context* context,
+                                        const pa_sink_input_info* info,
+                                        int eol,
+                                        void* userdata) {
+  if (eol != 0 || info == nullptr) return;
+
+  auto* self = static_cast<PulseAudioBackend*>(userdata);
+  if (self->UpdateSession(info)) {
+    self->NotifyChange();
+  }
+}
+
+void PulseAudioBackend::OnServerInfo(pa_context* context,
+                                     const pa_server_info* info,
+                                     void* userdata) {
+  if (info == nullptr || info->default_sink_name == nullptr) return;
+
+  auto* self = static_cast<PulseAudioBackend*>(userdata);
+  {
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    self->default_sink_ = info->default_sink_name;
+  }
+  Release(pa_context_get_sink_info_by_name(context, info->default_sink_name,
+                                           OnSinkInfo, self));
+}
+
+void PulseAudioBackend::OnSinkInfo(pa_context* context,
+                                   const pa_sink_info* info,
+                                   int eol,
+                                   void* userdata) {
+  if (eol != 0 || info == nullptr || info->name == nullptr) return;
+
+  auto* self = static_cast<PulseAudioBackend*>(userdata);
+  std::lock_guard<std::mutex> lock(self->mutex_);
+  if (self->default_sink_ == info->name) {
+    self->default_sink_channels_ = info->volume.channels;
+    self->output_volume_ = FromVolume(info->volume);
+  }
+}
+
+void PulseAudioBackend::OnReconnect(pa_mainloop_api* api,
+                                    pa_time_event* event,
+                                    const struct timeval* tv,
+                                    void* userdata) {
+  auto* self = static_cast<PulseAudioBackend*>(userdata);
+
+  api->time_free(event);
+  self->reconnect_event_ = nullptr;
+
+  self->Disconnect();
+  self->Connect();
+}
@@ -0,0 +1,100 @@
+#ifndef MIXLIT_AUDIO_PULSE_AUDIO_BACKEND_H_
+#define MIXLIT_AUDIO_PULSE_AUDIO_BACKEND_H_
+
+#include <pulse/pulseaudio.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One application stream (sink input) as the mixer sees it.
+struct AudioSession {
+  uint32_t index;
+  // streams that don't say which process they belong to get -(index + 1), so
+  // they can still be addressed
+  int64_t process_id;
+  std::string process_path;
+  double volume;  // 0 to 1, averaged over the channels
+  uint8_t channels;
+};
+
+// Talks to the PulseAudio server, or PipeWire through pipewire-pulse, over one
+// persistent connection driven by its own thread. The sink inputs are cached
+// from the server's subscription events, so listing the sessions never waits
+// on the server and setting an app's volume is one message per stream.
+class PulseAudioBackend {
+ public:
+  // Called on the backend's thread whenever a session starts or stops, or
+  // the connection comes or goes. It must not call back into the backend.
+  using ChangeCallback = std::function<void()>;
+
+  explicit PulseAudioBackend(ChangeCallback on_change);
+  ~PulseAudioBackend();
+
+  PulseAudioBackend(const PulseAudioBackend&) = delete;
+  PulseAudioBackend& operator=(const PulseAudioBackend&) = delete;
+
+  // Connects to the server named by PULSE_SERVER or the default one, and
+  // keeps reconnecting if it goes away.
+  bool Start();
+  void Stop();
+
+  bool IsReady() const;
+  std::vector<AudioSession> Sessions() const;
+  double OutputVolume() const;
+
+  // Returns the number of streams the volume was sent to.
+  int SetSessionVolume(int64_t process_id, double volume);
+  bool SetOutputVolume(double volume);
+
+ private:
+  static constexpr uint64_t kReconnectDelayUsec = 1000000;
+
+  static void OnContextState(pa_context* context, void* userdata);
+  static void OnSubscription(pa_context* context,
+                             pa_subscription_event_type_t type,
+                             uint32_t index,
+                             void* userdata);
+  static void OnSinkInputInfo(pa_context* context,
+                              const pa_sink_input_info* info,
+                              int eol,
+                              void* userdata);
+  static void OnServerInfo(pa_context* context,
+                           const pa_server_info* info,
+                           void* userdata);
+  static void OnSinkInfo(pa_context* context,
+                         const pa_sink_info* info,
+                         int eol,
+                         void* userdata);
+  static void OnReconnect(pa_mainloop_api* api,
+                          pa_time_event* event,
+                          const struct timeval* tv,
+                          void* userdata);
+
+  // these run on the backend's thread, or with the mainloop locked
+  void Connect();
+  void Disconnect();
+  void ScheduleReconnect();
+  bool UpdateSession(const pa_sink_input_info* info);
+  void NotifyChange();
+
+  pa_threaded_mainloop* mainloop_ = nullptr;
+  pa_context* context_ = nullptr;
+  pa_time_event* reconnect_event_ = nullptr;
+  bool stopping_ = false;
+
+  ChangeCallback on_change_;
+
+  // guards everything below, which is read from other threads
+  mutable std::mutex mutex_;
+  bool ready_ = false;
+  std::map<uint32_t, AudioSession> sessions_;
+  std::string default_sink_;
+  uint8_t default_sink_channels_ = 0;
+  double output_volume_ = 0;
+};
+
+#endif  // MIXLIT_AUDIO_PULSE_AUDIO_BACKEND_H_
@@ -0,0 +1,177 @@
+// Drives PulseAudioBackend against whatever server PULSE_SERVER points at,
+// normally the null sink server run_null_sink.sh starts. Plays a silent
+// stream of its own so there is a session to find, change and lose.
+
+#include <pulse/pulseaudio.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+
+#include "../pulse_audio_backend.h"
+
+namespace {
+
+constexpr int kSkipped = 77;  // ctest's SKIP_RETURN_CODE
+constexpr auto kTimeout = std::chrono::seconds(5);
+
+std::mutex changes_mutex;
+std::condition_variable changes;
+int change_count = 0;
+
+int ChangeCount() {
+  std::lock_guard<std::mutex> lock(changes_mutex);
+  return change_count;
+}
+
+// waits for a backend change until the condition holds, the condition is
+// checked once first so nothing is missed between the action and the wait
+bool WaitFor(const std::function<bool()>& condition) {
+  std::unique_lock<std::mutex> lock(changes_mutex);
+  return changes.wait_for(lock, kTimeout, condition);
+}
+
+// polls for state the backend doesn't announce, like volume levels
+bool PollFor(const std::function<bool()>& condition) {
+  const auto deadline = std::chrono::steady_clock::now() + kTimeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (condition()) return true;
+    usleep(10000);
+  }
+  return false;
+}
+
+const AudioSession* FindOwn(const std::vector<AudioSession>& sessions) {
+  for (const AudioSession& session : sessions) {
+    if (session.process_id == getpid()) return &session;
+  }
+  return nullptr;
+}
+
+bool HasOwnSession(const PulseAudioBackend& backend) {
+  return FindOwn(backend.Sessions()) != nullptr;
+}
+
+bool OwnVolumeIs(const PulseAudioBackend& backend, double volume) {
+  const std::vector<AudioSession> sessions = backend.Sessions();
+  const AudioSession* own = FindOwn(sessions);
+  return own != nullptr && std::fabs(own->volume - volume) < 0.01;
+}
+
+// A playback stream on its own connection, standing in for an application.
+class Player {
+ public:
+  bool Open() {
+    mainloop_ = pa_threaded_mainloop_new();
+    pa_threaded_mainloop_start(mainloop_);
+    pa_threaded_mainloop_lock(mainloop_);
+
+    context_ = pa_context_new(pa_threaded_mainloop_get_api(mainloop_),
+                              "mixlit test player");
+    pa_context_set_state_callback(context_, OnState, mainloop_);
+    pa_context_connect(context_, nullptr, PA_CONTEXT_NOAUTOSPAWN, nullptr);
+
+    while (pa_context_get_state(context_) != PA_CONTEXT_READY) {
+      if (!PA_CONTEXT_IS_GOOD(pa_context_get_state(context_))) {
+        pa_threaded_mainloop_unlock(mainloop_);
+        return false;
+      }
+      pa_threaded_mainloop_wait(mainloop_);
+    }
+
+    const pa_sample_spec spec = {PA_SAMPLE_S16LE, 44100, 2};
+    stream_ = pa_stream_new(context_, "silence", &spec, nullptr);
+    pa_stream_connect_playback(stream_, nullptr, nullptr,
+                               PA_STREAM_START_CORKED, nullptr, nullptr);
+
+    pa_threaded_mainloop_unlock(mainloop_);
+    return true;
+  }
+
+  void CloseStream() {
+    pa_threaded_mainloop_lock(mainloop_);
+    if (stream_ != nullptr) {
+      pa_stream_disconnect(stream_);
+      pa_stream_unref(stream_);
+      stream_ = nullptr;
+    }
+    pa_threaded_mainloop_unlock(mainloop_);
+  }
+
+  ~Player() {
+    if (mainloop_ == nullptr) return;
+
+    CloseStream();
+    pa_threaded_mainloop_lock(mainloop_);
+    pa_context_disconnect(context_);
+    pa_context_unref(context_);
+    pa_threaded_mainloop_unlock(mainloop_);
+    pa_threaded_mainloop_stop(mainloop_);
+    pa_threaded_mainloop_free(mainloop_);
+  }
+
+ private:
+  static void OnState(pa_context* context, void* userdata) {
+    pa_threaded_mainloop_signal(static_cast<pa_threaded_mainloop*>(userdata),
+                                0);
+  }
+
+  pa_threaded_mainloop* mainloop_ = nullptr;
+  pa_context* context_ = nullptr;
+  pa_stream* stream_ = nullptr;
+};
+
+#define CHECK(condition, message)               \
+  if (!(condition)) {                           \
+    std::fprintf(stderr, "FAIL: %s\n", message); \
+    return 1;                                   \
+  }
+
+}  // namespace
+
+int main() {
+  PulseAudioBackend backend([]() {
+    std::lock_guard<std::mutex> lock(changes_mutex);
+    change_count++;
+    changes.notify_all();
+  });
+
+  CHECK(backend.Start(), "backend didn't start");
+  if (!WaitFor([&backend]() { return backend.IsReady(); })) {
+    std::fprintf(stderr, "no PulseAudio server, skipping\n");
+    return kSkipped;
+  }
+
+  // the default sink's details arrive just after the connection is ready
+  CHECK(PollFor([&backend]() { return backend.SetOutputVolume(0.5); }),
+        "output volume couldn't be set");
+  CHECK(PollFor([&backend]() {
+          return std::fabs(backend.OutputVolume() - 0.5) < 0.01;
+        }),
+        "output volume didn't reach 50%");
+
+  Player player;
+  CHECK(player.Open(), "player couldn't connect");
+  CHECK(WaitFor([&backend]() { return HasOwnSession(backend); }),
+        "new session wasn't announced");
+
+  const int changes_before = ChangeCount();
+  CHECK(backend.SetSessionVolume(getpid(), 0.25) == 1,
+        "session volume wasn't sent to exactly one stream");
+  CHECK(PollFor([&backend]() { return OwnVolumeIs(backend, 0.25); }),
+        "session volume didn't reach 25%");
+  CHECK(ChangeCount() == changes_before,
+        "a volume change was announced as a session change");
+
+  player.CloseStream();
+  CHECK(WaitFor([&backend]() { return !HasOwnSession(backend); }),
+        "closed session wasn't announced");
+
+  backend.Stop();
+  std::printf("PASS (%d change events)\n", ChangeCount());
+  return 0;
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Runs a command against a private PulseAudio server whose only sink is a null
+# sink, so the test never touches the desk's real audio. Exits 77 (skipped)
+# when pulseaudio isn't installed.
+
+command -v pulseaudio >/dev/null 2>&1 || { echo "pulseaudio not installed, skipping"; exit 77; }
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+export PULSE_RUNTIME_PATH="$dir"
+export PULSE_STATE_PATH="$dir"
+export PULSE_SERVER="unix:$dir/native"
+
+pulseaudio -n --daemonize=no --use-pid-file=no --exit-idle-time=-1 \
+  --log-target=file:"$dir/server.log" \
+  -L "module-native-protocol-unix socket=$dir/native auth-anonymous=1" \
+  -L "module-null-sink sink_name=mixlit_test" &
+server=$!
+
+i=0
+while [ ! -S "$dir/native" ] && [ $i -lt 50 ]; do
+  sleep 0.1
+  i=$((i + 1))
+done
+
+"$@"
+status=$?
+
+kill $server
+wait $server 2>/dev/null
+
+[ $status -eq 0 ] || cat "$dir/server.log"
+exit $status
@@ -5,7 +5,9 @@
 #include <gdk/gdkx.h>
 #endif
 
+#include "audio/audio_backend_plugin.h"
 #include "flutter/generated_plugin_registrant.h"
+#include "serial/port_monitor_plugin.h"
 
 struct _MyApplication {
   GtkApplication parent_instance;
@@ -59,6 +61,16 @@ static void my_application_activate(GApplication* application) {
 
   fl_register_plugins(FL_PLUGIN_REGISTRY(view));
 
+  g_autoptr(FlPluginRegistrar) audio_backend_registrar =
+      fl_plugin_registry_get_registrar_for_plugin(FL_PLUGIN_REGISTRY(view),
+                                                  "AudioBackendPlugin");
+  audio_backend_plugin_register_with_registrar(audio_backend_registrar);
+
+  g_autoptr(FlPluginRegistrar) port_monitor_registrar =
+      fl_plugin_registry_get_registrar_for_plugin(FL_PLUGIN_REGISTRY(view),
+                                                  "PortMonitorPlugin");
+  port_monitor_plugin_register_with_registrar(port_monitor_registrar);
+
   gtk_widget_grab_focus(GTK_WIDGET(view));
 }
 
@@ -0,0 +1,162 @@
+#include "port_monitor.h"
+
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// udevd sends processed events to group 2, group 1 is the raw kernel ones
+constexpr uint32_t kUdevGroup = 2;
+constexpr uint32_t kUdevMagic = 0xfeedcafe;
+constexpr size_t kMessageSize = 8192;
+
+// what udevd puts in front of the properties, see device-monitor.c in systemd
+struct UdevHeader {
+  char prefix[8];  // "libudev\0"
+  uint32_t magic;  // big endian
+  uint32_t header_size;
+  uint32_t properties_offset;
+  uint32_t properties_length;
+  uint32_t filter_subsystem_hash;
+  uint32_t filter_devtype_hash;
+  uint32_t filter_tag_bloom_hi;
+  uint32_t filter_tag_bloom_lo;
+};
+
+uint16_t ParseHexId(const std::string& value) {
+  return static_cast<uint16_t>(strtoul(value.c_str(), nullptr, 16));
+}
+
+}  // namespace
+
+PortMonitor::~PortMonitor() {
+  Stop();
+}
+
+bool PortMonitor::Start() {
+  if (fd_ >= 0) return true;
+
+  fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+               NETLINK_KOBJECT_UEVENT);
+  if (fd_ < 0) return false;
+
+  sockaddr_nl address = {};
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = kUdevGroup;
+
+  // the sender's credentials come with every message so they can be checked
+  const int on = 1;
+  if (bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+      setsockopt(fd_, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) < 0) {
+    Stop();
+    return false;
+  }
+  return true;
+}
+
+void PortMonitor::Stop() {
+  if (fd_ < 0) return;
+  close(fd_);
+  fd_ = -1;
+}
+
+bool PortMonitor::Read(PortEvent* event) {
+  if (fd_ < 0) return false;
+
+  char data[kMessageSize];
+  iovec buffer = {data, sizeof(data)};
+  char control[CMSG_SPACE(sizeof(ucred))];
+  sockaddr_nl sender = {};
+
+  msghdr message = {};
+  message.msg_name = &sender;
+  message.msg_namelen = sizeof(sender);
+  message.msg_iov = &buffer;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  const ssize_t length = recvmsg(fd_, &message, 0);
+  if (length <= 0 || (message.msg_flags & MSG_TRUNC) != 0) return false;
+  if (sender.nl_groups != kUdevGroup) return false;
+
+  // anyone can send to the group, only root's messages are udevd's
+  const cmsghdr* header = CMSG_FIRSTHDR(&message);
+  if (header == nullptr || header->cmsg_level != SOL_SOCKET ||
+      header->cmsg_type != SCM_CREDENTIALS) {
+    return false;
+  }
+  ucred credentials;
+  memcpy(&credentials, CMSG_DATA(header), sizeof(credentials));
+  if (credentials.uid != 0) return false;
+
+  return Parse(data, static_cast<size_t>(length), event);
+}
+
+bool PortMonitor::Parse(const char* data, size_t length, PortEvent* event) {
+  if (length < sizeof(UdevHeader)) return false;
+
+  UdevHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (strncmp(header.prefix, "libudev", sizeof(header.prefix)) != 0 ||
+      ntohl(header.magic) != kUdevMagic) {
+    return false;
+  }
+  if (header.properties_offset < sizeof(UdevHeader) ||
+      header.properties_offset > length ||
+      header.properties_length > length - header.properties_offset) {
+    return false;
+  }
+
+  std::string action;
+  std::string subsystem;
+  std::string device_name;
+  std::string vendor_id;
+  std::string product_id;
+
+  // KEY=value pairs, each ending in a nul
+  const char* property = data + header.properties_offset;
+  const char* end = property + header.properties_length;
+  while (property < end) {
+    const size_t size = strnlen(property, end - property);
+    const char* equals =
+        static_cast<const char*>(memchr(property, '=', size));
+
+    if (equals != nullptr) {
+      const std::string key(property, equals - property);
+      const std::string value(equals + 1, property + size);
+
+      if (key == "ACTION") {
+        action = value;
+      } else if (key == "SUBSYSTEM") {
+        subsystem = value;
+      } else if (key == "DEVNAME") {
+        device_name = value;
+      } else if (key == "ID_VENDOR_ID") {
+        vendor_id = value;
+      } else if (key == "ID_MODEL_ID") {
+        product_id = value;
+      }
+    }
+    property += size + 1;
+  }
+
+  if (subsystem != "tty" || device_name.empty()) return false;
+  if (action == "add") {
+    event->added = true;
+  } else if (action == "remove") {
+    event->added = false;
+  } else {
+    return false;
+  }
+
+  event->path = device_name;
+  event->vendor_id = vendor_id.empty() ? 0 : ParseHexId(vendor_id);
+  event->product_id = product_id.empty() ? 0 : ParseHexId(product_id);
+  return true;
+}
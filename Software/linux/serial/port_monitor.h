@@ -0,0 +1,47 @@
+#ifndef MIXLIT_SERIAL_PORT_MONITOR_H_
+#define MIXLIT_SERIAL_PORT_MONITOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A serial port being plugged in or taken away.
+struct PortEvent {
+  bool added = false;
+  std::string path;  // the device node, /dev/ttyUSB0
+  // both 0 when the port isn't on usb or udev didn't know them
+  uint16_t vendor_id = 0;
+  uint16_t product_id = 0;
+};
+
+// Watches tty devices come and go on udev's netlink group. udev sends these
+// once its rules have run, so the device node already has its final
+// permissions by the time anything opens it. Doesn't need libudev, the
+// socket is read from whichever loop waits on fd().
+class PortMonitor {
+ public:
+  PortMonitor() = default;
+  ~PortMonitor();
+
+  PortMonitor(const PortMonitor&) = delete;
+  PortMonitor& operator=(const PortMonitor&) = delete;
+
+  // Fails where there's no netlink, such as some sandboxes. Nothing arrives
+  // if udevd isn't running, which can't be told from here.
+  bool Start();
+  void Stop();
+
+  int fd() const { return fd_; }
+
+  // Reads one message once fd() is readable, false if it wasn't a tty event
+  // from udev.
+  bool Read(PortEvent* event);
+
+  // Picks the port out of a udev message, exposed for the tests.
+  static bool Parse(const char* data, size_t length, PortEvent* event);
+
+ private:
+  int fd_ = -1;
+};
+
+#endif  // MIXLIT_SERIAL_PORT_MONITOR_H_
@@ -0,0 +1,130 @@
+#include "port_monitor_plugin.h"
+
+#include <glib-unix.h>
+
+#include <cstring>
+
+#include "port_monitor.h"
+
+namespace {
+
+struct PortMonitorPlugin {
+  FlMethodChannel* methods = nullptr;
+  FlEventChannel* events = nullptr;
+  bool listening = false;
+
+  PortMonitor monitor;
+  guint source = 0;
+};
+
+void StopMonitor(PortMonitorPlugin* plugin) {
+  if (plugin->source != 0) {
+    g_source_remove(plugin->source);
+    plugin->source = 0;
+  }
+  plugin->monitor.Stop();
+}
+
+gboolean OnReadable(gint fd, GIOCondition condition, gpointer user_data) {
+  auto* plugin = static_cast<PortMonitorPlugin*>(user_data);
+
+  if ((condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) != 0) {
+    // Dart falls back to polling for ports
+    plugin->source = 0;
+    plugin->monitor.Stop();
+    if (plugin->listening) {
+      g_autoptr(GError) error = nullptr;
+      if (!fl_event_channel_send_error(plugin->events, "closed",
+                                       "udev socket closed", nullptr, nullptr,
+                                       &error)) {
+        g_warning("Failed to send port monitor error: %s", error->message);
+      }
+    }
+    return G_SOURCE_REMOVE;
+  }
+
+  // one message a pass, the source fires again while there are more
+  PortEvent port;
+  if (!plugin->monitor.Read(&port) || !plugin->listening) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  g_autoptr(FlValue) event = fl_value_new_map();
+  fl_value_set_string_take(event, "added", fl_value_new_bool(port.added));
+  fl_value_set_string_take(event, "path",
+                           fl_value_new_string(port.path.c_str()));
+  fl_value_set_string_take(event, "vendorId",
+                           fl_value_new_int(port.vendor_id));
+  fl_value_set_string_take(event, "productId",
+                           fl_value_new_int(port.product_id));
+
+  g_autoptr(GError) error = nullptr;
+  if (!fl_event_channel_send(plugin->events, event, nullptr, &error)) {
+    g_warning("Failed to send port event: %s", error->message);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+void HandleMethodCall(FlMethodChannel* channel,
+                      FlMethodCall* method_call,
+                      gpointer user_data) {
+  auto* plugin = static_cast<PortMonitorPlugin*>(user_data);
+  const gchar* method = fl_method_call_get_name(method_call);
+
+  g_autoptr(FlMethodResponse) response = nullptr;
+
+  if (strcmp(method, "startPortMonitor") == 0) {
+    if (plugin->source == 0 && plugin->monitor.Start()) {
+      plugin->source = g_unix_fd_add(
+          plugin->monitor.fd(),
+          static_cast<GIOCondition>(G_IO_IN | G_IO_ERR | G_IO_HUP), OnReadable,
+          plugin);
+    }
+    g_autoptr(FlValue) result = fl_value_new_bool(plugin->source != 0);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+  } else if (strcmp(method, "stopPortMonitor") == 0) {
+    StopMonitor(plugin);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  } else {
+    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+  }
+
+  g_autoptr(GError) error = nullptr;
+  if (!fl_method_call_respond(method_call, response, &error)) {
+    g_warning("Failed to respond to %s: %s", method, error->message);
+  }
+}
+
+FlMethodErrorResponse* OnListen(FlEventChannel* channel,
+                                FlValue* args,
+                                gpointer user_data) {
+  static_cast<PortMonitorPlugin*>(user_data)->listening = true;
+  return nullptr;
+}
+
+FlMethodErrorResponse* OnCancel(FlEventChannel* channel,
+                                FlValue* args,
+                                gpointer user_data) {
+  static_cast<PortMonitorPlugin*>(user_data)->listening = false;
+  return nullptr;
+}
+
+}  // namespace
+
+void port_monitor_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
+  // lives as long as the application
+  auto* plugin = new PortMonitorPlugin();
+
+  FlBinaryMessenger* messenger = fl_plugin_registrar_get_messenger(registrar);
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+
+  plugin->methods = fl_method_channel_new(messenger, "mixlit/serial",
+                                          FL_METHOD_CODEC(codec));
+  fl_method_channel_set_method_call_handler(plugin->methods, HandleMethodCall,
+                                            plugin, nullptr);
+
+  plugin->events = fl_event_channel_new(messenger, "mixlit/serial/ports",
+                                        FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(plugin->events, OnListen, OnCancel,
+                                       plugin, nullptr);
+}
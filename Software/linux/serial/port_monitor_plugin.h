@@ -0,0 +1,13 @@
+#ifndef MIXLIT_SERIAL_PORT_MONITOR_PLUGIN_H_
+#define MIXLIT_SERIAL_PORT_MONITOR_PLUGIN_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+// Exposes PortMonitor to Dart:
+//   mixlit/serial        startPortMonitor, stopPortMonitor
+//   mixlit/serial/ports  {added, path, vendorId, productId} for every tty
+//                        plugged in or taken away
+// The socket is read on the main loop, there's no thread.
+void port_monitor_plugin_register_with_registrar(FlPluginRegistrar* registrar);
+
+#endif  // MIXLIT_SERIAL_PORT_MONITOR_PLUGIN_H_
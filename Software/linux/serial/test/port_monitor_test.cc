@@ -0,0 +1,118 @@
+// Feeds PortMonitor::Parse messages laid out the way udevd sends them.
+
+#include <arpa/inet.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../port_monitor.h"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const char* what) {
+  if (!condition) {
+    fprintf(stderr, "FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+// a udevd message, header then nul terminated KEY=value properties
+std::vector<char> UdevMessage(const std::vector<std::string>& properties,
+                              uint32_t magic = 0xfeedcafe) {
+  std::string body;
+  for (const std::string& property : properties) {
+    body += property;
+    body += '\0';
+  }
+
+  const uint32_t header_size = 40;
+  std::vector<char> message(header_size + body.size(), 0);
+  memcpy(message.data(), "libudev", 8);
+
+  const uint32_t fields[] = {htonl(magic), header_size, header_size,
+                             static_cast<uint32_t>(body.size())};
+  memcpy(message.data() + 8, fields, sizeof(fields));
+  memcpy(message.data() + header_size, body.data(), body.size());
+  return message;
+}
+
+bool Parse(const std::vector<char>& message, PortEvent* event) {
+  return PortMonitor::Parse(message.data(), message.size(), event);
+}
+
+const std::vector<std::string> kPluggedIn = {
+    "ACTION=add",
+    "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-2/1-2:1.0/ttyUSB0/tty/"
+    "ttyUSB0",
+    "SUBSYSTEM=tty",
+    "DEVNAME=/dev/ttyUSB0",
+    "SEQNUM=4312",
+    "ID_BUS=usb",
+    "ID_VENDOR_ID=1a86",
+    "ID_MODEL_ID=7523",
+    "ID_SERIAL=1a86_USB_Serial",
+};
+
+}  // namespace
+
+int main() {
+  PortEvent event;
+
+  Check(Parse(UdevMessage(kPluggedIn), &event), "usb adapter plugged in");
+  Check(event.added, "plugged in is an add");
+  Check(event.path == "/dev/ttyUSB0", "device node");
+  Check(event.vendor_id == 0x1a86, "vendor id");
+  Check(event.product_id == 0x7523, "product id");
+
+  std::vector<std::string> removed = kPluggedIn;
+  removed[0] = "ACTION=remove";
+  event = PortEvent();
+  Check(Parse(UdevMessage(removed), &event), "usb adapter taken away");
+  Check(!event.added, "taken away is a remove");
+  Check(event.path == "/dev/ttyUSB0", "removed device node");
+
+  event = PortEvent();
+  Check(Parse(UdevMessage({"ACTION=add", "SUBSYSTEM=tty",
+                           "DEVNAME=/dev/ttyS4"}),
+              &event),
+        "port that isn't on usb");
+  Check(event.vendor_id == 0 && event.product_id == 0, "no usb ids");
+
+  std::vector<std::string> changed = kPluggedIn;
+  changed[0] = "ACTION=change";
+  Check(!Parse(UdevMessage(changed), &event), "change is ignored");
+
+  Check(!Parse(UdevMessage({"ACTION=add", "SUBSYSTEM=usb",
+                            "DEVNAME=/dev/bus/usb/001/007"}),
+               &event),
+        "usb device that isn't a tty is ignored");
+
+  Check(!Parse(UdevMessage({"ACTION=add", "SUBSYSTEM=tty"}), &event),
+        "tty without a device node is ignored");
+
+  Check(!Parse(UdevMessage(kPluggedIn, 0xdeadbeef), &event),
+        "wrong magic is rejected");
+
+  const std::string kernel =
+      std::string("add@/devices/usb1/1-2/ttyUSB0/tty/ttyUSB0") + '\0' +
+      "ACTION=add" + '\0' + "SUBSYSTEM=tty" + '\0' + "DEVNAME=ttyUSB0";
+  Check(!PortMonitor::Parse(kernel.data(), kernel.size(), &event),
+        "raw kernel message is rejected");
+
+  std::vector<char> overrun = UdevMessage(kPluggedIn);
+  const uint32_t length = static_cast<uint32_t>(overrun.size());
+  memcpy(overrun.data() + 20, &length, sizeof(length));
+  Check(!Parse(overrun, &event), "properties past the end are rejected");
+
+  std::vector<char> truncated = UdevMessage(kPluggedIn);
+  truncated.resize(20);
+  Check(!Parse(truncated, &event), "truncated header is rejected");
+
+  if (failures > 0) return 1;
+  printf("port monitor parse: ok\n");
+  return 0;
+}
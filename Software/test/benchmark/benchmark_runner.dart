@@ -0,0 +1,162 @@
+import 'dart:async';
+import 'dart:convert';
+import 'dart:developer';
+import 'dart:io';
+import 'dart:isolate';
+import 'package:path/path.dart' as path;
+import 'package:vm_service/vm_service.dart' hide Isolate;
+import 'package:vm_service/vm_service_io.dart';
+
+/// What one benchmark measured, per message of its corpus
+class BenchmarkResult {
+  final String name;
+  final int messages;
+  final int bytes;
+  final int elapsedUs;
+
+  // null when the vm service isn't enabled
+  final double? allocationsPerMessage;
+  final double? allocatedBytesPerMessage;
+
+  BenchmarkResult(this.name, this.messages, this.bytes, this.elapsedUs,
+      this.allocationsPerMessage, this.allocatedBytesPerMessage);
+
+  double get messagesPerSecond => messages * 1000000 / elapsedUs;
+  double get nsPerMessage => elapsedUs * 1000 / messages;
+  double get megabytesPerSecond => bytes / elapsedUs;
+
+  Map<String, dynamic> toJson() => {
+        'name': name,
+        'messages': messages,
+        'bytes': bytes,
+        'elapsedUs': elapsedUs,
+        'messagesPerSecond': messagesPerSecond.round(),
+        'nsPerMessage': double.parse(nsPerMessage.toStringAsFixed(1)),
+        if (bytes > 0)
+          'megabytesPerSecond':
+              double.parse(megabytesPerSecond.toStringAsFixed(2)),
+        'allocationsPerMessage': allocationsPerMessage == null
+            ? null
+            : double.parse(allocationsPerMessage!.toStringAsFixed(3)),
+        'allocatedBytesPerMessage': allocatedBytesPerMessage == null
+            ? null
+            : double.parse(allocatedBytesPerMessage!.toStringAsFixed(1)),
+      };
+
+  @override
+  String toString() {
+    final allocations = allocationsPerMessage == null
+        ? 'allocations n/a'
+        : '${allocationsPerMessage!.toStringAsFixed(2)} allocs '
+            '${allocatedBytesPerMessage!.toStringAsFixed(0)} B';
+    return '${name.padRight(28)} '
+        '${nsPerMessage.toStringAsFixed(0).padLeft(8)} ns/msg  '
+        '${messagesPerSecond.toStringAsFixed(0).padLeft(10)} msg/s  '
+        '$allocations /msg';
+  }
+}
+
+/// Runs each benchmark body over its corpus until enough time has passed,
+/// then once more with the allocation profile reset to count what it made.
+/// Allocations are only counted when the test runs with --enable-vmservice.
+class BenchmarkRunner {
+  static const String OUTPUT_VARIABLE = 'MIXLIT_BENCHMARK_OUTPUT';
+  static const String DEFAULT_OUTPUT_DIRECTORY = 'build/benchmarks';
+  static const int WARMUP_PASSES = 5;
+  static const Duration MIN_DURATION = Duration(seconds: 1);
+
+  final List<BenchmarkResult> results = [];
+
+  VmService? _service;
+  String? _isolateId;
+
+  Future<void> connect() async {
+    final serverUri = (await Service.getInfo()).serverWebSocketUri;
+    if (serverUri == null) return;
+
+    _service = await vmServiceConnectUri(serverUri.toString());
+    _isolateId = Service.getIsolateId(Isolate.current);
+  }
+
+  Future<void> close() async {
+    await _service?.dispose();
+    _service = null;
+  }
+
+  /// Times [body], which handles [messages] messages of [bytes] bytes in
+  /// total each pass
+  Future<BenchmarkResult> run(
+    String name, {
+    required int messages,
+    int bytes = 0,
+    required FutureOr<void> Function() body,
+  }) async {
+    for (var i = 0; i < WARMUP_PASSES; i++) {
+      await body();
+    }
+
+    final stopwatch = Stopwatch()..start();
+    var passes = 0;
+    while (stopwatch.elapsed < MIN_DURATION) {
+      final result = body();
+      if (result is Future) await result;
+      passes++;
+    }
+    stopwatch.stop();
+
+    double? allocations;
+    double? allocatedBytes;
+    final service = _service;
+    if (service != null && _isolateId != null) {
+      await service.getAllocationProfile(_isolateId!, reset: true, gc: true);
+      await body();
+      final profile = await service.getAllocationProfile(_isolateId!);
+
+      var instances = 0;
+      var size = 0;
+      for (final member in profile.members ?? const <ClassHeapStats>[]) {
+        instances += member.instancesAccumulated ?? 0;
+        size += member.accumulatedSize ?? 0;
+      }
+      allocations = instances / messages;
+      allocatedBytes = size / messages;
+    }
+
+    final result = BenchmarkResult(name, messages * passes, bytes * passes,
+        stopwatch.elapsedMicroseconds, allocations, allocatedBytes);
+    results.add(result);
+    print(result);
+    return result;
+  }
+
+  /// Writes every result so far as JSON and returns the path
+  Future<String> save(String suite) async {
+    final commit = await _gitCommit();
+    final overridden = Platform.environment[OUTPUT_VARIABLE];
+    final file = File(overridden ??
+        path.join(DEFAULT_OUTPUT_DIRECTORY,
+            '$suite-${commit ?? DateTime.now().millisecondsSinceEpoch}.json'));
+    await file.parent.create(recursive: true);
+
+    await file.writeAsString(const JsonEncoder.withIndent('  ').convert({
+      'suite': suite,
+      'commit': commit,
+      'timestamp': DateTime.now().toUtc().toIso8601String(),
+      'dartVersion': Platform.version,
+      'os': Platform.operatingSystem,
+      'allocationsCounted': _service != null,
+      'results': [for (final result in results) result.toJson()],
+    }));
+    return file.path;
+  }
+
+  static Future<String?> _gitCommit() async {
+    try {
+      final result = await Process.run('git', ['rev-parse', '--short', 'HEAD']);
+      if (result.exitCode != 0) return null;
+      return (result.stdout as String).trim();
+    } catch (_) {
+      return null;
+    }
+  }
+}
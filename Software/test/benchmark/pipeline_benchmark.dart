@@ -0,0 +1,329 @@
+// Benchmarks for the code that runs on every serial byte and every stored
+// setting. Not named *_test so a plain `flutter test` skips it, run with
+//
+//   flutter test --enable-vmservice test/benchmark/pipeline_benchmark.dart
+//
+// Results are printed and saved as JSON under build/benchmarks, see
+// BenchmarkRunner.
+import 'dart:io';
+import 'dart:math';
+import 'dart:typed_data';
+import 'package:flutter_test/flutter_test.dart';
+import 'package:mixlit/backend/application/data/IconStore.dart';
+import 'package:mixlit/backend/application/data/StorageManager.dart';
+import 'package:mixlit/backend/application/serial/SerialPortReader.dart';
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
+import 'package:mixlit/backend/application/serial/SerialWorker.dart';
+import 'package:mixlit/backend/application/util/IconColourExtractor.dart';
+import 'benchmark_runner.dart';
+
+// the corpora are generated from a fixed seed so every run sees the same bytes
+const int SEED = 20;
+const int ASCII_LINES = 2000;
+const int BINARY_FRAMES = 4000;
+const int TRACED_EVERY = 20; // every 20th analog frame carries a trace
+const int BUTTON_EVERY = 50;
+const int READ_SIZE = 64; // bytes handed to the framer per read
+const int SNAPSHOT_EVERY = 8; // messages decoded per snapshot
+const int ICONS = 16;
+const int ICON_SIZE = 32;
+const int STORED_KEYS = 64;
+
+/// A stream of messages, all in one buffer
+class Corpus {
+  final Uint8List bytes;
+  final List<int> starts;
+  final List<int> ends;
+
+  Corpus(this.bytes, this.starts, this.ends);
+
+  int get messages => starts.length;
+
+  /// The stream cut into reads the way a serial port hands it over
+  List<Uint8List> reads(int size) => [
+        for (var i = 0; i < bytes.length; i += size)
+          Uint8List.sublistView(bytes, i, min(i + size, bytes.length))
+      ];
+}
+
+Corpus _asciiCorpus(Random random) {
+  final builder = BytesBuilder(copy: false);
+  final starts = <int>[];
+  final ends = <int>[];
+
+  for (var line = 0; line < ASCII_LINES; line++) {
+    final text = StringBuffer();
+    if (line % BUTTON_EVERY == BUTTON_EVERY - 1) {
+      text.write('${String.fromCharCode(0x61 + random.nextInt(5))}|1|');
+    } else {
+      final channels = 1 + random.nextInt(SerialDecoder.NUM_OF_CHANNELS);
+      for (var channel = 0; channel < channels; channel++) {
+        text.write('$channel|${random.nextInt(1024)}|');
+      }
+    }
+
+    starts.add(builder.length);
+    builder.add(text.toString().codeUnits);
+    ends.add(builder.length);
+    builder.add(const [0x0D, 0x0A]);
+  }
+  return Corpus(builder.takeBytes(), starts, ends);
+}
+
+Uint8List _frame(Random random, int sequence, int sync, int mask) {
+  final frame = Uint8List(SerialProtocol.frameLength(sync, mask));
+  frame[0] = sync;
+  frame[1] = sequence & 0xFF;
+  frame[2] = mask;
+  var offset = SerialProtocol.FRAME_HEADER_LENGTH;
+
+  if (mask == 0) {
+    final changed = 1 << random.nextInt(SerialProtocol.NUM_OF_BUTTONS);
+    frame[offset++] = changed;
+    frame[offset++] = random.nextBool() ? changed : 0;
+  } else {
+    // 10 bit values packed lsb first, like the firmware
+    var bitBuffer = 0;
+    var bitCount = 0;
+    for (var channel = 0; channel < 8; channel++) {
+      if ((mask & (1 << channel)) == 0) continue;
+      bitBuffer |= random.nextInt(1024) << bitCount;
+      bitCount += 10;
+      while (bitCount >= 8) {
+        frame[offset++] = bitBuffer & 0xFF;
+        bitBuffer >>= 8;
+        bitCount -= 8;
+      }
+    }
+    if (bitCount > 0) frame[offset++] = bitBuffer & 0xFF;
+
+    if (sync == SerialProtocol.FRAME_SYNC_TRACED) {
+      final queuedAt = sequence * 2500;
+      final scanAge = random.nextInt(2000);
+      for (final value in [queuedAt, queuedAt >> 8, queuedAt >> 16,
+          queuedAt >> 24, scanAge, scanAge >> 8]) {
+        frame[offset++] = value & 0xFF;
+      }
+    }
+  }
+
+  frame[offset] = SerialProtocol.crc8(frame, 1, offset);
+  return frame;
+}
+
+Corpus _binaryCorpus(Random random) {
+  final builder = BytesBuilder(copy: false);
+  final starts = <int>[];
+  final ends = <int>[];
+
+  for (var sequence = 0; sequence < BINARY_FRAMES; sequence++) {
+    final int mask;
+    final int sync;
+    if (sequence % BUTTON_EVERY == BUTTON_EVERY - 1) {
+      mask = 0;
+      sync = SerialProtocol.FRAME_SYNC;
+    } else {
+      // mostly one or two faders moving at once, like a person would
+      mask = random.nextInt(4) == 0
+          ? 1 + random.nextInt(0xFF)
+          : (1 << random.nextInt(8)) | (1 << random.nextInt(8));
+      sync = sequence % TRACED_EVERY == 0
+          ? SerialProtocol.FRAME_SYNC_TRACED
+          : SerialProtocol.FRAME_SYNC;
+    }
+
+    starts.add(builder.length);
+    builder.add(_frame(random, sequence, sync, mask));
+    ends.add(builder.length);
+  }
+  return Corpus(builder.takeBytes(), starts, ends);
+}
+
+/// Icons as rgba, a few flat colours on a transparent background with a
+/// soft edge, which is what the quantiser usually gets
+List<Uint8List> _iconCorpus(Random random) => [
+      for (var icon = 0; icon < ICONS; icon++)
+        () {
+          final pixels = Uint8List(ICON_SIZE * ICON_SIZE * 4);
+          final colours = [
+            for (var i = 0; i < 3; i++) random.nextInt(0xFFFFFF)
+          ];
+          for (var i = 0; i < ICON_SIZE * ICON_SIZE; i++) {
+            final x = i % ICON_SIZE - ICON_SIZE ~/ 2;
+            final y = i ~/ ICON_SIZE - ICON_SIZE ~/ 2;
+            final distance = sqrt(x * x + y * y);
+            final rgb = colours[(x.abs() + y.abs()) * 3 ~/ ICON_SIZE % 3];
+            pixels[i * 4] = (rgb >> 16) & 0xFF;
+            pixels[i * 4 + 1] = (rgb >> 8) & 0xFF;
+            pixels[i * 4 + 2] = rgb & 0xFF;
+            pixels[i * 4 + 3] = distance < 12
+                ? 255
+                : distance < 16
+                    ? ((16 - distance) * 64).toInt()
+                    : 0;
+          }
+          return pixels;
+        }()
+    ];
+
+/// What a slider's config looks like in storage
+Map<String, dynamic> _sliderConfig(Random random, int slider) => {
+      'sliderTag': slider,
+      'processName': 'process$slider.exe',
+      'appNames': ['process$slider.exe', 'helper$slider.exe'],
+      'volume': random.nextInt(101),
+      'colour': random.nextInt(0xFFFFFF),
+      'muted': random.nextBool(),
+    };
+
+void main() {
+  final runner = BenchmarkRunner();
+  final asciiCorpus = _asciiCorpus(Random(SEED));
+  final binaryCorpus = _binaryCorpus(Random(SEED));
+  final icons = _iconCorpus(Random(SEED));
+
+  setUpAll(runner.connect);
+
+  tearDownAll(() async {
+    print('Saved to ${await runner.save('pipeline')}');
+    await runner.close();
+  });
+
+  group('serial', () {
+    for (final (name, corpus) in [
+      ('ascii', asciiCorpus),
+      ('binary', binaryCorpus),
+    ]) {
+      test('framing $name', () async {
+        final framer = SerialFramer();
+        final reads = corpus.reads(READ_SIZE);
+
+        await runner.run('framer/$name',
+            messages: corpus.messages,
+            bytes: corpus.bytes.length,
+            body: () {
+          for (final read in reads) {
+            framer.add(read);
+            framer.takeBatch(0);
+          }
+        });
+      });
+
+      test('decoding $name', () async {
+        final decoder = SerialDecoder();
+        final data = corpus.bytes;
+
+        await runner.run('decoder/$name',
+            messages: corpus.messages, bytes: data.length, body: () {
+          for (var i = 0; i < corpus.messages; i++) {
+            decoder.decode(data, corpus.starts[i], corpus.ends[i]);
+            if (i % SNAPSHOT_EVERY == SNAPSHOT_EVERY - 1) {
+              decoder.takeSnapshot();
+            }
+          }
+        });
+      });
+    }
+  });
+
+  group('leds', () {
+    final random = Random(SEED);
+    final colours = [
+      for (var i = 0; i < 64; i++)
+        [random.nextInt(256), random.nextInt(256), random.nextInt(256)]
+    ];
+
+    test('led frames', () async {
+      // one solid and one gradient frame a colour, like a slider changing app
+      await runner.run('leds/frames', messages: colours.length * 2, body: () {
+        for (var i = 0; i < colours.length; i++) {
+          final from = colours[i];
+          final to = colours[(i + 1) % colours.length];
+          SerialProtocol.ledFrame(
+              SerialProtocol.LED_FRAME_SOLID, i % 5, false, from);
+          SerialProtocol.ledFrame(
+              SerialProtocol.LED_FRAME_GRADIENT, i % 5, true, [...from, ...to]);
+        }
+      });
+    });
+
+    test('led palettes', () async {
+      await runner.run('leds/palette', messages: colours.length, body: () {
+        for (var i = 0; i < colours.length; i++) {
+          final palette = SerialProtocol.gradientPalette(
+              colours[i], colours[(i + 1) % colours.length]);
+          SerialProtocol.ledFrame(
+              SerialProtocol.LED_FRAME_PALETTE, i % 5, true, palette);
+        }
+      });
+    });
+  });
+
+  group('icons', () {
+    test('quantise', () async {
+      await runner.run('icons/quantise',
+          messages: icons.length,
+          bytes: icons.length * ICON_SIZE * ICON_SIZE * 4,
+          body: () {
+        for (final icon in icons) {
+          IconColorExtractor.dominantRgb(icon);
+        }
+      });
+    });
+
+    test('hash', () async {
+      // every colour lookup hashes the icon bytes before the cache is checked
+      await runner.run('icons/hash',
+          messages: icons.length,
+          bytes: icons.length * ICON_SIZE * ICON_SIZE * 4,
+          body: () {
+        for (final icon in icons) {
+          IconStore.contentHash(icon);
+        }
+      });
+    });
+  });
+
+  group('storage', () {
+    late Directory directory;
+    final random = Random(SEED);
+    final configs = [
+      for (var slider = 0; slider < STORED_KEYS; slider++)
+        _sliderConfig(random, slider)
+    ];
+
+    setUpAll(() async {
+      directory = await Directory.systemTemp.createTemp('mixlit_benchmark');
+      StorageManager.instance.useConfigPath(directory.path);
+      await StorageManager.instance.load();
+    });
+
+    tearDownAll(() async {
+      await StorageManager.instance.flush();
+      await directory.delete(recursive: true);
+    });
+
+    test('round trip', () async {
+      final storage = StorageManager.instance;
+      await runner.run('storage/round_trip', messages: configs.length,
+          body: () async {
+        for (var i = 0; i < configs.length; i++) {
+          await storage.saveData('slider_$i', configs[i]);
+          await storage.getData('slider_$i');
+        }
+      });
+    });
+
+    test('flush', () async {
+      // the journal write and compaction after every key has changed
+      final storage = StorageManager.instance;
+      await runner.run('storage/flush', messages: configs.length,
+          body: () async {
+        for (var i = 0; i < configs.length; i++) {
+          await storage.saveData('slider_$i', configs[i]);
+        }
+        await storage.flush();
+      });
+    });
+  });
+}
@@ -0,0 +1,58 @@
+import 'dart:typed_data';
+import 'package:flutter_test/flutter_test.dart';
+import 'package:mixlit/backend/application/util/IconColourExtractor.dart';
+
+const int SIZE = IconColorExtractor.SAMPLE_SIZE;
+
+/// A SIZE x SIZE rgba icon of [background] with a [foreground] square [side]
+/// pixels across in the middle
+Uint8List _icon(List<int> background, List<int> foreground, int side) {
+  final pixels = Uint8List(SIZE * SIZE * 4);
+  final start = (SIZE - side) ~/ 2;
+  final end = start + side;
+
+  for (var y = 0; y < SIZE; y++) {
+    for (var x = 0; x < SIZE; x++) {
+      final inside = x >= start && x < end && y >= start && y < end;
+      final colour = inside ? foreground : background;
+      final i = (y * SIZE + x) * 4;
+      pixels.setRange(i, i + 4, colour);
+    }
+  }
+  return pixels;
+}
+
+void main() {
+  const white = [255, 255, 255, 255];
+  const black = [0, 0, 0, 255];
+  const transparent = [0, 0, 0, 0];
+  const red = [220, 30, 40, 255];
+  const blue = [30, 90, 230, 255];
+
+  // the logo covers a quarter of the icon, the background the rest
+  const logo = SIZE ~/ 2;
+
+  test('a saturated logo wins over a larger white background', () {
+    expect(IconColorExtractor.dominantRgb(_icon(white, red, logo)), 0xDC1E28);
+  });
+
+  test('a saturated logo wins over a larger black background', () {
+    expect(IconColorExtractor.dominantRgb(_icon(black, blue, logo)), 0x1E5AE6);
+  });
+
+  test('transparent pixels are ignored', () {
+    expect(IconColorExtractor.dominantRgb(_icon(transparent, white, 8)),
+        0xFFFFFF);
+    expect(IconColorExtractor.dominantRgb(_icon(transparent, transparent, 8)),
+        isNull);
+  });
+
+  test('the colour is the average of the winning bucket', () {
+    // both shades fall in the same 4 bit bucket
+    final pixels = _icon([200, 18, 16, 255], [206, 28, 30, 255], logo);
+
+    // 768 of the first and 256 of the second, (200 * 3 + 206) / 4 = 201 and
+    // so on, not the bucket's centre
+    expect(IconColorExtractor.dominantRgb(pixels), 0xC91413);
+  });
+}
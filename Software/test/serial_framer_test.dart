@@ -0,0 +1,69 @@
+import 'dart:typed_data';
+import 'package:flutter_test/flutter_test.dart';
+import 'package:mixlit/backend/application/serial/SerialPortReader.dart';
+import 'package:mixlit/backend/application/serial/SerialProtocol.dart';
+
+/// An analog frame for the first channel
+Uint8List _frame(int sequence, int value) {
+  final frame =
+      Uint8List(SerialProtocol.frameLength(SerialProtocol.FRAME_SYNC, 1));
+  frame[0] = SerialProtocol.FRAME_SYNC;
+  frame[1] = sequence & 0xFF;
+  frame[2] = 1;
+  frame[3] = value & 0xFF;
+  frame[4] = value >> 8;
+  frame[frame.length - 1] = SerialProtocol.crc8(frame, 1, frame.length - 1);
+  return frame;
+}
+
+/// Every message in the framer's next batch
+List<List<int>> _messages(SerialFramer framer) {
+  final batch = framer.takeBatch(0);
+  if (batch == null) return [];
+
+  final data = batch.data.materialize().asUint8List();
+  final messages = <List<int>>[];
+  var start = 0;
+  for (final end in batch.ends) {
+    messages.add(data.sublist(start, end));
+    start = end;
+  }
+  return messages;
+}
+
+void main() {
+  const ringSize = SerialPortReader.RING_SIZE;
+  final frames = [for (var i = 0; i < 20; i++) _frame(i, i * 50)];
+
+  test('frames after a nearly full leftover are all kept', () {
+    final framer = SerialFramer();
+
+    // a line that hasn't finished by the end of the read
+    final line = List<int>.filled(ringSize - 8, 0x30);
+    framer.add(Uint8List.fromList(line));
+    expect(_messages(framer), isEmpty);
+
+    // the read behind it finishes the line then carries on with frames, more
+    // than the ring has room for
+    final chunk = BytesBuilder()..addByte(10);
+    frames.forEach(chunk.add);
+    framer.add(chunk.takeBytes());
+
+    expect(_messages(framer), [line, ...frames]);
+  });
+
+  test('a whole ring without an end is dropped and framing carries on', () {
+    final framer = SerialFramer();
+
+    final chunk = BytesBuilder()
+      ..add(List<int>.filled(ringSize + 100, 0x30))
+      ..addByte(10);
+    frames.forEach(chunk.add);
+    framer.add(chunk.takeBytes());
+
+    // the noise after the ring was dropped comes out as a line
+    final messages = _messages(framer);
+    expect(messages.length, frames.length + 1);
+    expect(messages.skip(1), frames);
+  });
+}
@@ -0,0 +1,101 @@
+import 'dart:convert';
+import 'dart:io';
+import 'package:flutter_test/flutter_test.dart';
+import 'package:mixlit/backend/application/data/StorageManager.dart';
+import 'package:path/path.dart' as path;
+
+void main() {
+  late Directory directory;
+
+  File file(String name) => File(path.join(directory.path, name));
+
+  Future<void> writeSnapshot(int generation, Map<String, dynamic> data) =>
+      file('data.json')
+          .writeAsString(jsonEncode({'generation': generation, 'data': data}));
+
+  setUp(() async {
+    directory = await Directory.systemTemp.createTemp('mixlit_storage');
+  });
+
+  tearDown(() async {
+    await directory.delete(recursive: true);
+  });
+
+  test('changes survive a reload', () async {
+    final storage = StorageManager.at(directory.path);
+    await storage.saveData('volume', 512);
+    await storage.saveData('tags', ['app', 'unassigned']);
+    await storage.removeData('missing');
+    await storage.flush();
+
+    final reloaded = StorageManager.at(directory.path);
+    expect(await reloaded.getData('volume'), 512);
+    expect(await reloaded.getData('tags'), ['app', 'unassigned']);
+  });
+
+  test('a torn last journal line is dropped and the rest replayed', () async {
+    await writeSnapshot(1, {'volume': 100});
+    await file('data.journal').writeAsString(
+        '${jsonEncode({'gen': 1, 'key': 'volume', 'value': 200})}\n'
+        '${jsonEncode({'gen': 1, 'key': 'muted', 'value': true})}\n'
+        '{"gen": 1, "key": "tags", "val');
+
+    final storage = StorageManager.at(directory.path);
+    expect(await storage.getData('volume'), 200);
+    expect(await storage.getData('muted'), true);
+    expect(await storage.getData('tags'), isNull);
+
+    // folded into a new snapshot so the torn line never comes back
+    expect(await file('data.journal').exists(), isFalse);
+    final reloaded = StorageManager.at(directory.path);
+    expect(await reloaded.getData('volume'), 200);
+    expect(await reloaded.getData('muted'), true);
+  });
+
+  test('a journal older than the snapshot is not replayed', () async {
+    // a crash after the snapshot was renamed but before the journal went
+    await writeSnapshot(3, {'volume': 300});
+    await file('data.journal').writeAsString(
+        '${jsonEncode({'gen': 2, 'key': 'volume', 'value': 100})}\n'
+        '${jsonEncode({'gen': 2, 'remove': 'volume'})}\n');
+
+    final storage = StorageManager.at(directory.path);
+    expect(await storage.getData('volume'), 300);
+    expect(await file('data.journal').exists(), isFalse);
+  });
+
+  test('entries written on top of the snapshot are replayed', () async {
+    await writeSnapshot(3, {'volume': 300, 'muted': true});
+    await file('data.journal').writeAsString(
+        '${jsonEncode({'gen': 3, 'key': 'volume', 'value': 400})}\n'
+        '${jsonEncode({'gen': 3, 'remove': 'muted'})}\n');
+
+    final storage = StorageManager.at(directory.path);
+    expect(await storage.getData('volume'), 400);
+    expect(await storage.getData('muted'), isNull);
+  });
+
+  test('a legacy data.yml is moved into the snapshot', () async {
+    await file('data.yml').writeAsString('''
+last-com-port: COM3
+sliders:
+  - processName: spotify.exe
+    isMuted: false
+  - processName: null
+    isMuted: true
+''');
+
+    final storage = StorageManager.at(directory.path);
+    expect(await storage.getData('last-com-port'), 'COM3');
+    expect(await storage.getData('sliders'), [
+      {'processName': 'spotify.exe', 'isMuted': false},
+      {'processName': null, 'isMuted': true},
+    ]);
+    expect(await file('data.json').exists(), isTrue);
+
+    // the snapshot is used from now on, even with the old file still there
+    await file('data.yml').writeAsString('last-com-port: COM9\n');
+    final reloaded = StorageManager.at(directory.path);
+    expect(await reloaded.getData('last-com-port'), 'COM3');
+  });
+}
@@ -0,0 +1,40 @@
+#include "audio_session_channel.h"
+
+#include <flutter/event_stream_handler_functions.h>
+#include <flutter/standard_method_codec.h>
+
+#include <utility>
+
+AudioSessionChannel::AudioSessionChannel(flutter::BinaryMessenger* messenger,
+                                         HWND window)
+    : notifier_(window, kSessionsChangedMessage) {
+  channel_ = std::make_unique<flutter::EventChannel<flutter::EncodableValue>>(
+      messenger, "mixlit/audio/sessions",
+      &flutter::StandardMethodCodec::GetInstance());
+
+  auto handler = std::make_unique<
+      flutter::StreamHandlerFunctions<flutter::EncodableValue>>(
+      [this](const flutter::EncodableValue* arguments,
+             std::unique_ptr<flutter::EventSink<flutter::EncodableValue>>&&
+                 events)
+          -> std::unique_ptr<
+              flutter::StreamHandlerError<flutter::EncodableValue>> {
+        sink_ = std::move(events);
+        return nullptr;
+      },
+      [this](const flutter::EncodableValue* arguments)
+          -> std::unique_ptr<
+              flutter::StreamHandlerError<flutter::EncodableValue>> {
+        sink_.reset();
+        return nullptr;
+      });
+  channel_->SetStreamHandler(std::move(handler));
+
+  notifier_.Start();
+}
+
+void AudioSessionChannel::OnSessionsChanged() {
+  if (sink_) {
+    sink_->Success(flutter::EncodableValue());
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef RUNNER_AUDIO_AUDIO_SESSION_CHANNEL_H_
+#define RUNNER_AUDIO_AUDIO_SESSION_CHANNEL_H_
+
+#include <flutter/binary_messenger.h>
+#include <flutter/encodable_value.h>
+#include <flutter/event_channel.h>
+#include <windows.h>
+
+#include <memory>
+
+#include "audio_session_notifier.h"
+
+// Sends an event on mixlit/audio/sessions whenever an audio session starts
+// or ends, the same channel the Linux runner's PulseAudio backend uses.
+class AudioSessionChannel {
+ public:
+  // Posted to the window by the notifier, the window hands it back through
+  // OnSessionsChanged so the event goes out on the platform thread.
+  static constexpr UINT kSessionsChangedMessage = WM_APP + 0x4D;
+
+  AudioSessionChannel(flutter::BinaryMessenger* messenger, HWND window);
+
+  void OnSessionsChanged();
+
+ private:
+  std::unique_ptr<flutter::EventChannel<flutter::EncodableValue>> channel_;
+  std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> sink_;
+
+  // declared last so it stops before the channel goes
+  AudioSessionNotifier notifier_;
+};
+
+#endif  // RUNNER_AUDIO_AUDIO_SESSION_CHANNEL_H_
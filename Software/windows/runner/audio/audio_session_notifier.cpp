@@ -0,0 +1,332 @@
+#include "audio_session_notifier.h"
+
+namespace {
+
+// Reference counting shared by the callback objects below.
+template <typename Interface>
+class ComCallback : public Interface {
+ public:
+  ULONG STDMETHODCALLTYPE AddRef() override { return ++references_; }
+
+  ULONG STDMETHODCALLTYPE Release() override {
+    const ULONG references = --references_;
+    if (references == 0) {
+      delete this;
+    }
+    return references;
+  }
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid,
+                                           void** object) override {
+    if (iid == __uuidof(IUnknown) || iid == __uuidof(Interface)) {
+      *object = static_cast<Interface*>(this);
+      AddRef();
+      return S_OK;
+    }
+    *object = nullptr;
+    return E_NOINTERFACE;
+  }
+
+ protected:
+  virtual ~ComCallback() = default;
+
+ private:
+  std::atomic<ULONG> references_{1};
+};
+
+}  // namespace
+
+class AudioSessionNotifier::SessionEvents
+    : public ComCallback<IAudioSessionEvents> {
+ public:
+  explicit SessionEvents(AudioSessionNotifier* owner) : owner_(owner) {}
+
+  bool ended() const { return ended_; }
+
+  HRESULT STDMETHODCALLTYPE OnStateChanged(AudioSessionState state) override {
+    if (state == AudioSessionStateExpired) {
+      End();
+    }
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  OnSessionDisconnected(AudioSessionDisconnectReason reason) override {
+    End();
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnDisplayNameChanged(LPCWSTR name,
+                                                 LPCGUID context) override {
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnIconPathChanged(LPCWSTR path,
+                                              LPCGUID context) override {
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnSimpleVolumeChanged(float volume,
+                                                  BOOL mute,
+                                                  LPCGUID context) override {
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnChannelVolumeChanged(DWORD channel_count,
+                                                   float volumes[],
+                                                   DWORD changed_channel,
+                                                   LPCGUID context) override {
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnGroupingParamChanged(LPCGUID grouping,
+                                                   LPCGUID context) override {
+    return S_OK;
+  }
+
+ private:
+  void End() {
+    if (!ended_.exchange(true)) {
+      owner_->SessionEnded();
+    }
+  }
+
+  AudioSessionNotifier* owner_;
+  std::atomic<bool> ended_{false};
+};
+
+class AudioSessionNotifier::SessionNotification
+    : public ComCallback<IAudioSessionNotification> {
+ public:
+  explicit SessionNotification(AudioSessionNotifier* owner) : owner_(owner) {}
+
+  HRESULT STDMETHODCALLTYPE
+  OnSessionCreated(IAudioSessionControl* control) override {
+    owner_->SessionCreated(control);
+    return S_OK;
+  }
+
+ private:
+  AudioSessionNotifier* owner_;
+};
+
+class AudioSessionNotifier::DeviceNotification
+    : public ComCallback<IMMNotificationClient> {
+ public:
+  explicit DeviceNotification(AudioSessionNotifier* owner) : owner_(owner) {}
+
+  HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow flow,
+                                                   ERole role,
+                                                   LPCWSTR device) override {
+    if (flow == eRender && role == eConsole) {
+      owner_->DefaultDeviceChanged();
+    }
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR device,
+                                                 DWORD state) override {
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR device) override {
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR device) override {
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  OnPropertyValueChanged(LPCWSTR device, const PROPERTYKEY key) override {
+    return S_OK;
+  }
+
+ private:
+  AudioSessionNotifier* owner_;
+};
+
+AudioSessionNotifier::AudioSessionNotifier(HWND window, UINT message)
+    : window_(window), message_(message) {}
+
+AudioSessionNotifier::~AudioSessionNotifier() {
+  Stop();
+}
+
+void AudioSessionNotifier::Start() {
+  if (thread_.joinable()) return;
+
+  wake_ = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+  stopping_ = false;
+  thread_ = std::thread(&AudioSessionNotifier::Run, this);
+}
+
+void AudioSessionNotifier::Stop() {
+  if (!thread_.joinable()) return;
+
+  stopping_ = true;
+  SetEvent(wake_);
+  thread_.join();
+
+  CloseHandle(wake_);
+  wake_ = nullptr;
+}
+
+void AudioSessionNotifier::SessionCreated(IAudioSessionControl* control) {
+  control->AddRef();
+  {
+    std::lock_guard<std::mutex> lock(created_mutex_);
+    created_.push_back(control);
+  }
+  SetEvent(wake_);
+  Notify();
+}
+
+void AudioSessionNotifier::SessionEnded() {
+  SetEvent(wake_);
+  Notify();
+}
+
+void AudioSessionNotifier::DefaultDeviceChanged() {
+  device_changed_ = true;
+  SetEvent(wake_);
+}
+
+void AudioSessionNotifier::Notify() {
+  PostMessage(window_, message_, 0, 0);
+}
+
+void AudioSessionNotifier::Run() {
+  if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) return;
+
+  if (SUCCEEDED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr,
+                                 CLSCTX_ALL, IID_PPV_ARGS(&enumerator_)))) {
+    device_notification_ = new DeviceNotification(this);
+    enumerator_->RegisterEndpointNotificationCallback(device_notification_);
+
+    Watch();
+
+    while (true) {
+      WaitForSingleObject(wake_, INFINITE);
+      if (stopping_) break;
+
+      if (device_changed_.exchange(false)) {
+        Unwatch();
+        Watch();
+        Notify();
+      }
+      WatchCreatedSessions();
+      DropEndedSessions();
+    }
+
+    Unwatch();
+    enumerator_->UnregisterEndpointNotificationCallback(device_notification_);
+    device_notification_->Release();
+    device_notification_ = nullptr;
+    enumerator_->Release();
+    enumerator_ = nullptr;
+  }
+
+  CoUninitialize();
+}
+
+void AudioSessionNotifier::Watch() {
+  IMMDevice* device = nullptr;
+  if (FAILED(enumerator_->GetDefaultAudioEndpoint(eRender, eConsole,
+                                                  &device))) {
+    return;
+  }
+
+  const HRESULT result =
+      device->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL, nullptr,
+                       reinterpret_cast<void**>(&manager_));
+  device->Release();
+  if (FAILED(result)) {
+    manager_ = nullptr;
+    return;
+  }
+
+  // listing the sessions first is also what makes the session manager start
+  // sending notifications
+  IAudioSessionEnumerator* sessions = nullptr;
+  if (SUCCEEDED(manager_->GetSessionEnumerator(&sessions))) {
+    int count = 0;
+    sessions->GetCount(&count);
+    for (int i = 0; i < count; i++) {
+      IAudioSessionControl* control = nullptr;
+      if (SUCCEEDED(sessions->GetSession(i, &control))) {
+        WatchSession(control);
+        control->Release();
+      }
+    }
+    sessions->Release();
+  }
+
+  session_notification_ = new SessionNotification(this);
+  manager_->RegisterSessionNotification(session_notification_);
+}
+
+void AudioSessionNotifier::Unwatch() {
+  if (manager_ != nullptr) {
+    manager_->UnregisterSessionNotification(session_notification_);
+    session_notification_->Release();
+    session_notification_ = nullptr;
+  }
+
+  // created on the old device, or never got as far as being watched
+  {
+    std::lock_guard<std::mutex> lock(created_mutex_);
+    for (IAudioSessionControl* control : created_) {
+      control->Release();
+    }
+    created_.clear();
+  }
+
+  for (const WatchedSession& session : sessions_) {
+    session.control->UnregisterAudioSessionNotification(session.events);
+    session.control->Release();
+    session.events->Release();
+  }
+  sessions_.clear();
+
+  if (manager_ != nullptr) {
+    manager_->Release();
+    manager_ = nullptr;
+  }
+}
+
+void AudioSessionNotifier::WatchSession(IAudioSessionControl* control) {
+  SessionEvents* events = new SessionEvents(this);
+  if (SUCCEEDED(control->RegisterAudioSessionNotification(events))) {
+    control->AddRef();
+    sessions_.push_back({control, events});
+  } else {
+    events->Release();
+  }
+}
+
+void AudioSessionNotifier::WatchCreatedSessions() {
+  std::vector<IAudioSessionControl*> created;
+  {
+    std::lock_guard<std::mutex> lock(created_mutex_);
+    created.swap(created_);
+  }
+
+  for (IAudioSessionControl* control : created) {
+    WatchSession(control);
+    control->Release();
+  }
+}
+
+void AudioSessionNotifier::DropEndedSessions() {
+  for (auto session = sessions_.begin(); session != sessions_.end();) {
+    if (session->events->ended()) {
+      session->control->UnregisterAudioSessionNotification(session->events);
+      session->control->Release();
+      session->events->Release();
+      session = sessions_.erase(session);
+    } else {
+      ++session;
+    }
+  }
+}
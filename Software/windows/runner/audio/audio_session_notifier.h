@@ -0,0 +1,75 @@
+#ifndef RUNNER_AUDIO_AUDIO_SESSION_NOTIFIER_H_
+#define RUNNER_AUDIO_AUDIO_SESSION_NOTIFIER_H_
+
+#include <windows.h>
+
+#include <audiopolicy.h>
+#include <mmdeviceapi.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Watches the default output device's audio sessions and posts |message| to
+// |window| whenever one starts or ends, or the default device changes.
+//
+// Windows only delivers session notifications to the multithreaded
+// apartment, so the notifier runs its own thread. Callbacks arrive on COM's
+// threads and only post the message and wake that thread, which does the
+// registering and releasing the callbacks aren't allowed to do.
+class AudioSessionNotifier {
+ public:
+  AudioSessionNotifier(HWND window, UINT message);
+  ~AudioSessionNotifier();
+
+  AudioSessionNotifier(const AudioSessionNotifier&) = delete;
+  AudioSessionNotifier& operator=(const AudioSessionNotifier&) = delete;
+
+  void Start();
+  void Stop();
+
+ private:
+  class SessionEvents;
+  class SessionNotification;
+  class DeviceNotification;
+
+  // called from COM's threads
+  void SessionCreated(IAudioSessionControl* control);
+  void SessionEnded();
+  void DefaultDeviceChanged();
+  void Notify();
+
+  // the notifier's own thread
+  void Run();
+  void Watch();
+  void Unwatch();
+  void WatchSession(IAudioSessionControl* control);
+  void WatchCreatedSessions();
+  void DropEndedSessions();
+
+  struct WatchedSession {
+    IAudioSessionControl* control;
+    SessionEvents* events;
+  };
+
+  HWND window_;
+  UINT message_;
+
+  std::thread thread_;
+  HANDLE wake_ = nullptr;
+  std::atomic<bool> stopping_{false};
+  std::atomic<bool> device_changed_{false};
+
+  IMMDeviceEnumerator* enumerator_ = nullptr;
+  DeviceNotification* device_notification_ = nullptr;
+  IAudioSessionManager2* manager_ = nullptr;
+  SessionNotification* session_notification_ = nullptr;
+  std::vector<WatchedSession> sessions_;
+
+  // sessions created since the thread last woke, already AddRef'd
+  std::mutex created_mutex_;
+  std::vector<IAudioSessionControl*> created_;
+};
+
+#endif  // RUNNER_AUDIO_AUDIO_SESSION_NOTIFIER_H_
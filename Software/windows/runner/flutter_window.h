@@ -6,6 +6,7 @@
 
 #include <memory>
 
+#include "audio/audio_session_channel.h"
 #include "win32_window.h"
 
 // A window that does nothing but host a Flutter view.
@@ -28,6 +29,9 @@ class FlutterWindow : public Win32Window {
 
   // The Flutter instance hosted by this window.
   std::unique_ptr<flutter::FlutterViewController> flutter_controller_;
+
+  // Tells Dart when audio sessions start or end.
+  std::unique_ptr<AudioSessionChannel> audio_sessions_;
 };
 
 #endif  // RUNNER_FLUTTER_WINDOW_H_